@@ -2,10 +2,19 @@
 #include <iostream>
 #include <cstring>
 #include <sys/mman.h>
+#include <unistd.h>
 #include <napi.h>
 #include <uv.h>
+#include "shm_archiver.h"
+#include "shm_compactor.h"
+#include "shm_compressed_iterator.h"
+#include "shm_compressor.h"
 #include "shm_iterator.h"
 #include "shm_mapping.h"
+#include "shm_merged_iterator.h"
+#include "shm_partitioned_writer.h"
+#include "shm_mirror.h"
+#include "shm_spin.h"
 #include "shm_writer.h"
 using namespace Napi;
 
@@ -19,10 +28,43 @@ using namespace Napi;
  *   ...
  *   Buffer N-1: [size*(N-1), size*N)  <- Last buffer has NO overlap to prevent out-of-bounds
  *
- * TODO: fix double free error on exit
- *       there is a node.AtExit but doesn't seem to work
+ * With the optional 7th argument `mirror` set, a MAP_SHARED file mapping of
+ * page aligned size is mapped twice back to back (see shm_mirror.h) and the
+ * last buffer gets its overlap too, wrapping around to the start of the
+ * region. Without it the mapping is exactly what it always was.
+ *
+ * Deprecated: ring logs (openSharedLog({ ring: true })) use the same mirrored
+ * mapping and work with ShmIterator/ShmWriter; new code should use those.
+ *
+ * The buffers wrap the mapping without a finalizer, so nothing is unmapped or
+ * freed when they are collected or at exit; the mapping lives until the
+ * process ends.
  */
 
+// setup(..., mirror = true): every buffer, the last one included, overlaps
+// into the next through the second view of the region.
+Napi::Value setupMirrored(Napi::Env env, size_t size, size_t num, size_t overlap, int protection, int flags, int fd) {
+  const size_t regionSize = size * num;
+  const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  if (fd < 0 || (flags & MAP_SHARED) == 0 || regionSize == 0 || regionSize % pageSize != 0 || overlap > regionSize) {
+    Napi::Error::New(env, "mirrored setup needs a MAP_SHARED file mapping of whole pages and an overlap of at most size * num")
+      .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  char* buf = reinterpret_cast<char*>(shmio::MapMirrored(fd, 0, regionSize, protection, flags));
+  if (buf == nullptr) {
+    Napi::Error::New(env, std::string("mmap failed: ") + strerror(errno)).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  Napi::Array nodeBuffersArray = Napi::Array::New(env, num);
+  for (size_t i = 0; i < num; i++) {
+    nodeBuffersArray.Set(i, Napi::Buffer<char>::New(env, buf + i * size, size + overlap));
+  }
+  return nodeBuffersArray;
+}
+
 Napi::Value setup(const Napi::CallbackInfo& info) {
   
   Napi::Env env = info.Env();
@@ -34,6 +76,12 @@ Napi::Value setup(const Napi::CallbackInfo& info) {
   const int flags = info[4].As<Napi::Number>().Uint32Value();
   const int fd = info[5].As<Napi::Number>().Uint32Value();
 
+  const bool mirror = info.Length() >= 7 && info[6].ToBoolean().Value();
+
+  if (mirror) {
+    return setupMirrored(env, size, num, overlap, protection, flags, fd);
+  }
+
   // Allocate size*num (not size*num+overlap) to match file size
   char* buf = (char*) mmap(0, size * num, protection, flags, fd, 0);
 
@@ -57,14 +105,48 @@ Napi::Value setup(const Napi::CallbackInfo& info) {
   return nodeBuffersArray;
 }
 
+/**
+ * Pins the calling thread (the JS thread, or a worker's) to one CPU so a
+ * spinning reader keeps its cache and is not migrated by the scheduler.
+ */
+Napi::Value pinThread(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1 || !info[0].IsNumber()) {
+    Napi::TypeError::New(env, "pinThread(cpu) expects a CPU index").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  double cpu = info[0].As<Napi::Number>().DoubleValue();
+  if (cpu < 0 || cpu != static_cast<uint32_t>(cpu)) {
+    Napi::RangeError::New(env, "cpu must be a non-negative integer").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  int error = shmio::PinCurrentThread(static_cast<uint32_t>(cpu));
+  if (error != 0) {
+    Napi::Error::New(env, std::string("pinThread failed: ") + strerror(error)).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  return env.Undefined();
+}
+
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
   exports.Set(Napi::String::New(env, "setup"),
     Napi::Function::New(env, setup)
   );
+  exports.Set(Napi::String::New(env, "pinThread"),
+    Napi::Function::New(env, pinThread)
+  );
 
   ShmIterator::Init(env, exports);
+  ShmMergedIterator::Init(env, exports);
   ShmMapping::Init(env, exports);
   ShmWriter::Init(env, exports);
+  ShmPartitionedWriter::Init(env, exports);
+  ShmCompactor::Init(env, exports);
+  ShmArchiver::Init(env, exports);
+  ShmCompressor::Init(env, exports);
+  ShmCompressedIterator::Init(env, exports);
 
   return exports;
 }
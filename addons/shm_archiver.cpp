@@ -0,0 +1,365 @@
+#include "shm_archiver.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include "shm_file.h"
+#include "shm_format.h"
+#include "shm_mirror.h"
+#include "shm_options.h"
+#include "shm_uring.h"
+
+namespace {
+
+using shmio::MappedFile;
+using shmio::SystemError;
+
+constexpr unsigned kUringEntries = 8;
+constexpr const char* kWriteFailed = "write to archive failed";
+
+class ArchiveWorker : public Napi::AsyncWorker {
+public:
+  ArchiveWorker(Napi::Env env, ArchiveOptions options)
+    : Napi::AsyncWorker(env, "shmio:archiveLog"),
+      deferred_(Napi::Promise::Deferred::New(env)),
+      options_(std::move(options)) {}
+
+  Napi::Promise Promise() const { return deferred_.Promise(); }
+
+protected:
+  void Execute() override {
+    try {
+      stats_ = ArchiveLogRange(options_);
+    } catch (const std::exception& e) {
+      SetError(e.what());
+    }
+  }
+
+  void OnOK() override {
+    Napi::Env env = Env();
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("startCursor", Napi::BigInt::New(env, stats_.startCursor));
+    result.Set("endCursor", Napi::BigInt::New(env, stats_.endCursor));
+    result.Set("framesWritten", Napi::Number::New(env, static_cast<double>(stats_.framesWritten)));
+    result.Set("bytesWritten", Napi::Number::New(env, static_cast<double>(stats_.bytesWritten)));
+    result.Set("usedIoUring", Napi::Boolean::New(env, stats_.usedIoUring));
+    deferred_.Resolve(result);
+  }
+
+  void OnError(const Napi::Error& error) override {
+    deferred_.Reject(error.Value());
+  }
+
+private:
+  Napi::Promise::Deferred deferred_;
+  ArchiveOptions options_;
+  ArchiveStats stats_;
+};
+
+} // namespace
+
+ArchiveStats ArchiveLogRange(const ArchiveOptions& options) {
+  ArchiveStats stats;
+
+  // Declared first so the source pages outlive any io_uring writes into them.
+  MappedFile source;
+  source.fd = open(options.sourcePath.c_str(), O_RDONLY);
+  if (source.fd < 0) {
+    throw SystemError("Unable to open source log");
+  }
+
+  struct stat st {};
+  if (fstat(source.fd, &st) != 0) {
+    throw SystemError("fstat failed");
+  }
+  if (st.st_size < static_cast<off_t>(shmio::kDefaultHeaderSize)) {
+    throw std::runtime_error("source log is smaller than minimum header size");
+  }
+  uint64_t sourceLength = static_cast<uint64_t>(st.st_size);
+  if (sourceLength > std::numeric_limits<size_t>::max()) {
+    throw std::runtime_error("source log is too large to map");
+  }
+
+  uint8_t headerBytes[shmio::kHeaderV2Size] = {};
+  ssize_t headerRead = pread(source.fd, headerBytes, sizeof(headerBytes), 0);
+  if (headerRead < static_cast<ssize_t>(shmio::kDefaultHeaderSize)) {
+    throw SystemError("reading source header failed");
+  }
+  uint64_t headerAvailable = static_cast<uint64_t>(headerRead);
+  if (shmio::HasHeaderV2(headerBytes, headerAvailable) && !shmio::IsSupportedHeaderV2(headerBytes)) {
+    throw std::runtime_error("source log header version is not supported");
+  }
+  uint64_t dataOffset = shmio::ReadUint64LE(headerBytes + shmio::kDataOffsetOffset);
+  uint64_t ringBytes = shmio::RingBytes(headerBytes, headerAvailable);
+  uint64_t committedOffset = shmio::CommittedSizeOffset(headerBytes, headerAvailable);
+  uint32_t sequenceBytes = shmio::FrameSequenceBytes(headerBytes, headerAvailable);
+
+  // Ring logs are read through the mirror so a range that wraps is still one
+  // contiguous write.
+  if (ringBytes != 0) {
+    if (dataOffset == 0 || dataOffset + ringBytes > sourceLength) {
+      throw std::runtime_error("source log header is invalid");
+    }
+    source.base = shmio::MapMirrored(source.fd, static_cast<size_t>(dataOffset), static_cast<size_t>(ringBytes), PROT_READ);
+    if (source.base == nullptr) {
+      throw SystemError("mmap failed");
+    }
+    source.length = shmio::MirroredLength(static_cast<size_t>(dataOffset), static_cast<size_t>(ringBytes));
+  } else {
+    source.length = static_cast<size_t>(sourceLength);
+    void* mapped = mmap(nullptr, source.length, PROT_READ, MAP_SHARED, source.fd, 0);
+    if (mapped == MAP_FAILED) {
+      throw SystemError("mmap failed");
+    }
+    source.base = static_cast<uint8_t*>(mapped);
+  }
+
+  uint64_t committed = shmio::LoadCommitted(source.base, committedOffset);
+  if (dataOffset == 0 || dataOffset > sourceLength || committed < dataOffset
+      || (ringBytes == 0 && committed > source.length)) {
+    throw std::runtime_error("source log header is invalid");
+  }
+
+  uint64_t committedRelative = committed - dataOffset;
+  uint64_t from = options.fromCursor;
+  uint64_t to = std::min(options.toCursor, committedRelative);
+  if (from > to) {
+    throw std::runtime_error("fromCursor is beyond the committed size of the source log");
+  }
+  if (shmio::RingOverwritten(source.base, dataOffset, ringBytes, from)) {
+    throw std::runtime_error("source range has already been overwritten by the ring writer");
+  }
+
+  // Walk the frames so only whole frames are archived and a cursor that is not
+  // on a frame boundary is reported instead of producing a corrupt archive.
+  const uint8_t* rangeStart = source.base + dataOffset + (ringBytes != 0 ? from % ringBytes : from);
+  uint64_t length = to - from;
+  uint64_t offset = 0;
+  uint64_t wholeFrames = 0;
+  uint64_t nextSequence = 0;
+  // A ring writer lapping the range shows up as a broken frame first.
+  auto invalidFrame = [&](const std::string& message) {
+    if (shmio::RingOverwritten(source.base, dataOffset, ringBytes, from)) {
+      return std::runtime_error("source range was overwritten by the ring writer during archival");
+    }
+    return std::runtime_error(message + " at cursor " + std::to_string(from + offset));
+  };
+  while (offset + shmio::kFrameMetadataBytes <= length) {
+    uint16_t frameSize = shmio::ReadUint16LE(rangeStart + offset);
+    if (frameSize == 0) {
+      // Alignment padding is copied with the frame that follows it.
+      uint32_t paddingSize = shmio::PaddingLength(rangeStart + offset);
+      if (offset + paddingSize > length) {
+        break;
+      }
+      if (!shmio::IsValidPadding(rangeStart + offset, paddingSize)) {
+        throw invalidFrame("Invalid padding");
+      }
+      offset += paddingSize;
+      continue;
+    }
+    if (frameSize < shmio::kFrameMetadataBytes + sequenceBytes) {
+      throw invalidFrame("Invalid frame size (too small)");
+    }
+    if (offset + frameSize > length) {
+      break;
+    }
+    if (shmio::ReadUint16LE(rangeStart + offset + frameSize - shmio::kMessageHeaderBytes) != frameSize) {
+      throw invalidFrame("Frame suffix mismatch");
+    }
+    if (sequenceBytes != 0) {
+      nextSequence = shmio::ReadUint64LE(rangeStart + offset + shmio::kMessageHeaderBytes) + 1;
+    }
+    ++stats.framesWritten;
+    offset += frameSize;
+    wholeFrames = offset;
+  }
+  length = wholeFrames;
+
+  MappedFile target;
+  target.fd = open(options.targetPath.c_str(), O_RDWR | O_CREAT, 0664);
+  if (target.fd < 0) {
+    throw SystemError("Unable to open archive log");
+  }
+  if (fstat(target.fd, &st) != 0) {
+    throw SystemError("fstat failed");
+  }
+
+  // Frames are copied verbatim, so an archive of a log with frame sequences
+  // needs a v2 header that says so; other archives use the v1 layout.
+  uint64_t targetLength = static_cast<uint64_t>(st.st_size);
+  uint64_t writeOffset = shmio::kDefaultHeaderSize;
+  bool freshTarget = targetLength < shmio::kDefaultHeaderSize;
+  bool targetV2 = false;
+  uint64_t targetMessages = 0;
+  if (!freshTarget) {
+    uint8_t targetHeader[shmio::kHeaderV2Size] = {};
+    ssize_t targetRead = pread(target.fd, targetHeader, sizeof(targetHeader), 0);
+    if (targetRead < static_cast<ssize_t>(shmio::kDefaultHeaderSize)) {
+      throw SystemError("reading archive header failed");
+    }
+    freshTarget = shmio::ReadUint64LE(targetHeader + shmio::kHeaderSizeOffset) == 0;
+    if (!freshTarget) {
+      targetV2 = shmio::HasHeaderV2(targetHeader, static_cast<uint64_t>(targetRead));
+      if (targetV2 && (!shmio::IsSupportedHeaderV2(targetHeader)
+          || (shmio::ReadUint32LE(targetHeader + shmio::kHeaderFlagsOffset) & ~shmio::kFeatureFrameSequence) != 0)) {
+        throw std::runtime_error("archive target must be a fixed-size log, not a growable or ring log");
+      }
+      if (shmio::FrameSequenceBytes(targetHeader, static_cast<uint64_t>(targetRead)) != sequenceBytes) {
+        throw std::runtime_error("archive target and source log must both have frame sequences or neither");
+      }
+      if (targetV2) {
+        targetMessages = shmio::ReadUint64LE(targetHeader + shmio::kCommittedMessagesOffset);
+      }
+      uint64_t targetDataOffset = shmio::ReadUint64LE(targetHeader + shmio::kDataOffsetOffset);
+      writeOffset = shmio::ReadUint64LE(targetHeader + shmio::CommittedSizeOffset(targetHeader, static_cast<uint64_t>(targetRead)));
+      if (targetDataOffset == 0 || writeOffset < targetDataOffset || writeOffset > targetLength) {
+        throw std::runtime_error("archive log header is invalid");
+      }
+    }
+  }
+
+  if (freshTarget && sequenceBytes != 0) {
+    targetV2 = true;
+    writeOffset = shmio::kHeaderV2Size;
+  }
+
+  uint64_t requiredLength = std::max(writeOffset + length, options.capacityBytes);
+  if (requiredLength > targetLength) {
+    if (ftruncate(target.fd, static_cast<off_t>(requiredLength)) != 0) {
+      throw SystemError("ftruncate failed");
+    }
+    if (targetV2) {
+      uint8_t capacity[sizeof(uint64_t)];
+      shmio::WriteUint64LE(capacity, requiredLength);
+      shmio::PwriteAll(target.fd, capacity, sizeof(capacity), shmio::kCapacityOffset, kWriteFailed);
+      shmio::PwriteAll(target.fd, capacity, sizeof(capacity), shmio::kMaxCapacityOffset, kWriteFailed);
+    }
+  }
+
+  if (length > 0) {
+    madvise(const_cast<uint8_t*>(rangeStart), static_cast<size_t>(length), MADV_SEQUENTIAL);
+
+    bool written = false;
+    if (options.useIoUring) {
+      shmio::UringWriter uring;
+      if (uring.Init(kUringEntries)) {
+        written = uring.WriteAll(target.fd, rangeStart, static_cast<size_t>(length), writeOffset);
+        if (!written && !shmio::UringWriter::IsUnsupported(errno)) {
+          throw SystemError("write to archive failed");
+        }
+      }
+      stats.usedIoUring = written;
+    }
+    if (!written) {
+      shmio::PwriteAll(target.fd, rangeStart, static_cast<size_t>(length), writeOffset, kWriteFailed);
+    }
+
+    // A ring writer may have lapped the range while it was being copied, with
+    // committed or pending frames; the target's committed size has not moved
+    // yet, so the copy is simply dropped.
+    if (shmio::RingOverwritten(source.base, dataOffset, ringBytes, from)) {
+      throw std::runtime_error("source range was overwritten by the ring writer during archival");
+    }
+  }
+
+  if (fdatasync(target.fd) != 0) {
+    throw SystemError("flushing archive data failed");
+  }
+
+  // Stamped archives keep the source numbering, so their message count is
+  // the sequence after the last archived frame rather than a plain count.
+  uint64_t committedMessages = targetMessages + stats.framesWritten;
+  if (sequenceBytes != 0) {
+    committedMessages = stats.framesWritten != 0 ? nextSequence : targetMessages;
+  }
+
+  uint8_t header[shmio::kHeaderV2Size] = {};
+  uint64_t headerSize = targetV2 ? shmio::kHeaderV2Size : shmio::kDefaultHeaderSize;
+  uint64_t targetCommittedOffset = targetV2 ? shmio::kCommittedSizeV2Offset : shmio::kCommittedSizeOffset;
+  shmio::WriteUint64LE(header + shmio::kHeaderSizeOffset, headerSize);
+  shmio::WriteUint64LE(header + shmio::kDataOffsetOffset, headerSize);
+  shmio::WriteUint64LE(header + shmio::kCommittedSizeOffset, targetV2 ? headerSize : writeOffset + length);
+  if (targetV2) {
+    uint64_t capacity = std::max(targetLength, requiredLength);
+    shmio::WriteUint64LE(header + shmio::kHeaderMagicOffset, shmio::kHeaderMagic);
+    shmio::WriteUint32LE(header + shmio::kHeaderVersionOffset, shmio::kHeaderVersion2);
+    shmio::WriteUint32LE(header + shmio::kHeaderFlagsOffset, sequenceBytes != 0 ? shmio::kFeatureFrameSequence : 0);
+    shmio::WriteUint64LE(header + shmio::kMaxCapacityOffset, capacity);
+    shmio::WriteUint64LE(header + shmio::kCreatedAtOffset, static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count()));
+    shmio::WriteUint64LE(header + shmio::kCommittedSizeV2Offset, writeOffset + length);
+    shmio::WriteUint64LE(header + shmio::kCapacityOffset, capacity);
+    shmio::WriteUint64LE(header + shmio::kCommittedMessagesOffset, committedMessages);
+  }
+  if (freshTarget) {
+    shmio::PwriteAll(target.fd, header, static_cast<size_t>(headerSize), 0, kWriteFailed);
+  } else {
+    if (targetV2) {
+      shmio::PwriteAll(target.fd, header + shmio::kCommittedMessagesOffset, sizeof(uint64_t), shmio::kCommittedMessagesOffset, kWriteFailed);
+    }
+    shmio::PwriteAll(target.fd, header + targetCommittedOffset, sizeof(uint64_t), targetCommittedOffset, kWriteFailed);
+  }
+  if (fdatasync(target.fd) != 0) {
+    throw SystemError("flushing archive header failed");
+  }
+
+  stats.startCursor = from;
+  stats.endCursor = from + length;
+  stats.bytesWritten = length;
+  return stats;
+}
+
+void ShmArchiver::Init(Napi::Env env, Napi::Object exports) {
+  exports.Set("archiveLog", Napi::Function::New(env, ShmArchiver::ArchiveLog));
+}
+
+Napi::Value ShmArchiver::ArchiveLog(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1 || !info[0].IsObject()) {
+    Napi::TypeError::New(env, "archiveLog(options) expects an options object").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  Napi::Object opts = info[0].As<Napi::Object>();
+  ArchiveOptions options;
+
+  Napi::Value sourceValue = opts.Get("sourcePath");
+  Napi::Value targetValue = opts.Get("targetPath");
+  if (!sourceValue.IsString() || !targetValue.IsString()) {
+    Napi::TypeError::New(env, "options.sourcePath and options.targetPath must be strings").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  options.sourcePath = sourceValue.As<Napi::String>().Utf8Value();
+  options.targetPath = targetValue.As<Napi::String>().Utf8Value();
+  if (options.sourcePath == options.targetPath) {
+    Napi::TypeError::New(env, "targetPath must differ from sourcePath").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  if (!shmio::ParseCursorOption(env, opts, "fromCursor", &options.fromCursor)
+      || !shmio::ParseCursorOption(env, opts, "toCursor", &options.toCursor)
+      || !shmio::ParseCursorOption(env, opts, "capacityBytes", &options.capacityBytes)) {
+    return env.Null();
+  }
+
+  if (opts.Has("useIoUring")) {
+    options.useIoUring = opts.Get("useIoUring").ToBoolean().Value();
+  }
+
+  ArchiveWorker* worker = new ArchiveWorker(env, std::move(options));
+  Napi::Promise promise = worker->Promise();
+  worker->Queue();
+  return promise;
+}
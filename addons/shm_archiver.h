@@ -0,0 +1,39 @@
+#pragma once
+
+#include <napi.h>
+#include <cstdint>
+#include <limits>
+#include <string>
+
+struct ArchiveOptions {
+  std::string sourcePath;
+  std::string targetPath;
+  uint64_t fromCursor { 0 };
+  uint64_t toCursor { std::numeric_limits<uint64_t>::max() };
+  uint64_t capacityBytes { 0 };
+  bool useIoUring { true };
+};
+
+struct ArchiveStats {
+  uint64_t startCursor { 0 };
+  uint64_t endCursor { 0 };
+  uint64_t framesWritten { 0 };
+  uint64_t bytesWritten { 0 };
+  bool usedIoUring { false };
+};
+
+// Appends the committed frames of `sourcePath` in [fromCursor, toCursor) to
+// the plain log at `targetPath`, creating it when missing. Frames are copied
+// byte for byte so the target can be opened with openSharedLog/ShmIterator,
+// and the target's committed size only moves once the data is on disk.
+// `endCursor` is where the next incremental archive should start. Runs
+// without touching N-API and reports failures as std::runtime_error.
+ArchiveStats ArchiveLogRange(const ArchiveOptions& options);
+
+class ShmArchiver {
+public:
+  static void Init(Napi::Env env, Napi::Object exports);
+
+private:
+  static Napi::Value ArchiveLog(const Napi::CallbackInfo& info);
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <napi.h>
+
+#include <cstdint>
+
+// A Buffer over a raw pointer (Napi::Buffer::New) gets its own external
+// backing store plus finalizer bookkeeping, which costs far more than the view
+// itself. Frames are handed out as Buffers viewing one ArrayBuffer over the
+// whole mapping instead. Node-API cannot make a Buffer over part of an
+// existing ArrayBuffer, so the views come from Buffer.from(arrayBuffer,
+// byteOffset, length), which Node builds without copying.
+namespace shmio {
+
+// Buffer and Buffer.from, looked up once per environment: the main thread and
+// every worker thread have their own.
+struct BufferViewsData {
+  Napi::ObjectReference bufferClass;
+  Napi::FunctionReference bufferFrom;
+};
+
+inline BufferViewsData& GetBufferViewsData(Napi::Env env) {
+  BufferViewsData* data = env.GetInstanceData<BufferViewsData>();
+  if (data == nullptr) {
+    data = new BufferViewsData();
+    Napi::Object bufferClass = env.Global().Get("Buffer").As<Napi::Object>();
+    data->bufferClass = Napi::Persistent(bufferClass);
+    data->bufferFrom = Napi::Persistent(bufferClass.Get("from").As<Napi::Function>());
+    // The environment deletes the data when it is torn down.
+    env.SetInstanceData(data);
+  }
+  return *data;
+}
+
+// Makes Buffers over ranges of `arrayBuffer`. Meant to be created once per
+// call and used for every frame it returns.
+class BufferViews {
+public:
+  BufferViews(Napi::Env env, Napi::ArrayBuffer arrayBuffer)
+    : env_(env),
+      arrayBuffer_(arrayBuffer),
+      bufferClass_(GetBufferViewsData(env).bufferClass.Value()),
+      bufferFrom_(GetBufferViewsData(env).bufferFrom.Value()),
+      data_(static_cast<const uint8_t*>(arrayBuffer.Data())),
+      byteLength_(arrayBuffer.ByteLength()) {}
+
+  Napi::Value View(const uint8_t* data, size_t length) const {
+    size_t offset = static_cast<size_t>(data - data_);
+    if (data < data_ || offset > byteLength_ || length > byteLength_ - offset) {
+      throw Napi::RangeError::New(env_, "Frame lies outside the mapped ArrayBuffer");
+    }
+    return bufferFrom_.Call(bufferClass_, {
+      arrayBuffer_,
+      Napi::Number::New(env_, static_cast<double>(offset)),
+      Napi::Number::New(env_, static_cast<double>(length)),
+    });
+  }
+
+private:
+  Napi::Env env_;
+  Napi::ArrayBuffer arrayBuffer_;
+  Napi::Object bufferClass_;
+  Napi::Function bufferFrom_;
+  const uint8_t* data_;
+  size_t byteLength_;
+};
+
+} // namespace shmio
@@ -0,0 +1,134 @@
+#include "shm_checkpoint.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shm_format.h"
+
+namespace shmio {
+
+namespace {
+
+constexpr uint64_t kCheckpointMagic = 0x314b434f494d4853ULL; // "SHMIOCK1"
+constexpr size_t kCheckpointFileBytes = 192;
+constexpr size_t kRecordOffsets[2] = { 64, 128 };
+constexpr size_t kMaxConsumerNameLength = 64;
+
+uint64_t Checksum(uint64_t cursor, uint64_t sequence) {
+  uint64_t hash = cursor ^ (sequence * 0x9e3779b97f4a7c15ULL) ^ kCheckpointMagic;
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+bool RecordValid(const uint8_t* record) {
+  uint64_t sequence = ReadUint64LE(record + 8);
+  return sequence != 0 && ReadUint64LE(record + 16) == Checksum(ReadUint64LE(record), sequence);
+}
+
+} // namespace
+
+CursorCheckpoint::~CursorCheckpoint() {
+  if (base_ != nullptr) {
+    munmap(base_, kCheckpointFileBytes);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool CursorCheckpoint::Open(const std::string& path) {
+  fd_ = open(path.c_str(), O_RDWR | O_CREAT, 0664);
+  if (fd_ < 0) {
+    return false;
+  }
+
+  struct stat st {};
+  if (fstat(fd_, &st) != 0) {
+    return false;
+  }
+  if (st.st_size < static_cast<off_t>(kCheckpointFileBytes)
+      && ftruncate(fd_, static_cast<off_t>(kCheckpointFileBytes)) != 0) {
+    return false;
+  }
+
+  void* mapped = mmap(nullptr, kCheckpointFileBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (mapped == MAP_FAILED) {
+    return false;
+  }
+  base_ = static_cast<uint8_t*>(mapped);
+
+  uint64_t magic = ReadUint64LE(base_);
+  if (magic == 0) {
+    WriteUint64LE(base_, kCheckpointMagic);
+  } else if (magic != kCheckpointMagic) {
+    errno = EINVAL;
+    return false;
+  }
+
+  const uint8_t* latest = LatestRecord();
+  sequence_ = latest != nullptr ? ReadUint64LE(latest + 8) : 0;
+  return true;
+}
+
+const uint8_t* CursorCheckpoint::LatestRecord() const {
+  const uint8_t* first = base_ + kRecordOffsets[0];
+  const uint8_t* second = base_ + kRecordOffsets[1];
+  bool firstValid = RecordValid(first);
+  bool secondValid = RecordValid(second);
+  if (firstValid && secondValid) {
+    return ReadUint64LE(first + 8) > ReadUint64LE(second + 8) ? first : second;
+  }
+  if (firstValid) {
+    return first;
+  }
+  return secondValid ? second : nullptr;
+}
+
+bool CursorCheckpoint::Load(uint64_t* cursor) const {
+  const uint8_t* latest = LatestRecord();
+  if (latest == nullptr) {
+    return false;
+  }
+  *cursor = ReadUint64LE(latest);
+  return true;
+}
+
+void CursorCheckpoint::Store(uint64_t cursor) {
+  // Overwrite the older record; the newer one stays intact until the next call.
+  uint64_t sequence = ++sequence_;
+  uint8_t* record = base_ + kRecordOffsets[sequence & 1];
+  WriteUint64LE(record, cursor);
+  WriteUint64LE(record + 8, sequence);
+  WriteUint64LE(record + 16, Checksum(cursor, sequence));
+}
+
+bool CursorCheckpoint::Flush() {
+  return msync(base_, kCheckpointFileBytes, MS_SYNC) == 0;
+}
+
+std::string CursorCheckpoint::PathFor(const std::string& logPath, const std::string& consumer) {
+  return logPath + "." + consumer + ".cursor";
+}
+
+bool CursorCheckpoint::IsValidConsumerName(const std::string& consumer) {
+  if (consumer.empty() || consumer.size() > kMaxConsumerNameLength || consumer[0] == '.') {
+    return false;
+  }
+  for (char c : consumer) {
+    bool allowed = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+      || c == '_' || c == '-' || c == '.';
+    if (!allowed) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace shmio
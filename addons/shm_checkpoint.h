@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace shmio {
+
+// Durable reader position stored in a small sidecar file next to the log.
+// Two (cursor, sequence, checksum) records are written alternately with plain
+// stores into a shared mapping, so a process crash never loses the previous
+// position and a torn record (power loss before Flush) is detected by its
+// checksum and skipped in favour of the other one.
+//
+// Sidecar layout (little-endian u64):
+//   0    magic "SHMIOCK1"
+//   64   record 0: cursor, sequence, checksum
+//   128  record 1: cursor, sequence, checksum
+class CursorCheckpoint {
+public:
+  CursorCheckpoint() = default;
+  CursorCheckpoint(const CursorCheckpoint&) = delete;
+  CursorCheckpoint& operator=(const CursorCheckpoint&) = delete;
+  ~CursorCheckpoint();
+
+  // Opens the sidecar, creating it when missing. Returns false with errno set.
+  bool Open(const std::string& path);
+
+  // The most recent valid cursor; false when nothing was stored yet.
+  bool Load(uint64_t* cursor) const;
+
+  void Store(uint64_t cursor);
+
+  // Writes the mapping back to the file. Returns false with errno set.
+  bool Flush();
+
+  // Sidecar path for a consumer of the log at logPath.
+  static std::string PathFor(const std::string& logPath, const std::string& consumer);
+
+  // Consumer names become part of a file name: 1-64 characters from
+  // [A-Za-z0-9_.-], not starting with a dot.
+  static bool IsValidConsumerName(const std::string& consumer);
+
+private:
+  const uint8_t* LatestRecord() const;
+
+  int fd_ { -1 };
+  uint8_t* base_ { nullptr };
+  uint64_t sequence_ { 0 };
+};
+
+} // namespace shmio
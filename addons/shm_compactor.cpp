@@ -0,0 +1,357 @@
+#include "shm_compactor.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "shm_file.h"
+#include "shm_format.h"
+#include "shm_options.h"
+
+namespace {
+
+using shmio::MappedFile;
+using shmio::SystemError;
+
+uint64_t HashKey(const uint8_t* data, size_t length) {
+  // FNV-1a followed by a murmur finalizer so the low bits used for probing
+  // stay well distributed even for short, mostly-zero keys.
+  uint64_t hash = 1469598103934665603ULL;
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= data[i];
+    hash *= 1099511628211ULL;
+  }
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+// Open-addressing (linear probing) map from key bytes to the offset of the
+// latest frame carrying that key. Keys are not copied: slots point back into
+// the source mapping and collisions are resolved with memcmp.
+class KeyIndex {
+public:
+  KeyIndex(const uint8_t* base, uint32_t keyOffset, uint32_t keyLength)
+    : base_(base), keyOffset_(keyOffset), keyLength_(keyLength) {
+    slots_.resize(kInitialCapacity);
+  }
+
+  void Upsert(uint64_t frameOffset) {
+    if ((size_ + 1) * 10 > slots_.size() * 7) {
+      Grow();
+    }
+
+    const uint8_t* key = KeyAt(frameOffset);
+    uint64_t hash = HashKey(key, keyLength_);
+    size_t mask = slots_.size() - 1;
+    size_t index = static_cast<size_t>(hash) & mask;
+
+    while (true) {
+      Slot& slot = slots_[index];
+      if (slot.frameOffset == 0) {
+        slot.hash = hash;
+        slot.frameOffset = frameOffset;
+        ++size_;
+        return;
+      }
+      if (slot.hash == hash && std::memcmp(KeyAt(slot.frameOffset), key, keyLength_) == 0) {
+        slot.frameOffset = frameOffset;
+        return;
+      }
+      index = (index + 1) & mask;
+    }
+  }
+
+  std::vector<uint64_t> SortedOffsets() const {
+    std::vector<uint64_t> offsets;
+    offsets.reserve(size_);
+    for (const Slot& slot : slots_) {
+      if (slot.frameOffset != 0) {
+        offsets.push_back(slot.frameOffset);
+      }
+    }
+    std::sort(offsets.begin(), offsets.end());
+    return offsets;
+  }
+
+private:
+  struct Slot {
+    uint64_t hash { 0 };
+    uint64_t frameOffset { 0 }; // 0 marks an empty slot; frames never start there
+  };
+
+  static constexpr size_t kInitialCapacity = 1024;
+
+  const uint8_t* KeyAt(uint64_t frameOffset) const {
+    return base_ + frameOffset + shmio::kMessageHeaderBytes + keyOffset_;
+  }
+
+  void Grow() {
+    std::vector<Slot> previous(slots_.size() * 2);
+    previous.swap(slots_);
+    size_t mask = slots_.size() - 1;
+    for (const Slot& slot : previous) {
+      if (slot.frameOffset == 0) {
+        continue;
+      }
+      size_t index = static_cast<size_t>(slot.hash) & mask;
+      while (slots_[index].frameOffset != 0) {
+        index = (index + 1) & mask;
+      }
+      slots_[index] = slot;
+    }
+  }
+
+  const uint8_t* base_;
+  uint32_t keyOffset_;
+  uint32_t keyLength_;
+  size_t size_ { 0 };
+  std::vector<Slot> slots_;
+};
+
+class CompactWorker : public Napi::AsyncWorker {
+public:
+  CompactWorker(Napi::Env env, CompactionOptions options)
+    : Napi::AsyncWorker(env, "shmio:compactLog"),
+      deferred_(Napi::Promise::Deferred::New(env)),
+      options_(std::move(options)) {}
+
+  Napi::Promise Promise() const { return deferred_.Promise(); }
+
+protected:
+  void Execute() override {
+    try {
+      stats_ = CompactLogFile(options_);
+    } catch (const std::exception& e) {
+      SetError(e.what());
+    }
+  }
+
+  void OnOK() override {
+    Napi::Env env = Env();
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("framesRead", Napi::Number::New(env, static_cast<double>(stats_.framesRead)));
+    result.Set("framesWritten", Napi::Number::New(env, static_cast<double>(stats_.framesWritten)));
+    result.Set("framesWithoutKey", Napi::Number::New(env, static_cast<double>(stats_.framesWithoutKey)));
+    result.Set("bytesWritten", Napi::Number::New(env, static_cast<double>(stats_.bytesWritten)));
+    deferred_.Resolve(result);
+  }
+
+  void OnError(const Napi::Error& error) override {
+    deferred_.Reject(error.Value());
+  }
+
+private:
+  Napi::Promise::Deferred deferred_;
+  CompactionOptions options_;
+  CompactionStats stats_;
+};
+
+} // namespace
+
+CompactionStats CompactLogFile(const CompactionOptions& options) {
+  CompactionStats stats;
+
+  MappedFile source;
+  source.fd = open(options.sourcePath.c_str(), O_RDONLY);
+  if (source.fd < 0) {
+    throw SystemError("Unable to open source log");
+  }
+
+  struct stat st {};
+  if (fstat(source.fd, &st) != 0) {
+    throw SystemError("fstat failed");
+  }
+  if (st.st_size < static_cast<off_t>(shmio::kDefaultHeaderSize)) {
+    throw std::runtime_error("source log is smaller than minimum header size");
+  }
+
+  source.length = static_cast<size_t>(st.st_size);
+  void* mapped = mmap(nullptr, source.length, PROT_READ, MAP_SHARED, source.fd, 0);
+  if (mapped == MAP_FAILED) {
+    throw SystemError("mmap failed");
+  }
+  source.base = static_cast<uint8_t*>(mapped);
+
+  if (shmio::HasHeaderV2(source.base, source.length) && !shmio::IsSupportedHeaderV2(source.base)) {
+    throw std::runtime_error("source log header version is not supported");
+  }
+  if (shmio::RingBytes(source.base, source.length) != 0) {
+    throw std::runtime_error("ring logs cannot be compacted");
+  }
+
+  uint64_t dataOffset = shmio::ReadUint64LE(source.base + shmio::kDataOffsetOffset);
+  uint64_t committed = shmio::LoadCommitted(source.base, shmio::CommittedSizeOffset(source.base, source.length));
+  if (dataOffset == 0 || dataOffset > source.length || committed < dataOffset || committed > source.length) {
+    throw std::runtime_error("source log header is invalid");
+  }
+
+  madvise(source.base + dataOffset, committed - dataOffset, MADV_SEQUENTIAL);
+
+  // Keys are located relative to the payload, behind the sequence stamp if
+  // the source has one. The snapshot is written without stamps.
+  uint32_t sequenceBytes = shmio::FrameSequenceBytes(source.base, source.length);
+  uint64_t keyEnd = static_cast<uint64_t>(options.keyOffset) + options.keyLength;
+  KeyIndex index(source.base, options.keyOffset + sequenceBytes, options.keyLength);
+
+  uint64_t cursor = dataOffset;
+  while (cursor + shmio::kFrameMetadataBytes <= committed) {
+    uint16_t frameSize = shmio::ReadUint16LE(source.base + cursor);
+    if (frameSize == 0) {
+      // Alignment padding is dropped; the snapshot packs frames back to back.
+      uint32_t paddingSize = shmio::PaddingLength(source.base + cursor);
+      if (paddingSize < shmio::kMinPaddingBytes || cursor + paddingSize > committed) {
+        throw std::runtime_error("Invalid padding length at offset " + std::to_string(cursor));
+      }
+      cursor += paddingSize;
+      continue;
+    }
+    if (frameSize < shmio::kFrameMetadataBytes + sequenceBytes) {
+      throw std::runtime_error("Invalid frame size (too small) at offset " + std::to_string(cursor));
+    }
+    if (cursor + frameSize > committed) {
+      break;
+    }
+
+    ++stats.framesRead;
+    if (frameSize - shmio::kFrameMetadataBytes - sequenceBytes < keyEnd) {
+      ++stats.framesWithoutKey;
+    } else {
+      index.Upsert(cursor);
+    }
+    cursor += frameSize;
+  }
+
+  std::vector<uint64_t> offsets = index.SortedOffsets();
+  // Whole frames, size prefix and suffix included, less the sequence stamps.
+  uint64_t frameBytes = 0;
+  for (uint64_t offset : offsets) {
+    frameBytes += shmio::ReadUint16LE(source.base + offset) - sequenceBytes;
+  }
+
+  uint64_t capacity = std::max<uint64_t>(options.capacityBytes, shmio::kDefaultHeaderSize + frameBytes);
+  if (capacity > std::numeric_limits<size_t>::max()) {
+    throw std::runtime_error("compacted log is too large to map");
+  }
+
+  // Build the snapshot next to the target and rename it into place so readers
+  // never observe a half-written log.
+  std::string tempPath = options.targetPath + ".compacting";
+  MappedFile target;
+  target.fd = open(tempPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0664);
+  if (target.fd < 0) {
+    throw SystemError("Unable to create target log");
+  }
+  if (ftruncate(target.fd, static_cast<off_t>(capacity)) != 0) {
+    unlink(tempPath.c_str());
+    throw SystemError("ftruncate failed");
+  }
+
+  target.length = static_cast<size_t>(capacity);
+  mapped = mmap(nullptr, target.length, PROT_READ | PROT_WRITE, MAP_SHARED, target.fd, 0);
+  if (mapped == MAP_FAILED) {
+    unlink(tempPath.c_str());
+    throw SystemError("mmap failed");
+  }
+  target.base = static_cast<uint8_t*>(mapped);
+
+  uint64_t writeCursor = shmio::kDefaultHeaderSize;
+  for (uint64_t offset : offsets) {
+    uint16_t frameSize = shmio::ReadUint16LE(source.base + offset);
+    if (sequenceBytes == 0) {
+      std::memcpy(target.base + writeCursor, source.base + offset, frameSize);
+      writeCursor += frameSize;
+      continue;
+    }
+    uint16_t strippedSize = static_cast<uint16_t>(frameSize - sequenceBytes);
+    uint32_t payloadSize = strippedSize - shmio::kFrameMetadataBytes;
+    shmio::WriteUint16LE(target.base + writeCursor, strippedSize);
+    std::memcpy(target.base + writeCursor + shmio::kMessageHeaderBytes,
+      source.base + offset + shmio::kMessageHeaderBytes + sequenceBytes, payloadSize);
+    shmio::WriteUint16LE(target.base + writeCursor + strippedSize - shmio::kMessageHeaderBytes, strippedSize);
+    writeCursor += strippedSize;
+  }
+
+  shmio::WriteUint64LE(target.base + shmio::kHeaderSizeOffset, shmio::kDefaultHeaderSize);
+  shmio::WriteUint64LE(target.base + shmio::kDataOffsetOffset, shmio::kDefaultHeaderSize);
+  shmio::WriteUint64LE(target.base + shmio::kCommittedSizeOffset, writeCursor);
+
+  if (msync(target.base, target.length, MS_SYNC) != 0 || fsync(target.fd) != 0) {
+    unlink(tempPath.c_str());
+    throw SystemError("flushing compacted log failed");
+  }
+  if (rename(tempPath.c_str(), options.targetPath.c_str()) != 0) {
+    unlink(tempPath.c_str());
+    throw SystemError("rename of compacted log failed");
+  }
+
+  stats.framesWritten = offsets.size();
+  stats.bytesWritten = writeCursor;
+  return stats;
+}
+
+void ShmCompactor::Init(Napi::Env env, Napi::Object exports) {
+  exports.Set("compactLog", Napi::Function::New(env, ShmCompactor::CompactLog));
+}
+
+Napi::Value ShmCompactor::CompactLog(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1 || !info[0].IsObject()) {
+    Napi::TypeError::New(env, "compactLog(options) expects an options object").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  Napi::Object opts = info[0].As<Napi::Object>();
+  CompactionOptions options;
+
+  Napi::Value sourceValue = opts.Get("sourcePath");
+  Napi::Value targetValue = opts.Get("targetPath");
+  if (!sourceValue.IsString() || !targetValue.IsString()) {
+    Napi::TypeError::New(env, "options.sourcePath and options.targetPath must be strings").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  options.sourcePath = sourceValue.As<Napi::String>().Utf8Value();
+  options.targetPath = targetValue.As<Napi::String>().Utf8Value();
+  if (options.sourcePath == options.targetPath) {
+    Napi::TypeError::New(env, "targetPath must differ from sourcePath").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  Napi::Value keyOffsetValue = opts.Get("keyOffset");
+  Napi::Value keyLengthValue = opts.Get("keyLength");
+  if (!keyOffsetValue.IsNumber() || !keyLengthValue.IsNumber()) {
+    Napi::TypeError::New(env, "options.keyOffset and options.keyLength must be numbers").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  int64_t keyOffset = keyOffsetValue.As<Napi::Number>().Int64Value();
+  int64_t keyLength = keyLengthValue.As<Napi::Number>().Int64Value();
+  int64_t maxPayload = shmio::kMaxFrameBytes - shmio::kFrameMetadataBytes;
+  if (keyOffset < 0 || keyLength <= 0 || keyOffset + keyLength > maxPayload) {
+    Napi::RangeError::New(env, "key range must lie within the maximum frame payload").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  options.keyOffset = static_cast<uint32_t>(keyOffset);
+  options.keyLength = static_cast<uint32_t>(keyLength);
+
+  if (!shmio::ParseCursorOption(env, opts, "capacityBytes", &options.capacityBytes)) {
+    return env.Null();
+  }
+
+  CompactWorker* worker = new CompactWorker(env, std::move(options));
+  Napi::Promise promise = worker->Promise();
+  worker->Queue();
+  return promise;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <napi.h>
+#include <cstdint>
+#include <string>
+
+struct CompactionOptions {
+  std::string sourcePath;
+  std::string targetPath;
+  uint32_t keyOffset { 0 };
+  uint32_t keyLength { 0 };
+  uint64_t capacityBytes { 0 };
+};
+
+struct CompactionStats {
+  uint64_t framesRead { 0 };
+  uint64_t framesWritten { 0 };
+  uint64_t framesWithoutKey { 0 };
+  // Header and frames; capacity past them is left as a hole.
+  uint64_t bytesWritten { 0 };
+};
+
+// Reads the committed frames of `sourcePath` and writes a new log at
+// `targetPath` holding only the last frame for every distinct key, in the
+// order those frames appeared. Runs without touching N-API and reports
+// failures as std::runtime_error.
+CompactionStats CompactLogFile(const CompactionOptions& options);
+
+class ShmCompactor {
+public:
+  static void Init(Napi::Env env, Napi::Object exports);
+
+private:
+  static Napi::Value CompactLog(const Napi::CallbackInfo& info);
+};
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#include "shm_format.h"
+
+// Block compression for cold log ranges: a byte-oriented LZ77 codec (the
+// sequence layout of LZ4, so it is fast to decode and needs no dependency)
+// and the layout of compressed log files. Like shm_format.h this must not
+// depend on N-API.
+namespace shmio {
+
+// ---------------------------------------------------------------------------
+// Compressed log file
+//
+//   [file header, 64 bytes]
+//   [block header, 24 bytes][compressed bytes]   x blockCount
+//   [index entry, 16 bytes]                      x blockCount
+//
+// Each block holds whole frames copied verbatim from the source log
+// (including any padding in front of them), so the decompressed bytes are a
+// normal frame chain and block cursors are source cursors. A block whose
+// compressed size equals its raw size is stored uncompressed.
+// ---------------------------------------------------------------------------
+
+constexpr uint64_t kCompressedMagic = 0x01005A4F494D4853ULL; // "SHMIOZ\0\1"
+constexpr uint32_t kCompressedVersion = 1;
+constexpr uint32_t kCompressedFrameSequences = 1u << 0;
+
+constexpr uint64_t kCompressedHeaderSize = 64;
+constexpr uint64_t kCompressedMagicOffset = 0;
+constexpr uint64_t kCompressedVersionOffset = 8;
+constexpr uint64_t kCompressedFlagsOffset = 12;
+constexpr uint64_t kCompressedBlockCountOffset = 16;
+constexpr uint64_t kCompressedIndexOffset = 24;
+constexpr uint64_t kCompressedStartCursorOffset = 32;
+constexpr uint64_t kCompressedEndCursorOffset = 40;
+constexpr uint64_t kCompressedFramesOffset = 48;
+constexpr uint64_t kCompressedMaxBlockOffset = 56;
+
+constexpr uint64_t kBlockHeaderSize = 24;
+constexpr uint64_t kBlockCompressedBytesOffset = 0;
+constexpr uint64_t kBlockRawBytesOffset = 4;
+constexpr uint64_t kBlockFramesOffset = 8;
+constexpr uint64_t kBlockChecksumOffset = 12;
+constexpr uint64_t kBlockCursorOffset = 16;
+
+constexpr uint64_t kIndexEntrySize = 16;
+
+constexpr uint32_t kDefaultCompressedBlockBytes = 64 * 1024;
+constexpr uint32_t kMinCompressedBlockBytes = 4 * 1024;
+constexpr uint32_t kMaxCompressedBlockBytes = 16 * 1024 * 1024;
+
+// FNV-1a (32-bit) over a block's stored bytes.
+inline uint32_t BlockChecksum(const uint8_t* data, size_t length) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; ++i) {
+    hash = (hash ^ data[i]) * 16777619u;
+  }
+  return hash;
+}
+
+// ---------------------------------------------------------------------------
+// Codec
+//
+// A block is a run of sequences: a token (high nibble literal length, low
+// nibble match length - 4, 15 meaning "extended by the following bytes, each
+// 255 continuing"), the literals, then a u16 LE offset back into the output
+// and the match length extension. The final sequence has literals only.
+// ---------------------------------------------------------------------------
+
+constexpr uint32_t kMinMatch = 4;
+constexpr uint32_t kMaxMatchOffset = 65535;
+// Matches stop this far from the end so the final sequence carries literals.
+constexpr uint32_t kLastLiterals = 5;
+
+class BlockCompressor {
+public:
+  BlockCompressor() : table_(new uint32_t[kTableSize]) {}
+
+  // Compresses `length` bytes into `out`, which must hold at least `length`
+  // bytes. Returns the compressed size, or 0 when the block does not get
+  // smaller and should be stored as is.
+  size_t Compress(const uint8_t* input, size_t length, uint8_t* out) {
+    if (length < kMinMatch + kLastLiterals + 1) {
+      return 0;
+    }
+    std::memset(table_.get(), 0, kTableSize * sizeof(uint32_t));
+
+    const uint8_t* ip = input;
+    const uint8_t* anchor = input;
+    const uint8_t* const matchLimit = input + length - kLastLiterals;
+    uint8_t* op = out;
+    uint8_t* const outEnd = out + length;
+
+    while (ip + kMinMatch <= matchLimit) {
+      uint32_t sequence = Read32(ip);
+      uint32_t slot = Hash(sequence);
+      const uint8_t* candidate = input + table_[slot];
+      table_[slot] = static_cast<uint32_t>(ip - input);
+
+      if (candidate >= ip || static_cast<size_t>(ip - candidate) > kMaxMatchOffset || Read32(candidate) != sequence) {
+        ++ip;
+        continue;
+      }
+
+      size_t matchLength = kMinMatch;
+      while (ip + matchLength < matchLimit && candidate[matchLength] == ip[matchLength]) {
+        ++matchLength;
+      }
+
+      op = EmitSequence(op, outEnd, anchor, static_cast<size_t>(ip - anchor), static_cast<uint32_t>(ip - candidate), matchLength);
+      if (op == nullptr) {
+        return 0;
+      }
+      ip += matchLength;
+      anchor = ip;
+    }
+
+    op = EmitLiterals(op, outEnd, anchor, static_cast<size_t>(input + length - anchor));
+    if (op == nullptr || op >= outEnd) {
+      return 0;
+    }
+    return static_cast<size_t>(op - out);
+  }
+
+private:
+  static constexpr uint32_t kHashBits = 14;
+  static constexpr uint32_t kTableSize = 1u << kHashBits;
+
+  static uint32_t Read32(const uint8_t* data) {
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+  }
+
+  static uint32_t Hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - kHashBits);
+  }
+
+  static uint8_t* PutLength(uint8_t* op, uint8_t* outEnd, size_t length) {
+    while (length >= 255) {
+      if (op >= outEnd) {
+        return nullptr;
+      }
+      *op++ = 255;
+      length -= 255;
+    }
+    if (op >= outEnd) {
+      return nullptr;
+    }
+    *op++ = static_cast<uint8_t>(length);
+    return op;
+  }
+
+  static uint8_t* EmitLiterals(uint8_t* op, uint8_t* outEnd, const uint8_t* literals, size_t count) {
+    if (op >= outEnd) {
+      return nullptr;
+    }
+    *op++ = static_cast<uint8_t>((count < 15 ? count : 15) << 4);
+    if (count >= 15 && (op = PutLength(op, outEnd, count - 15)) == nullptr) {
+      return nullptr;
+    }
+    if (count > static_cast<size_t>(outEnd - op)) {
+      return nullptr;
+    }
+    std::memcpy(op, literals, count);
+    return op + count;
+  }
+
+  static uint8_t* EmitSequence(uint8_t* op, uint8_t* outEnd, const uint8_t* literals, size_t count,
+                               uint32_t offset, size_t matchLength) {
+    uint8_t* token = op;
+    if ((op = EmitLiterals(op, outEnd, literals, count)) == nullptr || outEnd - op < 2) {
+      return nullptr;
+    }
+    *op++ = static_cast<uint8_t>(offset);
+    *op++ = static_cast<uint8_t>(offset >> 8);
+    size_t extra = matchLength - kMinMatch;
+    *token |= static_cast<uint8_t>(extra < 15 ? extra : 15);
+    if (extra >= 15) {
+      op = PutLength(op, outEnd, extra - 15);
+    }
+    return op;
+  }
+
+  std::unique_ptr<uint32_t[]> table_;
+};
+
+// Decodes a block into exactly `rawLength` bytes. Returns false for any
+// malformed input instead of reading or writing out of bounds.
+inline bool DecompressBlock(const uint8_t* input, size_t length, uint8_t* out, size_t rawLength) {
+  const uint8_t* ip = input;
+  const uint8_t* const inEnd = input + length;
+  uint8_t* op = out;
+  uint8_t* const outEnd = out + rawLength;
+
+  auto readLength = [&](size_t* value) {
+    uint8_t byte;
+    do {
+      if (ip >= inEnd) {
+        return false;
+      }
+      byte = *ip++;
+      *value += byte;
+      if (*value > rawLength) {
+        return false;
+      }
+    } while (byte == 255);
+    return true;
+  };
+
+  while (ip < inEnd) {
+    uint8_t token = *ip++;
+    size_t literals = token >> 4;
+    if (literals == 15 && !readLength(&literals)) {
+      return false;
+    }
+    if (literals > static_cast<size_t>(inEnd - ip) || literals > static_cast<size_t>(outEnd - op)) {
+      return false;
+    }
+    std::memcpy(op, ip, literals);
+    ip += literals;
+    op += literals;
+    if (ip == inEnd) {
+      break;
+    }
+
+    if (inEnd - ip < 2) {
+      return false;
+    }
+    size_t offset = static_cast<size_t>(ip[0]) | (static_cast<size_t>(ip[1]) << 8);
+    ip += 2;
+    size_t matchLength = token & 15;
+    if (matchLength == 15 && !readLength(&matchLength)) {
+      return false;
+    }
+    matchLength += kMinMatch;
+    if (offset == 0 || offset > static_cast<size_t>(op - out) || matchLength > static_cast<size_t>(outEnd - op)) {
+      return false;
+    }
+    const uint8_t* match = op - offset;
+    if (offset >= matchLength) {
+      std::memcpy(op, match, matchLength);
+      op += matchLength;
+    } else {
+      // Overlapping copy repeats the last `offset` bytes.
+      for (size_t i = 0; i < matchLength; ++i) {
+        *op++ = match[i];
+      }
+    }
+  }
+  return op == outEnd;
+}
+
+} // namespace shmio
@@ -0,0 +1,353 @@
+#include "shm_compressed_iterator.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <string>
+
+#include "shm_buffer_views.h"
+#include "shm_compress.h"
+#include "shm_format.h"
+#include "shm_scan.h"
+
+namespace {
+constexpr uint32_t kDefaultMaxMessages = 64;
+constexpr uint32_t kDefaultMaxBytes = 256 * 1024;
+// Blocks end at the first frame boundary past blockBytes, so one frame and
+// its alignment padding may stick out.
+constexpr uint64_t kMaxBlockRawBytes = shmio::kMaxCompressedBlockBytes + shmio::kMaxFrameBytes + shmio::kMaxAlignment;
+
+[[noreturn]] void ThrowWithCode(Napi::Env env, const std::string& message, const char* code) {
+  Napi::Error err = Napi::Error::New(env, message);
+  err.Set("code", Napi::String::New(env, code));
+  throw err;
+}
+
+uint32_t ParseLimit(Napi::Env env, const Napi::Object& options, const char* name, uint32_t fallback) {
+  if (!options.Has(name)) {
+    return fallback;
+  }
+  Napi::Value value = options.Get(name);
+  if (!value.IsNumber()) {
+    ThrowWithCode(env, std::string(name) + " must be a number", "ERR_SHM_CURSOR");
+  }
+  int64_t limit = value.As<Napi::Number>().Int64Value();
+  if (limit <= 0 || limit > std::numeric_limits<uint32_t>::max()) {
+    ThrowWithCode(env, std::string(name) + " must be > 0 and <= 2^32-1", "ERR_SHM_CURSOR");
+  }
+  return static_cast<uint32_t>(limit);
+}
+}
+
+void ShmCompressedIterator::Init(Napi::Env env, Napi::Object exports) {
+  Napi::Function func = DefineClass(env, "CompressedIterator", {
+    InstanceMethod<&ShmCompressedIterator::Next>("next"),
+    InstanceMethod<&ShmCompressedIterator::NextBatch>("nextBatch"),
+    InstanceMethod<&ShmCompressedIterator::Cursor>("cursor"),
+    InstanceMethod<&ShmCompressedIterator::StartCursor>("startCursor"),
+    InstanceMethod<&ShmCompressedIterator::EndCursor>("endCursor"),
+    InstanceMethod<&ShmCompressedIterator::Frames>("frames"),
+    InstanceMethod<&ShmCompressedIterator::Seek>("seek"),
+    InstanceMethod<&ShmCompressedIterator::Close>("close"),
+  });
+
+  exports.Set("CompressedIterator", func);
+}
+
+ShmCompressedIterator::ShmCompressedIterator(const Napi::CallbackInfo& info)
+  : Napi::ObjectWrap<ShmCompressedIterator>(info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1 || !info[0].IsString()) {
+    Napi::TypeError::New(env, "CompressedIterator expects (path, { startCursor })").ThrowAsJavaScriptException();
+    return;
+  }
+  Open(env, info[0].As<Napi::String>().Utf8Value());
+
+  uint64_t position = startCursor_;
+  if (info.Length() >= 2 && info[1].IsObject()) {
+    Napi::Value value = info[1].As<Napi::Object>().Get("startCursor");
+    if (value.IsBigInt()) {
+      bool lossless = false;
+      position = value.As<Napi::BigInt>().Uint64Value(&lossless);
+      if (!lossless) {
+        ThrowWithCode(env, "startCursor must fit into uint64", "ERR_SHM_CURSOR");
+      }
+    } else if (!value.IsUndefined()) {
+      ThrowWithCode(env, "startCursor must be a BigInt", "ERR_SHM_CURSOR");
+    }
+  }
+  SeekTo(env, position);
+}
+
+void ShmCompressedIterator::Open(Napi::Env env, const std::string& path) {
+  file_ = std::make_unique<shmio::MappedFile>();
+  file_->fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (file_->fd < 0) {
+    ThrowWithCode(env, std::string("Unable to open compressed log: ") + strerror(errno), "ERR_SHM_IO");
+  }
+  struct stat st {};
+  if (fstat(file_->fd, &st) != 0) {
+    ThrowWithCode(env, std::string("fstat failed: ") + strerror(errno), "ERR_SHM_IO");
+  }
+  uint64_t fileLength = static_cast<uint64_t>(st.st_size);
+  if (fileLength < shmio::kCompressedHeaderSize || fileLength > std::numeric_limits<size_t>::max()) {
+    ThrowWithCode(env, "File is not a compressed log", "ERR_SHM_FRAME_CORRUPT");
+  }
+  void* mapped = mmap(nullptr, static_cast<size_t>(fileLength), PROT_READ, MAP_SHARED, file_->fd, 0);
+  if (mapped == MAP_FAILED) {
+    ThrowWithCode(env, std::string("mmap failed: ") + strerror(errno), "ERR_SHM_IO");
+  }
+  file_->base = static_cast<uint8_t*>(mapped);
+  file_->length = static_cast<size_t>(fileLength);
+
+  const uint8_t* header = file_->base;
+  if (shmio::ReadUint64LE(header + shmio::kCompressedMagicOffset) != shmio::kCompressedMagic) {
+    ThrowWithCode(env, "File is not a compressed log", "ERR_SHM_FRAME_CORRUPT");
+  }
+  if (shmio::ReadUint32LE(header + shmio::kCompressedVersionOffset) != shmio::kCompressedVersion) {
+    ThrowWithCode(env, "Compressed log version is not supported", "ERR_SHM_FRAME_CORRUPT");
+  }
+  uint32_t flags = shmio::ReadUint32LE(header + shmio::kCompressedFlagsOffset);
+  sequenceBytes_ = (flags & shmio::kCompressedFrameSequences) != 0 ? shmio::kFrameSequenceBytes : 0;
+  uint64_t blockCount = shmio::ReadUint64LE(header + shmio::kCompressedBlockCountOffset);
+  indexOffset_ = shmio::ReadUint64LE(header + shmio::kCompressedIndexOffset);
+  startCursor_ = shmio::ReadUint64LE(header + shmio::kCompressedStartCursorOffset);
+  endCursor_ = shmio::ReadUint64LE(header + shmio::kCompressedEndCursorOffset);
+  frames_ = shmio::ReadUint64LE(header + shmio::kCompressedFramesOffset);
+  uint32_t maxBlockBytes = shmio::ReadUint32LE(header + shmio::kCompressedMaxBlockOffset);
+
+  if (indexOffset_ < shmio::kCompressedHeaderSize || indexOffset_ > fileLength
+      || blockCount != (fileLength - indexOffset_) / shmio::kIndexEntrySize
+      || (fileLength - indexOffset_) % shmio::kIndexEntrySize != 0
+      || startCursor_ > endCursor_ || (blockCount == 0) != (startCursor_ == endCursor_)
+      || maxBlockBytes > kMaxBlockRawBytes) {
+    ThrowWithCode(env, "Compressed log header is invalid", "ERR_SHM_FRAME_CORRUPT");
+  }
+
+  blocks_.resize(static_cast<size_t>(blockCount));
+  for (size_t i = 0; i < blocks_.size(); ++i) {
+    const uint8_t* entry = file_->base + indexOffset_ + i * shmio::kIndexEntrySize;
+    blocks_[i].fileOffset = shmio::ReadUint64LE(entry);
+    blocks_[i].firstCursor = shmio::ReadUint64LE(entry + sizeof(uint64_t));
+    bool ordered = i == 0 ? blocks_[i].firstCursor == startCursor_ : blocks_[i].firstCursor > blocks_[i - 1].firstCursor;
+    if (!ordered || blocks_[i].firstCursor >= endCursor_ || blocks_[i].fileOffset < shmio::kCompressedHeaderSize
+        || blocks_[i].fileOffset > indexOffset_ - shmio::kBlockHeaderSize) {
+      ThrowWithCode(env, "Compressed log index is invalid", "ERR_SHM_FRAME_CORRUPT");
+    }
+  }
+
+  // Owned by V8, so views handed out stay backed after close().
+  Napi::ArrayBuffer scratch = Napi::ArrayBuffer::New(env, maxBlockBytes);
+  scratchRef_ = Napi::Persistent(scratch);
+  scratch_ = static_cast<uint8_t*>(scratch.Data());
+  scratchBytes_ = maxBlockBytes;
+  loaded_ = blocks_.size();
+  madvise(file_->base, file_->length, MADV_SEQUENTIAL);
+}
+
+uint64_t ShmCompressedIterator::BlockEnd(size_t index) const {
+  return index + 1 < blocks_.size() ? blocks_[index + 1].firstCursor : endCursor_;
+}
+
+void ShmCompressedIterator::LoadBlock(Napi::Env env, size_t index) {
+  loaded_ = blocks_.size();
+  const Block& block = blocks_[index];
+  const uint8_t* header = file_->base + block.fileOffset;
+  uint32_t compressedBytes = shmio::ReadUint32LE(header + shmio::kBlockCompressedBytesOffset);
+  uint32_t rawBytes = shmio::ReadUint32LE(header + shmio::kBlockRawBytesOffset);
+  uint32_t frames = shmio::ReadUint32LE(header + shmio::kBlockFramesOffset);
+  const uint8_t* data = header + shmio::kBlockHeaderSize;
+  std::string where = "Compressed block " + std::to_string(index);
+
+  if (compressedBytes > indexOffset_ - block.fileOffset - shmio::kBlockHeaderSize
+      || rawBytes != BlockEnd(index) - block.firstCursor || rawBytes > scratchBytes_
+      || compressedBytes > rawBytes || shmio::ReadUint64LE(header + shmio::kBlockCursorOffset) != block.firstCursor) {
+    ThrowWithCode(env, where + " header is invalid", "ERR_SHM_FRAME_CORRUPT");
+  }
+  if (shmio::BlockChecksum(data, compressedBytes) != shmio::ReadUint32LE(header + shmio::kBlockChecksumOffset)) {
+    ThrowWithCode(env, where + " checksum mismatch", "ERR_SHM_FRAME_CORRUPT");
+  }
+  if (compressedBytes == rawBytes) {
+    std::memcpy(scratch_, data, rawBytes);
+  } else if (!shmio::DecompressBlock(data, compressedBytes, scratch_, rawBytes)) {
+    ThrowWithCode(env, where + " does not decompress", "ERR_SHM_FRAME_CORRUPT");
+  }
+
+  // Checked once here so batches can walk the block without validation.
+  shmio::LogRegion region;
+  region.data = scratch_;
+  region.sequenceBytes = sequenceBytes_;
+  shmio::WalkResult walk = shmio::WalkFrames(region, 0, rawBytes, true,
+    [](uint64_t, const uint8_t*, uint32_t) { return true; });
+  if (!walk.error.empty() || walk.end != rawBytes || walk.frames != frames) {
+    ThrowWithCode(env, where + " frames are corrupt" + (walk.error.empty() ? "" : ": " + walk.error),
+      "ERR_SHM_FRAME_CORRUPT");
+  }
+
+  loaded_ = index;
+  loadedBytes_ = rawBytes;
+}
+
+std::vector<ShmCompressedIterator::Slice> ShmCompressedIterator::Collect(Napi::Env env, uint32_t maxMessages, uint32_t maxBytes) {
+  std::vector<Slice> slices;
+  if (blocks_.empty()) {
+    return slices;
+  }
+  if (blocks_[block_].firstCursor + offset_ == BlockEnd(block_)) {
+    if (block_ + 1 == blocks_.size()) {
+      return slices;
+    }
+    ++block_;
+    offset_ = 0;
+  }
+  if (loaded_ != block_) {
+    LoadBlock(env, block_);
+  }
+
+  shmio::LogRegion region;
+  region.data = scratch_;
+  region.sequenceBytes = sequenceBytes_;
+  uint64_t start = offset_;
+  uint64_t end = offset_;
+  shmio::WalkFrames(region, start, loadedBytes_, false, [&](uint64_t position, const uint8_t* frame, uint32_t frameSize) {
+    if (position + frameSize - start > maxBytes) {
+      return false;
+    }
+    slices.push_back(Slice { frame + shmio::kMessageHeaderBytes + sequenceBytes_,
+      frameSize - shmio::kFrameMetadataBytes - sequenceBytes_ });
+    end = position + frameSize;
+    return slices.size() < maxMessages;
+  });
+  offset_ = end;
+  return slices;
+}
+
+Napi::Value ShmCompressedIterator::Next(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  EnsureOpen(env);
+
+  std::vector<Slice> slices = Collect(env, 1, std::numeric_limits<uint32_t>::max());
+  if (slices.empty()) {
+    return env.Null();
+  }
+  return shmio::BufferViews(env, scratchRef_.Value()).View(slices[0].ptr, slices[0].length);
+}
+
+Napi::Value ShmCompressedIterator::NextBatch(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  EnsureOpen(env);
+
+  uint32_t maxMessages = kDefaultMaxMessages;
+  uint32_t maxBytes = kDefaultMaxBytes;
+  if (info.Length() >= 1 && info[0].IsObject()) {
+    Napi::Object options = info[0].As<Napi::Object>();
+    maxMessages = ParseLimit(env, options, "maxMessages", maxMessages);
+    maxBytes = ParseLimit(env, options, "maxBytes", maxBytes);
+  } else if (info.Length() >= 1 && !info[0].IsUndefined() && !info[0].IsNull()) {
+    ThrowWithCode(env, "nextBatch options must be an object", "ERR_SHM_CURSOR");
+  }
+
+  std::vector<Slice> slices = Collect(env, maxMessages, maxBytes);
+  Napi::Array output = Napi::Array::New(env, slices.size());
+  if (slices.empty()) {
+    return output;
+  }
+  shmio::BufferViews views(env, scratchRef_.Value());
+  for (size_t i = 0; i < slices.size(); ++i) {
+    output.Set(i, views.View(slices[i].ptr, slices[i].length));
+  }
+  return output;
+}
+
+Napi::Value ShmCompressedIterator::Cursor(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  EnsureOpen(env);
+  return Napi::BigInt::New(env, blocks_.empty() ? startCursor_ : blocks_[block_].firstCursor + offset_);
+}
+
+Napi::Value ShmCompressedIterator::StartCursor(const Napi::CallbackInfo& info) {
+  return Napi::BigInt::New(info.Env(), startCursor_);
+}
+
+Napi::Value ShmCompressedIterator::EndCursor(const Napi::CallbackInfo& info) {
+  return Napi::BigInt::New(info.Env(), endCursor_);
+}
+
+Napi::Value ShmCompressedIterator::Frames(const Napi::CallbackInfo& info) {
+  return Napi::Number::New(info.Env(), static_cast<double>(frames_));
+}
+
+void ShmCompressedIterator::Seek(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  EnsureOpen(env);
+
+  if (info.Length() < 1 || !info[0].IsBigInt()) {
+    ThrowWithCode(env, "seek(position) expects a BigInt", "ERR_SHM_CURSOR");
+  }
+  bool lossless = false;
+  uint64_t position = info[0].As<Napi::BigInt>().Uint64Value(&lossless);
+  if (!lossless) {
+    ThrowWithCode(env, "seek position must fit into uint64", "ERR_SHM_CURSOR");
+  }
+  SeekTo(env, position);
+}
+
+void ShmCompressedIterator::SeekTo(Napi::Env env, uint64_t position) {
+  if (position < startCursor_ || position > endCursor_) {
+    ThrowWithCode(env, "Seek position outside the compressed range", "ERR_SHM_CURSOR");
+  }
+  if (blocks_.empty()) {
+    return;
+  }
+
+  // Last block starting at or before the position.
+  auto it = std::upper_bound(blocks_.begin(), blocks_.end(), position,
+    [](uint64_t value, const Block& block) { return value < block.firstCursor; });
+  size_t index = static_cast<size_t>(it - blocks_.begin()) - 1;
+  uint64_t offset = position - blocks_[index].firstCursor;
+
+  if (offset != 0 && position != endCursor_) {
+    if (loaded_ != index) {
+      LoadBlock(env, index);
+    }
+    shmio::LogRegion region;
+    region.data = scratch_;
+    region.sequenceBytes = sequenceBytes_;
+    bool boundary = false;
+    shmio::WalkFrames(region, 0, loadedBytes_, false, [&](uint64_t framePosition, const uint8_t*, uint32_t frameSize) {
+      boundary = framePosition + frameSize == offset;
+      return framePosition + frameSize < offset;
+    });
+    if (!boundary) {
+      ThrowWithCode(env, "Seek position is not a frame boundary", "ERR_SHM_CURSOR");
+    }
+  }
+
+  block_ = index;
+  offset_ = offset;
+}
+
+void ShmCompressedIterator::Close(const Napi::CallbackInfo& info) {
+  if (closed_) {
+    return;
+  }
+  closed_ = true;
+  file_.reset();
+  blocks_.clear();
+  scratchRef_.Reset();
+  scratch_ = nullptr;
+  scratchBytes_ = 0;
+}
+
+void ShmCompressedIterator::EnsureOpen(Napi::Env env) const {
+  if (closed_) {
+    ThrowWithCode(env, "CompressedIterator is closed", "ERR_SHM_ITERATOR_CLOSED");
+  }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <napi.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "shm_file.h"
+
+// Reads a log written by compressLog. Blocks are decompressed one at a time
+// into an ArrayBuffer the iterator reuses, and frames are returned as views
+// of it, so they are only valid until the next call. A batch never spans two
+// blocks. Cursors are those of the source log.
+class ShmCompressedIterator : public Napi::ObjectWrap<ShmCompressedIterator> {
+public:
+  static void Init(Napi::Env env, Napi::Object exports);
+  ShmCompressedIterator(const Napi::CallbackInfo& info);
+
+private:
+  struct Block {
+    uint64_t fileOffset;
+    uint64_t firstCursor;
+  };
+
+  struct Slice {
+    const uint8_t* ptr;
+    size_t length;
+  };
+
+  Napi::Value Next(const Napi::CallbackInfo& info);
+  Napi::Value NextBatch(const Napi::CallbackInfo& info);
+  Napi::Value Cursor(const Napi::CallbackInfo& info);
+  Napi::Value StartCursor(const Napi::CallbackInfo& info);
+  Napi::Value EndCursor(const Napi::CallbackInfo& info);
+  Napi::Value Frames(const Napi::CallbackInfo& info);
+  void Seek(const Napi::CallbackInfo& info);
+  void Close(const Napi::CallbackInfo& info);
+
+  void Open(Napi::Env env, const std::string& path);
+  void SeekTo(Napi::Env env, uint64_t position);
+  // Decompresses block `index` into the scratch buffer and checks that it
+  // holds exactly the frames its header announces.
+  void LoadBlock(Napi::Env env, size_t index);
+  // Returns payload views of the next frames of the current block, moving to
+  // the next block first when the current one is used up.
+  std::vector<Slice> Collect(Napi::Env env, uint32_t maxMessages, uint32_t maxBytes);
+  uint64_t BlockEnd(size_t index) const;
+  void EnsureOpen(Napi::Env env) const;
+
+  std::unique_ptr<shmio::MappedFile> file_;
+  std::vector<Block> blocks_;
+  Napi::Reference<Napi::ArrayBuffer> scratchRef_;
+  uint8_t* scratch_ { nullptr };
+  size_t scratchBytes_ { 0 };
+  uint64_t indexOffset_ { 0 };
+  uint64_t startCursor_ { 0 };
+  uint64_t endCursor_ { 0 };
+  uint64_t frames_ { 0 };
+  uint32_t sequenceBytes_ { 0 };
+  // Block in scratch_ (blocks_.size() when none) and its raw size.
+  size_t loaded_ { 0 };
+  uint64_t loadedBytes_ { 0 };
+  // Position as (block, offset into its raw bytes).
+  size_t block_ { 0 };
+  uint64_t offset_ { 0 };
+  bool closed_ { false };
+};
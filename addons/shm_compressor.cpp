@@ -0,0 +1,345 @@
+#include "shm_compressor.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "shm_file.h"
+#include "shm_format.h"
+#include "shm_mirror.h"
+#include "shm_options.h"
+#include "shm_scan.h"
+
+namespace {
+
+using shmio::MappedFile;
+using shmio::SystemError;
+
+constexpr const char* kWriteFailed = "write to compressed log failed";
+
+// Removes the temporary file unless the compressed log made it into place.
+struct TempFile {
+  std::string path;
+  bool keep { false };
+
+  ~TempFile() {
+    if (!keep) {
+      unlink(path.c_str());
+    }
+  }
+};
+
+// Appends compressed blocks to the target and records the index.
+class BlockWriter {
+public:
+  BlockWriter(int fd, uint32_t blockBytes) : fd_(fd), offset_(shmio::kCompressedHeaderSize) {
+    stored_.resize(shmio::kBlockHeaderSize + blockBytes);
+  }
+
+  void Write(const uint8_t* raw, uint32_t rawBytes, uint32_t frames, uint64_t firstCursor) {
+    if (stored_.size() < shmio::kBlockHeaderSize + rawBytes) {
+      stored_.resize(shmio::kBlockHeaderSize + rawBytes);
+    }
+    uint8_t* data = stored_.data() + shmio::kBlockHeaderSize;
+    size_t compressedBytes = compressor_.Compress(raw, rawBytes, data);
+    if (compressedBytes == 0) {
+      std::memcpy(data, raw, rawBytes);
+      compressedBytes = rawBytes;
+    }
+
+    uint8_t* header = stored_.data();
+    shmio::WriteUint32LE(header + shmio::kBlockCompressedBytesOffset, static_cast<uint32_t>(compressedBytes));
+    shmio::WriteUint32LE(header + shmio::kBlockRawBytesOffset, rawBytes);
+    shmio::WriteUint32LE(header + shmio::kBlockFramesOffset, frames);
+    shmio::WriteUint32LE(header + shmio::kBlockChecksumOffset, shmio::BlockChecksum(data, compressedBytes));
+    shmio::WriteUint64LE(header + shmio::kBlockCursorOffset, firstCursor);
+    shmio::PwriteAll(fd_, stored_.data(), shmio::kBlockHeaderSize + compressedBytes, offset_, kWriteFailed);
+
+    uint8_t entry[shmio::kIndexEntrySize];
+    shmio::WriteUint64LE(entry, offset_);
+    shmio::WriteUint64LE(entry + sizeof(uint64_t), firstCursor);
+    index_.insert(index_.end(), entry, entry + sizeof(entry));
+
+    offset_ += shmio::kBlockHeaderSize + compressedBytes;
+    maxRawBytes_ = std::max(maxRawBytes_, rawBytes);
+    ++blocks_;
+  }
+
+  // Appends the index; returns its file offset.
+  uint64_t Finish() {
+    uint64_t indexOffset = offset_;
+    shmio::PwriteAll(fd_, index_.data(), index_.size(), indexOffset, kWriteFailed);
+    offset_ += index_.size();
+    return indexOffset;
+  }
+
+  uint64_t blocks() const { return blocks_; }
+  uint64_t fileBytes() const { return offset_; }
+  uint32_t maxRawBytes() const { return maxRawBytes_; }
+
+private:
+  int fd_;
+  uint64_t offset_;
+  uint64_t blocks_ { 0 };
+  uint32_t maxRawBytes_ { 0 };
+  shmio::BlockCompressor compressor_;
+  std::vector<uint8_t> stored_;
+  std::vector<uint8_t> index_;
+};
+
+class CompressWorker : public Napi::AsyncWorker {
+public:
+  CompressWorker(Napi::Env env, CompressOptions options)
+    : Napi::AsyncWorker(env, "shmio:compressLog"),
+      deferred_(Napi::Promise::Deferred::New(env)),
+      options_(std::move(options)) {}
+
+  Napi::Promise Promise() const { return deferred_.Promise(); }
+
+protected:
+  void Execute() override {
+    try {
+      stats_ = CompressLogRange(options_);
+    } catch (const std::exception& e) {
+      SetError(e.what());
+    }
+  }
+
+  void OnOK() override {
+    Napi::Env env = Env();
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("startCursor", Napi::BigInt::New(env, stats_.startCursor));
+    result.Set("endCursor", Napi::BigInt::New(env, stats_.endCursor));
+    result.Set("blocks", Napi::Number::New(env, static_cast<double>(stats_.blocks)));
+    result.Set("framesWritten", Napi::Number::New(env, static_cast<double>(stats_.framesWritten)));
+    result.Set("rawBytes", Napi::Number::New(env, static_cast<double>(stats_.rawBytes)));
+    result.Set("compressedBytes", Napi::Number::New(env, static_cast<double>(stats_.compressedBytes)));
+    deferred_.Resolve(result);
+  }
+
+  void OnError(const Napi::Error& error) override {
+    deferred_.Reject(error.Value());
+  }
+
+private:
+  Napi::Promise::Deferred deferred_;
+  CompressOptions options_;
+  CompressStats stats_;
+};
+
+} // namespace
+
+CompressStats CompressLogRange(const CompressOptions& options) {
+  CompressStats stats;
+
+  MappedFile source;
+  source.fd = open(options.sourcePath.c_str(), O_RDONLY);
+  if (source.fd < 0) {
+    throw SystemError("Unable to open source log");
+  }
+
+  struct stat st {};
+  if (fstat(source.fd, &st) != 0) {
+    throw SystemError("fstat failed");
+  }
+  if (st.st_size < static_cast<off_t>(shmio::kDefaultHeaderSize)) {
+    throw std::runtime_error("source log is smaller than minimum header size");
+  }
+  uint64_t sourceLength = static_cast<uint64_t>(st.st_size);
+  if (sourceLength > std::numeric_limits<size_t>::max()) {
+    throw std::runtime_error("source log is too large to map");
+  }
+
+  uint8_t headerBytes[shmio::kHeaderV2Size] = {};
+  ssize_t headerRead = pread(source.fd, headerBytes, sizeof(headerBytes), 0);
+  if (headerRead < static_cast<ssize_t>(shmio::kDefaultHeaderSize)) {
+    throw SystemError("reading source header failed");
+  }
+  uint64_t headerAvailable = static_cast<uint64_t>(headerRead);
+  if (shmio::HasHeaderV2(headerBytes, headerAvailable) && !shmio::IsSupportedHeaderV2(headerBytes)) {
+    throw std::runtime_error("source log header version is not supported");
+  }
+  uint64_t dataOffset = shmio::ReadUint64LE(headerBytes + shmio::kDataOffsetOffset);
+  uint64_t ringBytes = shmio::RingBytes(headerBytes, headerAvailable);
+  uint64_t committedOffset = shmio::CommittedSizeOffset(headerBytes, headerAvailable);
+  uint32_t sequenceBytes = shmio::FrameSequenceBytes(headerBytes, headerAvailable);
+
+  // Ring logs are read through the mirror so a block that wraps is still one
+  // contiguous buffer for the compressor.
+  if (ringBytes != 0) {
+    if (dataOffset == 0 || dataOffset + ringBytes > sourceLength) {
+      throw std::runtime_error("source log header is invalid");
+    }
+    source.base = shmio::MapMirrored(source.fd, static_cast<size_t>(dataOffset), static_cast<size_t>(ringBytes), PROT_READ);
+    if (source.base == nullptr) {
+      throw SystemError("mmap failed");
+    }
+    source.length = shmio::MirroredLength(static_cast<size_t>(dataOffset), static_cast<size_t>(ringBytes));
+  } else {
+    source.length = static_cast<size_t>(sourceLength);
+    void* mapped = mmap(nullptr, source.length, PROT_READ, MAP_SHARED, source.fd, 0);
+    if (mapped == MAP_FAILED) {
+      throw SystemError("mmap failed");
+    }
+    source.base = static_cast<uint8_t*>(mapped);
+  }
+
+  uint64_t committed = shmio::LoadCommitted(source.base, committedOffset);
+  if (dataOffset == 0 || dataOffset > sourceLength || committed < dataOffset
+      || (ringBytes == 0 && committed > source.length)) {
+    throw std::runtime_error("source log header is invalid");
+  }
+
+  shmio::LogRegion region;
+  region.data = source.base + dataOffset;
+  region.ringBytes = ringBytes;
+  region.sequenceBytes = sequenceBytes;
+
+  uint64_t committedRelative = committed - dataOffset;
+  uint64_t from = options.hasFromCursor ? options.fromCursor : shmio::OldestFrame(region, committedRelative);
+  uint64_t to = std::min(options.toCursor, committedRelative);
+  if (from > to) {
+    throw std::runtime_error("fromCursor is beyond the committed size of the source log");
+  }
+  if (shmio::RingOverwritten(source.base, dataOffset, ringBytes, from)) {
+    throw std::runtime_error("source range has already been overwritten by the ring writer");
+  }
+
+  TempFile temp { options.targetPath + ".compressing" };
+  MappedFile target;
+  target.fd = open(temp.path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0664);
+  if (target.fd < 0) {
+    throw SystemError("Unable to create compressed log");
+  }
+
+  // Blocks end on frame boundaries. Padding in front of a frame goes into the
+  // block of that frame, so consecutive blocks cover the range without gaps.
+  BlockWriter writer(target.fd, options.blockBytes);
+  uint64_t blockStart = from;
+  uint64_t blockEnd = from;
+  uint32_t blockFrames = 0;
+  auto flush = [&]() {
+    writer.Write(region.At(blockStart), static_cast<uint32_t>(blockEnd - blockStart), blockFrames, blockStart);
+    stats.framesWritten += blockFrames;
+    blockStart = blockEnd;
+    blockFrames = 0;
+  };
+
+  // The walk runs to the committed end so a frame crossing `to` is seen
+  // whole and left out, rather than reported as truncated.
+  shmio::WalkResult walk = shmio::WalkFrames(region, from, committedRelative, true,
+    [&](uint64_t position, const uint8_t*, uint32_t frameSize) {
+      uint64_t frameEnd = position + frameSize;
+      if (frameEnd > to) {
+        return false;
+      }
+      if (blockFrames != 0 && frameEnd - blockStart > options.blockBytes) {
+        flush();
+      }
+      blockEnd = frameEnd;
+      ++blockFrames;
+      return true;
+    });
+  if (!walk.error.empty() && walk.end < to) {
+    if (shmio::RingOverwritten(source.base, dataOffset, ringBytes, from)) {
+      throw std::runtime_error("source range was overwritten by the ring writer during compression");
+    }
+    throw std::runtime_error("source log is corrupt at cursor " + std::to_string(walk.end) + ": " + walk.error);
+  }
+  if (blockFrames != 0) {
+    flush();
+  }
+
+  // A ring writer may have lapped the range while it was being compressed.
+  if (shmio::RingOverwritten(source.base, dataOffset, ringBytes, from)) {
+    throw std::runtime_error("source range was overwritten by the ring writer during compression");
+  }
+
+  uint64_t indexOffset = writer.Finish();
+  uint8_t header[shmio::kCompressedHeaderSize] = {};
+  shmio::WriteUint64LE(header + shmio::kCompressedMagicOffset, shmio::kCompressedMagic);
+  shmio::WriteUint32LE(header + shmio::kCompressedVersionOffset, shmio::kCompressedVersion);
+  shmio::WriteUint32LE(header + shmio::kCompressedFlagsOffset, sequenceBytes != 0 ? shmio::kCompressedFrameSequences : 0);
+  shmio::WriteUint64LE(header + shmio::kCompressedBlockCountOffset, writer.blocks());
+  shmio::WriteUint64LE(header + shmio::kCompressedIndexOffset, indexOffset);
+  shmio::WriteUint64LE(header + shmio::kCompressedStartCursorOffset, from);
+  shmio::WriteUint64LE(header + shmio::kCompressedEndCursorOffset, blockEnd);
+  shmio::WriteUint64LE(header + shmio::kCompressedFramesOffset, stats.framesWritten);
+  shmio::WriteUint32LE(header + shmio::kCompressedMaxBlockOffset, writer.maxRawBytes());
+  shmio::PwriteAll(target.fd, header, sizeof(header), 0, kWriteFailed);
+
+  if (fsync(target.fd) != 0) {
+    throw SystemError("flushing compressed log failed");
+  }
+  if (rename(temp.path.c_str(), options.targetPath.c_str()) != 0) {
+    throw SystemError("rename of compressed log failed");
+  }
+  temp.keep = true;
+
+  stats.startCursor = from;
+  stats.endCursor = blockEnd;
+  stats.blocks = writer.blocks();
+  stats.rawBytes = blockEnd - from;
+  stats.compressedBytes = writer.fileBytes();
+  return stats;
+}
+
+void ShmCompressor::Init(Napi::Env env, Napi::Object exports) {
+  exports.Set("compressLog", Napi::Function::New(env, ShmCompressor::CompressLog));
+}
+
+Napi::Value ShmCompressor::CompressLog(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1 || !info[0].IsObject()) {
+    Napi::TypeError::New(env, "compressLog(options) expects an options object").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  Napi::Object opts = info[0].As<Napi::Object>();
+  CompressOptions options;
+
+  Napi::Value sourceValue = opts.Get("sourcePath");
+  Napi::Value targetValue = opts.Get("targetPath");
+  if (!sourceValue.IsString() || !targetValue.IsString()) {
+    Napi::TypeError::New(env, "options.sourcePath and options.targetPath must be strings").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  options.sourcePath = sourceValue.As<Napi::String>().Utf8Value();
+  options.targetPath = targetValue.As<Napi::String>().Utf8Value();
+  if (options.sourcePath == options.targetPath) {
+    Napi::TypeError::New(env, "targetPath must differ from sourcePath").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  if (!shmio::ParseCursorOption(env, opts, "fromCursor", &options.fromCursor, &options.hasFromCursor)
+      || !shmio::ParseCursorOption(env, opts, "toCursor", &options.toCursor)) {
+    return env.Null();
+  }
+
+  Napi::Value blockValue = opts.Get("blockBytes");
+  if (!blockValue.IsUndefined()) {
+    double blockBytes = blockValue.IsNumber() ? blockValue.As<Napi::Number>().DoubleValue() : 0;
+    if (blockBytes < shmio::kMinCompressedBlockBytes || blockBytes > shmio::kMaxCompressedBlockBytes
+        || blockBytes != static_cast<uint32_t>(blockBytes)) {
+      Napi::RangeError::New(env, "options.blockBytes must be an integer between 4 KiB and 16 MiB")
+        .ThrowAsJavaScriptException();
+      return env.Null();
+    }
+    options.blockBytes = static_cast<uint32_t>(blockBytes);
+  }
+
+  CompressWorker* worker = new CompressWorker(env, std::move(options));
+  Napi::Promise promise = worker->Promise();
+  worker->Queue();
+  return promise;
+}
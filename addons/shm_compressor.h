@@ -0,0 +1,42 @@
+#pragma once
+
+#include <napi.h>
+#include <cstdint>
+#include <limits>
+#include <string>
+
+#include "shm_compress.h"
+
+struct CompressOptions {
+  std::string sourcePath;
+  std::string targetPath;
+  uint64_t fromCursor { 0 };
+  bool hasFromCursor { false };
+  uint64_t toCursor { std::numeric_limits<uint64_t>::max() };
+  uint32_t blockBytes { shmio::kDefaultCompressedBlockBytes };
+};
+
+struct CompressStats {
+  uint64_t startCursor { 0 };
+  uint64_t endCursor { 0 };
+  uint64_t blocks { 0 };
+  uint64_t framesWritten { 0 };
+  uint64_t rawBytes { 0 };
+  uint64_t compressedBytes { 0 };
+};
+
+// Writes the whole frames of `sourcePath` in [fromCursor, toCursor) to a new
+// compressed log at `targetPath` (see shm_compress.h), cut into blocks of
+// about `blockBytes` raw bytes. fromCursor defaults to the oldest frame the
+// source still holds. The file is built next to the target and renamed into
+// place. Runs without touching N-API and reports failures as
+// std::runtime_error.
+CompressStats CompressLogRange(const CompressOptions& options);
+
+class ShmCompressor {
+public:
+  static void Init(Napi::Env env, Napi::Object exports);
+
+private:
+  static Napi::Value CompressLog(const Napi::CallbackInfo& info);
+};
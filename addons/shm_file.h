@@ -0,0 +1,93 @@
+#pragma once
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+// Helpers for the files behind logs and for the worker-thread file tools
+// (compaction, archival). Like shm_format.h this must not depend on N-API.
+namespace shmio {
+
+inline std::runtime_error SystemError(const std::string& what) {
+  return std::runtime_error(what + ": " + strerror(errno));
+}
+
+// Owns a file descriptor and an optional mapping of it.
+struct MappedFile {
+  int fd { -1 };
+  uint8_t* base { nullptr };
+  size_t length { 0 };
+
+  MappedFile() = default;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() {
+    if (base != nullptr) {
+      munmap(base, length);
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+};
+
+// Writes all of `data` at `offset`, retrying short writes and EINTR. Throws
+// SystemError(what) on failure.
+inline void PwriteAll(int fd, const uint8_t* data, size_t length, uint64_t offset, const char* what) {
+  size_t written = 0;
+  while (written < length) {
+    ssize_t result = pwrite(fd, data + written, length - written, static_cast<off_t>(offset + written));
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw SystemError(what);
+    }
+    written += static_cast<size_t>(result);
+  }
+}
+
+// Anonymous shared memory that leaves nothing in the filesystem and can be
+// sealed. Returns -1 with errno set; ENOSYS where memfd is unavailable.
+inline int CreateSealableMemfd(const char* name) {
+#if defined(__linux__) && defined(MFD_ALLOW_SEALING)
+  return memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+  (void)name;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+// Forbids shrinking the file (and growing it unless `allowGrowth`), so no
+// process can truncate the log under a reader's mapping and make it fault.
+inline bool SealSize(int fd, bool allowGrowth) {
+#ifdef F_ADD_SEALS
+  int seals = F_SEAL_SHRINK | F_SEAL_SEAL | (allowGrowth ? 0 : F_SEAL_GROW);
+  return fcntl(fd, F_ADD_SEALS, seals) == 0;
+#else
+  (void)fd;
+  (void)allowGrowth;
+  errno = ENOSYS;
+  return false;
+#endif
+}
+
+inline bool IsShrinkSealed(int fd) {
+#ifdef F_GET_SEALS
+  int seals = fcntl(fd, F_GET_SEALS);
+  return seals >= 0 && (seals & F_SEAL_SHRINK) != 0;
+#else
+  (void)fd;
+  return false;
+#endif
+}
+
+} // namespace shmio
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// On-disk layout shared by the addon and the standalone native tools. Nothing
+// in here may depend on N-API so it can be used from worker threads.
+namespace shmio {
+
+constexpr uint64_t kDefaultHeaderSize = 24; // 3 * u64 (headerSize, dataOffset, size)
+constexpr uint64_t kHeaderSizeOffset = 0;
+constexpr uint64_t kDataOffsetOffset = 8;
+constexpr uint64_t kCommittedSizeOffset = 16;
+
+// Header v2 (384 bytes) is split into three 128-byte sections - two cache
+// lines each, so adjacent-line prefetch never pairs them - keeping the
+// writer's per-commit stores away from static metadata and reader state:
+//
+//   [0, 128)    static: headerSize, dataOffset, v1 size, magic, version,
+//               feature flags, maxCapacity, growthStep, ringBytes, createdAt
+//   [128, 256)  writer: committed size, capacity, commit sequence, committed
+//               message count, ring write frontier, commit generation
+//   [256, 384)  readers: cursors of critical ring readers (shm_readers.h)
+//
+// The v1 size word at offset 16 is pinned to dataOffset, so a v1-only reader
+// sees an empty log rather than misreading a v2 one.
+constexpr uint64_t kHeaderV2Size = 384;
+constexpr uint64_t kHeaderMagicOffset = 24;
+constexpr uint64_t kHeaderMagic = 0x3244484f494d4853ULL; // "SHMIOHD2"
+constexpr uint64_t kHeaderVersionOffset = 32; // u32
+constexpr uint64_t kHeaderFlagsOffset = 36;   // u32, kFeature* bits
+constexpr uint64_t kMaxCapacityOffset = 40;   // address space readers must reserve
+constexpr uint64_t kGrowthStepOffset = 48;    // bytes added per growth step
+constexpr uint64_t kRingBytesOffset = 56;     // size of the mirrored data region, 0 for linear logs
+constexpr uint64_t kCreatedAtOffset = 64;     // wall-clock creation time in ns since the epoch, 0 if unknown
+
+constexpr uint64_t kWriterSectionOffset = 128;
+constexpr uint64_t kCommittedSizeV2Offset = 128;
+constexpr uint64_t kCapacityOffset = 136;       // current file length, bumped on growth
+constexpr uint64_t kCommitSequenceOffset = 144; // u32 bumped on every commit, a futex word (shm_futex.h)
+// Frames committed so far. Stored before the committed size, so a reader that
+// loads the size first never sees fewer messages than the frames it covers.
+// Logs with frame sequences keep the sequence the next frame will get here.
+constexpr uint64_t kCommittedMessagesOffset = 152;
+// Ring logs: absolute end of the space the writer has written into, pending
+// frames included. Raised before the bytes are touched and never lowered, so
+// a reader that finds it less than a lap ahead after reading knew the bytes
+// were intact. 0 in logs from writers that predate it.
+constexpr uint64_t kWriteFrontierOffset = 160;
+// u32 seqlock around the committed size and message count: odd while a commit
+// stores them, so a reader can take both as one pair. Stays 0 in logs from
+// writers that predate it.
+constexpr uint64_t kCommitGenerationOffset = 168;
+
+constexpr uint64_t kReaderSectionOffset = 256;
+
+constexpr uint32_t kHeaderVersion2 = 2;
+constexpr uint32_t kFeatureGrowable = 1u << 0;
+constexpr uint32_t kFeatureRing = 1u << 1;
+// Every frame carries its u64 sequence number in front of the payload:
+// [u16 size][u64 sequence][payload][u16 size].
+constexpr uint32_t kFeatureFrameSequence = 1u << 2;
+constexpr uint32_t kKnownFeatures = kFeatureGrowable | kFeatureRing | kFeatureFrameSequence;
+
+// Ring logs wrap at ringBytes; a full-size frame must still fit in the mirror.
+constexpr uint64_t kMinRingBytes = 64 * 1024;
+
+constexpr uint32_t kMessageHeaderBytes = 2;
+constexpr uint32_t kFrameMetadataBytes = kMessageHeaderBytes * 2; // 2-byte prefix + 2-byte suffix
+constexpr uint32_t kMaxFrameBytes = 0xffff;
+constexpr uint32_t kMaxPayloadBytes = kMaxFrameBytes - kFrameMetadataBytes;
+constexpr uint32_t kFrameSequenceBytes = 8;
+
+// Aligned allocations put a padding block in front of the frame so its
+// payload starts on the requested boundary. Real frames are at least 5 bytes,
+// so a zero size word never starts or ends one; padding is laid out as
+// [u16 0][u16 length] ... [u16 length][u16 0] and can be skipped in either
+// direction.
+constexpr uint32_t kMinPaddingBytes = 8;
+constexpr uint32_t kMaxAlignment = 4096;
+
+inline uint16_t ReadUint16LE(const uint8_t* data) {
+  return static_cast<uint16_t>(data[0] | (static_cast<uint16_t>(data[1]) << 8));
+}
+
+inline void WriteUint16LE(uint8_t* data, uint16_t value) {
+  data[0] = static_cast<uint8_t>(value & 0xff);
+  data[1] = static_cast<uint8_t>((value >> 8) & 0xff);
+}
+
+inline uint32_t ReadUint32LE(const uint8_t* data) {
+  return static_cast<uint32_t>(data[0])
+    | (static_cast<uint32_t>(data[1]) << 8)
+    | (static_cast<uint32_t>(data[2]) << 16)
+    | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+inline void WriteUint32LE(uint8_t* data, uint32_t value) {
+  for (size_t i = 0; i < 4; ++i) {
+    data[i] = static_cast<uint8_t>((value >> (8 * i)) & 0xff);
+  }
+}
+
+inline uint64_t ReadUint64LE(const uint8_t* data) {
+  uint64_t value = 0;
+  for (int i = 7; i >= 0; --i) {
+    value = (value << 8) | data[i];
+  }
+  return value;
+}
+
+inline void WriteUint64LE(uint8_t* data, uint64_t value) {
+  for (size_t i = 0; i < 8; ++i) {
+    data[i] = static_cast<uint8_t>((value >> (8 * i)) & 0xff);
+  }
+}
+
+inline bool HasHeaderV2(const uint8_t* header, uint64_t available) {
+  return available >= kHeaderV2Size
+    && ReadUint64LE(header + kHeaderSizeOffset) >= kHeaderV2Size
+    && ReadUint64LE(header + kHeaderMagicOffset) == kHeaderMagic;
+}
+
+// A v2 header this build can use: a newer version or an unknown feature
+// flag means the layout or semantics changed, so the log is refused.
+inline bool IsSupportedHeaderV2(const uint8_t* header) {
+  return ReadUint32LE(header + kHeaderVersionOffset) == kHeaderVersion2
+    && (ReadUint32LE(header + kHeaderFlagsOffset) & ~kKnownFeatures) == 0;
+}
+
+inline uint64_t CommittedSizeOffset(const uint8_t* header, uint64_t available) {
+  return HasHeaderV2(header, available) ? kCommittedSizeV2Offset : kCommittedSizeOffset;
+}
+
+// Acquire load of the committed size at `committedOffset` (see
+// CommittedSizeOffset), for tools that map a log without a ShmMapping.
+inline uint64_t LoadCommitted(const uint8_t* header, uint64_t committedOffset) {
+  return __atomic_load_n(reinterpret_cast<const uint64_t*>(header + committedOffset), __ATOMIC_ACQUIRE);
+}
+
+inline uint64_t RingBytes(const uint8_t* header, uint64_t available) {
+  return HasHeaderV2(header, available) ? ReadUint64LE(header + kRingBytesOffset) : 0;
+}
+
+// Bytes between the frame prefix and the payload: the sequence stamp, if any.
+inline uint32_t FrameSequenceBytes(const uint8_t* header, uint64_t available) {
+  return HasHeaderV2(header, available)
+      && (ReadUint32LE(header + kHeaderFlagsOffset) & kFeatureFrameSequence) != 0
+    ? kFrameSequenceBytes : 0;
+}
+
+// Raises the ring write frontier to `frontier` ahead of writing below it. The
+// fence keeps the writer's following stores behind the new frontier.
+inline void PublishWriteFrontier(uint8_t* header, uint64_t frontier) {
+  __atomic_store_n(reinterpret_cast<uint64_t*>(header + kWriteFrontierOffset), frontier, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+// True when ring bytes from relative position `from` onwards may have been
+// overwritten: the writer has committed or allocated more than a lap past
+// it. Readers call this after reading as well as before; the fence keeps
+// their reads ahead of the loads. Always false for linear logs.
+inline bool RingOverwritten(const uint8_t* header, uint64_t dataOffset, uint64_t ringBytes, uint64_t from) {
+  if (ringBytes == 0) {
+    return false;
+  }
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  uint64_t committed = __atomic_load_n(reinterpret_cast<const uint64_t*>(header + kCommittedSizeV2Offset), __ATOMIC_ACQUIRE);
+  uint64_t frontier = __atomic_load_n(reinterpret_cast<const uint64_t*>(header + kWriteFrontierOffset), __ATOMIC_ACQUIRE);
+  uint64_t written = committed > frontier ? committed : frontier;
+  return written > dataOffset + from && written - dataOffset - from > ringBytes;
+}
+
+// Bytes of padding needed before a frame at `position` so that its payload,
+// `payloadOffset` bytes into the frame, starts on an `alignment` boundary;
+// either 0 or at least kMinPaddingBytes.
+inline uint32_t PaddingFor(uint64_t position, uint32_t alignment, uint32_t payloadOffset = kMessageHeaderBytes) {
+  if (alignment <= 1) {
+    return 0;
+  }
+  uint32_t misalignment = static_cast<uint32_t>((position + payloadOffset) % alignment);
+  if (misalignment == 0) {
+    return 0;
+  }
+  uint32_t padding = alignment - misalignment;
+  while (padding < kMinPaddingBytes) {
+    padding += alignment;
+  }
+  return padding;
+}
+
+inline void WritePadding(uint8_t* data, uint32_t length) {
+  WriteUint16LE(data, 0);
+  WriteUint16LE(data + kMessageHeaderBytes, static_cast<uint16_t>(length));
+  WriteUint16LE(data + length - 2 * kMessageHeaderBytes, static_cast<uint16_t>(length));
+  WriteUint16LE(data + length - kMessageHeaderBytes, 0);
+}
+
+inline bool IsPadding(const uint8_t* data) {
+  return ReadUint16LE(data) == 0;
+}
+
+// Length recorded by the padding block at `data`; check it with IsValidPadding.
+inline uint32_t PaddingLength(const uint8_t* data) {
+  return ReadUint16LE(data + kMessageHeaderBytes);
+}
+
+inline bool IsValidPadding(const uint8_t* data, uint32_t length) {
+  return length >= kMinPaddingBytes
+    && ReadUint16LE(data + length - 2 * kMessageHeaderBytes) == length
+    && ReadUint16LE(data + length - kMessageHeaderBytes) == 0;
+}
+
+// Partition of a key in a partitioned log: FNV-1a (64-bit) of the key bytes
+// modulo the partition count. Manifests name this scheme "fnv1a64", so other
+// writers and consumers can route keys the same way; it must never change.
+inline uint32_t PartitionForKey(const uint8_t* key, size_t length, uint32_t partitions) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= key[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return static_cast<uint32_t>(hash % partitions);
+}
+
+} // namespace shmio
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <errno.h>
+#include <time.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <cstdint>
+
+namespace shmio {
+
+// Futexes on a MAP_SHARED mapping are keyed by the file page, not by the
+// address, so a wait in one process is woken by a wake in any other process
+// that maps the same log. Hence no FUTEX_PRIVATE_FLAG.
+
+// Sleeps while *word == expected, for at most timeoutNs (negative: no limit).
+// Returns 0 when woken (possibly spuriously), otherwise errno: EAGAIN when
+// *word already differed, ETIMEDOUT, EINTR, or ENOSYS off Linux.
+inline int FutexWait(const uint32_t* word, uint32_t expected, int64_t timeoutNs) {
+#ifdef __linux__
+  struct timespec timeout;
+  struct timespec* timeoutPtr = nullptr;
+  if (timeoutNs >= 0) {
+    timeout.tv_sec = static_cast<time_t>(timeoutNs / 1000000000);
+    timeout.tv_nsec = static_cast<long>(timeoutNs % 1000000000);
+    timeoutPtr = &timeout;
+  }
+  if (syscall(SYS_futex, word, FUTEX_WAIT, expected, timeoutPtr, nullptr, 0) == 0) {
+    return 0;
+  }
+  return errno;
+#else
+  (void)word;
+  (void)expected;
+  (void)timeoutNs;
+  return ENOSYS;
+#endif
+}
+
+// Wakes every thread, in any process, sleeping in FutexWait on `word`.
+inline void FutexWakeAll(const uint32_t* word) {
+#ifdef __linux__
+  syscall(SYS_futex, word, FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+#else
+  (void)word;
+#endif
+}
+
+} // namespace shmio
@@ -0,0 +1,503 @@
+// shmio-inspect: standalone inspector for shared logs, built next to the addon
+// from the same layout headers. The log is opened O_RDONLY and mapped
+// PROT_READ, so it is safe to point at a live log; nothing is ever stored
+// into the file and only committed bytes are read.
+//
+//   shmio-inspect header <path>
+//   shmio-inspect validate <path>
+//   shmio-inspect stats <path>
+//   shmio-inspect tail <path> [--from <cursor>] [--bytes <n>]
+//
+// Exit status: 0 on success, 1 when the frame chain is invalid, 2 on usage or
+// I/O errors.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "shm_file.h"
+#include "shm_format.h"
+#include "shm_mirror.h"
+#include "shm_readers.h"
+#include "shm_scan.h"
+
+namespace {
+
+using shmio::SystemError;
+using shmio::WalkResult;
+
+constexpr int kExitInvalid = 1;
+constexpr int kExitUsage = 2;
+constexpr size_t kHistogramBuckets = 17; // payload sizes up to 2^16
+constexpr size_t kDefaultTailBytes = 64;
+
+uint64_t NowNanos() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+// Read-only view of a log. Linear logs are mapped up to the file length and
+// remapped when a growable writer extends the file; ring logs are mapped
+// through the mirror so every frame is contiguous.
+class Log {
+public:
+  explicit Log(const std::string& path) : path_(path) {
+    fd_ = open(path.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+      throw SystemError("Unable to open " + path);
+    }
+
+    uint8_t header[shmio::kHeaderV2Size] = {};
+    ssize_t headerRead = pread(fd_, header, sizeof(header), 0);
+    if (headerRead < static_cast<ssize_t>(shmio::kDefaultHeaderSize)) {
+      throw std::runtime_error(path + " is too small to hold a log header");
+    }
+    uint64_t available = static_cast<uint64_t>(headerRead);
+    v2_ = shmio::HasHeaderV2(header, available);
+    if (v2_ && !shmio::IsSupportedHeaderV2(header)) {
+      throw std::runtime_error("header version " + std::to_string(shmio::ReadUint32LE(header + shmio::kHeaderVersionOffset))
+        + " with flags " + std::to_string(shmio::ReadUint32LE(header + shmio::kHeaderFlagsOffset))
+        + " is not supported by this build");
+    }
+
+    headerSize_ = shmio::ReadUint64LE(header + shmio::kHeaderSizeOffset);
+    dataOffset_ = shmio::ReadUint64LE(header + shmio::kDataOffsetOffset);
+    ringBytes_ = shmio::RingBytes(header, available);
+    committedOffset_ = shmio::CommittedSizeOffset(header, available);
+    sequenceBytes_ = shmio::FrameSequenceBytes(header, available);
+
+    if (ringBytes_ != 0) {
+      base_ = shmio::MapMirrored(fd_, static_cast<size_t>(dataOffset_), static_cast<size_t>(ringBytes_), PROT_READ);
+      if (base_ == nullptr) {
+        throw SystemError("mmap failed");
+      }
+      mapped_ = shmio::MirroredLength(static_cast<size_t>(dataOffset_), static_cast<size_t>(ringBytes_));
+      fileLength_ = dataOffset_ + ringBytes_;
+    } else if (!Refresh()) {
+      throw SystemError("mmap failed");
+    }
+
+    if (dataOffset_ == 0 || headerSize_ > dataOffset_ || LoadCommitted() < dataOffset_
+        || (ringBytes_ == 0 && dataOffset_ > fileLength_)) {
+      throw std::runtime_error(path + " does not have a valid log header");
+    }
+  }
+
+  ~Log() {
+    if (base_ != nullptr) {
+      munmap(base_, mapped_);
+    }
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  Log(const Log&) = delete;
+  Log& operator=(const Log&) = delete;
+
+  // Picks up space added by a growable writer. Regions taken earlier are
+  // invalidated when this remaps.
+  bool Refresh() {
+    if (ringBytes_ != 0) {
+      return true;
+    }
+    struct stat st {};
+    if (fstat(fd_, &st) != 0) {
+      return false;
+    }
+    size_t length = static_cast<size_t>(st.st_size);
+    if (base_ != nullptr && length <= mapped_) {
+      return true;
+    }
+    void* mapped = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd_, 0);
+    if (mapped == MAP_FAILED) {
+      return false;
+    }
+    if (base_ != nullptr) {
+      munmap(base_, mapped_);
+    }
+    base_ = static_cast<uint8_t*>(mapped);
+    mapped_ = length;
+    fileLength_ = length;
+    return true;
+  }
+
+  uint64_t LoadCommitted() const {
+    return shmio::LoadCommitted(base_, committedOffset_);
+  }
+
+  // Committed bytes relative to the data region, i.e. iterator cursors.
+  uint64_t Committed() const { return LoadCommitted() - dataOffset_; }
+
+  // Bytes past the data offset that are mapped; unbounded for ring logs.
+  uint64_t DataLimit() const {
+    return ringBytes_ != 0 ? UINT64_MAX : fileLength_ - dataOffset_;
+  }
+
+  // True once a ring writer, pending frames included, is a lap past `from`.
+  bool Overwritten(uint64_t from) const {
+    return shmio::RingOverwritten(base_, dataOffset_, ringBytes_, from);
+  }
+
+  shmio::LogRegion Region() const {
+    shmio::LogRegion region;
+    region.data = base_ + dataOffset_;
+    region.ringBytes = ringBytes_;
+    region.sequenceBytes = sequenceBytes_;
+    return region;
+  }
+
+  uint64_t Field(uint64_t offset) const { return shmio::ReadUint64LE(base_ + offset); }
+  uint32_t Field32(uint64_t offset) const { return shmio::ReadUint32LE(base_ + offset); }
+  uint64_t LoadField(uint64_t offset) const {
+    return __atomic_load_n(reinterpret_cast<const uint64_t*>(base_ + offset), __ATOMIC_ACQUIRE);
+  }
+
+  const std::string& path() const { return path_; }
+  bool v2() const { return v2_; }
+  uint64_t headerSize() const { return headerSize_; }
+  uint64_t dataOffset() const { return dataOffset_; }
+  uint64_t ringBytes() const { return ringBytes_; }
+  uint64_t fileLength() const { return fileLength_; }
+  uint32_t sequenceBytes() const { return sequenceBytes_; }
+
+private:
+  std::string path_;
+  int fd_ { -1 };
+  uint8_t* base_ { nullptr };
+  size_t mapped_ { 0 };
+  uint64_t fileLength_ { 0 };
+  bool v2_ { false };
+  uint64_t headerSize_ { 0 };
+  uint64_t dataOffset_ { 0 };
+  uint64_t ringBytes_ { 0 };
+  uint64_t committedOffset_ { 0 };
+  uint32_t sequenceBytes_ { 0 };
+};
+
+// Committed range to walk: everything for linear logs, the last lap for rings.
+bool CommittedRange(Log& log, uint64_t* from, uint64_t* to) {
+  uint64_t committed = log.Committed();
+  if (committed > log.DataLimit() && (!log.Refresh() || committed > log.DataLimit())) {
+    return false;
+  }
+  *from = shmio::OldestFrame(log.Region(), committed);
+  *to = committed;
+  return true;
+}
+
+bool Lapped(const Log& log, uint64_t from) {
+  return log.Overwritten(from);
+}
+
+std::string FormatTime(uint64_t nanos) {
+  time_t seconds = static_cast<time_t>(nanos / 1000000000ULL);
+  struct tm utc {};
+  gmtime_r(&seconds, &utc);
+  char buffer[32];
+  strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%SZ", &utc);
+  return buffer;
+}
+
+std::string FormatBytes(double bytes) {
+  const char* units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+  size_t unit = 0;
+  while (bytes >= 1024 && unit + 1 < sizeof(units) / sizeof(units[0])) {
+    bytes /= 1024;
+    ++unit;
+  }
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), unit == 0 ? "%.0f %s" : "%.2f %s", bytes, units[unit]);
+  return buffer;
+}
+
+void HexDump(const uint8_t* data, size_t length) {
+  for (size_t line = 0; line < length; line += 16) {
+    printf("  %04zx ", line);
+    for (size_t i = 0; i < 16; ++i) {
+      if (line + i < length) {
+        printf(" %02x", data[line + i]);
+      } else {
+        printf("   ");
+      }
+    }
+    printf("  |");
+    for (size_t i = 0; i < 16 && line + i < length; ++i) {
+      uint8_t c = data[line + i];
+      putchar(c >= 0x20 && c < 0x7f ? c : '.');
+    }
+    printf("|\n");
+  }
+}
+
+int Header(Log& log) {
+  uint64_t committed = log.Committed();
+  printf("path                %s\n", log.path().c_str());
+  printf("file size           %" PRIu64 "\n", log.fileLength());
+  printf("header              v%d (%" PRIu64 " bytes)\n", log.v2() ? 2 : 1, log.headerSize());
+  printf("data offset         %" PRIu64 "\n", log.dataOffset());
+  printf("committed size      %" PRIu64 " (%s)\n", committed, FormatBytes(static_cast<double>(committed)).c_str());
+  if (!log.v2()) {
+    return 0;
+  }
+
+  uint32_t flags = log.Field32(shmio::kHeaderFlagsOffset);
+  std::string features;
+  if (flags & shmio::kFeatureGrowable) features += " growable";
+  if (flags & shmio::kFeatureRing) features += " ring";
+  if (flags & shmio::kFeatureFrameSequence) features += " frame-sequences";
+  printf("features           %s\n", features.empty() ? " none" : features.c_str());
+  printf("capacity            %" PRIu64 "\n", log.LoadField(shmio::kCapacityOffset));
+  printf("max capacity        %" PRIu64 "\n", log.Field(shmio::kMaxCapacityOffset));
+  if (flags & shmio::kFeatureGrowable) {
+    printf("growth step         %" PRIu64 "\n", log.Field(shmio::kGrowthStepOffset));
+  }
+  if (log.ringBytes() != 0) {
+    printf("ring bytes          %" PRIu64 "\n", log.ringBytes());
+    uint32_t lapped = log.Field32(shmio::kReaderLappedOffset);
+    for (uint32_t slot = 0; slot < shmio::kReaderSlots; ++slot) {
+      uint32_t pid = log.Field32(shmio::kReaderOwnersOffset + 4 * slot);
+      if (pid == 0) {
+        continue;
+      }
+      uint64_t cursor = log.LoadField(shmio::kReaderCursorsOffset + 8 * slot);
+      bool unset = cursor == shmio::kNoReaderCursor;
+      bool marked = !unset && (cursor & shmio::kLappedCursorBit) != 0;
+      printf("critical reader %u   pid %" PRIu32 ", cursor %s%s\n", slot, pid,
+        unset ? "unset" : std::to_string(cursor & ~shmio::kLappedCursorBit).c_str(),
+        marked || (lapped & (1u << slot)) != 0 ? " (lapped)" : "");
+    }
+  }
+  printf("committed messages  %" PRIu64 "\n", log.LoadField(shmio::kCommittedMessagesOffset));
+  printf("commit sequence     %" PRIu32 "\n", log.Field32(shmio::kCommitSequenceOffset));
+  uint64_t createdAt = log.Field(shmio::kCreatedAtOffset);
+  if (createdAt != 0) {
+    printf("created             %s\n", FormatTime(createdAt).c_str());
+  }
+  return 0;
+}
+
+int Validate(Log& log) {
+  uint64_t from = 0;
+  uint64_t to = 0;
+  if (!CommittedRange(log, &from, &to)) {
+    fprintf(stderr, "%s: committed size %" PRIu64 " is beyond the file\n", log.path().c_str(), log.Committed());
+    return kExitInvalid;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  WalkResult result = shmio::WalkFrames(log.Region(), from, to, true, [](uint64_t, const uint8_t*, uint32_t) { return true; });
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  if (Lapped(log, from)) {
+    fprintf(stderr, "%s: the ring writer overwrote the range while it was being validated; run again\n", log.path().c_str());
+    return kExitInvalid;
+  }
+  if (!result.error.empty()) {
+    fprintf(stderr, "%s: %s at cursor %" PRIu64 " (after %" PRIu64 " valid frames)\n",
+      log.path().c_str(), result.error.c_str(), result.end, result.frames);
+    return kExitInvalid;
+  }
+
+  uint64_t bytes = result.end - from;
+  printf("ok: %" PRIu64 " frames, %s (%s padding) in [%" PRIu64 ", %" PRIu64 ") validated in %.3f ms (%s/s)\n",
+    result.frames, FormatBytes(static_cast<double>(bytes)).c_str(), FormatBytes(static_cast<double>(result.paddingBytes)).c_str(),
+    from, result.end, seconds * 1e3, FormatBytes(seconds > 0 ? bytes / seconds : 0).c_str());
+  return 0;
+}
+
+int Stats(Log& log) {
+  uint64_t from = 0;
+  uint64_t to = 0;
+  if (!CommittedRange(log, &from, &to)) {
+    fprintf(stderr, "%s: committed size %" PRIu64 " is beyond the file\n", log.path().c_str(), log.Committed());
+    return kExitInvalid;
+  }
+
+  uint64_t histogram[kHistogramBuckets] = {};
+  uint64_t payloadBytes = 0;
+  uint32_t minPayload = UINT32_MAX;
+  uint32_t maxPayload = 0;
+  uint32_t overhead = shmio::kFrameMetadataBytes + log.sequenceBytes();
+  WalkResult result = shmio::WalkFrames(log.Region(), from, to, true, [&](uint64_t, const uint8_t*, uint32_t frameSize) {
+    uint32_t payload = frameSize - overhead;
+    size_t bucket = 0;
+    while (bucket + 1 < kHistogramBuckets && (1u << (bucket + 1)) <= payload) {
+      ++bucket;
+    }
+    ++histogram[bucket];
+    payloadBytes += payload;
+    minPayload = std::min(minPayload, payload);
+    maxPayload = std::max(maxPayload, payload);
+    return true;
+  });
+
+  if (!result.error.empty()) {
+    fprintf(stderr, "%s: %s at cursor %" PRIu64 "; statistics cover the frames before it\n",
+      log.path().c_str(), result.error.c_str(), result.end);
+  }
+  if (Lapped(log, from)) {
+    fprintf(stderr, "%s: the ring writer overwrote part of the range; statistics are approximate\n", log.path().c_str());
+  }
+
+  printf("frames              %" PRIu64 " in [%" PRIu64 ", %" PRIu64 ")\n", result.frames, from, result.end);
+  printf("payload bytes       %s\n", FormatBytes(static_cast<double>(payloadBytes)).c_str());
+  printf("overhead bytes      %s (frame headers and padding)\n",
+    FormatBytes(static_cast<double>(result.end - from - payloadBytes)).c_str());
+  if (result.frames != 0) {
+    printf("payload size        min %" PRIu32 ", mean %.1f, max %" PRIu32 "\n",
+      minPayload, static_cast<double>(payloadBytes) / result.frames, maxPayload);
+    printf("\npayload size histogram\n");
+    uint64_t peak = *std::max_element(histogram, histogram + kHistogramBuckets);
+    for (size_t bucket = 0; bucket < kHistogramBuckets; ++bucket) {
+      if (histogram[bucket] == 0) {
+        continue;
+      }
+      int width = static_cast<int>(40.0 * histogram[bucket] / peak + 0.5);
+      printf("  %6u - %-6u %12" PRIu64 " %6.2f%% %.*s\n", 1u << bucket, (1u << (bucket + 1)) - 1,
+        histogram[bucket], 100.0 * histogram[bucket] / result.frames, std::max(width, 1),
+        "########################################");
+    }
+  }
+
+  uint64_t createdAt = log.v2() ? log.Field(shmio::kCreatedAtOffset) : 0;
+  uint64_t now = NowNanos();
+  if (createdAt != 0 && now > createdAt) {
+    // Positions and the message count never move backwards, even in ring
+    // logs, so they give the average since creation.
+    double seconds = static_cast<double>(now - createdAt) / 1e9;
+    uint64_t messages = log.LoadField(shmio::kCommittedMessagesOffset);
+    printf("\nsince creation      %s (%.0f s)\n", FormatTime(createdAt).c_str(), seconds);
+    printf("throughput          %.1f messages/s, %s/s\n", messages / seconds,
+      FormatBytes(static_cast<double>(to) / seconds).c_str());
+  }
+  return result.error.empty() ? 0 : kExitInvalid;
+}
+
+int Tail(Log& log, bool hasFrom, uint64_t from, size_t maxBytes) {
+  uint64_t cursor = hasFrom ? from : log.Committed();
+  if (cursor > log.Committed()) {
+    fprintf(stderr, "%s: cursor %" PRIu64 " is beyond the committed size\n", log.path().c_str(), cursor);
+    return kExitUsage;
+  }
+
+  auto idle = std::chrono::milliseconds(1);
+  while (true) {
+    uint64_t committed = log.Committed();
+    if (committed == cursor) {
+      std::this_thread::sleep_for(idle);
+      idle = std::min(idle * 2, std::chrono::milliseconds(50));
+      continue;
+    }
+    idle = std::chrono::milliseconds(1);
+
+    if (committed > log.DataLimit() && (!log.Refresh() || committed > log.DataLimit())) {
+      fprintf(stderr, "%s: committed size %" PRIu64 " is beyond the file\n", log.path().c_str(), committed);
+      return kExitInvalid;
+    }
+    if (log.ringBytes() != 0 && committed - cursor > log.ringBytes()) {
+      printf("-- lapped by the writer at cursor %" PRIu64 ", skipping to %" PRIu64 "\n", cursor, committed);
+      cursor = committed;
+      continue;
+    }
+
+    uint32_t sequenceBytes = log.sequenceBytes();
+    WalkResult result = shmio::WalkFrames(log.Region(), cursor, committed, true, [&](uint64_t position, const uint8_t* frame, uint32_t frameSize) {
+      uint32_t payload = frameSize - shmio::kFrameMetadataBytes - sequenceBytes;
+      printf("@%" PRIu64 " payload=%" PRIu32, position, payload);
+      if (sequenceBytes != 0) {
+        printf(" seq=%" PRIu64, shmio::ReadUint64LE(frame + shmio::kMessageHeaderBytes));
+      }
+      printf("\n");
+      HexDump(frame + shmio::kMessageHeaderBytes + sequenceBytes, std::min<size_t>(payload, maxBytes));
+      return true;
+    });
+    fflush(stdout);
+
+    if (!result.error.empty()) {
+      if (Lapped(log, cursor)) {
+        continue; // overwritten while printing; the check above resynchronises
+      }
+      fprintf(stderr, "%s: %s at cursor %" PRIu64 "\n", log.path().c_str(), result.error.c_str(), result.end);
+      return kExitInvalid;
+    }
+    cursor = result.end;
+  }
+}
+
+int Usage() {
+  fprintf(stderr,
+    "usage: shmio-inspect header <path>\n"
+    "       shmio-inspect validate <path>\n"
+    "       shmio-inspect stats <path>\n"
+    "       shmio-inspect tail <path> [--from <cursor>] [--bytes <n>]\n");
+  return kExitUsage;
+}
+
+bool ParseUint64(const char* text, uint64_t* out) {
+  char* end = nullptr;
+  errno = 0;
+  unsigned long long value = strtoull(text, &end, 0);
+  if (errno != 0 || end == text || *end != '\0') {
+    return false;
+  }
+  *out = value;
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    return Usage();
+  }
+  std::string command = argv[1];
+
+  bool hasFrom = false;
+  uint64_t from = 0;
+  uint64_t tailBytes = kDefaultTailBytes;
+  for (int i = 3; i < argc; ++i) {
+    std::string option = argv[i];
+    if (command == "tail" && option == "--from" && i + 1 < argc && ParseUint64(argv[i + 1], &from)) {
+      hasFrom = true;
+      ++i;
+    } else if (command == "tail" && option == "--bytes" && i + 1 < argc && ParseUint64(argv[i + 1], &tailBytes)) {
+      ++i;
+    } else {
+      return Usage();
+    }
+  }
+
+  try {
+    Log log(argv[2]);
+    if (command == "header") {
+      return Header(log);
+    }
+    if (command == "validate") {
+      return Validate(log);
+    }
+    if (command == "stats") {
+      return Stats(log);
+    }
+    if (command == "tail") {
+      return Tail(log, hasFrom, from, static_cast<size_t>(tailBytes));
+    }
+    return Usage();
+  } catch (const std::exception& e) {
+    fprintf(stderr, "shmio-inspect: %s\n", e.what());
+    return kExitUsage;
+  }
+}
@@ -1,18 +1,39 @@
 #include "shm_iterator.h"
 #include "shm_mapping.h"
 
+#include <errno.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
 #include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <limits>
 #include <stdexcept>
 #include <string>
 
+#include "shm_buffer_views.h"
+#include "shm_format.h"
+#include "shm_readers.h"
+#include "shm_spin.h"
+
 namespace {
 constexpr uint32_t kDefaultMaxMessages = 64;
 constexpr uint32_t kDefaultMaxBytes = 256 * 1024;
 constexpr uint32_t kFrameMetadataBytes = 4; // 2-byte prefix + 2-byte suffix
-
-inline void NoopFinalize(Napi::Env /*env*/, uint8_t* /*data*/) {}
+constexpr uint64_t kDefaultMaxSpinNs = 100 * 1000;
+// CollectFrames prefetches this far ahead of the frame it is reading.
+constexpr uintptr_t kCacheLineBytes = 64;
+constexpr uintptr_t kPrefetchBytes = 4 * kCacheLineBytes;
+// Upper bound on the slice capacity reserved up front for one batch.
+constexpr uint64_t kMaxReservedFrames = 1024;
+// Keeps steady_clock::now() + maxSpinNs from overflowing.
+constexpr uint64_t kMaxSpinNsLimit = 1ull << 53;
+
+// Capacity word for iterators over a caller-provided Buffer, which never grow.
+const std::atomic<uint64_t> kFixedCapacity { 0 };
 }
 
 Napi::FunctionReference ShmIterator::constructor_;
@@ -21,8 +42,16 @@ void ShmIterator::Init(Napi::Env env, Napi::Object exports) {
   Napi::Function func = DefineClass(env, "ShmIterator", {
     InstanceMethod<&ShmIterator::Next>("next"),
     InstanceMethod<&ShmIterator::NextBatch>("nextBatch"),
+    InstanceMethod<&ShmIterator::SpinNext>("spinNext"),
+    InstanceMethod<&ShmIterator::SpinBatch>("spinBatch"),
     InstanceMethod<&ShmIterator::Cursor>("cursor"),
     InstanceMethod<&ShmIterator::CommittedSize>("committedSize"),
+    InstanceMethod<&ShmIterator::TransferTo>("transferTo"),
+    InstanceMethod<&ShmIterator::Checkpoint>("checkpoint"),
+    InstanceMethod<&ShmIterator::Sequence>("sequence"),
+    InstanceMethod<&ShmIterator::Lag>("lag"),
+    InstanceMethod<&ShmIterator::IsFinished>("isFinished"),
+    InstanceMethod<&ShmIterator::Follow>("follow"),
     InstanceMethod<&ShmIterator::Seek>("seek"),
     InstanceMethod<&ShmIterator::Close>("close"),
   });
@@ -49,10 +78,15 @@ ShmIterator::ShmIterator(const Napi::CallbackInfo& info)
     headerSize_ = mapping_->headerSize();
     dataOffset_ = mapping_->dataOffset();
     committedSizeAtomic_ = mapping_->committedSizeAtomic();
+    capacityAtomic_ = mapping_->capacityAtomic();
+    committedMessagesAtomic_ = mapping_->committedMessagesAtomic();
+    frameSequenceBytes_ = mapping_->frameSequenceBytes();
+    ringBytes_ = mapping_->ringBytes();
 
     bool lossless = false;
+    bool hasStartCursor = info.Length() >= 3 && info[2].IsBigInt();
     uint64_t startCursor = 0;
-    if (info.Length() >= 3 && info[2].IsBigInt()) {
+    if (hasStartCursor) {
       startCursor = info[2].As<Napi::BigInt>().Uint64Value(&lossless);
       if (!lossless) {
         ThrowWithCode(env, "startCursor must fit into uint64", "ERR_SHM_CURSOR");
@@ -65,6 +99,27 @@ ShmIterator::ShmIterator(const Napi::CallbackInfo& info)
       return;
     }
 
+    if (info.Length() >= 4 && info[3].IsString()) {
+      if (info.Length() >= 6) {
+        checkpointEvery_ = std::max<uint32_t>(1, info[4].As<Napi::Number>().Uint32Value());
+        flushCheckpoints_ = info[5].ToBoolean().Value();
+      }
+      OpenCheckpoint(env, info[3].As<Napi::String>().Utf8Value());
+      if (!hasStartCursor) {
+        checkpoint_->Load(&startCursor);
+      }
+    }
+
+    // A snapshot iterator never reads past the snapshot's end, which the
+    // mapping validated against the committed size.
+    if (info.Length() >= 8 && info[7].IsBigInt()) {
+      snapshotEnd_ = dataOffset_ + info[7].As<Napi::BigInt>().Uint64Value(&lossless);
+      if (info.Length() >= 9 && info[8].IsBigInt()) {
+        snapshotMessages_ = info[8].As<Napi::BigInt>().Uint64Value(&lossless);
+        snapshotMessagesKnown_ = true;
+      }
+    }
+
     uint64_t committedSnapshot = LoadCommittedSize();
     uint64_t committedRelative = committedSnapshot > dataOffset_ ? committedSnapshot - dataOffset_ : 0;
     if (startCursor > committedRelative) {
@@ -73,6 +128,10 @@ ShmIterator::ShmIterator(const Napi::CallbackInfo& info)
     }
 
     cursor_ = startCursor;
+    sequenceKnown_ = startCursor == 0;
+    if (info.Length() >= 7 && info[6].ToBoolean().Value() && ringBytes_ != 0) {
+      ClaimReaderSlot(env);
+    }
     return;
   }
 
@@ -113,9 +172,21 @@ ShmIterator::ShmIterator(const Napi::CallbackInfo& info)
     return;
   }
 
+  if (shmio::HasHeaderV2(base_, mappingLength_)
+      && (!shmio::IsSupportedHeaderV2(base_) || shmio::RingBytes(base_, mappingLength_) != 0)) {
+    ThrowWithCode(env, "Header version or ring layout not supported over a plain Buffer; use openSharedLog", "ERR_SHM_MAPPING_GONE");
+    return;
+  }
+
   headerSize_ = ReadUint64LE(base_);
   dataOffset_ = ReadUint64LE(base_ + 8);
-  committedSizeAtomic_ = reinterpret_cast<std::atomic<uint64_t>*>(base_ + 16);
+  committedSizeAtomic_ = reinterpret_cast<std::atomic<uint64_t>*>(
+    base_ + shmio::CommittedSizeOffset(base_, mappingLength_));
+  capacityAtomic_ = &kFixedCapacity;
+  if (shmio::HasHeaderV2(base_, mappingLength_)) {
+    committedMessagesAtomic_ = reinterpret_cast<const std::atomic<uint64_t>*>(base_ + shmio::kCommittedMessagesOffset);
+    frameSequenceBytes_ = shmio::FrameSequenceBytes(base_, mappingLength_);
+  }
 
   if (dataOffset_ > mappingLength_) {
     ThrowWithCode(env, "dataOffset exceeds mapping length", "ERR_SHM_CURSOR");
@@ -144,11 +215,15 @@ ShmIterator::ShmIterator(const Napi::CallbackInfo& info)
   }
 
   cursor_ = startCursor;
+  sequenceKnown_ = startCursor == 0;
 }
 
 Napi::Value ShmIterator::Next(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
   EnsureOpen(env);
+  EnsureNoTransferInFlight(env);
+  MaybeCheckpoint(env);
+  PublishCursor();
 
   BatchOptions options {
     1u,
@@ -161,14 +236,17 @@ Napi::Value ShmIterator::Next(const Napi::CallbackInfo& info) {
     return env.Null();
   }
 
-  cursor_ += result.consumedBytes;
+  Consume(result);
   const auto& slice = result.frames.front();
-  return Napi::Buffer<uint8_t>::New(env, slice.ptr, slice.length, NoopFinalize);
+  return shmio::BufferViews(env, FrameArrayBuffer(env)).View(slice.ptr, slice.length);
 }
 
 Napi::Value ShmIterator::NextBatch(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
   EnsureOpen(env);
+  EnsureNoTransferInFlight(env);
+  MaybeCheckpoint(env);
+  PublishCursor();
 
   BatchOptions options {
     kDefaultMaxMessages,
@@ -184,16 +262,46 @@ Napi::Value ShmIterator::NextBatch(const Napi::CallbackInfo& info) {
   }
 
   BatchResult result = CollectFrames(env, options);
-  cursor_ += result.consumedBytes;
+  Consume(result);
 
   Napi::Array output = Napi::Array::New(env, result.frames.size());
+  if (result.frames.empty()) {
+    return output;
+  }
+  if (options.externalBuffers) {
+    for (size_t i = 0; i < result.frames.size(); ++i) {
+      const auto& slice = result.frames[i];
+      output.Set(i, Napi::Buffer<uint8_t>::New(env, slice.ptr, slice.length, [](Napi::Env, uint8_t*) {}));
+    }
+    return output;
+  }
+  shmio::BufferViews views(env, FrameArrayBuffer(env));
   for (size_t i = 0; i < result.frames.size(); ++i) {
     const auto& slice = result.frames[i];
-    output.Set(i, Napi::Buffer<uint8_t>::New(env, slice.ptr, slice.length, NoopFinalize));
+    output.Set(i, views.View(slice.ptr, slice.length));
   }
   return output;
 }
 
+// The spin variants wait in native code for the committed size to move past
+// the cursor, so an empty poll costs a cache-line load instead of a call from
+// JS. The JS thread is blocked for up to maxSpinNs.
+Napi::Value ShmIterator::SpinNext(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  EnsureOpen(env);
+  EnsureNoTransferInFlight(env);
+  WaitForFrames(ParseMaxSpinNs(env, info));
+  return Next(info);
+}
+
+Napi::Value ShmIterator::SpinBatch(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  EnsureOpen(env);
+  EnsureNoTransferInFlight(env);
+  WaitForFrames(ParseMaxSpinNs(env, info));
+  return NextBatch(info);
+}
+
 Napi::Value ShmIterator::Cursor(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
   EnsureOpen(env);
@@ -213,6 +321,142 @@ Napi::Value ShmIterator::CommittedSize(const Napi::CallbackInfo& info) {
   return Napi::BigInt::New(env, committedSnapshot - dataOffset_);
 }
 
+Napi::Value ShmIterator::TransferTo(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  EnsureOpen(env);
+
+  if (info.Length() < 1 || !info[0].IsNumber()) {
+    ThrowWithCode(env, "transferTo(fd, options) expects a file descriptor", "ERR_SHM_IO");
+  }
+
+  int32_t fd = info[0].As<Napi::Number>().Int32Value();
+  if (fd < 0) {
+    ThrowWithCode(env, "transferTo fd must be non-negative", "ERR_SHM_IO");
+  }
+
+  BatchOptions options {
+    std::numeric_limits<uint32_t>::max(),
+    kDefaultMaxBytes,
+    false
+  };
+
+  if (info.Length() >= 2 && info[1].IsObject()) {
+    Napi::Object value = info[1].As<Napi::Object>();
+    options = ParseOptions(env, value);
+    if (!value.Has("maxMessages")) {
+      options.maxMessages = std::numeric_limits<uint32_t>::max();
+    }
+  } else if (info.Length() >= 2 && !info[1].IsUndefined() && !info[1].IsNull()) {
+    ThrowWithCode(env, "transferTo options must be an object", "ERR_SHM_CURSOR");
+  }
+
+  // A previous call may have left the cursor inside a range of whole frames
+  // (short write on a socket); finish that range before scanning new frames.
+  uint64_t rangeEnd = transferEnd_;
+  if (cursor_ >= rangeEnd) {
+    MaybeCheckpoint(env);
+    PublishCursor();
+    BatchResult result = CollectFrames(env, options, false);
+    rangeEnd = cursor_ + result.consumedBytes;
+    transferMessages_ = result.messages;
+    transferNextSequence_ = result.nextSequence;
+  }
+
+  if (rangeEnd == cursor_) {
+    transferEnd_ = 0;
+    return Napi::Number::New(env, 0);
+  }
+
+  size_t written = WriteRange(env, fd, cursor_, rangeEnd - cursor_);
+  cursor_ += written;
+  transferEnd_ = cursor_ < rangeEnd ? rangeEnd : 0;
+  if (transferEnd_ == 0) {
+    AdvanceSequence(transferMessages_, transferNextSequence_);
+    framesSinceCheckpoint_ += transferMessages_;
+    transferMessages_ = 0;
+  }
+
+  return Napi::Number::New(env, static_cast<double>(written));
+}
+
+Napi::Value ShmIterator::Checkpoint(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  EnsureOpen(env);
+  EnsureNoTransferInFlight(env);
+
+  if (!checkpoint_) {
+    ThrowWithCode(env, "checkpoint() requires an iterator created with a consumer", "ERR_SHM_CURSOR");
+  }
+
+  bool flush = flushCheckpoints_;
+  if (info.Length() >= 1 && info[0].IsObject()) {
+    Napi::Object options = info[0].As<Napi::Object>();
+    if (options.Has("flush")) {
+      flush = options.Get("flush").ToBoolean().Value();
+    }
+  }
+
+  StoreCheckpoint(env, flush);
+  return Napi::BigInt::New(env, cursor_);
+}
+
+Napi::Value ShmIterator::Sequence(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  EnsureOpen(env);
+
+  if (!ResolveSequence(env)) {
+    return env.Null();
+  }
+  return Napi::BigInt::New(env, sequence_);
+}
+
+Napi::Value ShmIterator::Lag(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  EnsureOpen(env);
+
+  if (committedMessagesAtomic_ == nullptr) {
+    return env.Null();
+  }
+
+  // The writer stores the message count before the committed size, so the
+  // count loaded after the size covers at least every frame below it.
+  uint64_t committedSnapshot = LoadCommittedSize();
+  if (committedSnapshot < dataOffset_) {
+    ThrowWithCode(env, "Committed size precedes data offset", "ERR_SHM_CURSOR");
+  }
+  if (cursor_ >= committedSnapshot - dataOffset_) {
+    return Napi::BigInt::New(env, static_cast<uint64_t>(0));
+  }
+  if (!ResolveSequence(env)) {
+    return env.Null();
+  }
+
+  uint64_t committedMessages = committedMessagesAtomic_->load(std::memory_order_acquire);
+  if (snapshotEnd_ != kLive) {
+    if (!snapshotMessagesKnown_) {
+      return env.Null();
+    }
+    committedMessages = snapshotMessages_;
+  }
+  return Napi::BigInt::New(env, committedMessages > sequence_ ? committedMessages - sequence_ : 0);
+}
+
+Napi::Value ShmIterator::IsFinished(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  EnsureOpen(env);
+  return Napi::Boolean::New(env, Finished());
+}
+
+// Turns a snapshot iterator into a live one at its cursor. After isFinished()
+// that is exactly the snapshot's end, so the first live frame is the first
+// one committed after the snapshot.
+void ShmIterator::Follow(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  EnsureOpen(env);
+  snapshotEnd_ = kLive;
+  snapshotMessagesKnown_ = false;
+}
+
 void ShmIterator::Seek(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
   EnsureOpen(env);
@@ -242,6 +486,13 @@ void ShmIterator::Seek(const Napi::CallbackInfo& info) {
   }
 
   cursor_ = position;
+  transferEnd_ = 0;
+  transferMessages_ = 0;
+  sequence_ = 0;
+  sequenceKnown_ = position == 0;
+  if (readerSlot_ >= 0 && !mapping_->closed()) {
+    mapping_->readerSlots().Rewind(static_cast<uint32_t>(readerSlot_), cursor_);
+  }
 }
 
 void ShmIterator::Close(const Napi::CallbackInfo& info) {
@@ -249,9 +500,13 @@ void ShmIterator::Close(const Napi::CallbackInfo& info) {
     return;
   }
   closed_ = true;
+  ReleaseReaderSlot();
   base_ = nullptr;
   mappingLength_ = 0;
   committedSizeAtomic_ = nullptr;
+  capacityAtomic_ = nullptr;
+  committedMessagesAtomic_ = nullptr;
+  checkpoint_.reset();
   baseBufferRef_.Reset();
   if (!mappingRef_.IsEmpty()) {
     mappingRef_.Reset();
@@ -303,10 +558,59 @@ ShmIterator::BatchOptions ShmIterator::ParseOptions(Napi::Env env, const Napi::O
     options.debugChecks = v.As<Napi::Boolean>().Value();
   }
 
+  if (value.Has("externalBuffers")) {
+    Napi::Value v = value.Get("externalBuffers");
+    if (!v.IsBoolean()) {
+      ThrowWithCode(env, "externalBuffers must be boolean", "ERR_SHM_CURSOR");
+      return options;
+    }
+    options.externalBuffers = v.As<Napi::Boolean>().Value();
+  }
+
   return options;
 }
 
-ShmIterator::BatchResult ShmIterator::CollectFrames(Napi::Env env, const BatchOptions& options) {
+uint64_t ShmIterator::ParseMaxSpinNs(Napi::Env env, const Napi::CallbackInfo& info) const {
+  if (info.Length() < 1 || info[0].IsUndefined() || info[0].IsNull()) {
+    return kDefaultMaxSpinNs;
+  }
+  if (!info[0].IsObject()) {
+    ThrowWithCode(env, "spin options must be an object", "ERR_SHM_CURSOR");
+  }
+  Napi::Object options = info[0].As<Napi::Object>();
+  if (!options.Has("maxSpinNs")) {
+    return kDefaultMaxSpinNs;
+  }
+  Napi::Value value = options.Get("maxSpinNs");
+  double maxSpinNs = value.IsNumber() ? value.As<Napi::Number>().DoubleValue() : -1;
+  if (!(maxSpinNs >= 0) || maxSpinNs > static_cast<double>(kMaxSpinNsLimit)) {
+    ThrowWithCode(env, "maxSpinNs must be a number between 0 and 2^53", "ERR_SHM_CURSOR");
+  }
+  return static_cast<uint64_t>(maxSpinNs);
+}
+
+bool ShmIterator::WaitForFrames(uint64_t maxSpinNs) const {
+  // A finished snapshot iterator has nothing more to wait for.
+  if (Finished()) {
+    return false;
+  }
+  // Frames are committed whole (padding together with the frame after it),
+  // so any committed byte past the cursor means a frame is ready. A lapped or
+  // corrupt cursor also ends the wait; CollectFrames reports it.
+  return shmio::SpinUntil([this] {
+    return LoadCommittedSize() != dataOffset_ + cursor_;
+  }, maxSpinNs);
+}
+
+ShmIterator::BatchResult ShmIterator::CollectFrames(Napi::Env env, const BatchOptions& options, bool collectSlices) {
+  // The common case gets a loop without the validation branches.
+  return options.debugChecks
+    ? CollectFramesImpl<true>(env, options, collectSlices)
+    : CollectFramesImpl<false>(env, options, collectSlices);
+}
+
+template <bool kDebugChecks>
+ShmIterator::BatchResult ShmIterator::CollectFramesImpl(Napi::Env env, const BatchOptions& options, bool collectSlices) {
   Napi::HandleScope scope(env);
   BatchResult result;
   result.consumedBytes = 0;
@@ -322,88 +626,337 @@ ShmIterator::BatchResult ShmIterator::CollectFrames(Napi::Env env, const BatchOp
     return result;
   }
 
+  // The committed size is loaded first: the writer publishes a new capacity
+  // before committing frames that live in the added space.
+  if (capacityAtomic_->load(std::memory_order_relaxed) > mappingLength_) {
+    RefreshMapping(env);
+  }
+
   uint64_t committedRelative = committedSnapshot - dataOffset_;
   EnsureCursorInBounds(env, cursor_, committedRelative);
 
-  uint64_t cursorRelative = cursor_;
-  uint64_t cursorAbsolute = dataOffset_ + cursorRelative;
-  uint64_t maxAbsolute = dataOffset_ + committedRelative;
-
-  uint32_t messages = 0;
-  uint64_t accumulatedBytes = 0;
+  // Ring logs are walked inside the mirrored window: starting in the first
+  // view, up to one full lap stays contiguous.
+  uint64_t cursorAbsolute = dataOffset_ + PhysicalOffset(cursor_);
+  uint64_t maxAbsolute = cursorAbsolute + (committedRelative - cursor_);
+  uint64_t mappedLimit = ringBytes_ != 0 ? dataOffset_ + 2 * ringBytes_ : mappingLength_;
+  // Every frame returned ends at or before the committed size, so one check
+  // covers the batch. The pages themselves can only go away if another
+  // process truncates the file, which sealed memfd logs rule out.
+  if (maxAbsolute > mappedLimit) {
+    ThrowWithCode(env, "Committed frames exceed the mapping length", "ERR_SHM_MAPPING_GONE");
+    return result;
+  }
 
-  while (cursorRelative < committedRelative && messages < options.maxMessages) {
-    if (cursorAbsolute + kFrameMetadataBytes > maxAbsolute) {
-      break;
-    }
-    if (cursorAbsolute + kFrameMetadataBytes > mappingLength_) {
-      ThrowWithCode(env, "Cursor beyond mapping length", "ERR_SHM_MAPPING_GONE");
-      return result;
-    }
+  // `end` bounds what is committed, `limit` also the batch's byte budget;
+  // a frame or padding block past `limit` ends the batch.
+  const uint8_t* const start = base_ + cursorAbsolute;
+  const uint8_t* const end = base_ + maxAbsolute;
+  const uint8_t* const limit = start + std::min<uint64_t>(options.maxBytes, maxAbsolute - cursorAbsolute);
+  const uint32_t minFrameBytes = kFrameMetadataBytes + frameSequenceBytes_;
+  const char* corruptCode = kDebugChecks ? "ERR_SHM_FRAME_CORRUPT" : "ERR_SHM_CURSOR";
+
+  if (collectSlices && limit - start >= minFrameBytes) {
+    uint64_t fit = static_cast<uint64_t>(limit - start) / minFrameBytes;
+    result.frames.reserve(static_cast<size_t>(std::min<uint64_t>({ options.maxMessages, fit, kMaxReservedFrames })));
+  }
 
-    const uint8_t* framePtr = base_ + cursorAbsolute;
-    uint16_t frameSize = ReadUint16LE(framePtr);
+  const uint8_t* frame = start;
+  const uint8_t* prefetched = start;
+  uint32_t messages = 0;
 
-    if (frameSize < kFrameMetadataBytes) {
-      ThrowWithCode(env, "Invalid frame size (too small)", options.debugChecks ? "ERR_SHM_FRAME_CORRUPT" : "ERR_SHM_CURSOR");
-      return result;
+  while (messages < options.maxMessages && frame + kFrameMetadataBytes <= limit) {
+    // The length prefixes form a chain of dependent loads; keep the lines a
+    // few frames ahead in flight so small frames do not wait on each miss.
+    while (prefetched < frame + kPrefetchBytes && prefetched < end) {
+      __builtin_prefetch(prefetched);
+      prefetched += kCacheLineBytes;
     }
 
-    uint64_t frameEndRelative = cursorRelative + frameSize;
-    uint64_t frameEndAbsolute = cursorAbsolute + frameSize;
+    uint16_t frameSize = ReadUint16LE(frame);
 
-    if (frameEndRelative > committedRelative) {
-      break; // partial frame, wait for more data
+    if (frameSize == 0) {
+      // Padding in front of an aligned frame; it is committed together with
+      // the frame, so it never ends the committed range.
+      uint32_t paddingSize = shmio::PaddingLength(frame);
+      if (paddingSize < shmio::kMinPaddingBytes || paddingSize > static_cast<uint64_t>(end - frame)) {
+        ThrowCorrupt(env, "Invalid padding length", corruptCode);
+        return result;
+      }
+      if (kDebugChecks && !shmio::IsValidPadding(frame, paddingSize)) {
+        ThrowCorrupt(env, "Padding markers do not match", "ERR_SHM_FRAME_CORRUPT");
+        return result;
+      }
+      if (paddingSize > static_cast<uint64_t>(limit - frame)) {
+        break;
+      }
+      frame += paddingSize;
+      continue;
     }
 
-    if (frameEndAbsolute > mappingLength_) {
-      ThrowWithCode(env, "Frame exceeds mapping length", "ERR_SHM_MAPPING_GONE");
+    if (frameSize < minFrameBytes) {
+      ThrowCorrupt(env, "Invalid frame size (too small)", corruptCode);
       return result;
     }
 
-    if (accumulatedBytes + frameSize > options.maxBytes) {
+    // Partial frame (wait for more data) or over the byte budget.
+    if (frameSize > static_cast<uint64_t>(limit - frame)) {
       break;
     }
 
-    if (options.debugChecks) {
-      uint16_t suffix = ReadUint16LE(framePtr + frameSize - sizeof(uint16_t));
+    if (kDebugChecks) {
+      uint16_t suffix = ReadUint16LE(frame + frameSize - sizeof(uint16_t));
       if (suffix != frameSize) {
-        ThrowWithCode(env, "Frame length mismatch between prefix and suffix", "ERR_SHM_FRAME_CORRUPT");
+        ThrowCorrupt(env, "Frame length mismatch between prefix and suffix", "ERR_SHM_FRAME_CORRUPT");
         return result;
       }
     }
 
-    uint8_t* payloadPtr = base_ + cursorAbsolute + sizeof(uint16_t);
-    size_t payloadLength = frameSize - kFrameMetadataBytes;
-
-    result.frames.push_back(BatchResult::FrameSlice{ payloadPtr, payloadLength });
+    if (collectSlices) {
+      result.frames.push_back(BatchResult::FrameSlice{
+        const_cast<uint8_t*>(frame) + sizeof(uint16_t) + frameSequenceBytes_,
+        static_cast<size_t>(frameSize - minFrameBytes) });
+    }
+    if (frameSequenceBytes_ != 0) {
+      result.nextSequence = ReadUint64LE(frame + sizeof(uint16_t)) + 1;
+    }
 
     ++messages;
-    accumulatedBytes += frameSize;
-    cursorRelative = frameEndRelative;
-    cursorAbsolute = frameEndAbsolute;
+    frame += frameSize;
   }
 
-  result.consumedBytes = cursorRelative - cursor_;
+  // The writer may have lapped us while the frame headers were read.
+  if (ringBytes_ != 0) {
+    EnsureNotLapped(env);
+  }
+
+  result.consumedBytes = static_cast<uint64_t>(frame - start);
+  result.messages = messages;
   return result;
 }
 
+size_t ShmIterator::WriteRange(Napi::Env env, int fd, uint64_t cursorRelative, uint64_t length) {
+  uint64_t absolute = dataOffset_ + PhysicalOffset(cursorRelative);
+  size_t written = 0;
+
+#ifdef __linux__
+  // sendfile keeps the copy in the kernel when the log is backed by a file
+  // descriptor; fall back to write() for targets or sources it cannot handle.
+  // Ring ranges may wrap in the file, so they are written from the mirror.
+  int sourceFd = mapping_ != nullptr && ringBytes_ == 0 ? mapping_->fd() : -1;
+  if (sourceFd >= 0) {
+    off_t offset = static_cast<off_t>(absolute);
+    while (written < length) {
+      ssize_t sent = sendfile(fd, sourceFd, &offset, static_cast<size_t>(length - written));
+      if (sent > 0) {
+        written += static_cast<size_t>(sent);
+        continue;
+      }
+      if (sent < 0 && errno == EINTR) {
+        continue;
+      }
+      if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return written;
+      }
+      if (sent < 0 && written == 0 && (errno == EINVAL || errno == ENOSYS)) {
+        break;
+      }
+      if (sent == 0) {
+        return written;
+      }
+      ThrowWithCode(env, std::string("sendfile failed: ") + strerror(errno), "ERR_SHM_IO");
+    }
+    if (written == length) {
+      return written;
+    }
+  }
+#endif
+
+  while (written < length) {
+    ssize_t sent = write(fd, base_ + absolute + written, static_cast<size_t>(length - written));
+    if (sent > 0) {
+      written += static_cast<size_t>(sent);
+      continue;
+    }
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+    if (sent == 0) {
+      break;
+    }
+    ThrowWithCode(env, std::string("write failed: ") + strerror(errno), "ERR_SHM_IO");
+  }
+
+  return written;
+}
+
+void ShmIterator::EnsureNoTransferInFlight(Napi::Env env) const {
+  if (cursor_ < transferEnd_) {
+    ThrowWithCode(env, "transferTo left the cursor inside a frame; finish the transfer first", "ERR_SHM_CURSOR");
+  }
+}
+
 void ShmIterator::EnsureOpen(Napi::Env env) const {
   if (closed_) {
     const_cast<ShmIterator*>(this)->ThrowWithCode(env, "ShmIterator is closed", "ERR_SHM_ITERATOR_CLOSED");
   }
 }
 
+void ShmIterator::OpenCheckpoint(Napi::Env env, const std::string& consumer) {
+  std::string path = shmio::CursorCheckpoint::PathFor(mapping_->path(), consumer);
+  checkpoint_ = std::make_unique<shmio::CursorCheckpoint>();
+  if (!checkpoint_->Open(path)) {
+    std::string reason = strerror(errno);
+    checkpoint_.reset();
+    ThrowWithCode(env, "Unable to open cursor checkpoint " + path + ": " + reason, "ERR_SHM_IO");
+  }
+}
+
+// Called before frames are handed out: by then the consumer is done with the
+// previous batch, so the stored cursor gives at-least-once delivery on restart.
+void ShmIterator::MaybeCheckpoint(Napi::Env env) {
+  if (checkpoint_ && framesSinceCheckpoint_ >= checkpointEvery_) {
+    StoreCheckpoint(env, flushCheckpoints_);
+  }
+}
+
+void ShmIterator::ClaimReaderSlot(Napi::Env env) {
+  readerSlot_ = mapping_->ClaimReaderSlot(cursor_);
+  if (readerSlot_ < 0 && errno == ENOSPC) {
+    ThrowWithCode(env, "All " + std::to_string(shmio::kReaderSlots) + " critical reader slots of the log are taken",
+      "ERR_SHM_READER_SLOTS");
+  }
+  if (readerSlot_ < 0 && (errno == EACCES || errno == EPERM || errno == EROFS)) {
+    ThrowWithCode(env, std::string("Critical readers publish their cursor in the log header and need write access to the log; "
+      "open it by a path you can write to, or from a descriptor opened read-write (") + strerror(errno) + ")",
+      "ERR_SHM_READER_ACCESS");
+  }
+  if (readerSlot_ < 0) {
+    ThrowWithCode(env, std::string("Unable to map the reader slots of the log: ") + strerror(errno), "ERR_SHM_IO");
+  }
+}
+
+void ShmIterator::PublishCursor() {
+  if (readerSlot_ >= 0 && !mapping_->closed()) {
+    mapping_->readerSlots().Publish(static_cast<uint32_t>(readerSlot_), cursor_);
+  }
+}
+
+void ShmIterator::ReleaseReaderSlot() {
+  if (readerSlot_ >= 0 && mapping_ != nullptr) {
+    mapping_->ReleaseReaderSlot(readerSlot_);
+  }
+  readerSlot_ = -1;
+}
+
+void ShmIterator::StoreCheckpoint(Napi::Env env, bool flush) {
+  checkpoint_->Store(cursor_);
+  framesSinceCheckpoint_ = 0;
+  if (flush && !checkpoint_->Flush()) {
+    ThrowWithCode(env, std::string("Flushing cursor checkpoint failed: ") + strerror(errno), "ERR_SHM_IO");
+  }
+}
+
+void ShmIterator::Consume(const BatchResult& result) {
+  cursor_ += result.consumedBytes;
+  AdvanceSequence(result.messages, result.nextSequence);
+  framesSinceCheckpoint_ += result.messages;
+}
+
+void ShmIterator::AdvanceSequence(uint32_t messages, uint64_t nextSequence) {
+  if (messages == 0) {
+    return;
+  }
+  if (frameSequenceBytes_ != 0) {
+    sequence_ = nextSequence;
+    sequenceKnown_ = true;
+  } else if (sequenceKnown_) {
+    sequence_ += messages;
+  }
+}
+
+// After a seek, stamped logs recover the sequence from the next frame. Returns
+// false when it is unknown: unstamped logs not read from cursor 0, or a
+// stamped log whose reader waits at the head or in the middle of transferTo.
+bool ShmIterator::ResolveSequence(Napi::Env env) {
+  if (sequenceKnown_ || frameSequenceBytes_ == 0 || cursor_ < transferEnd_) {
+    return sequenceKnown_;
+  }
+
+  uint64_t committedSnapshot = LoadCommittedSize();
+  if (committedSnapshot < dataOffset_) {
+    ThrowWithCode(env, "Committed size precedes data offset", "ERR_SHM_CURSOR");
+  }
+  if (capacityAtomic_->load(std::memory_order_relaxed) > mappingLength_) {
+    RefreshMapping(env);
+  }
+
+  uint64_t committedRelative = committedSnapshot - dataOffset_;
+  EnsureCursorInBounds(env, cursor_, committedRelative);
+
+  uint64_t position = cursor_;
+  while (position + kFrameMetadataBytes <= committedRelative) {
+    const uint8_t* framePtr = base_ + dataOffset_ + PhysicalOffset(position);
+    if (!shmio::IsPadding(framePtr)) {
+      uint64_t sequence = ReadUint64LE(framePtr + sizeof(uint16_t));
+      if (ringBytes_ != 0) {
+        EnsureNotLapped(env);
+      }
+      sequence_ = sequence;
+      sequenceKnown_ = true;
+      return true;
+    }
+    uint32_t paddingSize = shmio::PaddingLength(framePtr);
+    if (paddingSize < shmio::kMinPaddingBytes) {
+      ThrowCorrupt(env, "Invalid padding length", "ERR_SHM_FRAME_CORRUPT");
+    }
+    position += paddingSize;
+  }
+  return false;
+}
+
 void ShmIterator::EnsureCursorInBounds(Napi::Env env, uint64_t cursorSnapshot, uint64_t committedSnapshot) const {
   if (cursorSnapshot > committedSnapshot) {
     ThrowWithCode(env, "Cursor beyond committed size", "ERR_SHM_CURSOR");
   }
 
+  if (ringBytes_ != 0) {
+    EnsureNotLapped(env);
+    return;
+  }
+
   if (dataOffset_ + cursorSnapshot > mappingLength_) {
     ThrowWithCode(env, "Cursor exceeds mapping length", "ERR_SHM_MAPPING_GONE");
   }
 }
 
+void ShmIterator::EnsureNotLapped(Napi::Env env) const {
+  // A writer with the overwrite policy marks the critical readers it laps
+  // before it writes, so they find out even ahead of the commit. Everyone
+  // else compares the cursor with the writer's frontier, which also covers
+  // frames allocated but not committed yet, and snapshot iterators with
+  // where the writer is rather than with the snapshot's end.
+  bool marked = readerSlot_ >= 0 && !mapping_->closed()
+    && mapping_->readerSlots().Lapped(static_cast<uint32_t>(readerSlot_));
+  if (marked || shmio::RingOverwritten(base_, dataOffset_, ringBytes_, cursor_)) {
+    ThrowWithCode(env, "Reader was lapped by the writer; frames were overwritten", "ERR_SHM_LAPPED");
+  }
+}
+
+[[noreturn]] void ShmIterator::ThrowCorrupt(Napi::Env env, const std::string& message, const std::string& code) const {
+  if (ringBytes_ != 0) {
+    EnsureNotLapped(env);
+  }
+  ThrowWithCode(env, message, code);
+}
+
+uint64_t ShmIterator::PhysicalOffset(uint64_t cursorRelative) const {
+  return ringBytes_ != 0 ? cursorRelative % ringBytes_ : cursorRelative;
+}
+
 [[noreturn]] void ShmIterator::ThrowWithCode(Napi::Env env, const std::string& message, const std::string& code) const {
   Napi::Error err = Napi::Error::New(env, message);
   err.Set("code", Napi::String::New(env, code));
@@ -414,7 +967,24 @@ uint64_t ShmIterator::LoadCommittedSize() const {
   if (committedSizeAtomic_ == nullptr) {
     return 0;
   }
-  return committedSizeAtomic_->load(std::memory_order_acquire);
+  return std::min(committedSizeAtomic_->load(std::memory_order_acquire), snapshotEnd_);
+}
+
+Napi::ArrayBuffer ShmIterator::FrameArrayBuffer(Napi::Env env) {
+  if (mapping_ != nullptr) {
+    return mapping_->MappingArrayBuffer(env);
+  }
+  return baseBufferRef_.Value().ArrayBuffer();
+}
+
+void ShmIterator::RefreshMapping(Napi::Env env) {
+  if (mapping_ == nullptr) {
+    return;
+  }
+  if (!mapping_->RefreshLength()) {
+    ThrowWithCode(env, std::string("Unable to map grown shared log: ") + strerror(errno), "ERR_SHM_MAPPING_GONE");
+  }
+  mappingLength_ = mapping_->length();
 }
 
 uint64_t ShmIterator::ReadUint64LE(const uint8_t* data) {
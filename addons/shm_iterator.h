@@ -1,9 +1,13 @@
 #pragma once
 
 #include <atomic>
+#include <cstdint>
+#include <memory>
 #include <vector>
 #include <napi.h>
 
+#include "shm_checkpoint.h"
+
 class ShmMapping;
 
 class ShmIterator : public Napi::ObjectWrap<ShmIterator> {
@@ -13,10 +17,14 @@ public:
 
 private:
   friend class ShmMapping;
+  friend class ShmMergedIterator;
   struct BatchOptions {
     uint32_t maxMessages;
     uint32_t maxBytes;
     bool debugChecks;
+    // nextBatch() only: one external Buffer per frame, the path before frames
+    // became views of the mapping ArrayBuffer. Kept for benchmarks.
+    bool externalBuffers { false };
   };
 
   struct BatchResult {
@@ -26,23 +34,68 @@ private:
     };
     std::vector<FrameSlice> frames;
     uint64_t consumedBytes;
+    uint32_t messages { 0 };
+    // Sequence of the frame after the last one collected; stamped logs only.
+    uint64_t nextSequence { 0 };
   };
 
   static Napi::FunctionReference constructor_;
 
   Napi::Value Next(const Napi::CallbackInfo& info);
   Napi::Value NextBatch(const Napi::CallbackInfo& info);
+  Napi::Value SpinNext(const Napi::CallbackInfo& info);
+  Napi::Value SpinBatch(const Napi::CallbackInfo& info);
   Napi::Value Cursor(const Napi::CallbackInfo& info);
   Napi::Value CommittedSize(const Napi::CallbackInfo& info);
+  Napi::Value TransferTo(const Napi::CallbackInfo& info);
+  Napi::Value Checkpoint(const Napi::CallbackInfo& info);
+  Napi::Value Sequence(const Napi::CallbackInfo& info);
+  Napi::Value Lag(const Napi::CallbackInfo& info);
+  Napi::Value IsFinished(const Napi::CallbackInfo& info);
+  void Follow(const Napi::CallbackInfo& info);
   void Seek(const Napi::CallbackInfo& info);
   void Close(const Napi::CallbackInfo& info);
 
   BatchOptions ParseOptions(Napi::Env env, const Napi::Object& value) const;
-  BatchResult CollectFrames(Napi::Env env, const BatchOptions& options);
+  uint64_t ParseMaxSpinNs(Napi::Env env, const Napi::CallbackInfo& info) const;
+  // Spins until frames are committed past the cursor or maxSpinNs elapse.
+  bool WaitForFrames(uint64_t maxSpinNs) const;
+  BatchResult CollectFrames(Napi::Env env, const BatchOptions& options, bool collectSlices = true);
+  template <bool kDebugChecks>
+  BatchResult CollectFramesImpl(Napi::Env env, const BatchOptions& options, bool collectSlices);
+  size_t WriteRange(Napi::Env env, int fd, uint64_t cursorRelative, uint64_t length);
+  void EnsureNoTransferInFlight(Napi::Env env) const;
+  void OpenCheckpoint(Napi::Env env, const std::string& consumer);
+  void MaybeCheckpoint(Napi::Env env);
+  void StoreCheckpoint(Napi::Env env, bool flush);
+  // Critical iterators of ring logs hold a reader slot (shm_readers.h) and
+  // publish their cursor there before frames are handed out, so the writer
+  // keeps the previous batch intact until the next read.
+  void ClaimReaderSlot(Napi::Env env);
+  void PublishCursor();
+  void ReleaseReaderSlot();
+  void AdvanceSequence(uint32_t messages, uint64_t nextSequence);
+  // Moves the cursor past frames returned by CollectFrames and counts them
+  // towards the next checkpoint. Frames collected but not consumed (the
+  // merged iterator's lookahead) are not counted.
+  void Consume(const BatchResult& result);
+  bool ResolveSequence(Napi::Env env);
   void EnsureOpen(Napi::Env env) const;
   void EnsureCursorInBounds(Napi::Env env, uint64_t cursorSnapshot, uint64_t committedSnapshot) const;
+  void EnsureNotLapped(Napi::Env env) const;
+  // Frame errors on ring logs are reported as ERR_SHM_LAPPED when the writer
+  // has overwritten the frames meanwhile.
+  [[noreturn]] void ThrowCorrupt(Napi::Env env, const std::string& message, const std::string& code) const;
+  uint64_t PhysicalOffset(uint64_t cursorRelative) const;
   [[noreturn]] void ThrowWithCode(Napi::Env env, const std::string& message, const std::string& code) const;
+  // Committed size as far as this iterator reads: capped at the snapshot's
+  // end for snapshot iterators.
   uint64_t LoadCommittedSize() const;
+  bool Finished() const { return snapshotEnd_ != kLive && dataOffset_ + cursor_ >= snapshotEnd_; }
+  void RefreshMapping(Napi::Env env);
+  // ArrayBuffer over the mapping (or the caller's Buffer) that returned
+  // frames are views of.
+  Napi::ArrayBuffer FrameArrayBuffer(Napi::Env env);
   static uint64_t ReadUint64LE(const uint8_t* data);
   static uint16_t ReadUint16LE(const uint8_t* data);
 
@@ -51,8 +104,30 @@ private:
   size_t mappingLength_ { 0 };
   uint64_t headerSize_ { 0 };
   uint64_t dataOffset_ { 0 };
+  uint64_t ringBytes_ { 0 };
   uint64_t cursor_ { 0 };
+  uint64_t transferEnd_ { 0 };
+  std::unique_ptr<shmio::CursorCheckpoint> checkpoint_;
+  uint32_t checkpointEvery_ { 1 };
+  bool flushCheckpoints_ { false };
+  uint64_t framesSinceCheckpoint_ { 0 };
+  int readerSlot_ { -1 };
+  // Absolute committed size captured by ShmMapping::Snapshot, and the message
+  // count with it; kLive for iterators that follow the writer.
+  static constexpr uint64_t kLive = UINT64_MAX;
+  uint64_t snapshotEnd_ { kLive };
+  uint64_t snapshotMessages_ { 0 };
+  bool snapshotMessagesKnown_ { false };
+  // Number of frames before the cursor. Known from cursor 0 onwards, or read
+  // from the frame stamps in logs created with frameSequences.
+  uint64_t sequence_ { 0 };
+  bool sequenceKnown_ { false };
+  uint32_t frameSequenceBytes_ { 0 };
+  uint32_t transferMessages_ { 0 };
+  uint64_t transferNextSequence_ { 0 };
+  const std::atomic<uint64_t>* committedMessagesAtomic_ { nullptr };
   std::atomic<uint64_t>* committedSizeAtomic_ { nullptr };
+  const std::atomic<uint64_t>* capacityAtomic_ { nullptr };
   Napi::Reference<Napi::Buffer<uint8_t>> baseBufferRef_;
   Napi::Reference<Napi::Object> mappingRef_;
   ShmMapping* mapping_ { nullptr };
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace shmio {
+
+// Tournament tree of losers over k sources for k-way merging. Leaves are
+// source indexes; every internal node keeps the loser of the match played
+// there and node 0 the overall winner. After the winner's key changes only
+// its path to the root is replayed, so a step costs log2(k) comparisons with
+// no sift-down as in a binary heap. `Less(a, b)` orders sources by their
+// current keys and must treat exhausted sources as greater than any other.
+class LoserTree {
+public:
+  template <typename Less>
+  void Build(size_t sources, Less&& less) {
+    sources_ = sources;
+    tree_.assign(sources_ == 0 ? 1 : sources_, 0);
+    if (sources_ <= 1) {
+      return;
+    }
+    // Leaves sit at positions [k, 2k) of the implicit complete binary tree;
+    // winners are computed bottom-up and only the losers are stored.
+    std::vector<size_t> winners(sources_);
+    for (size_t node = sources_ - 1; node >= 1; --node) {
+      size_t left = Child(2 * node, winners);
+      size_t right = Child(2 * node + 1, winners);
+      bool leftWins = !less(right, left);
+      winners[node] = leftWins ? left : right;
+      tree_[node] = leftWins ? right : left;
+    }
+    tree_[0] = winners[1];
+  }
+
+  // Call after the key of the current winner changed.
+  template <typename Less>
+  void Replay(Less&& less) {
+    if (sources_ <= 1) {
+      return;
+    }
+    size_t winner = tree_[0];
+    for (size_t node = (winner + sources_) / 2; node >= 1; node /= 2) {
+      if (less(tree_[node], winner)) {
+        std::swap(tree_[node], winner);
+      }
+    }
+    tree_[0] = winner;
+  }
+
+  size_t Winner() const { return tree_[0]; }
+
+private:
+  size_t Child(size_t position, const std::vector<size_t>& winners) const {
+    return position >= sources_ ? position - sources_ : winners[position];
+  }
+
+  size_t sources_ { 0 };
+  std::vector<size_t> tree_;
+};
+
+} // namespace shmio
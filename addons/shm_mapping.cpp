@@ -5,15 +5,33 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <string>
 #include <limits>
 
+#include "shm_buffer_views.h"
+#include "shm_checkpoint.h"
+#include "shm_file.h"
+#include "shm_format.h"
+#include "shm_futex.h"
 #include "shm_iterator.h"
+#include "shm_mirror.h"
+#include "shm_scanner.h"
+#include "shm_spin.h"
 #include "shm_writer.h"
 
 namespace {
 constexpr uint64_t kDefaultHeaderSize = 24; // 3 * u64 (headerSize, dataOffset, size)
+// How long snapshot() retries while commits keep racing it. Only a writer that
+// died in the middle of a commit holds the seqlock odd for longer.
+constexpr uint64_t kSnapshotRetryNs = 1000 * 1000;
+
+uint64_t RoundUpToPage(uint64_t value) {
+  uint64_t pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+  return (value + pageSize - 1) / pageSize * pageSize;
+}
 }
 
 Napi::FunctionReference ShmMapping::constructor_;
@@ -21,8 +39,18 @@ Napi::FunctionReference ShmMapping::constructor_;
 void ShmMapping::Init(Napi::Env env, Napi::Object exports) {
   Napi::Function func = DefineClass(env, "ShmMapping", {
     InstanceMethod<&ShmMapping::HeaderView>("headerView"),
+    InstanceMethod<&ShmMapping::AtomicHeaderView>("atomicHeaderView"),
+    InstanceMethod<&ShmMapping::WaitForCommit>("waitForCommit"),
     InstanceMethod<&ShmMapping::CreateIterator>("createIterator"),
     InstanceMethod<&ShmMapping::CreateWriter>("createWriter"),
+    InstanceMethod<&ShmMapping::CapacityBytes>("capacityBytes"),
+    InstanceMethod<&ShmMapping::Fd>("fd"),
+    InstanceMethod<&ShmMapping::Sealed>("sealed"),
+    InstanceMethod<&ShmMapping::Snapshot>("snapshot"),
+    InstanceMethod<&ShmMapping::CountFrames>("countFrames"),
+    InstanceMethod<&ShmMapping::Validate>("validate"),
+    InstanceMethod<&ShmMapping::FindLast>("findLast"),
+    InstanceMethod<&ShmMapping::ScanRange>("scanRange"),
     InstanceMethod<&ShmMapping::Close>("close"),
   });
 
@@ -43,13 +71,36 @@ Napi::Value ShmMapping::Open(const Napi::CallbackInfo& info) {
 
   Napi::Object opts = info[0].As<Napi::Object>();
 
-  auto pathValue = opts.Get("path");
-  if (!pathValue.IsString()) {
+  // A log is opened by path, from an inherited descriptor, or created as an
+  // anonymous memfd by its writer.
+  Napi::Value pathValue = opts.Get("path");
+  Napi::Value fdValue = opts.Get("fd");
+  bool memfd = opts.Has("memfd") ? opts.Get("memfd").ToBoolean().Value() : false;
+  bool hasPath = !pathValue.IsUndefined() && !pathValue.IsNull();
+  bool hasFd = !fdValue.IsUndefined() && !fdValue.IsNull();
+  if (hasPath + hasFd + memfd != 1) {
+    Napi::TypeError::New(env, "openSharedLog needs exactly one of path, fd or memfd").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  if (hasPath && !pathValue.IsString()) {
     Napi::TypeError::New(env, "options.path must be a string").ThrowAsJavaScriptException();
     return env.Null();
   }
+  int32_t fd = -1;
+  if (hasFd) {
+    double fdNumber = fdValue.IsNumber() ? fdValue.As<Napi::Number>().DoubleValue() : -1;
+    if (fdNumber < 0 || fdNumber != static_cast<int32_t>(fdNumber)) {
+      Napi::TypeError::New(env, "options.fd must be a file descriptor").ThrowAsJavaScriptException();
+      return env.Null();
+    }
+    fd = static_cast<int32_t>(fdNumber);
+  }
 
   bool writable = opts.Has("writable") ? opts.Get("writable").ToBoolean().Value() : false;
+  if (memfd && !writable) {
+    Napi::TypeError::New(env, "memfd logs are created by their writer; readers open them by fd").ThrowAsJavaScriptException();
+    return env.Null();
+  }
   bool debugChecks = opts.Has("debugChecks") ? opts.Get("debugChecks").ToBoolean().Value() : false;
 
   bool lossless = false;
@@ -90,11 +141,64 @@ Napi::Value ShmMapping::Open(const Napi::CallbackInfo& info) {
     return env.Null();
   }
 
+  uint64_t growthStepBytes = 0;
+  uint64_t maxCapacityBytes = 0;
+  if (!ParseUint64Option(env, opts, "growthStepBytes", &growthStepBytes)
+      || !ParseUint64Option(env, opts, "maxCapacityBytes", &maxCapacityBytes)) {
+    return env.Null();
+  }
+
+  if (writable && maxCapacityBytes != 0 && maxCapacityBytes < capacityBytes) {
+    Napi::TypeError::New(env, "maxCapacityBytes must be at least capacityBytes").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  bool ring = opts.Has("ring") ? opts.Get("ring").ToBoolean().Value() : false;
+  if (writable && ring && maxCapacityBytes != 0) {
+    Napi::TypeError::New(env, "ring logs cannot be growable").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  if (writable && growthStepBytes != 0 && maxCapacityBytes == 0) {
+    Napi::TypeError::New(env, "growthStepBytes requires maxCapacityBytes").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  // Layout for newly created logs; existing logs keep whatever they were
+  // created with. 0 leaves the choice to the constructor: v2, unless the log
+  // is too small for it and needs no v2 feature.
+  uint32_t headerVersion = 0;
+  if (opts.Has("headerVersion") && !opts.Get("headerVersion").IsUndefined()) {
+    Napi::Value versionValue = opts.Get("headerVersion");
+    headerVersion = versionValue.IsNumber() ? versionValue.As<Napi::Number>().Uint32Value() : 0;
+    if (headerVersion != 1 && headerVersion != shmio::kHeaderVersion2) {
+      Napi::TypeError::New(env, "options.headerVersion must be 1 or 2").ThrowAsJavaScriptException();
+      return env.Null();
+    }
+  }
+  if (writable && headerVersion == 1 && (ring || maxCapacityBytes != 0)) {
+    Napi::TypeError::New(env, "growable and ring logs need headerVersion 2").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  bool frameSequences = opts.Has("frameSequences") ? opts.Get("frameSequences").ToBoolean().Value() : false;
+  if (writable && frameSequences && headerVersion == 1) {
+    Napi::TypeError::New(env, "frameSequences need headerVersion 2").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
   Napi::Object instance = constructor_.New({
-    pathValue,
+    hasPath ? pathValue : Napi::String::New(env, ""),
     Napi::BigInt::New(env, capacityBytes),
     Napi::Boolean::New(env, writable),
     Napi::Boolean::New(env, debugChecks),
+    Napi::BigInt::New(env, growthStepBytes),
+    Napi::BigInt::New(env, maxCapacityBytes),
+    Napi::Boolean::New(env, ring),
+    Napi::Number::New(env, headerVersion),
+    Napi::Boolean::New(env, frameSequences),
+    Napi::Number::New(env, fd),
+    Napi::Boolean::New(env, memfd),
   });
 
   return instance;
@@ -111,6 +215,7 @@ ShmMapping::ShmMapping(const Napi::CallbackInfo& info)
   }
 
   std::string path = info[0].As<Napi::String>().Utf8Value();
+  path_ = path;
 
   bool lossless = false;
   uint64_t capacityBytes = info[1].As<Napi::BigInt>().Uint64Value(&lossless);
@@ -122,32 +227,92 @@ ShmMapping::ShmMapping(const Napi::CallbackInfo& info)
   writable_ = info[2].As<Napi::Boolean>().Value();
   debugChecks_ = info[3].As<Napi::Boolean>().Value();
 
+  uint64_t growthStepBytes = 0;
+  uint64_t maxCapacityBytes = 0;
+  if (info.Length() >= 6) {
+    growthStepBytes = info[4].As<Napi::BigInt>().Uint64Value(&lossless);
+    maxCapacityBytes = info[5].As<Napi::BigInt>().Uint64Value(&lossless);
+  }
+
+  // Growable logs are extended one page-aligned step at a time, so the
+  // initial size has to be page aligned as well.
+  bool growable = writable_ && maxCapacityBytes != 0;
+  if (growable) {
+    capacityBytes = std::max(RoundUpToPage(capacityBytes), RoundUpToPage(2 * shmio::kHeaderV2Size));
+    maxCapacityBytes = std::max(RoundUpToPage(maxCapacityBytes), capacityBytes);
+    growthStepBytes = RoundUpToPage(growthStepBytes != 0 ? growthStepBytes : capacityBytes);
+  }
+
+  // Ring logs keep the header on its own page so the data region can be
+  // mapped a second time right behind itself.
+  uint64_t pageSize = RoundUpToPage(1);
+  bool createRing = writable_ && !growable && info.Length() >= 7 && info[6].As<Napi::Boolean>().Value();
+  uint32_t headerVersion = info.Length() >= 8 ? info[7].As<Napi::Number>().Uint32Value() : 0;
+  bool frameSequences = writable_ && info.Length() >= 9 && info[8].As<Napi::Boolean>().Value();
+  bool defaultHeaderVersion = headerVersion == 0;
+  if (defaultHeaderVersion) {
+    headerVersion = shmio::kHeaderVersion2;
+  }
+  if (createRing) {
+    capacityBytes = RoundUpToPage(capacityBytes);
+    if (capacityBytes < pageSize + shmio::kMinRingBytes) {
+      Napi::Error::New(env, "ring logs need capacityBytes of at least one page plus 64 KiB").ThrowAsJavaScriptException();
+      return;
+    }
+  }
+
+  int inheritedFd = info.Length() >= 10 ? info[9].As<Napi::Number>().Int32Value() : -1;
+  bool memfd = writable_ && info.Length() >= 11 && info[10].As<Napi::Boolean>().Value();
+
   int flags = writable_ ? (O_RDWR) : O_RDONLY;
   int permissions = 0664;
 
   bool created = false;
 
-  fd_ = open(path.c_str(), flags, permissions);
-  if (fd_ < 0) {
-    if (!writable_) {
-      Napi::Error::New(env, std::string("Unable to open shared memory ") + strerror(errno)).ThrowAsJavaScriptException();
+  if (memfd) {
+    fd_ = shmio::CreateSealableMemfd("shmio");
+    if (fd_ < 0) {
+      Napi::Error::New(env, std::string("memfd_create failed: ") + strerror(errno)).ThrowAsJavaScriptException();
       return;
     }
-
-    fd_ = open(path.c_str(), O_RDWR | O_CREAT, permissions);
+    created = true;
+  } else if (inheritedFd >= 0) {
+    // The caller keeps its descriptor; closing the log closes only our copy.
+    fd_ = fcntl(inheritedFd, F_DUPFD_CLOEXEC, 0);
     if (fd_ < 0) {
-      Napi::Error::New(env, std::string("Unable to create shared memory ") + strerror(errno)).ThrowAsJavaScriptException();
+      Napi::Error::New(env, std::string("Unable to duplicate fd ") + std::to_string(inheritedFd) + ": " + strerror(errno))
+        .ThrowAsJavaScriptException();
       return;
     }
-
-    created = true;
-
-    if (ftruncate(fd_, static_cast<off_t>(capacityBytes)) != 0) {
-      Napi::Error::New(env, std::string("ftruncate failed: ") + strerror(errno)).ThrowAsJavaScriptException();
+    if (writable_ && (fcntl(fd_, F_GETFL) & O_ACCMODE) == O_RDONLY) {
+      Napi::Error::New(env, "fd " + std::to_string(inheritedFd) + " is read-only").ThrowAsJavaScriptException();
       close(fd_);
       fd_ = -1;
       return;
     }
+  } else {
+    fd_ = open(path.c_str(), flags, permissions);
+    if (fd_ < 0) {
+      if (!writable_) {
+        Napi::Error::New(env, std::string("Unable to open shared memory ") + strerror(errno)).ThrowAsJavaScriptException();
+        return;
+      }
+
+      fd_ = open(path.c_str(), O_RDWR | O_CREAT, permissions);
+      if (fd_ < 0) {
+        Napi::Error::New(env, std::string("Unable to create shared memory ") + strerror(errno)).ThrowAsJavaScriptException();
+        return;
+      }
+
+      created = true;
+    }
+  }
+
+  if (created && ftruncate(fd_, static_cast<off_t>(capacityBytes)) != 0) {
+    Napi::Error::New(env, std::string("ftruncate failed: ") + strerror(errno)).ThrowAsJavaScriptException();
+    close(fd_);
+    fd_ = -1;
+    return;
   }
 
   struct stat st {};
@@ -184,10 +349,98 @@ ShmMapping::ShmMapping(const Napi::CallbackInfo& info)
     return;
   }
 
+  // Growable logs reserve address space up to their maximum capacity so that
+  // growth maps new pages in place and previously returned Buffers stay valid.
+  uint8_t headerBytes[shmio::kHeaderV2Size] = {};
+  ssize_t headerRead = pread(fd_, headerBytes, sizeof(headerBytes), 0);
+  bool headerV2 = headerRead > 0 && shmio::HasHeaderV2(headerBytes, static_cast<uint64_t>(headerRead));
+  bool freshHeader = headerRead > 0 && shmio::ReadUint64LE(headerBytes) == 0;
+  bool initializeGrowable = growable && freshHeader;
+  bool initializeRing = createRing && freshHeader;
+  bool initializeV2 = writable_ && freshHeader && headerVersion == shmio::kHeaderVersion2;
+  // Logs too small to hold a v2 header next to some data keep the v1 layout,
+  // as they did before v2 existed, unless v2 was asked for or is needed.
+  if (initializeV2 && mappingLength < 2 * shmio::kHeaderV2Size && defaultHeaderVersion
+      && !growable && !createRing && !frameSequences) {
+    initializeV2 = false;
+  }
+  if (initializeV2 && mappingLength < 2 * shmio::kHeaderV2Size) {
+    Napi::RangeError::New(env, "capacityBytes must be at least " + std::to_string(2 * shmio::kHeaderV2Size)
+      + " for headerVersion 2; pass headerVersion: 1 for smaller logs").ThrowAsJavaScriptException();
+    close(fd_);
+    fd_ = -1;
+    return;
+  }
+
+  if (headerV2 && !shmio::IsSupportedHeaderV2(headerBytes)) {
+    Napi::Error::New(env, "shared log header version " + std::to_string(shmio::ReadUint32LE(headerBytes + shmio::kHeaderVersionOffset))
+      + " with flags " + std::to_string(shmio::ReadUint32LE(headerBytes + shmio::kHeaderFlagsOffset))
+      + " is not supported by this build").ThrowAsJavaScriptException();
+    close(fd_);
+    fd_ = -1;
+    return;
+  }
+
+  uint64_t maxCapacity = 0;
+  uint64_t ringBytes = 0;
+  uint64_t ringDataOffset = pageSize;
+  if (headerV2) {
+    maxCapacity = shmio::ReadUint64LE(headerBytes + shmio::kMaxCapacityOffset);
+    ringBytes = shmio::ReadUint64LE(headerBytes + shmio::kRingBytesOffset);
+    ringDataOffset = shmio::ReadUint64LE(headerBytes + shmio::kDataOffsetOffset);
+  } else if (initializeGrowable) {
+    maxCapacity = maxCapacityBytes;
+  } else if (initializeRing) {
+    ringBytes = mappingLength - pageSize;
+  }
+
+  if (ringBytes != 0
+      && (ringDataOffset % pageSize != 0 || ringBytes % pageSize != 0 || ringDataOffset + ringBytes > mappingLength)) {
+    Napi::Error::New(env, "ring log header is inconsistent with the segment size").ThrowAsJavaScriptException();
+    close(fd_);
+    fd_ = -1;
+    return;
+  }
+
+  uint64_t reservedLength = std::max(mappingLength, maxCapacity);
+  if (reservedLength > std::numeric_limits<size_t>::max()) {
+    Napi::Error::New(env, "shared memory segment is too large to map").ThrowAsJavaScriptException();
+    close(fd_);
+    fd_ = -1;
+    return;
+  }
+
   int protection = writable_ ? (PROT_READ | PROT_WRITE) : PROT_READ;
-  void* mapped = mmap(nullptr, static_cast<size_t>(mappingLength), protection, MAP_SHARED, fd_, 0);
+  void* mapped = MAP_FAILED;
+  if (ringBytes != 0) {
+    uint8_t* mirrored = shmio::MapMirrored(fd_, static_cast<size_t>(ringDataOffset), static_cast<size_t>(ringBytes), protection);
+    if (mirrored != nullptr) {
+      mapped = mirrored;
+      mappingLength = ringDataOffset + ringBytes;
+      reservedLength_ = shmio::MirroredLength(static_cast<size_t>(ringDataOffset), static_cast<size_t>(ringBytes));
+    }
+  } else if (reservedLength > mappingLength) {
+    mapped = mmap(nullptr, static_cast<size_t>(reservedLength), PROT_NONE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapped != MAP_FAILED) {
+      base_ = static_cast<uint8_t*>(mapped);
+      reservedLength_ = static_cast<size_t>(reservedLength);
+      if (!MapRange(0, static_cast<size_t>(mappingLength))) {
+        int mapErrno = errno;
+        munmap(mapped, reservedLength_);
+        errno = mapErrno;
+        mapped = MAP_FAILED;
+      }
+    }
+  } else {
+    mapped = mmap(nullptr, static_cast<size_t>(mappingLength), protection, MAP_SHARED, fd_, 0);
+    reservedLength_ = static_cast<size_t>(mappingLength);
+  }
+
   if (mapped == MAP_FAILED) {
     Napi::Error::New(env, std::string("mmap failed: ") + strerror(errno)).ThrowAsJavaScriptException();
+    base_ = nullptr;
+    reservedLength_ = 0;
     close(fd_);
     fd_ = -1;
     return;
@@ -196,32 +449,85 @@ ShmMapping::ShmMapping(const Napi::CallbackInfo& info)
   base_ = static_cast<uint8_t*>(mapped);
   length_ = static_cast<size_t>(mappingLength);
 
-  mappingBufferRef_ = Napi::Persistent(Napi::Buffer<uint8_t>::New(env, base_, length_));
-  mappingBufferRef_.SuppressDestruct();
+  MappingArrayBuffer(env);
+
+  if (initializeV2) {
+    uint64_t dataOffset = initializeRing ? ringDataOffset : shmio::kHeaderV2Size;
+    uint32_t features = (initializeGrowable ? shmio::kFeatureGrowable : 0) | (initializeRing ? shmio::kFeatureRing : 0)
+      | (frameSequences ? shmio::kFeatureFrameSequence : 0);
+    WriteUint64LE(base_ + shmio::kDataOffsetOffset, dataOffset);
+    WriteUint64LE(base_ + shmio::kCommittedSizeOffset, dataOffset);
+    WriteUint64LE(base_ + shmio::kHeaderMagicOffset, shmio::kHeaderMagic);
+    shmio::WriteUint32LE(base_ + shmio::kHeaderVersionOffset, shmio::kHeaderVersion2);
+    shmio::WriteUint32LE(base_ + shmio::kHeaderFlagsOffset, features);
+    WriteUint64LE(base_ + shmio::kMaxCapacityOffset, initializeGrowable ? maxCapacityBytes : length_);
+    WriteUint64LE(base_ + shmio::kGrowthStepOffset, initializeGrowable ? growthStepBytes : 0);
+    WriteUint64LE(base_ + shmio::kRingBytesOffset, ringBytes);
+    WriteUint64LE(base_ + shmio::kCreatedAtOffset, static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count()));
+    WriteUint64LE(base_ + shmio::kCapacityOffset, length_);
+  }
 
   headerSize_ = ReadUint64LE(base_);
   if (headerSize_ == 0 || headerSize_ > length_) {
-    headerSize_ = kDefaultHeaderSize;
+    headerSize_ = initializeV2 ? shmio::kHeaderV2Size : kDefaultHeaderSize;
     WriteUint64LE(base_, headerSize_);
   }
 
-  dataOffset_ = ReadUint64LE(base_ + 8);
+  uint64_t committedOffset = shmio::kCommittedSizeOffset;
+  if (shmio::HasHeaderV2(base_, length_)) {
+    committedOffset = shmio::kCommittedSizeV2Offset;
+    capacityAtomic_ = reinterpret_cast<std::atomic<uint64_t>*>(base_ + shmio::kCapacityOffset);
+    commitSequence_ = reinterpret_cast<std::atomic<uint32_t>*>(base_ + shmio::kCommitSequenceOffset);
+    committedMessagesAtomic_ = reinterpret_cast<std::atomic<uint64_t>*>(base_ + shmio::kCommittedMessagesOffset);
+    commitGeneration_ = reinterpret_cast<std::atomic<uint32_t>*>(base_ + shmio::kCommitGenerationOffset);
+    frameSequenceBytes_ = shmio::FrameSequenceBytes(base_, length_);
+    growthStep_ = ReadUint64LE(base_ + shmio::kGrowthStepOffset);
+    ringBytes_ = ReadUint64LE(base_ + shmio::kRingBytesOffset);
+  } else {
+    fixedCapacity_.store(length_, std::memory_order_relaxed);
+    capacityAtomic_ = &fixedCapacity_;
+  }
+
+  dataOffset_ = ReadUint64LE(base_ + shmio::kDataOffsetOffset);
   if (dataOffset_ == 0 || dataOffset_ > length_) {
     dataOffset_ = headerSize_;
-    WriteUint64LE(base_ + 8, dataOffset_);
+    WriteUint64LE(base_ + shmio::kDataOffsetOffset, dataOffset_);
   }
 
-  committedSizeAtomic_ = reinterpret_cast<std::atomic<uint64_t>*>(base_ + 16);
+  committedSizeAtomic_ = reinterpret_cast<std::atomic<uint64_t>*>(base_ + committedOffset);
+  if (writable_ && ringBytes_ != 0) {
+    readerSlots_ = shmio::ReaderSlots(base_);
+  }
 
+  // A growable log may already have been extended past the length seen by
+  // fstat above; the reservation bounds what a valid committed size can be.
+  // Ring logs publish a monotonic position that is not bounded by the file.
+  uint64_t committedLimit = capacityAtomic_ == &fixedCapacity_ ? length_ : reservedLength_;
+  if (ringBytes_ != 0) {
+    committedLimit = std::numeric_limits<uint64_t>::max();
+  }
   uint64_t committed = committedSizeAtomic_->load(std::memory_order_acquire);
-  if (committed < dataOffset_ || committed > length_) {
+  if (committed < dataOffset_ || committed > committedLimit) {
     committed = dataOffset_;
     committedSizeAtomic_->store(committed, std::memory_order_release);
   }
+
+  // Sealed once the header is written. Growable logs still have to extend
+  // the file, so they are only sealed against shrinking.
+  if (memfd && !shmio::SealSize(fd_, growable)) {
+    Napi::Error::New(env, std::string("Sealing memfd failed: ") + strerror(errno)).ThrowAsJavaScriptException();
+    Cleanup();
+    return;
+  }
+  sealed_ = shmio::IsShrinkSealed(fd_);
 }
 
 ShmMapping::~ShmMapping() {
   Cleanup();
+  // Queued scans hold a reference to this object, so none can still be
+  // running once it is collected.
+  ReleaseMapping();
 }
 
 uint64_t ShmMapping::LoadCommittedSize() const {
@@ -231,11 +537,91 @@ uint64_t ShmMapping::LoadCommittedSize() const {
   return committedSizeAtomic_->load(std::memory_order_acquire);
 }
 
-void ShmMapping::StoreCommittedSize(uint64_t value) {
+uint64_t ShmMapping::LoadCommittedMessages() const {
+  if (committedMessagesAtomic_ == nullptr) {
+    return 0;
+  }
+  return committedMessagesAtomic_->load(std::memory_order_acquire);
+}
+
+void ShmMapping::StoreCommittedSize(uint64_t value, uint64_t committedMessages) {
   if (committedSizeAtomic_ == nullptr) {
     return;
   }
-  committedSizeAtomic_->store(value, std::memory_order_release);
+  if (committedMessagesAtomic_ == nullptr) {
+    committedSizeAtomic_->store(value, std::memory_order_release);
+  } else {
+    // Seqlock write: the generation is odd while the pair changes. The fence
+    // keeps the odd store ahead of both stores below.
+    uint32_t generation = commitGeneration_->load(std::memory_order_relaxed);
+    commitGeneration_->store(generation + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    committedMessagesAtomic_->store(committedMessages, std::memory_order_release);
+    committedSizeAtomic_->store(value, std::memory_order_release);
+    commitGeneration_->store(generation + 2, std::memory_order_release);
+  }
+  if (commitSequence_ != nullptr) {
+    // Single writer, so a plain increment is enough; the release store orders
+    // it after the committed size for readers that wake on the sequence.
+    commitSequence_->store(commitSequence_->load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+}
+
+bool ShmMapping::Grow(Napi::Env env, uint64_t requiredLength) {
+  if (!writable_ || growthStep_ == 0 || requiredLength > reservedLength_) {
+    return false;
+  }
+
+  uint64_t newLength = length_;
+  while (newLength < requiredLength) {
+    newLength += growthStep_;
+  }
+  newLength = std::min<uint64_t>(newLength, reservedLength_);
+
+  if (ftruncate(fd_, static_cast<off_t>(newLength)) != 0) {
+    Napi::Error::New(env, std::string("ftruncate failed: ") + strerror(errno)).ThrowAsJavaScriptException();
+    return false;
+  }
+
+  if (!MapRange(length_, static_cast<size_t>(newLength) - length_)) {
+    Napi::Error::New(env, std::string("mmap failed: ") + strerror(errno)).ThrowAsJavaScriptException();
+    return false;
+  }
+
+  length_ = static_cast<size_t>(newLength);
+  // Publish only after the file is extended so readers can map it right away.
+  capacityAtomic_->store(newLength, std::memory_order_release);
+  return true;
+}
+
+bool ShmMapping::RefreshLength() {
+  if (closed_) {
+    errno = EBADF;
+    return false;
+  }
+
+  uint64_t capacity = capacityAtomic_->load(std::memory_order_acquire);
+  if (capacity <= length_) {
+    return true;
+  }
+
+  if (capacity > reservedLength_) {
+    errno = ENOMEM;
+    return false;
+  }
+
+  if (!MapRange(length_, static_cast<size_t>(capacity) - length_)) {
+    return false;
+  }
+
+  length_ = static_cast<size_t>(capacity);
+  return true;
+}
+
+bool ShmMapping::MapRange(size_t offset, size_t length) {
+  int protection = writable_ ? (PROT_READ | PROT_WRITE) : PROT_READ;
+  void* mapped = mmap(base_ + offset, length, protection, MAP_SHARED | MAP_FIXED, fd_, static_cast<off_t>(offset));
+  return mapped != MAP_FAILED;
 }
 
 void ShmMapping::EnsureOpen(Napi::Env env) const {
@@ -244,31 +630,323 @@ void ShmMapping::EnsureOpen(Napi::Env env) const {
   }
 }
 
+Napi::ArrayBuffer ShmMapping::MappingArrayBuffer(Napi::Env env) {
+  // Starts at the data offset, so frame.buffer does not expose the header.
+  // Ring frames may run into the mirror, which is mapped in full; growable
+  // logs only up to the current length.
+  size_t viewLength = (ringBytes_ != 0 ? reservedLength_ : length_) - dataOffset_;
+  if (mappingBufferRef_.IsEmpty() || mappingBufferLength_ != viewLength) {
+    // No finalizer: the pages are unmapped by close(), as before for every
+    // frame Buffer. Views of a smaller, earlier ArrayBuffer stay valid.
+    mappingBufferRef_ = Napi::Persistent(Napi::ArrayBuffer::New(env, base_ + dataOffset_, viewLength));
+    mappingBufferRef_.SuppressDestruct();
+    mappingBufferLength_ = viewLength;
+  }
+  return mappingBufferRef_.Value();
+}
+
+int ShmMapping::ClaimReaderSlot(uint64_t cursor) {
+  if (!readerSlots_.valid() && !MapReaderSection()) {
+    return -1;
+  }
+  uint32_t pid = static_cast<uint32_t>(getpid());
+  int slot = readerSlots_.Claim(pid, cursor);
+  if (slot < 0 && readerSlots_.ReclaimDead() != 0) {
+    slot = readerSlots_.Claim(pid, cursor);
+  }
+  if (slot < 0) {
+    errno = ENOSPC;
+    return -1;
+  }
+  claimedReaderSlots_ |= 1u << slot;
+  return slot;
+}
+
+void ShmMapping::ReleaseReaderSlot(int slot) {
+  uint32_t bit = 1u << slot;
+  if (closed_ || (claimedReaderSlots_ & bit) == 0) {
+    return;
+  }
+  readerSlots_.Release(static_cast<uint32_t>(slot));
+  claimedReaderSlots_ &= ~bit;
+}
+
+void ShmMapping::ReleaseReaderSlots() {
+  for (uint32_t slot = 0; slot < shmio::kReaderSlots; ++slot) {
+    if ((claimedReaderSlots_ & (1u << slot)) != 0) {
+      readerSlots_.Release(slot);
+    }
+  }
+  claimedReaderSlots_ = 0;
+}
+
+bool ShmMapping::MapReaderSection() {
+  // The main mapping of a reader is read-only, and so may be its descriptor;
+  // a log opened by path is reopened for writing instead. A read-only
+  // descriptor without a path fails with EACCES.
+  int fd = fd_;
+  bool reopened = false;
+  if ((fcntl(fd_, F_GETFL) & O_ACCMODE) == O_RDONLY) {
+    if (path_.empty()) {
+      errno = EACCES;
+      return false;
+    }
+    fd = open(path_.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    reopened = true;
+  }
+  size_t length = static_cast<size_t>(dataOffset_);
+  void* mapped = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  int mapErrno = errno;
+  if (reopened) {
+    close(fd);
+  }
+  if (mapped == MAP_FAILED) {
+    errno = mapErrno;
+    return false;
+  }
+  readerHeader_ = static_cast<uint8_t*>(mapped);
+  readerHeaderLength_ = length;
+  readerSlots_ = shmio::ReaderSlots(readerHeader_);
+  return true;
+}
+
 Napi::Value ShmMapping::HeaderView(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
   EnsureOpen(env);
   return Napi::Buffer<uint8_t>::New(env, base_, static_cast<size_t>(headerSize_));
 }
 
+// An external ArrayBuffer over a read-only mapping of its own, unmapped by its
+// finalizer, so the view stays readable after close(). Atomics.load works on
+// it. It is not a SharedArrayBuffer (Node-API cannot make one over external
+// memory), so Atomics.wait does not; sleeping goes through waitForCommit().
+Napi::Value ShmMapping::AtomicHeaderView(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  EnsureOpen(env);
+  if (env.IsExceptionPending()) {
+    return env.Null();
+  }
+
+  size_t mappedLength = static_cast<size_t>(RoundUpToPage(headerSize_));
+  void* mapped = mmap(nullptr, mappedLength, PROT_READ, MAP_SHARED, fd_, 0);
+  if (mapped == MAP_FAILED) {
+    Napi::Error::New(env, std::string("mmap failed: ") + strerror(errno)).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  return Napi::ArrayBuffer::New(env, mapped, static_cast<size_t>(headerSize_),
+    [mappedLength](Napi::Env, void* data) { munmap(data, mappedLength); });
+}
+
+// waitForCommit(lastSequence, timeoutMs?) keeps the Atomics.wait contract:
+// 'not-equal' when the sequence has already moved, 'ok' once a commit moves
+// it, 'timed-out' otherwise. It sleeps in a futex on the commit sequence word,
+// which a commit in any process wakes, and like Atomics.wait it blocks the
+// calling thread, event loop included. The wait only reads the header.
+Napi::Value ShmMapping::WaitForCommit(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  EnsureOpen(env);
+  if (env.IsExceptionPending()) {
+    return env.Null();
+  }
+  if (commitSequence_ == nullptr) {
+    Napi::Error::New(env, "v1 log headers have no commit sequence; recreate the log with headerVersion 2")
+      .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  if (info.Length() < 1 || !info[0].IsNumber()) {
+    Napi::TypeError::New(env, "waitForCommit(lastSequence, timeoutMs) expects a sequence number").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  // Sequences read through an Int32Array are signed; compare the bits.
+  uint32_t lastSequence = static_cast<uint32_t>(info[0].As<Napi::Number>().Int32Value());
+  int64_t timeoutNs = -1;
+  if (info.Length() >= 2 && !info[1].IsUndefined()) {
+    double timeoutMs = info[1].IsNumber() ? info[1].As<Napi::Number>().DoubleValue() : -1;
+    if (!(timeoutMs >= 0)) {
+      Napi::RangeError::New(env, "timeoutMs must be a non-negative number").ThrowAsJavaScriptException();
+      return env.Null();
+    }
+    // Anything past a century is as good as no limit (Infinity included).
+    if (timeoutMs < 3.2e12) {
+      timeoutNs = static_cast<int64_t>(timeoutMs * 1e6);
+    }
+  }
+
+  if (commitSequence_->load(std::memory_order_acquire) != lastSequence) {
+    return Napi::String::New(env, "not-equal");
+  }
+  using Clock = std::chrono::steady_clock;
+  const Clock::time_point deadline = Clock::now() + std::chrono::nanoseconds(std::max<int64_t>(timeoutNs, 0));
+  const uint32_t* word = reinterpret_cast<const uint32_t*>(commitSequence_);
+  const char* result = "timed-out";
+  int error = 0;
+  for (;;) {
+    int64_t remainingNs = -1;
+    if (timeoutNs >= 0) {
+      remainingNs = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - Clock::now()).count();
+      if (remainingNs <= 0) {
+        break;
+      }
+    }
+    error = shmio::FutexWait(word, lastSequence, remainingNs);
+    if (commitSequence_->load(std::memory_order_acquire) != lastSequence) {
+      result = "ok";
+      break;
+    }
+    if (error == ETIMEDOUT) {
+      break;
+    }
+    if (error != 0 && error != EINTR && error != EAGAIN) {
+      result = nullptr;
+      break;
+    }
+  }
+  if (result == nullptr) {
+    Napi::Error::New(env, std::string("futex wait failed: ") + strerror(error)).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  return Napi::String::New(env, result);
+}
+
+void ShmMapping::NotifyCommitWaiters() {
+  if (commitSequence_ == nullptr || !writable_) {
+    return;
+  }
+  // Waiters are not counted: that would need readers to write to the header.
+  // A wake with nobody asleep is one syscall that finds an empty queue.
+  shmio::FutexWakeAll(reinterpret_cast<const uint32_t*>(commitSequence_));
+}
+
+Napi::Value ShmMapping::CapacityBytes(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  EnsureOpen(env);
+  return Napi::BigInt::New(env, capacityAtomic_->load(std::memory_order_acquire));
+}
+
+Napi::Value ShmMapping::Fd(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  EnsureOpen(env);
+  return Napi::Number::New(env, fd_);
+}
+
+Napi::Value ShmMapping::Sealed(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  EnsureOpen(env);
+  return Napi::Boolean::New(env, sealed_);
+}
+
+// Captures the committed size for snapshot iterators, together with the
+// message count of exactly the frames below it. Both are read under the commit
+// generation seqlock and retried while a commit races the read. Logs from
+// writers that predate the seqlock leave the generation at 0, so there the
+// count may include frames committed just after the size was read.
+Napi::Value ShmMapping::Snapshot(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  EnsureOpen(env);
+
+  uint64_t committed = LoadCommittedSize();
+  Napi::Value messages = env.Null();
+  if (committedMessagesAtomic_ != nullptr) {
+    uint64_t count = 0;
+    bool consistent = shmio::SpinUntil([&] {
+      uint32_t before = commitGeneration_->load(std::memory_order_acquire);
+      count = committedMessagesAtomic_->load(std::memory_order_acquire);
+      committed = committedSizeAtomic_->load(std::memory_order_acquire);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return (before & 1) == 0 && commitGeneration_->load(std::memory_order_relaxed) == before;
+    }, kSnapshotRetryNs);
+    // A generation stuck odd means the writer died mid-commit: the size is
+    // still a frame boundary, but the count is unknown.
+    if (consistent) {
+      messages = Napi::BigInt::New(env, count);
+    }
+  }
+
+  Napi::Object snapshot = Napi::Object::New(env);
+  snapshot.Set("endCursor", Napi::BigInt::New(env, committed > dataOffset_ ? committed - dataOffset_ : 0));
+  snapshot.Set("messages", messages);
+  return snapshot;
+}
+
 Napi::Value ShmMapping::CreateIterator(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
   EnsureOpen(env);
 
-  uint64_t startCursor = 0;
+  // startCursor is left undefined when not given so a consumer checkpoint can
+  // supply the resume position.
+  Napi::Value startCursor = env.Undefined();
+  Napi::Value consumer = env.Undefined();
+  uint32_t checkpointEvery = 1;
+  bool flushCheckpoints = false;
+  bool critical = false;
+  Napi::Value snapshotEnd = env.Undefined();
+  Napi::Value snapshotMessages = env.Undefined();
   if (info.Length() >= 1 && info[0].IsObject()) {
     Napi::Object options = info[0].As<Napi::Object>();
-    if (options.Has("startCursor")) {
+    if (options.Has("startCursor") && !options.Get("startCursor").IsUndefined()) {
       Napi::Value cursorValue = options.Get("startCursor");
       if (!cursorValue.IsBigInt()) {
         Napi::TypeError::New(env, "startCursor must be a BigInt").ThrowAsJavaScriptException();
         return env.Null();
       }
       bool lossless = false;
-      startCursor = cursorValue.As<Napi::BigInt>().Uint64Value(&lossless);
+      cursorValue.As<Napi::BigInt>().Uint64Value(&lossless);
       if (!lossless) {
         Napi::TypeError::New(env, "startCursor must fit into uint64").ThrowAsJavaScriptException();
         return env.Null();
       }
+      startCursor = cursorValue;
+    }
+    if (options.Has("consumer") && !options.Get("consumer").IsUndefined()) {
+      consumer = options.Get("consumer");
+      if (!consumer.IsString()
+          || !shmio::CursorCheckpoint::IsValidConsumerName(consumer.As<Napi::String>().Utf8Value())) {
+        Napi::TypeError::New(env, "consumer must be 1-64 characters of [A-Za-z0-9_.-] not starting with '.'").ThrowAsJavaScriptException();
+        return env.Null();
+      }
+      // The checkpoint is a sidecar file next to the log.
+      if (path_.empty()) {
+        Napi::TypeError::New(env, "consumer checkpoints need a log opened by path").ThrowAsJavaScriptException();
+        return env.Null();
+      }
+    }
+    if (options.Has("checkpointEvery") && !options.Get("checkpointEvery").IsUndefined()) {
+      Napi::Value everyValue = options.Get("checkpointEvery");
+      double every = everyValue.IsNumber() ? everyValue.As<Napi::Number>().DoubleValue() : 0;
+      if (every < 1 || every > std::numeric_limits<uint32_t>::max()) {
+        Napi::RangeError::New(env, "checkpointEvery must be a positive number of frames").ThrowAsJavaScriptException();
+        return env.Null();
+      }
+      checkpointEvery = static_cast<uint32_t>(every);
+    }
+    if (options.Has("flushCheckpoints")) {
+      flushCheckpoints = options.Get("flushCheckpoints").ToBoolean().Value();
+    }
+    if (options.Has("critical")) {
+      critical = options.Get("critical").ToBoolean().Value();
+    }
+    if (options.Has("snapshot") && !options.Get("snapshot").IsUndefined()) {
+      Napi::Value snapshotValue = options.Get("snapshot");
+      Napi::Value endValue = snapshotValue.IsObject() ? snapshotValue.As<Napi::Object>().Get("endCursor") : env.Undefined();
+      if (!endValue.IsBigInt()) {
+        Napi::TypeError::New(env, "snapshot must come from snapshot()").ThrowAsJavaScriptException();
+        return env.Null();
+      }
+      bool lossless = false;
+      uint64_t end = endValue.As<Napi::BigInt>().Uint64Value(&lossless);
+      uint64_t committed = LoadCommittedSize();
+      if (!lossless || end > (committed > dataOffset_ ? committed - dataOffset_ : 0)) {
+        Napi::RangeError::New(env, "snapshot ends beyond the committed size").ThrowAsJavaScriptException();
+        return env.Null();
+      }
+      snapshotEnd = endValue;
+      Napi::Value messagesValue = snapshotValue.As<Napi::Object>().Get("messages");
+      if (messagesValue.IsBigInt()) {
+        snapshotMessages = messagesValue;
+      }
     }
   } else if (info.Length() >= 1 && !info[0].IsUndefined() && !info[0].IsNull()) {
     Napi::TypeError::New(env, "createIterator options must be an object").ThrowAsJavaScriptException();
@@ -280,7 +958,13 @@ Napi::Value ShmMapping::CreateIterator(const Napi::CallbackInfo& info) {
   Napi::Object iterator = ShmIterator::constructor_.New({
     external,
     self,
-    Napi::BigInt::New(env, startCursor),
+    startCursor,
+    consumer,
+    Napi::Number::New(env, checkpointEvery),
+    Napi::Boolean::New(env, flushCheckpoints),
+    Napi::Boolean::New(env, critical),
+    snapshotEnd,
+    snapshotMessages,
   });
 
   return iterator;
@@ -296,11 +980,29 @@ Napi::Value ShmMapping::CreateWriter(const Napi::CallbackInfo& info) {
   }
 
   bool debugChecks = debugChecks_;
+  std::string backpressure = "overwrite";
+  double maxBlockNs = 1e7;
   if (info.Length() >= 1 && info[0].IsObject()) {
     Napi::Object options = info[0].As<Napi::Object>();
     if (options.Has("debugChecks")) {
       debugChecks = options.Get("debugChecks").ToBoolean().Value();
     }
+    if (options.Has("backpressure") && !options.Get("backpressure").IsUndefined()) {
+      Napi::Value policy = options.Get("backpressure");
+      backpressure = policy.IsString() ? policy.As<Napi::String>().Utf8Value() : "";
+      if (backpressure != "overwrite" && backpressure != "fail" && backpressure != "block") {
+        Napi::TypeError::New(env, "backpressure must be 'overwrite', 'fail' or 'block'").ThrowAsJavaScriptException();
+        return env.Null();
+      }
+    }
+    if (options.Has("maxBlockNs") && !options.Get("maxBlockNs").IsUndefined()) {
+      Napi::Value value = options.Get("maxBlockNs");
+      maxBlockNs = value.IsNumber() ? value.As<Napi::Number>().DoubleValue() : -1;
+      if (!(maxBlockNs >= 0) || maxBlockNs > 9007199254740992.0) {
+        Napi::RangeError::New(env, "maxBlockNs must be a number between 0 and 2^53").ThrowAsJavaScriptException();
+        return env.Null();
+      }
+    }
   } else if (info.Length() >= 1 && !info[0].IsUndefined() && !info[0].IsNull()) {
     Napi::TypeError::New(env, "createWriter options must be an object").ThrowAsJavaScriptException();
     return env.Null();
@@ -312,36 +1014,112 @@ Napi::Value ShmMapping::CreateWriter(const Napi::CallbackInfo& info) {
     external,
     self,
     Napi::Boolean::New(env, debugChecks),
+    Napi::String::New(env, backpressure),
+    Napi::Number::New(env, maxBlockNs),
   });
 
   return writer;
 }
 
+Napi::Value ShmMapping::CountFrames(const Napi::CallbackInfo& info) {
+  return ShmScanner::Queue(info, this, ScanMode::Count);
+}
+
+Napi::Value ShmMapping::Validate(const Napi::CallbackInfo& info) {
+  return ShmScanner::Queue(info, this, ScanMode::Validate);
+}
+
+Napi::Value ShmMapping::FindLast(const Napi::CallbackInfo& info) {
+  return ShmScanner::Queue(info, this, ScanMode::FindLast);
+}
+
+Napi::Value ShmMapping::ScanRange(const Napi::CallbackInfo& info) {
+  return ShmScanner::Queue(info, this, ScanMode::Range);
+}
+
 void ShmMapping::Close(const Napi::CallbackInfo& info) {
   Cleanup();
 }
 
+void ShmMapping::EndScan() {
+  if (--scansInFlight_ == 0 && closed_) {
+    ReleaseMapping();
+  }
+}
+
 void ShmMapping::Cleanup() {
   if (closed_) {
     return;
   }
 
   closed_ = true;
+  ReleaseReaderSlots();
+  readerSlots_ = shmio::ReaderSlots();
+  if (readerHeader_ != nullptr) {
+    munmap(readerHeader_, readerHeaderLength_);
+    readerHeader_ = nullptr;
+    readerHeaderLength_ = 0;
+  }
+
+  if (scansInFlight_ == 0) {
+    ReleaseMapping();
+  }
 
-  if (base_ != nullptr && length_ > 0) {
-    munmap(base_, length_);
+  if (!mappingBufferRef_.IsEmpty()) {
+    mappingBufferRef_.Reset();
+  }
+
+  commitSequence_ = nullptr;
+  committedMessagesAtomic_ = nullptr;
+  commitGeneration_ = nullptr;
+}
+
+void ShmMapping::ReleaseMapping() {
+  if (base_ != nullptr && reservedLength_ > 0) {
+    munmap(base_, reservedLength_);
     base_ = nullptr;
     length_ = 0;
+    reservedLength_ = 0;
   }
 
   if (fd_ >= 0) {
     close(fd_);
     fd_ = -1;
   }
+}
+
+bool ShmMapping::ParseUint64Option(Napi::Env env, const Napi::Object& opts, const char* name, uint64_t* out) {
+  if (!opts.Has(name)) {
+    return true;
+  }
 
-  if (!mappingBufferRef_.IsEmpty()) {
-    mappingBufferRef_.Reset();
+  Napi::Value value = opts.Get(name);
+  if (value.IsUndefined() || value.IsNull()) {
+    return true;
   }
+
+  if (value.IsBigInt()) {
+    bool lossless = false;
+    *out = value.As<Napi::BigInt>().Uint64Value(&lossless);
+    if (!lossless) {
+      Napi::TypeError::New(env, std::string(name) + " must fit into uint64").ThrowAsJavaScriptException();
+      return false;
+    }
+    return true;
+  }
+
+  if (value.IsNumber()) {
+    double number = value.As<Napi::Number>().DoubleValue();
+    if (number < 0) {
+      Napi::TypeError::New(env, std::string(name) + " must not be negative").ThrowAsJavaScriptException();
+      return false;
+    }
+    *out = static_cast<uint64_t>(number);
+    return true;
+  }
+
+  Napi::TypeError::New(env, std::string("options.") + name + " must be a number or bigint").ThrowAsJavaScriptException();
+  return false;
 }
 
 uint64_t ShmMapping::ReadUint64LE(const uint8_t* data) {
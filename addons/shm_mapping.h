@@ -5,6 +5,8 @@
 #include <napi.h>
 #include <string>
 
+#include "shm_readers.h"
+
 class ShmIterator;
 class ShmWriter;
 
@@ -21,34 +23,122 @@ public:
   size_t length() const { return length_; }
   uint64_t headerSize() const { return headerSize_; }
   uint64_t dataOffset() const { return dataOffset_; }
+  uint64_t ringBytes() const { return ringBytes_; }
   std::atomic<uint64_t>* committedSizeAtomic() const { return committedSizeAtomic_; }
+  const std::atomic<uint64_t>* capacityAtomic() const { return capacityAtomic_; }
+  // Null for v1 headers, which do not count messages.
+  const std::atomic<uint64_t>* committedMessagesAtomic() const { return committedMessagesAtomic_; }
+  uint32_t frameSequenceBytes() const { return frameSequenceBytes_; }
   bool writable() const { return writable_; }
+  bool closed() const { return closed_; }
   bool debugChecks() const { return debugChecks_; }
+  int fd() const { return fd_; }
+  // True when the file cannot shrink (a sealed memfd), so the mapping can
+  // never lose pages under a reader.
+  bool sealed() const { return sealed_; }
+  // Empty for logs opened from a descriptor or created as a memfd.
+  const std::string& path() const { return path_; }
+
+  // Translates an absolute log position into the mapping. Ring logs wrap
+  // positions into the mirrored data region; the returned pointer is valid
+  // for up to ringBytes() contiguous bytes.
+  uint8_t* DataPtr(uint64_t absolute) const {
+    if (ringBytes_ == 0) {
+      return base_ + absolute;
+    }
+    return base_ + dataOffset_ + (absolute - dataOffset_) % ringBytes_;
+  }
 
   uint64_t LoadCommittedSize() const;
-  void StoreCommittedSize(uint64_t value);
+  uint64_t LoadCommittedMessages() const;
+  // Publishes the message count and then the committed size.
+  void StoreCommittedSize(uint64_t value, uint64_t committedMessages);
+  // Wakes waitForCommit() callers in every process that maps the log. One
+  // futex syscall per commit.
+  void NotifyCommitWaiters();
+
+  // Writer side: extends the file and the mapping so that at least
+  // requiredLength bytes are addressable. Returns false when the log is not
+  // growable or the maximum capacity would be exceeded.
+  bool Grow(Napi::Env env, uint64_t requiredLength);
+  // Reader side: maps space added by the writer since this mapping was
+  // opened. Returns false (with errno set) when the new space cannot be mapped.
+  bool RefreshLength();
 
   void EnsureOpen(Napi::Env env) const;
 
+  // External ArrayBuffer over the data region of the mapping. Frames are
+  // returned as Buffer views of it (shm_buffer_views.h) rather than as
+  // Buffers with a backing store each. Replaced after the mapping grows.
+  Napi::ArrayBuffer MappingArrayBuffer(Napi::Env env);
+
+  // Reader slots of a ring log (shm_readers.h). Read-only mappings map the
+  // header page writable on their first claim. ClaimReaderSlot returns -1
+  // with errno set: ENOSPC when every slot is taken. Slots still held when
+  // the mapping closes are released with it.
+  int ClaimReaderSlot(uint64_t cursor);
+  void ReleaseReaderSlot(int slot);
+  shmio::ReaderSlots& readerSlots() { return readerSlots_; }
+
+  // Async scans read the mapping off the JS thread. While any is queued,
+  // close() only marks the mapping closed; the pages and the descriptor are
+  // released when the last scan ends.
+  void BeginScan() { ++scansInFlight_; }
+  void EndScan();
+
 private:
   Napi::Value HeaderView(const Napi::CallbackInfo& info);
+  Napi::Value AtomicHeaderView(const Napi::CallbackInfo& info);
+  Napi::Value WaitForCommit(const Napi::CallbackInfo& info);
   Napi::Value CreateIterator(const Napi::CallbackInfo& info);
   Napi::Value CreateWriter(const Napi::CallbackInfo& info);
+  Napi::Value CapacityBytes(const Napi::CallbackInfo& info);
+  Napi::Value Fd(const Napi::CallbackInfo& info);
+  Napi::Value Sealed(const Napi::CallbackInfo& info);
+  Napi::Value Snapshot(const Napi::CallbackInfo& info);
+  Napi::Value CountFrames(const Napi::CallbackInfo& info);
+  Napi::Value Validate(const Napi::CallbackInfo& info);
+  Napi::Value FindLast(const Napi::CallbackInfo& info);
+  Napi::Value ScanRange(const Napi::CallbackInfo& info);
   void Close(const Napi::CallbackInfo& info);
 
   void Cleanup();
+  void ReleaseMapping();
+
+  bool MapRange(size_t offset, size_t length);
+  bool MapReaderSection();
+  void ReleaseReaderSlots();
 
+  static bool ParseUint64Option(Napi::Env env, const Napi::Object& opts, const char* name, uint64_t* out);
   static uint64_t ReadUint64LE(const uint8_t* data);
   static void WriteUint64LE(uint8_t* data, uint64_t value);
 
   uint8_t* base_ { nullptr };
   size_t length_ { 0 };
+  size_t reservedLength_ { 0 };
+  uint64_t growthStep_ { 0 };
+  uint64_t ringBytes_ { 0 };
   bool writable_ { false };
   bool debugChecks_ { false };
   bool closed_ { false };
+  bool sealed_ { false };
+  uint32_t scansInFlight_ { 0 };
   int fd_ { -1 };
+  std::string path_;
   uint64_t headerSize_ { 0 };
   uint64_t dataOffset_ { 0 };
   std::atomic<uint64_t>* committedSizeAtomic_ { nullptr };
-  Napi::Reference<Napi::Buffer<uint8_t>> mappingBufferRef_;
+  std::atomic<uint64_t>* capacityAtomic_ { nullptr };
+  std::atomic<uint64_t> fixedCapacity_ { 0 };
+  std::atomic<uint32_t>* commitSequence_ { nullptr };
+  std::atomic<uint64_t>* committedMessagesAtomic_ { nullptr };
+  std::atomic<uint32_t>* commitGeneration_ { nullptr };
+  uint32_t frameSequenceBytes_ { 0 };
+  shmio::ReaderSlots readerSlots_;
+  // Writable header page mapped for the reader slots of a read-only mapping.
+  uint8_t* readerHeader_ { nullptr };
+  size_t readerHeaderLength_ { 0 };
+  uint32_t claimedReaderSlots_ { 0 };
+  Napi::Reference<Napi::ArrayBuffer> mappingBufferRef_;
+  size_t mappingBufferLength_ { 0 };
 };
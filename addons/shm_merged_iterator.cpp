@@ -0,0 +1,224 @@
+#include "shm_merged_iterator.h"
+
+#include <limits>
+#include <optional>
+#include <string>
+
+#include "shm_buffer_views.h"
+#include "shm_format.h"
+
+namespace {
+constexpr uint32_t kTimestampBytes = sizeof(uint64_t);
+
+[[noreturn]] void ThrowWithCode(Napi::Env env, const std::string& message, const char* code) {
+  Napi::Error err = Napi::Error::New(env, message);
+  err.Set("code", Napi::String::New(env, code));
+  throw err;
+}
+}
+
+void ShmMergedIterator::Init(Napi::Env env, Napi::Object exports) {
+  Napi::Function func = DefineClass(env, "MergedIterator", {
+    InstanceMethod<&ShmMergedIterator::Next>("next"),
+    InstanceMethod<&ShmMergedIterator::NextBatch>("nextBatch"),
+    InstanceMethod<&ShmMergedIterator::Close>("close"),
+  });
+
+  exports.Set("MergedIterator", func);
+}
+
+ShmMergedIterator::ShmMergedIterator(const Napi::CallbackInfo& info)
+  : Napi::ObjectWrap<ShmMergedIterator>(info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 2 || !info[0].IsArray() || !info[1].IsObject()) {
+    Napi::TypeError::New(env, "MergedIterator expects (iterators, { timestampOffset })").ThrowAsJavaScriptException();
+    return;
+  }
+
+  Napi::Array iterators = info[0].As<Napi::Array>();
+  if (iterators.Length() == 0) {
+    Napi::RangeError::New(env, "MergedIterator needs at least one iterator").ThrowAsJavaScriptException();
+    return;
+  }
+
+  Napi::Object options = info[1].As<Napi::Object>();
+  Napi::Value offsetValue = options.Get("timestampOffset");
+  double offset = offsetValue.IsNumber() ? offsetValue.As<Napi::Number>().DoubleValue() : -1;
+  if (offset < 0 || offset + kTimestampBytes > shmio::kMaxPayloadBytes || offset != static_cast<uint32_t>(offset)) {
+    Napi::RangeError::New(env, "timestampOffset must be a payload offset that leaves room for a u64")
+      .ThrowAsJavaScriptException();
+    return;
+  }
+  timestampOffset_ = static_cast<uint32_t>(offset);
+  waitForAll_ = options.Get("waitForAll").ToBoolean().Value();
+  debugChecks_ = options.Get("debugChecks").ToBoolean().Value();
+
+  Napi::Function iteratorClass = ShmIterator::constructor_.Value();
+  sources_.resize(iterators.Length());
+  for (uint32_t i = 0; i < iterators.Length(); ++i) {
+    Napi::Value value = iterators.Get(i);
+    if (!value.IsObject() || !value.As<Napi::Object>().InstanceOf(iteratorClass)) {
+      Napi::TypeError::New(env, "MergedIterator sources must be ShmIterators").ThrowAsJavaScriptException();
+      sources_.clear();
+      return;
+    }
+    Napi::Object object = value.As<Napi::Object>();
+    for (uint32_t j = 0; j < i; ++j) {
+      if (sources_[j].ref.Value().StrictEquals(object)) {
+        Napi::TypeError::New(env, "MergedIterator sources must be distinct").ThrowAsJavaScriptException();
+        sources_.clear();
+        return;
+      }
+    }
+    sources_[i].iterator = ShmIterator::Unwrap(object);
+    sources_[i].ref = Napi::Persistent(object);
+  }
+}
+
+Napi::Value ShmMergedIterator::Next(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  EnsureOpen(env);
+
+  ShmIterator::BatchOptions options { 1u, std::numeric_limits<uint32_t>::max(), debugChecks_ };
+  std::vector<ShmIterator::BatchResult::FrameSlice> frames;
+  std::vector<uint32_t> sources;
+  Merge(env, options, &frames, &sources);
+  if (frames.empty()) {
+    return env.Null();
+  }
+
+  Napi::Object result = Napi::Object::New(env);
+  ShmIterator* source = sources_[sources[0]].iterator;
+  result.Set("frame", shmio::BufferViews(env, source->FrameArrayBuffer(env)).View(frames[0].ptr, frames[0].length));
+  result.Set("source", Napi::Number::New(env, sources[0]));
+  return result;
+}
+
+Napi::Value ShmMergedIterator::NextBatch(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  EnsureOpen(env);
+
+  ShmIterator::BatchOptions options { 64u, 256u * 1024u, debugChecks_ };
+  if (info.Length() >= 1 && info[0].IsObject()) {
+    options = sources_.front().iterator->ParseOptions(env, info[0].As<Napi::Object>());
+    options.debugChecks = options.debugChecks || debugChecks_;
+  } else if (info.Length() >= 1 && !info[0].IsUndefined() && !info[0].IsNull()) {
+    ThrowWithCode(env, "nextBatch options must be an object", "ERR_SHM_CURSOR");
+  }
+
+  std::vector<ShmIterator::BatchResult::FrameSlice> frames;
+  std::vector<uint32_t> sources;
+  Merge(env, options, &frames, &sources);
+
+  Napi::Array output = Napi::Array::New(env, frames.size());
+  Napi::Uint32Array sourceIndexes = Napi::Uint32Array::New(env, sources.size(), napi_uint32_array);
+  // One view factory per source that contributed to the batch.
+  std::vector<std::optional<shmio::BufferViews>> views(sources_.size());
+  for (size_t i = 0; i < frames.size(); ++i) {
+    std::optional<shmio::BufferViews>& sourceViews = views[sources[i]];
+    if (!sourceViews) {
+      sourceViews.emplace(env, sources_[sources[i]].iterator->FrameArrayBuffer(env));
+    }
+    output.Set(i, sourceViews->View(frames[i].ptr, frames[i].length));
+    sourceIndexes[i] = sources[i];
+  }
+
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("frames", output);
+  result.Set("sources", sourceIndexes);
+  return result;
+}
+
+void ShmMergedIterator::Close(const Napi::CallbackInfo& info) {
+  // Lookahead frames were never consumed, so the sources resume at them.
+  closed_ = true;
+  sources_.clear();
+}
+
+void ShmMergedIterator::Merge(Napi::Env env, const ShmIterator::BatchOptions& options,
+    std::vector<ShmIterator::BatchResult::FrameSlice>* frames, std::vector<uint32_t>* sources) {
+  uint32_t count = static_cast<uint32_t>(sources_.size());
+  bool allReady = true;
+  for (uint32_t i = 0; i < count; ++i) {
+    // Checkpoints only cover frames returned by earlier calls.
+    sources_[i].iterator->EnsureOpen(env);
+    sources_[i].iterator->MaybeCheckpoint(env);
+    sources_[i].iterator->PublishCursor();
+    if (!HasHead(i) && !Peek(env, i, options.debugChecks)) {
+      allReady = false;
+    }
+  }
+  if (waitForAll_ && !allReady) {
+    return;
+  }
+
+  // Sources without a frame sort last; ties go to the lower source index.
+  auto less = [this](size_t a, size_t b) {
+    bool aReady = HasHead(static_cast<uint32_t>(a));
+    bool bReady = HasHead(static_cast<uint32_t>(b));
+    if (!aReady || !bReady) {
+      return aReady;
+    }
+    uint64_t aTimestamp = sources_[a].timestamp;
+    uint64_t bTimestamp = sources_[b].timestamp;
+    return aTimestamp != bTimestamp ? aTimestamp < bTimestamp : a < b;
+  };
+  tree_.Build(count, less);
+
+  uint64_t accumulatedBytes = 0;
+  while (frames->size() < options.maxMessages) {
+    uint32_t winner = static_cast<uint32_t>(tree_.Winner());
+    if (!HasHead(winner)) {
+      break;
+    }
+    Source& source = sources_[winner];
+    if (accumulatedBytes + source.head.consumedBytes > options.maxBytes) {
+      break;
+    }
+
+    ShmIterator* iterator = source.iterator;
+    if (iterator->ringBytes_ != 0) {
+      // The lookahead may have been overwritten since it was read.
+      iterator->EnsureNotLapped(env);
+    }
+    frames->push_back(source.head.frames.front());
+    sources->push_back(winner);
+    accumulatedBytes += source.head.consumedBytes;
+    iterator->Consume(source.head);
+    source.head.frames.clear();
+
+    bool refilled = Peek(env, winner, options.debugChecks);
+    tree_.Replay(less);
+    // A source that ran dry might commit an earlier timestamp next.
+    if (!refilled && waitForAll_) {
+      break;
+    }
+  }
+}
+
+bool ShmMergedIterator::Peek(Napi::Env env, uint32_t index, bool debugChecks) {
+  Source& source = sources_[index];
+  source.iterator->EnsureNoTransferInFlight(env);
+
+  ShmIterator::BatchOptions options { 1u, std::numeric_limits<uint32_t>::max(), debugChecks };
+  source.head = source.iterator->CollectFrames(env, options);
+  if (source.head.frames.empty()) {
+    return false;
+  }
+
+  const auto& slice = source.head.frames.front();
+  if (slice.length < timestampOffset_ + kTimestampBytes) {
+    source.head.frames.clear();
+    ThrowWithCode(env, "Frame of source " + std::to_string(index) + " is too short for the timestamp",
+      "ERR_SHM_FRAME_CORRUPT");
+  }
+  source.timestamp = shmio::ReadUint64LE(slice.ptr + timestampOffset_);
+  return true;
+}
+
+void ShmMergedIterator::EnsureOpen(Napi::Env env) const {
+  if (closed_) {
+    ThrowWithCode(env, "MergedIterator is closed", "ERR_SHM_ITERATOR_CLOSED");
+  }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <napi.h>
+#include <cstdint>
+#include <vector>
+
+#include "shm_iterator.h"
+#include "shm_loser_tree.h"
+
+// Merges several ShmIterators into one stream ordered by a u64 little-endian
+// timestamp at a fixed payload offset. Each source keeps a one-frame
+// lookahead that is only consumed once the frame has been returned, so the
+// sources' cursors and checkpoints never run ahead of the merged output.
+// Sources belong to the merged iterator while it is open.
+class ShmMergedIterator : public Napi::ObjectWrap<ShmMergedIterator> {
+public:
+  static void Init(Napi::Env env, Napi::Object exports);
+  ShmMergedIterator(const Napi::CallbackInfo& info);
+
+private:
+  struct Source {
+    ShmIterator* iterator { nullptr };
+    Napi::ObjectReference ref;
+    // Next frame of the source; empty frames mean nothing is committed.
+    ShmIterator::BatchResult head;
+    uint64_t timestamp { 0 };
+  };
+
+  Napi::Value Next(const Napi::CallbackInfo& info);
+  Napi::Value NextBatch(const Napi::CallbackInfo& info);
+  void Close(const Napi::CallbackInfo& info);
+
+  // Collects frames in timestamp order, within the batch limits, together
+  // with the index of the source each came from.
+  void Merge(Napi::Env env, const ShmIterator::BatchOptions& options,
+    std::vector<ShmIterator::BatchResult::FrameSlice>* frames, std::vector<uint32_t>* sources);
+  // Reads the next frame of a source into its lookahead without consuming it.
+  bool Peek(Napi::Env env, uint32_t index, bool debugChecks);
+  bool HasHead(uint32_t index) const { return !sources_[index].head.frames.empty(); }
+  void EnsureOpen(Napi::Env env) const;
+
+  std::vector<Source> sources_;
+  shmio::LoserTree tree_;
+  uint32_t timestampOffset_ { 0 };
+  bool waitForAll_ { false };
+  bool debugChecks_ { false };
+  bool closed_ { false };
+};
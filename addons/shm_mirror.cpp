@@ -0,0 +1,39 @@
+#include "shm_mirror.h"
+
+#include <errno.h>
+#include <sys/mman.h>
+
+namespace shmio {
+
+uint8_t* MapMirrored(int fd, size_t dataOffset, size_t ringBytes, int protection, int flags) {
+  // Private views would be two copies, not one region seen twice.
+  if ((flags & MAP_SHARED) == 0) {
+    errno = EINVAL;
+    return nullptr;
+  }
+  size_t totalLength = MirroredLength(dataOffset, ringBytes);
+
+  // Reserve the whole window first so both views land back to back and no
+  // other mapping can slip in between them.
+  void* reserved = mmap(nullptr, totalLength, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (reserved == MAP_FAILED) {
+    return nullptr;
+  }
+
+  uint8_t* base = static_cast<uint8_t*>(reserved);
+  void* primary = mmap(base, dataOffset + ringBytes, protection, flags | MAP_FIXED, fd, 0);
+  void* mirror = primary == MAP_FAILED
+    ? MAP_FAILED
+    : mmap(base + dataOffset + ringBytes, ringBytes, protection, flags | MAP_FIXED, fd, static_cast<off_t>(dataOffset));
+
+  if (mirror == MAP_FAILED) {
+    int mapErrno = errno;
+    munmap(reserved, totalLength);
+    errno = mapErrno;
+    return nullptr;
+  }
+
+  return base;
+}
+
+} // namespace shmio
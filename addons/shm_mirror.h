@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <sys/mman.h>
+
+namespace shmio {
+
+// Length of the address range used by a mirrored mapping: the header pages,
+// the ring data region and a second view of the ring data region.
+inline size_t MirroredLength(size_t dataOffset, size_t ringBytes) {
+  return dataOffset + 2 * ringBytes;
+}
+
+// Maps [0, dataOffset + ringBytes) of fd and maps the data region
+// [dataOffset, dataOffset + ringBytes) a second time directly behind it, so
+// any range of up to ringBytes starting inside the ring is contiguous in
+// memory. dataOffset and ringBytes must be page aligned. `flags` are passed to
+// both views (MAP_FIXED is added) and must include MAP_SHARED. Returns nullptr
+// with errno set on failure; release with munmap(base, MirroredLength(...)).
+uint8_t* MapMirrored(int fd, size_t dataOffset, size_t ringBytes, int protection, int flags = MAP_SHARED);
+
+} // namespace shmio
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <napi.h>
+
+#include <cstdint>
+#include <string>
+
+// Option parsing shared by the functions that take plain option objects
+// (scanRange, archiveLog, compressLog, compactLog).
+namespace shmio {
+
+constexpr double kTwoToThe64 = 18446744073709551616.0;
+
+// Reads options[name] as a uint64 from a bigint or a non-negative number.
+// Leaves *out alone when the option is undefined or null. Otherwise sets
+// *present, if given. Throws a TypeError into JS and returns false when the
+// value has the wrong type or does not fit.
+inline bool ParseCursorOption(Napi::Env env, const Napi::Object& opts, const char* name, uint64_t* out, bool* present = nullptr) {
+  Napi::Value value = opts.Get(name);
+  if (value.IsUndefined() || value.IsNull()) {
+    return true;
+  }
+  if (value.IsBigInt()) {
+    bool lossless = false;
+    *out = value.As<Napi::BigInt>().Uint64Value(&lossless);
+    if (!lossless) {
+      Napi::TypeError::New(env, std::string("options.") + name + " must fit into uint64").ThrowAsJavaScriptException();
+      return false;
+    }
+  } else if (value.IsNumber() && value.As<Napi::Number>().DoubleValue() >= 0
+      && value.As<Napi::Number>().DoubleValue() < kTwoToThe64) {
+    *out = static_cast<uint64_t>(value.As<Napi::Number>().DoubleValue());
+  } else {
+    Napi::TypeError::New(env, std::string("options.") + name + " must be a non-negative number or bigint").ThrowAsJavaScriptException();
+    return false;
+  }
+  if (present != nullptr) {
+    *present = true;
+  }
+  return true;
+}
+
+} // namespace shmio
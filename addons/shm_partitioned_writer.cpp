@@ -0,0 +1,211 @@
+#include "shm_partitioned_writer.h"
+
+#include <cstring>
+#include <limits>
+#include <string>
+
+#include "shm_format.h"
+#include "shm_writer.h"
+
+void ShmPartitionedWriter::Init(Napi::Env env, Napi::Object exports) {
+  Napi::Function func = DefineClass(env, "PartitionedWriter", {
+    InstanceMethod<&ShmPartitionedWriter::PartitionFor>("partitionFor"),
+    InstanceMethod<&ShmPartitionedWriter::Append>("append"),
+    InstanceMethod<&ShmPartitionedWriter::Allocate>("allocate"),
+    InstanceMethod<&ShmPartitionedWriter::Commit>("commit"),
+    InstanceMethod<&ShmPartitionedWriter::Abort>("abort"),
+    InstanceMethod<&ShmPartitionedWriter::Close>("close"),
+  });
+
+  exports.Set("PartitionedWriter", func);
+}
+
+ShmPartitionedWriter::ShmPartitionedWriter(const Napi::CallbackInfo& info)
+  : Napi::ObjectWrap<ShmPartitionedWriter>(info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 2 || !info[0].IsArray() || !info[1].IsObject()) {
+    Napi::TypeError::New(env, "PartitionedWriter expects (writers, { keyOffset, keyLength })").ThrowAsJavaScriptException();
+    return;
+  }
+
+  Napi::Array writers = info[0].As<Napi::Array>();
+  if (writers.Length() == 0) {
+    Napi::RangeError::New(env, "PartitionedWriter needs at least one writer").ThrowAsJavaScriptException();
+    return;
+  }
+
+  Napi::Object options = info[1].As<Napi::Object>();
+  Napi::Value offsetValue = options.Get("keyOffset");
+  Napi::Value lengthValue = options.Get("keyLength");
+  double offset = offsetValue.IsNumber() ? offsetValue.As<Napi::Number>().DoubleValue() : -1;
+  double length = lengthValue.IsNumber() ? lengthValue.As<Napi::Number>().DoubleValue() : 0;
+  if (offset < 0 || length < 1 || offset + length > shmio::kMaxPayloadBytes
+      || offset != static_cast<uint32_t>(offset) || length != static_cast<uint32_t>(length)) {
+    Napi::RangeError::New(env, "keyOffset and keyLength must describe a non-empty payload range").ThrowAsJavaScriptException();
+    return;
+  }
+  keyOffset_ = static_cast<uint32_t>(offset);
+  keyLength_ = static_cast<uint32_t>(length);
+
+  Napi::Function writerClass = ShmWriter::constructor_.Value();
+  partitions_.resize(writers.Length());
+  for (uint32_t i = 0; i < writers.Length(); ++i) {
+    Napi::Value value = writers.Get(i);
+    if (!value.IsObject() || !value.As<Napi::Object>().InstanceOf(writerClass)) {
+      Napi::TypeError::New(env, "PartitionedWriter partitions must be ShmWriters").ThrowAsJavaScriptException();
+      partitions_.clear();
+      return;
+    }
+    Napi::Object object = value.As<Napi::Object>();
+    ShmWriter* writer = ShmWriter::Unwrap(object);
+    for (uint32_t j = 0; j < i; ++j) {
+      if (partitions_[j].writer == writer || partitions_[j].writer->SharesMapping(*writer)) {
+        Napi::TypeError::New(env, "PartitionedWriter partitions must be distinct logs").ThrowAsJavaScriptException();
+        partitions_.clear();
+        return;
+      }
+    }
+    partitions_[i].writer = writer;
+    partitions_[i].ref = Napi::Persistent(object);
+  }
+}
+
+Napi::Value ShmPartitionedWriter::PartitionFor(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (!EnsureOpen(env)) {
+    return env.Null();
+  }
+  int64_t partition = KeyPartition(env, info.Length() >= 1 ? info[0] : env.Undefined());
+  if (partition < 0) {
+    return env.Null();
+  }
+  return Napi::Number::New(env, static_cast<double>(partition));
+}
+
+Napi::Value ShmPartitionedWriter::Append(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (!EnsureOpen(env)) {
+    return env.Null();
+  }
+
+  if (info.Length() < 1 || !info[0].IsBuffer()) {
+    Napi::TypeError::New(env, "append(payload) expects a Buffer").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  Napi::Buffer<uint8_t> payload = info[0].As<Napi::Buffer<uint8_t>>();
+  if (payload.Length() < static_cast<size_t>(keyOffset_) + keyLength_) {
+    Napi::RangeError::New(env, "payload is too short to contain the partition key").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  if (payload.Length() > shmio::kMaxPayloadBytes) {
+    Napi::RangeError::New(env, "payload size must be <= " + std::to_string(shmio::kMaxPayloadBytes)).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  uint32_t alignment = 1;
+  if (info.Length() >= 2 && !ShmWriter::ParseAlignment(env, info[1], &alignment)) {
+    return env.Null();
+  }
+
+  uint32_t partition = shmio::PartitionForKey(payload.Data() + keyOffset_, keyLength_,
+    static_cast<uint32_t>(partitions_.size()));
+  ShmWriter* writer = partitions_[partition].writer;
+  writer->EnsureOpen(env);
+  if (env.IsExceptionPending()) {
+    return env.Null();
+  }
+  uint8_t* target = writer->AllocateFrame(env, static_cast<uint32_t>(payload.Length()), alignment);
+  if (target == nullptr) {
+    return env.Null();
+  }
+  std::memcpy(target, payload.Data(), payload.Length());
+  return Napi::Number::New(env, partition);
+}
+
+Napi::Value ShmPartitionedWriter::Allocate(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (!EnsureOpen(env)) {
+    return env.Null();
+  }
+
+  int64_t partition = KeyPartition(env, info.Length() >= 1 ? info[0] : env.Undefined());
+  if (partition < 0) {
+    return env.Null();
+  }
+  ShmWriter* writer = partitions_[static_cast<size_t>(partition)].writer;
+  writer->EnsureOpen(env);
+
+  uint32_t payloadSize = 0;
+  uint32_t alignment = 1;
+  if (!writer->ParseAllocation(env, info, 1, &payloadSize, &alignment)) {
+    return env.Null();
+  }
+  if (payloadSize < keyOffset_ + keyLength_) {
+    Napi::RangeError::New(env, "allocate size is too small to contain the partition key").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  uint8_t* target = writer->AllocateFrame(env, payloadSize, alignment);
+  if (target == nullptr) {
+    return env.Null();
+  }
+  // The key is written up front so the frame always matches its partition.
+  Napi::Buffer<uint8_t> key = info[0].As<Napi::Buffer<uint8_t>>();
+  std::memcpy(target + keyOffset_, key.Data(), keyLength_);
+  return writer->PayloadView(env, target, payloadSize);
+}
+
+void ShmPartitionedWriter::Commit(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (!EnsureOpen(env)) {
+    return;
+  }
+  // Not atomic across partitions: each partition publishes its frames
+  // atomically, one after another, so a reader of several partitions can see
+  // one partition's share of the batch before another's. A writer that fails
+  // or dies part way leaves the earlier partitions committed.
+  for (Partition& partition : partitions_) {
+    ShmWriter* writer = partition.writer;
+    writer->EnsureOpen(env);
+    if (env.IsExceptionPending()) {
+      return;
+    }
+    writer->CommitPending(env);
+  }
+}
+
+void ShmPartitionedWriter::Abort(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (!EnsureOpen(env)) {
+    return;
+  }
+  for (Partition& partition : partitions_) {
+    partition.writer->AbortPending();
+  }
+}
+
+void ShmPartitionedWriter::Close(const Napi::CallbackInfo& info) {
+  closed_ = true;
+  partitions_.clear();
+}
+
+int64_t ShmPartitionedWriter::KeyPartition(Napi::Env env, const Napi::Value& value) const {
+  if (!value.IsBuffer()) {
+    Napi::TypeError::New(env, "key must be a Buffer").ThrowAsJavaScriptException();
+    return -1;
+  }
+  Napi::Buffer<uint8_t> key = value.As<Napi::Buffer<uint8_t>>();
+  if (key.Length() != keyLength_) {
+    Napi::RangeError::New(env, "key must be exactly " + std::to_string(keyLength_) + " bytes").ThrowAsJavaScriptException();
+    return -1;
+  }
+  return shmio::PartitionForKey(key.Data(), keyLength_, static_cast<uint32_t>(partitions_.size()));
+}
+
+bool ShmPartitionedWriter::EnsureOpen(Napi::Env env) const {
+  if (closed_) {
+    Napi::Error::New(env, "PartitionedWriter is closed").ThrowAsJavaScriptException();
+    return false;
+  }
+  return true;
+}
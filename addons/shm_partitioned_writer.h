@@ -0,0 +1,40 @@
+#pragma once
+
+#include <napi.h>
+#include <cstdint>
+#include <vector>
+
+class ShmWriter;
+
+// Routes frames to one of several ShmWriters by a hash of a key range of the
+// payload (shmio::PartitionForKey), so every key stays in one partition and
+// keeps its order there. The writers stay owned by their logs; this only
+// holds references to them while it is open.
+class ShmPartitionedWriter : public Napi::ObjectWrap<ShmPartitionedWriter> {
+public:
+  static void Init(Napi::Env env, Napi::Object exports);
+  ShmPartitionedWriter(const Napi::CallbackInfo& info);
+
+private:
+  struct Partition {
+    ShmWriter* writer { nullptr };
+    Napi::ObjectReference ref;
+  };
+
+  Napi::Value PartitionFor(const Napi::CallbackInfo& info);
+  Napi::Value Append(const Napi::CallbackInfo& info);
+  Napi::Value Allocate(const Napi::CallbackInfo& info);
+  void Commit(const Napi::CallbackInfo& info);
+  void Abort(const Napi::CallbackInfo& info);
+  void Close(const Napi::CallbackInfo& info);
+
+  // Partition of the key in `value`, which must be a Buffer of keyLength_
+  // bytes. Returns -1 with a JS exception pending otherwise.
+  int64_t KeyPartition(Napi::Env env, const Napi::Value& value) const;
+  bool EnsureOpen(Napi::Env env) const;
+
+  std::vector<Partition> partitions_;
+  uint32_t keyOffset_ { 0 };
+  uint32_t keyLength_ { 0 };
+  bool closed_ { false };
+};
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <errno.h>
+#include <signal.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+
+#include "shm_format.h"
+#include "shm_futex.h"
+#include "shm_spin.h"
+
+namespace shmio {
+
+// Critical readers of a ring log publish their cursor in the reader section
+// of the v2 header, so the writer can hold off instead of overwriting frames
+// they have not read. Best-effort readers take no slot and never slow the
+// writer down. The section is split so the line the writer polls on every
+// allocation only changes when readers come and go:
+//
+//   [256, 320)  generation u32 (bumped when a slot is claimed, released or
+//               rewound), lapped u32 (bit per slot, set by an overwriting
+//               writer), owner pid u32 per slot (0 = free), progress u32
+//               (futex word readers bump to wake a blocked writer), writer
+//               waiting u32 (set while the writer sleeps on progress)
+//   [320, 384)  published cursor u64 per slot, relative to dataOffset; the
+//               top bit marks a reader the writer lapped
+//
+// Slots left by a crashed reader are reclaimed once its process is gone.
+constexpr uint32_t kReaderSlots = 8;
+constexpr uint64_t kReaderGenerationOffset = kReaderSectionOffset;
+constexpr uint64_t kReaderLappedOffset = kReaderSectionOffset + 4;
+constexpr uint64_t kReaderOwnersOffset = kReaderSectionOffset + 8;
+constexpr uint64_t kReaderProgressOffset = kReaderSectionOffset + 40;
+constexpr uint64_t kWriterWaitingOffset = kReaderSectionOffset + 44;
+constexpr uint64_t kReaderCursorsOffset = kReaderSectionOffset + 64;
+// How long a blocked writer spins before it sleeps until a reader moves.
+constexpr uint64_t kReaderSpinNs = 20 * 1000;
+// Cursor of a slot that is being claimed or released; it holds nothing back.
+constexpr uint64_t kNoReaderCursor = std::numeric_limits<uint64_t>::max();
+// Set in a published cursor by a writer that overwrote frames from there on.
+// The writer sets it with a CAS against the cursor it saw, so a reader that
+// has published a newer position in the meantime is never marked.
+constexpr uint64_t kLappedCursorBit = uint64_t { 1 } << 63;
+
+static_assert(kReaderOwnersOffset + 4 * kReaderSlots <= kReaderProgressOffset, "reader owners overlap the progress word");
+static_assert(kWriterWaitingOffset + 4 <= kReaderCursorsOffset, "writer waiting flag overlaps the cursors");
+static_assert(kReaderCursorsOffset + 8 * kReaderSlots <= kHeaderV2Size, "reader cursors overflow the header");
+
+class ReaderSlots {
+public:
+  ReaderSlots() = default;
+  // `header` is the start of a writable mapping of the v2 header.
+  explicit ReaderSlots(uint8_t* header) : header_(header) {}
+
+  bool valid() const { return header_ != nullptr; }
+
+  uint32_t Generation() const { return generation().load(std::memory_order_acquire); }
+  uint32_t Owner(uint32_t slot) const { return owner(slot).load(std::memory_order_acquire); }
+  uint64_t Cursor(uint32_t slot) const {
+    uint64_t position = cursor(slot).load(std::memory_order_acquire);
+    return position == kNoReaderCursor ? position : position & ~kLappedCursorBit;
+  }
+  bool Lapped(uint32_t slot) const {
+    return IsLappedCursor(cursor(slot).load(std::memory_order_acquire))
+      || (lapped().load(std::memory_order_acquire) & (1u << slot)) != 0;
+  }
+
+  // Takes a free slot for process `pid`, starting at `position`. Returns the
+  // slot, or -1 when all are taken.
+  int Claim(uint32_t pid, uint64_t position) {
+    for (uint32_t slot = 0; slot < kReaderSlots; ++slot) {
+      uint32_t expected = 0;
+      if (owner(slot).compare_exchange_strong(expected, pid, std::memory_order_acq_rel)) {
+        Rewind(slot, position);
+        return static_cast<int>(slot);
+      }
+    }
+    return -1;
+  }
+
+  void Release(uint32_t slot) {
+    cursor(slot).store(kNoReaderCursor, std::memory_order_release);
+    lapped().fetch_and(~(1u << slot), std::memory_order_acq_rel);
+    owner(slot).store(0, std::memory_order_release);
+    generation().fetch_add(1, std::memory_order_acq_rel);
+    WakeWriter();
+  }
+
+  // Frames from `position` on are held back from the writer. Moving forward
+  // needs no generation bump: the writer only rescans when it is held up. A
+  // lapped mark stays until Rewind, so the reader still sees it.
+  void Publish(uint32_t slot, uint64_t position) {
+    uint64_t current = cursor(slot).load(std::memory_order_relaxed);
+    while (!IsLappedCursor(current)
+        && !cursor(slot).compare_exchange_weak(current, position, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+    WakeWriter();
+  }
+
+  // Block backpressure: polls `ready` (which rescans the slots) for up to
+  // kReaderSpinNs, then sleeps until a reader publishes or leaves, until
+  // `ready` returns true or maxWaitNs have passed. Returns the last result.
+  template <typename Ready>
+  bool WaitForReaders(Ready&& ready, uint64_t maxWaitNs) {
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point deadline = Clock::now() + std::chrono::nanoseconds(maxWaitNs);
+    if (SpinUntil(ready, std::min(maxWaitNs, kReaderSpinNs))) {
+      return true;
+    }
+    bool result = false;
+    for (;;) {
+      // Announce the wait before the last look at the cursors; pairs with the
+      // fence in WakeWriter, so either the rescan sees the reader's cursor or
+      // the reader sees the flag and bumps the progress word.
+      writerWaiting().store(1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      uint32_t seen = progress().load(std::memory_order_acquire);
+      if ((result = ready())) {
+        break;
+      }
+      int64_t remainingNs = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - Clock::now()).count();
+      if (remainingNs <= 0) {
+        break;
+      }
+      FutexWait(reinterpret_cast<const uint32_t*>(&progress()), seen, remainingNs);
+    }
+    writerWaiting().store(0, std::memory_order_relaxed);
+    return result;
+  }
+
+  // Publishes a position that may lie behind the previous one (a seek) and
+  // clears the lapped mark; the generation bump makes the writer rescan.
+  void Rewind(uint32_t slot, uint64_t position) {
+    cursor(slot).store(position, std::memory_order_release);
+    lapped().fetch_and(~(1u << slot), std::memory_order_acq_rel);
+    generation().fetch_add(1, std::memory_order_acq_rel);
+  }
+
+  // Lowest cursor of the readers the writer must not lap: occupied, not
+  // already lapped, and published. kNoReaderCursor when there are none.
+  uint64_t MinCursor() const {
+    uint32_t lappedMask = lapped().load(std::memory_order_acquire);
+    uint64_t lowest = kNoReaderCursor;
+    for (uint32_t slot = 0; slot < kReaderSlots; ++slot) {
+      if ((lappedMask & (1u << slot)) != 0 || owner(slot).load(std::memory_order_acquire) == 0) {
+        continue;
+      }
+      // Lapped and unset cursors have the top bit set and never win.
+      uint64_t position = cursor(slot).load(std::memory_order_acquire);
+      if (position < lowest) {
+        lowest = position;
+      }
+    }
+    return lowest;
+  }
+
+  // Marks the readers whose cursor is below `position` as lapped, so they
+  // stop holding the writer back and fail their next read. Returns how many.
+  // The mark goes into the cursor with a CAS against the value compared, so
+  // a reader that publishes past `position` meanwhile is left alone.
+  uint32_t MarkLappedBelow(uint64_t position) {
+    uint32_t mask = 0;
+    for (uint32_t slot = 0; slot < kReaderSlots; ++slot) {
+      if (owner(slot).load(std::memory_order_acquire) == 0) {
+        continue;
+      }
+      uint64_t seen = cursor(slot).load(std::memory_order_acquire);
+      while (seen < position
+          && !cursor(slot).compare_exchange_weak(seen, seen | kLappedCursorBit, std::memory_order_acq_rel)) {
+      }
+      if (seen < position) {
+        mask |= 1u << slot;
+      }
+    }
+    if (mask != 0) {
+      lapped().fetch_or(mask, std::memory_order_acq_rel);
+    }
+    return static_cast<uint32_t>(__builtin_popcount(mask));
+  }
+
+  // Frees slots whose owning process no longer exists. Returns how many.
+  uint32_t ReclaimDead() {
+    uint32_t reclaimed = 0;
+    for (uint32_t slot = 0; slot < kReaderSlots; ++slot) {
+      uint32_t pid = owner(slot).load(std::memory_order_acquire);
+      if (pid == 0 || pid == kReclaimingOwner || kill(static_cast<pid_t>(pid), 0) == 0 || errno != ESRCH) {
+        continue;
+      }
+      // Park the slot first so no reader can claim it while it is cleared.
+      if (owner(slot).compare_exchange_strong(pid, kReclaimingOwner, std::memory_order_acq_rel)) {
+        Release(slot);
+        ++reclaimed;
+      }
+    }
+    return reclaimed;
+  }
+
+private:
+  static bool IsLappedCursor(uint64_t position) {
+    return (position & kLappedCursorBit) != 0 && position != kNoReaderCursor;
+  }
+
+  // A syscall only while the writer sleeps in WaitForReaders.
+  void WakeWriter() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (writerWaiting().load(std::memory_order_relaxed) != 0) {
+      progress().fetch_add(1, std::memory_order_release);
+      FutexWakeAll(reinterpret_cast<const uint32_t*>(&progress()));
+    }
+  }
+
+  std::atomic<uint32_t>& generation() const {
+    return *reinterpret_cast<std::atomic<uint32_t>*>(header_ + kReaderGenerationOffset);
+  }
+  std::atomic<uint32_t>& lapped() const {
+    return *reinterpret_cast<std::atomic<uint32_t>*>(header_ + kReaderLappedOffset);
+  }
+  std::atomic<uint32_t>& owner(uint32_t slot) const {
+    return *reinterpret_cast<std::atomic<uint32_t>*>(header_ + kReaderOwnersOffset + 4 * slot);
+  }
+  std::atomic<uint32_t>& progress() const {
+    return *reinterpret_cast<std::atomic<uint32_t>*>(header_ + kReaderProgressOffset);
+  }
+  std::atomic<uint32_t>& writerWaiting() const {
+    return *reinterpret_cast<std::atomic<uint32_t>*>(header_ + kWriterWaitingOffset);
+  }
+  std::atomic<uint64_t>& cursor(uint32_t slot) const {
+    return *reinterpret_cast<std::atomic<uint64_t>*>(header_ + kReaderCursorsOffset + 8 * slot);
+  }
+
+  // Owner of a slot being reclaimed; pids never get this large.
+  static constexpr uint32_t kReclaimingOwner = std::numeric_limits<uint32_t>::max();
+
+  uint8_t* header_ { nullptr };
+};
+
+} // namespace shmio
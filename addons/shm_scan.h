@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "shm_format.h"
+
+// Frame chain walking shared by the async scans and shmio-inspect. Like
+// shm_format.h this must not depend on N-API.
+namespace shmio {
+
+// Data region of a mapped log, addressed by log position (iterator cursor).
+// Ring positions wrap into the mirrored mapping, so a frame starting anywhere
+// in the ring is contiguous.
+struct LogRegion {
+  const uint8_t* data { nullptr };
+  uint64_t ringBytes { 0 };
+  uint32_t sequenceBytes { 0 };
+
+  const uint8_t* At(uint64_t position) const {
+    return data + (ringBytes != 0 ? position % ringBytes : position);
+  }
+};
+
+struct WalkResult {
+  uint64_t end { 0 };
+  uint64_t frames { 0 };
+  uint64_t paddingBytes { 0 };
+  std::string error;
+};
+
+// Walks whole frames in [from, to) and calls onFrame(position, frame,
+// frameSize) for each; returning false from it stops the walk after that
+// frame. Frame sizes are always checked against the range. With `validate`
+// prefixes are compared with suffixes, padding markers are checked and
+// stamped logs must have consecutive sequence numbers. Stops at the first
+// inconsistency and describes it in `error`; `end` is then its position.
+template <typename OnFrame>
+WalkResult WalkFrames(const LogRegion& region, uint64_t from, uint64_t to, bool validate, OnFrame&& onFrame) {
+  WalkResult result;
+  uint64_t position = from;
+  uint64_t expectedSequence = 0;
+  bool haveSequence = false;
+  uint32_t minFrame = kFrameMetadataBytes + region.sequenceBytes;
+
+  while (position + kFrameMetadataBytes <= to) {
+    const uint8_t* frame = region.At(position);
+    uint16_t frameSize = ReadUint16LE(frame);
+
+    if (frameSize == 0) {
+      uint32_t paddingSize = PaddingLength(frame);
+      if (paddingSize < kMinPaddingBytes || position + paddingSize > to) {
+        result.error = "invalid padding length " + std::to_string(paddingSize);
+        break;
+      }
+      if (validate && !IsValidPadding(frame, paddingSize)) {
+        result.error = "padding markers do not match";
+        break;
+      }
+      result.paddingBytes += paddingSize;
+      position += paddingSize;
+      continue;
+    }
+
+    if (frameSize < minFrame) {
+      result.error = "frame size " + std::to_string(frameSize) + " is too small";
+      break;
+    }
+    if (position + frameSize > to) {
+      result.error = "frame of " + std::to_string(frameSize) + " bytes runs past the committed size";
+      break;
+    }
+    if (validate) {
+      uint16_t suffix = ReadUint16LE(frame + frameSize - kMessageHeaderBytes);
+      if (suffix != frameSize) {
+        result.error = "prefix " + std::to_string(frameSize) + " does not match suffix " + std::to_string(suffix);
+        break;
+      }
+      if (region.sequenceBytes != 0) {
+        uint64_t sequence = ReadUint64LE(frame + kMessageHeaderBytes);
+        if (haveSequence && sequence != expectedSequence) {
+          result.error = "sequence " + std::to_string(sequence) + " follows " + std::to_string(expectedSequence - 1);
+          break;
+        }
+        expectedSequence = sequence + 1;
+        haveSequence = true;
+      }
+    }
+
+    ++result.frames;
+    position += frameSize;
+    if (!onFrame(position - frameSize, frame, static_cast<uint32_t>(frameSize))) {
+      break;
+    }
+  }
+
+  result.end = position;
+  return result;
+}
+
+// Oldest whole frame still held by a ring log. Once the writer has wrapped,
+// the start of the ring is mid-frame, so the chain is followed backwards
+// from the committed end using the frame suffixes. Linear logs start at 0.
+inline uint64_t OldestFrame(const LogRegion& region, uint64_t committed) {
+  if (region.ringBytes == 0 || committed <= region.ringBytes) {
+    return 0;
+  }
+  uint64_t floor = committed - region.ringBytes;
+  uint64_t position = committed;
+  while (position - floor >= kFrameMetadataBytes) {
+    uint16_t suffix = ReadUint16LE(region.At(position - kMessageHeaderBytes));
+    uint32_t size = suffix != 0 ? suffix : ReadUint16LE(region.At(position - 2 * kMessageHeaderBytes));
+    if (size < kFrameMetadataBytes || size > position - floor) {
+      break;
+    }
+    position -= size;
+  }
+  return position;
+}
+
+// Finds the last frame of a non-empty committed range [from, committed) from
+// its suffix. Padding always precedes a frame, so the last suffix belongs to
+// a real frame. Returns false when the suffix and prefix disagree.
+inline bool LastFrame(const LogRegion& region, uint64_t from, uint64_t committed, uint64_t* position) {
+  if (committed < from + kFrameMetadataBytes + region.sequenceBytes) {
+    return false;
+  }
+  uint16_t frameSize = ReadUint16LE(region.At(committed - kMessageHeaderBytes));
+  if (frameSize < kFrameMetadataBytes + region.sequenceBytes || frameSize > committed - from
+      || ReadUint16LE(region.At(committed - frameSize)) != frameSize) {
+    return false;
+  }
+  *position = committed - frameSize;
+  return true;
+}
+
+} // namespace shmio
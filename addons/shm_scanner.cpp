@@ -0,0 +1,301 @@
+#include "shm_scanner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "shm_format.h"
+#include "shm_mapping.h"
+#include "shm_options.h"
+#include "shm_scan.h"
+
+namespace {
+
+struct ScanOptions {
+  bool hasFromCursor { false };
+  uint64_t fromCursor { 0 };
+  uint64_t toCursor { std::numeric_limits<uint64_t>::max() };
+  uint64_t maxFrames { std::numeric_limits<uint64_t>::max() };
+  bool validate { false };
+};
+
+// Failure reported to JS with an ERR_SHM_* code. ERR_SHM_CURSOR blames the
+// caller's cursors and is rejected as a RangeError.
+class ScanError : public std::runtime_error {
+public:
+  ScanError(const std::string& message, const char* code) : std::runtime_error(message), code_(code) {}
+  const char* code() const { return code_; }
+
+private:
+  const char* code_;
+};
+
+class ScanWorker : public Napi::AsyncWorker {
+public:
+  ScanWorker(Napi::Env env, ShmMapping* mapping, Napi::Object self, ScanMode mode, ScanOptions options)
+    : Napi::AsyncWorker(env, "shmio:scan"),
+      deferred_(Napi::Promise::Deferred::New(env)),
+      mapping_(mapping),
+      mode_(mode),
+      options_(options) {
+    mappingRef_ = Napi::Persistent(self);
+    mapping_->BeginScan();
+
+    // Snapshot on the JS thread: the committed size only grows, and linear
+    // logs map space added by a growable writer before the walk starts.
+    region_.data = mapping_->base() + mapping_->dataOffset();
+    region_.ringBytes = mapping_->ringBytes();
+    region_.sequenceBytes = mapping_->frameSequenceBytes();
+    committed_ = mapping_->LoadCommittedSize() - mapping_->dataOffset();
+    if (region_.ringBytes == 0 && mapping_->dataOffset() + committed_ > mapping_->length() && !mapping_->RefreshLength()) {
+      mappingError_ = true;
+    }
+  }
+
+  Napi::Promise Promise() const { return deferred_.Promise(); }
+
+protected:
+  void Execute() override {
+    try {
+      if (mappingError_) {
+        throw ScanError("committed frames are beyond the mapped length", "ERR_SHM_MAPPING_GONE");
+      }
+      Scan();
+    } catch (const ScanError& e) {
+      code_ = e.code();
+      SetError(e.what());
+    } catch (const std::exception& e) {
+      SetError(e.what());
+    }
+  }
+
+  void OnOK() override {
+    mapping_->EndScan();
+    Napi::Env env = Env();
+
+    switch (mode_) {
+      case ScanMode::Count:
+        deferred_.Resolve(Napi::Number::New(env, static_cast<double>(frames_)));
+        return;
+
+      case ScanMode::Validate: {
+        Napi::Object result = Napi::Object::New(env);
+        result.Set("valid", Napi::Boolean::New(env, error_.empty()));
+        result.Set("frames", Napi::Number::New(env, static_cast<double>(frames_)));
+        result.Set("startCursor", Napi::BigInt::New(env, startCursor_));
+        result.Set("endCursor", Napi::BigInt::New(env, endCursor_));
+        if (!error_.empty()) {
+          result.Set("error", Napi::String::New(env, error_));
+        }
+        deferred_.Resolve(result);
+        return;
+      }
+
+      case ScanMode::FindLast: {
+        if (frames_ == 0) {
+          deferred_.Resolve(env.Null());
+          return;
+        }
+        Napi::Object result = Napi::Object::New(env);
+        result.Set("cursor", Napi::BigInt::New(env, startCursor_));
+        result.Set("endCursor", Napi::BigInt::New(env, endCursor_));
+        result.Set("payload", Napi::Buffer<uint8_t>::Copy(env, payload_.data(), payload_.size()));
+        if (region_.sequenceBytes != 0) {
+          result.Set("sequence", Napi::BigInt::New(env, lastSequence_));
+        } else {
+          result.Set("sequence", env.Null());
+        }
+        deferred_.Resolve(result);
+        return;
+      }
+
+      case ScanMode::Range: {
+        Napi::Object result = Napi::Object::New(env);
+        result.Set("startCursor", Napi::BigInt::New(env, startCursor_));
+        result.Set("endCursor", Napi::BigInt::New(env, endCursor_));
+        result.Set("frames", Napi::Number::New(env, static_cast<double>(frames_)));
+        result.Set("payloadBytes", Napi::Number::New(env, static_cast<double>(payloadBytes_)));
+        result.Set("paddingBytes", Napi::Number::New(env, static_cast<double>(paddingBytes_)));
+        Napi::BigUint64Array cursors = Napi::BigUint64Array::New(env, cursors_.size(), napi_biguint64_array);
+        if (!cursors_.empty()) {
+          std::memcpy(cursors.Data(), cursors_.data(), cursors_.size() * sizeof(uint64_t));
+        }
+        result.Set("cursors", cursors);
+        deferred_.Resolve(result);
+        return;
+      }
+    }
+  }
+
+  void OnError(const Napi::Error& error) override {
+    mapping_->EndScan();
+    Napi::Object value = error.Value();
+    if (code_ != nullptr && std::strcmp(code_, "ERR_SHM_CURSOR") == 0) {
+      value = Napi::RangeError::New(Env(), error.Message()).Value();
+    }
+    if (code_ != nullptr) {
+      value.Set("code", Napi::String::New(Env(), code_));
+    }
+    deferred_.Reject(value);
+  }
+
+private:
+  void Scan() {
+    uint64_t from = options_.hasFromCursor ? options_.fromCursor : shmio::OldestFrame(region_, committed_);
+    uint64_t to = std::min(options_.toCursor, committed_);
+    if (from > committed_) {
+      throw ScanError("fromCursor " + std::to_string(from) + " is beyond the committed size " + std::to_string(committed_), "ERR_SHM_CURSOR");
+    }
+    if (from > to) {
+      throw ScanError("fromCursor is beyond toCursor", "ERR_SHM_CURSOR");
+    }
+    EnsureNotLapped(from);
+
+    startCursor_ = from;
+    endCursor_ = from;
+
+    if (mode_ == ScanMode::FindLast) {
+      if (to == from) {
+        return;
+      }
+      uint64_t position = 0;
+      if (!shmio::LastFrame(region_, from, to, &position)) {
+        EnsureNotLapped(from);
+        throw ScanError("last frame before cursor " + std::to_string(to) + " is corrupt", "ERR_SHM_FRAME_CORRUPT");
+      }
+      const uint8_t* frame = region_.At(position);
+      uint16_t frameSize = shmio::ReadUint16LE(frame);
+      const uint8_t* payload = frame + shmio::kMessageHeaderBytes + region_.sequenceBytes;
+      payload_.assign(payload, frame + frameSize - shmio::kMessageHeaderBytes);
+      if (region_.sequenceBytes != 0) {
+        lastSequence_ = shmio::ReadUint64LE(frame + shmio::kMessageHeaderBytes);
+      }
+      // The copy is only usable if the ring writer did not reuse the frame
+      // while it was being read.
+      EnsureNotLapped(position);
+      frames_ = 1;
+      startCursor_ = position;
+      endCursor_ = to;
+      return;
+    }
+
+    bool validate = mode_ == ScanMode::Validate || options_.validate;
+    bool collectCursors = mode_ == ScanMode::Range;
+    uint64_t maxFrames = mode_ == ScanMode::Range ? options_.maxFrames : std::numeric_limits<uint64_t>::max();
+    uint32_t frameOverhead = shmio::kFrameMetadataBytes + region_.sequenceBytes;
+    uint64_t seen = 0;
+    shmio::WalkResult walk;
+    if (maxFrames != 0) {
+      walk = shmio::WalkFrames(region_, from, to, validate, [&](uint64_t position, const uint8_t*, uint32_t frameSize) {
+        payloadBytes_ += frameSize - frameOverhead;
+        if (collectCursors) {
+          cursors_.push_back(position);
+        }
+        return ++seen < maxFrames;
+      });
+    } else {
+      walk.end = from;
+    }
+    EnsureNotLapped(from);
+
+    frames_ = walk.frames;
+    paddingBytes_ = walk.paddingBytes;
+    endCursor_ = walk.end;
+
+    // The committed size always ends on a frame boundary, so a walk that
+    // stops short of it without reaching maxFrames has met a broken chain.
+    bool stoppedEarly = frames_ >= maxFrames;
+    if (!stoppedEarly && walk.end != to && to < committed_) {
+      EnsureToCursorOnBoundary(walk.end, to);
+    }
+    if (walk.error.empty() && !stoppedEarly && walk.end != to) {
+      walk.error = std::to_string(to - walk.end) + " trailing bytes do not form a frame";
+    }
+    if (walk.error.empty()) {
+      return;
+    }
+    walk.error += " at cursor " + std::to_string(walk.end);
+    if (mode_ == ScanMode::Validate) {
+      error_ = walk.error;
+      return;
+    }
+    throw ScanError(walk.error, "ERR_SHM_FRAME_CORRUPT");
+  }
+
+  // A walk bounded by a toCursor below the committed size stopped short of
+  // it at `end`. If the frames from `end` are intact up to the committed
+  // size, toCursor falls inside one of them: the caller's mistake, not
+  // corruption.
+  void EnsureToCursorOnBoundary(uint64_t end, uint64_t to) const {
+    shmio::WalkResult next = shmio::WalkFrames(region_, end, committed_, options_.validate,
+      [](uint64_t, const uint8_t*, uint32_t) { return false; });
+    EnsureNotLapped(end);
+    if (next.error.empty() && next.end > to) {
+      throw ScanError("toCursor " + std::to_string(to) + " is not on a frame boundary; the frame at "
+        + std::to_string(end) + " ends at " + std::to_string(next.end), "ERR_SHM_CURSOR");
+    }
+  }
+
+  // Bytes from `from` onwards are intact while the writer, pending frames
+  // included, is less than one lap ahead of it.
+  void EnsureNotLapped(uint64_t from) const {
+    if (shmio::RingOverwritten(mapping_->base(), mapping_->dataOffset(), region_.ringBytes, from)) {
+      throw ScanError("scan range was overwritten by the ring writer", "ERR_SHM_LAPPED");
+    }
+  }
+
+  Napi::Promise::Deferred deferred_;
+  Napi::ObjectReference mappingRef_;
+  ShmMapping* mapping_;
+  ScanMode mode_;
+  ScanOptions options_;
+  shmio::LogRegion region_;
+  uint64_t committed_ { 0 };
+  bool mappingError_ { false };
+  const char* code_ { nullptr };
+
+  uint64_t startCursor_ { 0 };
+  uint64_t endCursor_ { 0 };
+  uint64_t frames_ { 0 };
+  uint64_t payloadBytes_ { 0 };
+  uint64_t paddingBytes_ { 0 };
+  uint64_t lastSequence_ { 0 };
+  std::string error_;
+  std::vector<uint8_t> payload_;
+  std::vector<uint64_t> cursors_;
+};
+
+} // namespace
+
+Napi::Value ShmScanner::Queue(const Napi::CallbackInfo& info, ShmMapping* mapping, ScanMode mode) {
+  Napi::Env env = info.Env();
+  if (mapping->closed()) {
+    Napi::Error err = Napi::Error::New(env, "Shared log mapping is closed");
+    err.Set("code", Napi::String::New(env, "ERR_SHM_MAPPING_GONE"));
+    throw err;
+  }
+
+  ScanOptions options;
+  if (mode == ScanMode::Range && info.Length() >= 1 && info[0].IsObject()) {
+    Napi::Object opts = info[0].As<Napi::Object>();
+    if (!shmio::ParseCursorOption(env, opts, "fromCursor", &options.fromCursor, &options.hasFromCursor)
+        || !shmio::ParseCursorOption(env, opts, "toCursor", &options.toCursor)
+        || !shmio::ParseCursorOption(env, opts, "maxFrames", &options.maxFrames)) {
+      return env.Null();
+    }
+    options.validate = opts.Get("validate").ToBoolean().Value();
+  } else if (mode == ScanMode::Range && info.Length() >= 1 && !info[0].IsUndefined() && !info[0].IsNull()) {
+    Napi::TypeError::New(env, "scanRange options must be an object").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  ScanWorker* worker = new ScanWorker(env, mapping, info.This().As<Napi::Object>(), mode, options);
+  Napi::Promise promise = worker->Promise();
+  worker->Queue();
+  return promise;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <napi.h>
+
+class ShmMapping;
+
+enum class ScanMode {
+  Count,
+  Validate,
+  FindLast,
+  Range,
+};
+
+// Walks the committed frames of an open mapping on the libuv threadpool, so
+// whole-log checks do not stall the event loop. The worker holds a reference
+// to the mapping object and the mapping keeps its pages until every queued
+// scan has finished, even if it is closed in the meantime.
+class ShmScanner {
+public:
+  // Parses the arguments of countFrames/validate/findLast/scanRange, queues
+  // the scan and returns its promise.
+  static Napi::Value Queue(const Napi::CallbackInfo& info, ShmMapping* mapping, ScanMode mode);
+};
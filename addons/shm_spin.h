@@ -0,0 +1,78 @@
+#pragma once
+
+#include <errno.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace shmio {
+
+// Tells the core we are in a spin-wait: PAUSE on x86 (also keeps the loop from
+// flooding the memory pipeline), YIELD on ARM.
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  asm volatile("yield" ::: "memory");
+#endif
+}
+
+// Pause hints per poll before the waiter starts yielding its time slice.
+constexpr uint32_t kMaxSpinPauses = 64;
+
+// Polls `ready` until it returns true or `maxSpinNs` have passed. The gap
+// between polls doubles from one pause hint up to kMaxSpinPauses (a few
+// microseconds of spinning in all), after which every poll is followed by a
+// sched_yield so other threads pinned to the CPU still run. Returns the last
+// result of `ready`.
+template <typename Ready>
+bool SpinUntil(Ready&& ready, uint64_t maxSpinNs) {
+  using Clock = std::chrono::steady_clock;
+  if (ready()) {
+    return true;
+  }
+  const Clock::time_point deadline = Clock::now() + std::chrono::nanoseconds(maxSpinNs);
+  uint32_t pauses = 1;
+  while (Clock::now() < deadline) {
+    if (pauses <= kMaxSpinPauses) {
+      for (uint32_t i = 0; i < pauses; ++i) {
+        CpuRelax();
+      }
+      pauses <<= 1;
+    } else {
+      std::this_thread::yield();
+    }
+    if (ready()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Restricts the calling thread to one CPU. Returns 0 or an errno value;
+// ENOSYS where thread affinity is not supported.
+inline int PinCurrentThread(uint32_t cpu) {
+#ifdef __linux__
+  if (cpu >= CPU_SETSIZE) {
+    return EINVAL;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+  (void)cpu;
+  return ENOSYS;
+#endif
+}
+
+} // namespace shmio
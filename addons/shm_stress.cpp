@@ -0,0 +1,636 @@
+// shmio-stress: native stress test of the frame format and the publishing
+// protocol, built next to the addon from the same layout headers. One writer
+// thread appends frames of random size, half of them within 64 bytes of the
+// u16 limit, in random batches with random alignment, and publishes them the
+// way ShmWriter does: message count first, then the committed size. Reader
+// threads walk the committed frames with the scan code, check every payload
+// against its sequence stamp and checksum, and seek at random.
+//
+// Ring runs make every reader critical (shm_readers.h), so the writer has to
+// hold back instead of overwriting frames a reader has not read; a lapped
+// reader or a torn frame is a failure. Linear runs refill one log, seeking
+// back to remembered frames as well as to the head. Built with
+// -fsanitize=thread (npm run stress:tsan), any access the protocol leaves
+// unordered is reported.
+//
+//   shmio-stress [--seconds 60] [--readers 4] [--mode ring|linear|both]
+//                [--ring-bytes 16777216] [--capacity 268435456]
+//                [--seek-every 64] [--seed <n>]
+//
+// Exit status: 0 when every frame checked out, 1 on the first bad frame, 2 on
+// usage or I/O errors.
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "shm_file.h"
+#include "shm_format.h"
+#include "shm_mirror.h"
+#include "shm_readers.h"
+#include "shm_scan.h"
+#include "shm_spin.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using shmio::SystemError;
+
+constexpr int kExitFailed = 1;
+constexpr int kExitUsage = 2;
+constexpr uint32_t kSequenceBytes = shmio::kFrameSequenceBytes;
+constexpr uint32_t kMaxPayload = shmio::kMaxPayloadBytes - kSequenceBytes;
+constexpr uint32_t kChecksumBytes = 4;
+constexpr uint64_t kMaxBatchFrames = 64;
+// A reader hands control back to its seek logic after this many bytes.
+constexpr uint64_t kMaxReadBytes = 1 << 20;
+// Frame positions a linear reader remembers to seek back to.
+constexpr size_t kRememberedFrames = 1024;
+
+struct Options {
+  double seconds { 60 };
+  uint32_t readers { 4 };
+  std::string mode { "both" };
+  uint64_t ringBytes { 16 << 20 };
+  uint64_t capacity { 256 << 20 };
+  uint64_t seekEvery { 64 };
+  uint64_t seed { 0 };
+};
+
+// splitmix64: payload bytes and sizes are derived from the sequence number,
+// so readers can check frames without sharing state with the writer.
+uint64_t Mix(uint64_t value) {
+  value += 0x9e3779b97f4a7c15ULL;
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+  return value ^ (value >> 31);
+}
+
+struct Random {
+  uint64_t state;
+
+  uint64_t Next() { return Mix(state += 0x9e3779b97f4a7c15ULL); }
+  uint64_t Below(uint64_t bound) { return Next() % bound; }
+};
+
+uint32_t PayloadSize(uint64_t seed, uint64_t sequence) {
+  uint64_t r = Mix(seed ^ Mix(sequence));
+  switch (r & 3) {
+    case 0:
+    case 1:
+      return kMaxPayload - static_cast<uint32_t>((r >> 8) % 64);
+    case 2:
+      return 1 + static_cast<uint32_t>((r >> 8) % 16);
+    default:
+      return 1 + static_cast<uint32_t>((r >> 8) % kMaxPayload);
+  }
+}
+
+// FNV-1a over 8-byte words, so checking keeps up with writing.
+uint32_t Checksum(uint64_t sequence, const uint8_t* data, size_t length) {
+  uint64_t hash = (0xcbf29ce484222325ULL ^ sequence) * 0x100000001b3ULL;
+  size_t i = 0;
+  for (; i + 8 <= length; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, 8);
+    hash = (hash ^ word) * 0x100000001b3ULL;
+  }
+  for (; i < length; ++i) {
+    hash = (hash ^ data[i]) * 0x100000001b3ULL;
+  }
+  return static_cast<uint32_t>(hash ^ (hash >> 32));
+}
+
+// Random bytes followed by a checksum of them and the sequence number.
+// Payloads shorter than the checksum are the random bytes alone.
+void FillPayload(uint8_t* payload, uint32_t length, uint64_t seed, uint64_t sequence) {
+  uint32_t body = length >= kChecksumBytes ? length - kChecksumBytes : length;
+  uint64_t state = Mix(seed + sequence);
+  for (uint32_t i = 0; i < body; i += 8) {
+    uint64_t word = Mix(state += 0x9e3779b97f4a7c15ULL);
+    memcpy(payload + i, &word, std::min<uint32_t>(8, body - i));
+  }
+  if (length >= kChecksumBytes) {
+    shmio::WriteUint32LE(payload + body, Checksum(sequence, payload, body));
+  }
+}
+
+bool CheckPayload(const uint8_t* payload, uint32_t length, uint64_t seed, uint64_t sequence, std::string* error) {
+  uint32_t expected = PayloadSize(seed, sequence);
+  if (length != expected) {
+    *error = "frame " + std::to_string(sequence) + " has " + std::to_string(length) + " payload bytes, expected "
+      + std::to_string(expected);
+    return false;
+  }
+  if (length < kChecksumBytes) {
+    uint8_t reference[kChecksumBytes];
+    FillPayload(reference, length, seed, sequence);
+    if (memcmp(reference, payload, length) != 0) {
+      *error = "frame " + std::to_string(sequence) + " has the wrong payload";
+      return false;
+    }
+    return true;
+  }
+  uint32_t body = length - kChecksumBytes;
+  if (shmio::ReadUint32LE(payload + body) != Checksum(sequence, payload, body)) {
+    *error = "frame " + std::to_string(sequence) + " fails its checksum";
+    return false;
+  }
+  return true;
+}
+
+// A v2 log with frame sequences in an anonymous file, laid out like the
+// addon's: ring logs keep the header on its own page and mirror the ring.
+class Log {
+public:
+  Log(uint64_t ringBytes, uint64_t capacity) : ringBytes_(ringBytes) {
+    uint64_t pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    dataOffset_ = ringBytes != 0 ? pageSize : shmio::kHeaderV2Size;
+    uint64_t fileLength = ringBytes != 0 ? dataOffset_ + ringBytes : dataOffset_ + capacity;
+    capacity_ = fileLength - dataOffset_;
+
+    file_.fd = shmio::CreateSealableMemfd("shmio-stress");
+    if (file_.fd < 0) {
+      char path[] = "/dev/shm/shmio-stress-XXXXXX";
+      file_.fd = mkstemp(path);
+      if (file_.fd < 0) {
+        throw SystemError("creating the log");
+      }
+      unlink(path);
+    }
+    if (ftruncate(file_.fd, static_cast<off_t>(fileLength)) != 0) {
+      throw SystemError("sizing the log");
+    }
+    if (ringBytes != 0) {
+      file_.base = shmio::MapMirrored(file_.fd, static_cast<size_t>(dataOffset_), static_cast<size_t>(ringBytes),
+        PROT_READ | PROT_WRITE);
+      file_.length = shmio::MirroredLength(static_cast<size_t>(dataOffset_), static_cast<size_t>(ringBytes));
+    } else {
+      void* mapped = mmap(nullptr, static_cast<size_t>(fileLength), PROT_READ | PROT_WRITE, MAP_SHARED, file_.fd, 0);
+      file_.base = mapped == MAP_FAILED ? nullptr : static_cast<uint8_t*>(mapped);
+      file_.length = static_cast<size_t>(fileLength);
+    }
+    if (file_.base == nullptr) {
+      throw SystemError("mapping the log");
+    }
+
+    uint8_t* header = file_.base;
+    shmio::WriteUint64LE(header + shmio::kHeaderSizeOffset, shmio::kHeaderV2Size);
+    shmio::WriteUint64LE(header + shmio::kDataOffsetOffset, dataOffset_);
+    shmio::WriteUint64LE(header + shmio::kCommittedSizeOffset, dataOffset_);
+    shmio::WriteUint64LE(header + shmio::kHeaderMagicOffset, shmio::kHeaderMagic);
+    shmio::WriteUint32LE(header + shmio::kHeaderVersionOffset, shmio::kHeaderVersion2);
+    shmio::WriteUint32LE(header + shmio::kHeaderFlagsOffset,
+      shmio::kFeatureFrameSequence | (ringBytes != 0 ? shmio::kFeatureRing : 0));
+    shmio::WriteUint64LE(header + shmio::kMaxCapacityOffset, fileLength);
+    shmio::WriteUint64LE(header + shmio::kRingBytesOffset, ringBytes);
+    shmio::WriteUint64LE(header + shmio::kCapacityOffset, fileLength);
+    committedSize_ = reinterpret_cast<std::atomic<uint64_t>*>(header + shmio::kCommittedSizeV2Offset);
+    committedMessages_ = reinterpret_cast<std::atomic<uint64_t>*>(header + shmio::kCommittedMessagesOffset);
+    readers_ = shmio::ReaderSlots(header);
+    Reset();
+  }
+
+  // Empties a linear log for the next round. Old frames stay in place past
+  // the committed size, where readers must never look.
+  void Reset() {
+    committedMessages_->store(0, std::memory_order_relaxed);
+    committedSize_->store(dataOffset_, std::memory_order_release);
+  }
+
+  // Relative positions, like iterator cursors.
+  uint64_t Committed() const { return committedSize_->load(std::memory_order_acquire) - dataOffset_; }
+  void Publish(uint64_t committed, uint64_t messages) {
+    committedMessages_->store(messages, std::memory_order_release);
+    committedSize_->store(dataOffset_ + committed, std::memory_order_release);
+  }
+
+  // Ring logs: raised ahead of writing below `end`, as ShmWriter does.
+  void PublishFrontier(uint64_t end) { shmio::PublishWriteFrontier(file_.base, dataOffset_ + end); }
+  bool Overwritten(uint64_t from) const {
+    return shmio::RingOverwritten(file_.base, dataOffset_, ringBytes_, from);
+  }
+
+  uint8_t* At(uint64_t position) const {
+    return file_.base + dataOffset_ + (ringBytes_ != 0 ? position % ringBytes_ : position);
+  }
+
+  shmio::LogRegion Region() const {
+    shmio::LogRegion region;
+    region.data = file_.base + dataOffset_;
+    region.ringBytes = ringBytes_;
+    region.sequenceBytes = kSequenceBytes;
+    return region;
+  }
+
+  uint64_t dataOffset() const { return dataOffset_; }
+  uint64_t ringBytes() const { return ringBytes_; }
+  uint64_t capacity() const { return capacity_; }
+  shmio::ReaderSlots& readers() { return readers_; }
+
+private:
+  shmio::MappedFile file_;
+  uint64_t dataOffset_ { 0 };
+  uint64_t ringBytes_ { 0 };
+  uint64_t capacity_ { 0 };
+  std::atomic<uint64_t>* committedSize_ { nullptr };
+  std::atomic<uint64_t>* committedMessages_ { nullptr };
+  shmio::ReaderSlots readers_;
+};
+
+struct Totals {
+  uint64_t framesWritten { 0 };
+  uint64_t bytesWritten { 0 };
+  uint64_t writerStalls { 0 };
+  uint64_t rounds { 0 };
+  std::atomic<uint64_t> framesVerified { 0 };
+  std::atomic<uint64_t> bytesVerified { 0 };
+  std::atomic<uint64_t> seeks { 0 };
+};
+
+class Round {
+public:
+  Round(Log& log, const Options& options, Totals& totals) : log_(log), options_(options), totals_(totals) {}
+
+  bool failed() const { return failed_.load(std::memory_order_acquire); }
+  const std::string& error() const { return error_; }
+
+  // Runs the writer and the readers until the deadline or, for linear logs,
+  // until the log is full, and waits for the readers to catch up.
+  void Run(Clock::time_point deadline, uint64_t seed) {
+    writerDone_.store(false, std::memory_order_relaxed);
+    std::vector<std::thread> readers;
+    std::atomic<uint32_t> claimed { 0 };
+    for (uint32_t i = 0; i < options_.readers; ++i) {
+      readers.emplace_back([this, i, seed, &claimed] { Read(i, seed, &claimed); });
+    }
+    // Ring readers claim their slot before the writer may lap them.
+    while (claimed.load(std::memory_order_acquire) < options_.readers && !failed()) {
+      std::this_thread::yield();
+    }
+    Write(deadline, seed);
+    writerDone_.store(true, std::memory_order_release);
+    for (std::thread& reader : readers) {
+      reader.join();
+    }
+  }
+
+private:
+  void Fail(const std::string& message) {
+    std::lock_guard<std::mutex> lock(errorMutex_);
+    if (error_.empty()) {
+      error_ = message;
+    }
+    failed_.store(true, std::memory_order_release);
+  }
+
+  void Write(Clock::time_point deadline, uint64_t seed) {
+    Random random { seed ^ 0x5752495445ULL };
+    shmio::ReaderSlots& slots = log_.readers();
+    uint64_t ringBytes = log_.ringBytes();
+    uint64_t committed = log_.Committed();
+    uint64_t sequence = 0;
+    uint64_t frontier = committed;
+    uint64_t readerLimit = 0;
+    uint32_t readerGeneration = slots.Generation() - 1;
+    bool full = false;
+
+    while (!full && !failed() && Clock::now() < deadline) {
+      uint64_t pending = 0;
+      uint64_t batch = 1 + random.Below(kMaxBatchFrames);
+      for (uint64_t i = 0; i < batch; ++i) {
+        uint32_t payloadSize = PayloadSize(seed, sequence);
+        uint32_t frameSize = payloadSize + shmio::kFrameMetadataBytes + kSequenceBytes;
+        uint32_t alignment = random.Below(8) == 0 ? 8u << random.Below(10) : 1;
+        uint64_t position = committed + pending;
+        uint32_t padding = shmio::PaddingFor(log_.dataOffset() + position, alignment,
+          shmio::kMessageHeaderBytes + kSequenceBytes);
+        uint64_t end = position + padding + frameSize;
+
+        if (ringBytes != 0) {
+          if (end - committed > ringBytes) {
+            break;
+          }
+          // Same check as ShmWriter::MakeRoomForReaders with the block policy.
+          if (end > readerLimit || slots.Generation() != readerGeneration) {
+            readerGeneration = slots.Generation();
+            auto roomFor = [&] {
+              uint64_t lowest = slots.MinCursor();
+              readerLimit = lowest == shmio::kNoReaderCursor ? UINT64_MAX : lowest + ringBytes;
+              return end <= readerLimit || failed();
+            };
+            if (!roomFor()) {
+              ++totals_.writerStalls;
+              while (!slots.WaitForReaders(roomFor, 1000 * 1000 * 1000)) {
+              }
+              if (failed()) {
+                return;
+              }
+            }
+          }
+        } else if (end > log_.capacity()) {
+          full = true;
+          break;
+        }
+
+        if (ringBytes != 0 && end > frontier) {
+          frontier = end;
+          log_.PublishFrontier(frontier);
+        }
+        if (padding != 0) {
+          shmio::WritePadding(log_.At(position), padding);
+          position += padding;
+        }
+        uint8_t* frame = log_.At(position);
+        shmio::WriteUint16LE(frame, static_cast<uint16_t>(frameSize));
+        shmio::WriteUint64LE(frame + shmio::kMessageHeaderBytes, sequence);
+        FillPayload(frame + shmio::kMessageHeaderBytes + kSequenceBytes, payloadSize, seed, sequence);
+        shmio::WriteUint16LE(frame + frameSize - shmio::kMessageHeaderBytes, static_cast<uint16_t>(frameSize));
+        pending = end - committed;
+        ++sequence;
+        ++totals_.framesWritten;
+        totals_.bytesWritten += frameSize;
+      }
+      if (pending != 0) {
+        committed += pending;
+        log_.Publish(committed, sequence);
+      }
+    }
+    finalCommitted_.store(committed, std::memory_order_release);
+  }
+
+  struct Remembered {
+    uint64_t position;
+    uint64_t sequence;
+  };
+
+  void Read(uint32_t index, uint64_t seed, std::atomic<uint32_t>* claimed) {
+    Random random { seed ^ Mix(index + 1) };
+    shmio::LogRegion region = log_.Region();
+    shmio::ReaderSlots& slots = log_.readers();
+    bool ring = log_.ringBytes() != 0;
+    int slot = -1;
+    if (ring) {
+      slot = slots.Claim(static_cast<uint32_t>(getpid()), 0);
+      if (slot < 0) {
+        Fail("reader " + std::to_string(index) + " found no free reader slot");
+      }
+    }
+    claimed->fetch_add(1, std::memory_order_acq_rel);
+    if (slot < 0 && ring) {
+      return;
+    }
+
+    uint64_t cursor = 0;
+    uint64_t expected = 0;
+    bool sequenceKnown = true;
+    std::vector<Remembered> remembered;
+    std::string error;
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    uint64_t seeks = 0;
+
+    while (!failed()) {
+      if (slot >= 0) {
+        slots.Publish(static_cast<uint32_t>(slot), cursor);
+      }
+      uint64_t committed = log_.Committed();
+      if (log_.Overwritten(cursor)) {
+        Fail("reader " + std::to_string(index) + " was lapped at cursor " + std::to_string(cursor));
+        break;
+      }
+      if (committed == cursor) {
+        if (writerDone_.load(std::memory_order_acquire)
+            && finalCommitted_.load(std::memory_order_acquire) == cursor) {
+          break;
+        }
+        // Yield rather than pause: the writer may share this CPU.
+        std::this_thread::yield();
+        continue;
+      }
+
+      uint64_t start = cursor;
+      shmio::WalkResult result = shmio::WalkFrames(region, cursor, committed, true,
+          [&](uint64_t position, const uint8_t* frame, uint32_t frameSize) {
+        uint64_t sequence = shmio::ReadUint64LE(frame + shmio::kMessageHeaderBytes);
+        if (sequenceKnown && sequence != expected) {
+          error = "frame " + std::to_string(sequence) + " follows " + std::to_string(expected - 1);
+          return false;
+        }
+        uint32_t payloadSize = frameSize - shmio::kFrameMetadataBytes - kSequenceBytes;
+        if (!CheckPayload(frame + shmio::kMessageHeaderBytes + kSequenceBytes, payloadSize, seed, sequence, &error)) {
+          return false;
+        }
+        expected = sequence + 1;
+        sequenceKnown = true;
+        ++frames;
+        bytes += frameSize;
+        if (!ring && random.Below(64) == 0) {
+          Remembered entry { position, sequence };
+          if (remembered.size() < kRememberedFrames) {
+            remembered.push_back(entry);
+          } else {
+            remembered[random.Below(kRememberedFrames)] = entry;
+          }
+        }
+        return position + frameSize - start < kMaxReadBytes;
+      });
+      if (error.empty() && !result.error.empty()) {
+        error = result.error;
+      }
+      if (log_.Overwritten(start)) {
+        error = "frames were overwritten while they were read";
+      }
+      if (!error.empty()) {
+        Fail("reader " + std::to_string(index) + ": " + error + " at cursor " + std::to_string(result.end));
+        break;
+      }
+      cursor = result.end;
+
+      if (options_.seekEvery == 0 || random.Below(options_.seekEvery) != 0) {
+        continue;
+      }
+      // Rings only seek forward: frames behind the published cursor may
+      // already be overwritten.
+      uint64_t target = 0;
+      uint64_t choice = ring ? 0 : random.Below(3);
+      if (choice == 0 && shmio::LastFrame(region, cursor, committed, &target)) {
+        cursor = target;
+        sequenceKnown = false;
+        ++seeks;
+      } else if (choice == 1 && !remembered.empty()) {
+        const Remembered& entry = remembered[random.Below(remembered.size())];
+        cursor = entry.position;
+        expected = entry.sequence;
+        ++seeks;
+      } else if (choice == 2) {
+        cursor = 0;
+        expected = 0;
+        sequenceKnown = true;
+        ++seeks;
+      }
+    }
+
+    if (slot >= 0) {
+      slots.Release(static_cast<uint32_t>(slot));
+    }
+    totals_.framesVerified.fetch_add(frames, std::memory_order_relaxed);
+    totals_.bytesVerified.fetch_add(bytes, std::memory_order_relaxed);
+    totals_.seeks.fetch_add(seeks, std::memory_order_relaxed);
+  }
+
+  Log& log_;
+  const Options& options_;
+  Totals& totals_;
+  std::atomic<bool> writerDone_ { false };
+  std::atomic<uint64_t> finalCommitted_ { 0 };
+  std::atomic<bool> failed_ { false };
+  std::mutex errorMutex_;
+  std::string error_;
+};
+
+std::string FormatBytes(double bytes) {
+  const char* units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+  size_t unit = 0;
+  while (bytes >= 1024 && unit + 1 < sizeof(units) / sizeof(units[0])) {
+    bytes /= 1024;
+    ++unit;
+  }
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), unit == 0 ? "%.0f %s" : "%.2f %s", bytes, units[unit]);
+  return buffer;
+}
+
+int RunMode(const std::string& mode, const Options& options, double seconds) {
+  bool ring = mode == "ring";
+  Log log(ring ? options.ringBytes : 0, options.capacity);
+  Totals totals;
+  auto start = Clock::now();
+  auto deadline = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+  uint64_t seed = options.seed;
+  do {
+    log.Reset();
+    Round round(log, options, totals);
+    round.Run(deadline, seed);
+    ++totals.rounds;
+    if (round.failed()) {
+      fprintf(stderr, "shmio-stress: %s log, seed %" PRIu64 ": %s\n", mode.c_str(), seed, round.error().c_str());
+      return kExitFailed;
+    }
+    seed = Mix(seed);
+  } while (Clock::now() < deadline);
+  double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+  printf("%s: %u readers, %.1f s, %" PRIu64 " round%s\n", mode.c_str(), options.readers, elapsed, totals.rounds,
+    totals.rounds == 1 ? "" : "s");
+  printf("  written   %" PRIu64 " frames, %s (%.0f frames/s, %s/s)\n", totals.framesWritten,
+    FormatBytes(static_cast<double>(totals.bytesWritten)).c_str(), totals.framesWritten / elapsed,
+    FormatBytes(totals.bytesWritten / elapsed).c_str());
+  uint64_t verified = totals.framesVerified.load();
+  uint64_t verifiedBytes = totals.bytesVerified.load();
+  printf("  verified  %" PRIu64 " frames, %s (%s/s across readers), %" PRIu64 " seeks\n", verified,
+    FormatBytes(static_cast<double>(verifiedBytes)).c_str(), FormatBytes(verifiedBytes / elapsed).c_str(),
+    totals.seeks.load());
+  if (ring) {
+    printf("  writer    held back by readers %" PRIu64 " times\n", totals.writerStalls);
+  }
+  return 0;
+}
+
+int Usage() {
+  fprintf(stderr,
+    "usage: shmio-stress [--seconds <s>] [--readers <n>] [--mode ring|linear|both]\n"
+    "                    [--ring-bytes <n>] [--capacity <n>] [--seek-every <batches>] [--seed <n>]\n");
+  return kExitUsage;
+}
+
+bool ParseUint64(const char* text, uint64_t* out) {
+  char* end = nullptr;
+  errno = 0;
+  unsigned long long value = strtoull(text, &end, 0);
+  if (errno != 0 || end == text || *end != '\0') {
+    return false;
+  }
+  *out = value;
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  options.seed = static_cast<uint64_t>(Clock::now().time_since_epoch().count());
+  for (int i = 1; i < argc; ++i) {
+    std::string option = argv[i];
+    if (i + 1 >= argc) {
+      return Usage();
+    }
+    const char* value = argv[++i];
+    uint64_t number = 0;
+    if (option == "--mode") {
+      options.mode = value;
+    } else if (!ParseUint64(value, &number)) {
+      return Usage();
+    } else if (option == "--seconds") {
+      options.seconds = static_cast<double>(number);
+    } else if (option == "--readers") {
+      options.readers = static_cast<uint32_t>(number);
+    } else if (option == "--ring-bytes") {
+      options.ringBytes = number;
+    } else if (option == "--capacity") {
+      options.capacity = number;
+    } else if (option == "--seek-every") {
+      options.seekEvery = number;
+    } else if (option == "--seed") {
+      options.seed = number;
+    } else {
+      return Usage();
+    }
+  }
+
+  uint64_t pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+  bool runRing = options.mode == "ring" || options.mode == "both";
+  bool runLinear = options.mode == "linear" || options.mode == "both";
+  if ((!runRing && !runLinear) || options.readers == 0) {
+    return Usage();
+  }
+  if (runRing && (options.readers > shmio::kReaderSlots || options.ringBytes % pageSize != 0
+      || options.ringBytes < shmio::kMinRingBytes)) {
+    fprintf(stderr, "shmio-stress: ring runs need at most %u readers and --ring-bytes of whole pages >= %" PRIu64 "\n",
+      shmio::kReaderSlots, shmio::kMinRingBytes);
+    return kExitUsage;
+  }
+  if (runLinear && options.capacity < 2 * shmio::kMaxFrameBytes) {
+    fprintf(stderr, "shmio-stress: --capacity must hold at least two full-size frames\n");
+    return kExitUsage;
+  }
+
+  printf("seed %" PRIu64 "\n", options.seed);
+  fflush(stdout);
+  try {
+    double seconds = runRing && runLinear ? options.seconds / 2 : options.seconds;
+    if (runRing && RunMode("ring", options, seconds) != 0) {
+      return kExitFailed;
+    }
+    if (runLinear && RunMode("linear", options, seconds) != 0) {
+      return kExitFailed;
+    }
+  } catch (const std::exception& e) {
+    fprintf(stderr, "shmio-stress: %s\n", e.what());
+    return kExitUsage;
+  }
+  return 0;
+}
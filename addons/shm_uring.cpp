@@ -0,0 +1,249 @@
+#include "shm_uring.h"
+
+#include <errno.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define SHMIO_HAVE_IO_URING 1
+#endif
+#endif
+
+#ifdef SHMIO_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#endif
+
+namespace shmio {
+
+bool UringWriter::IsUnsupported(int error) {
+  return error == EINVAL || error == ENOSYS || error == EPERM || error == EOPNOTSUPP;
+}
+
+#ifdef SHMIO_HAVE_IO_URING
+
+namespace {
+
+constexpr uint32_t kChunkBytes = 1024 * 1024;
+
+} // namespace
+
+UringWriter::~UringWriter() {
+  // Closing the ring waits for anything still in flight, so callers must keep
+  // the source buffers alive until the writer is gone.
+  if (sqes_ != nullptr) {
+    munmap(sqes_, sqesBytes_);
+  }
+  if (cqRing_ != nullptr && cqRing_ != sqRing_) {
+    munmap(cqRing_, cqRingBytes_);
+  }
+  if (sqRing_ != nullptr) {
+    munmap(sqRing_, sqRingBytes_);
+  }
+  if (ringFd_ >= 0) {
+    close(ringFd_);
+  }
+}
+
+bool UringWriter::Init(unsigned entries) {
+  io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+
+  long fd = syscall(__NR_io_uring_setup, entries, &params);
+  if (fd < 0) {
+    return false;
+  }
+  ringFd_ = static_cast<int>(fd);
+  entries_ = params.sq_entries;
+
+  sqRingBytes_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cqRingBytes_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (singleMmap) {
+    sqRingBytes_ = cqRingBytes_ = std::max(sqRingBytes_, cqRingBytes_);
+  }
+
+  void* sq = mmap(nullptr, sqRingBytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+  if (sq == MAP_FAILED) {
+    return false;
+  }
+  sqRing_ = sq;
+
+  if (singleMmap) {
+    cqRing_ = sqRing_;
+  } else {
+    void* cq = mmap(nullptr, cqRingBytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_CQ_RING);
+    if (cq == MAP_FAILED) {
+      return false;
+    }
+    cqRing_ = cq;
+  }
+
+  sqesBytes_ = params.sq_entries * sizeof(io_uring_sqe);
+  void* sqes = mmap(nullptr, sqesBytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    return false;
+  }
+  sqes_ = sqes;
+
+  uint8_t* sqBase = static_cast<uint8_t*>(sqRing_);
+  sqTail_ = reinterpret_cast<unsigned*>(sqBase + params.sq_off.tail);
+  sqMask_ = reinterpret_cast<unsigned*>(sqBase + params.sq_off.ring_mask);
+  sqArray_ = reinterpret_cast<unsigned*>(sqBase + params.sq_off.array);
+
+  uint8_t* cqBase = static_cast<uint8_t*>(cqRing_);
+  cqHead_ = reinterpret_cast<unsigned*>(cqBase + params.cq_off.head);
+  cqTail_ = reinterpret_cast<unsigned*>(cqBase + params.cq_off.tail);
+  cqMask_ = reinterpret_cast<unsigned*>(cqBase + params.cq_off.ring_mask);
+  cqes_ = cqBase + params.cq_off.cqes;
+
+  chunks_.assign(entries_, Chunk {});
+  freeSlots_.clear();
+  for (uint32_t slot = 0; slot < entries_; ++slot) {
+    freeSlots_.push_back(slot);
+  }
+  return true;
+}
+
+void UringWriter::Submit(int fd, uint32_t slot, unsigned* toSubmit) {
+  // Single producer: only this thread advances the SQ tail.
+  unsigned tail = *sqTail_;
+  unsigned index = tail & *sqMask_;
+  io_uring_sqe* sqe = static_cast<io_uring_sqe*>(sqes_) + index;
+  const Chunk& chunk = chunks_[slot];
+
+  std::memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_WRITE;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uintptr_t>(chunk.data);
+  sqe->len = chunk.length;
+  sqe->off = chunk.offset;
+  sqe->user_data = slot;
+
+  sqArray_[index] = index;
+  __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+  ++*toSubmit;
+}
+
+bool UringWriter::Enter(unsigned toSubmit, unsigned minComplete) {
+  while (true) {
+    long consumed = syscall(__NR_io_uring_enter, ringFd_, toSubmit, minComplete,
+      minComplete > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+    if (consumed < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+        continue;
+      }
+      return false;
+    }
+    if (static_cast<unsigned>(consumed) >= toSubmit) {
+      return true;
+    }
+    toSubmit -= static_cast<unsigned>(consumed);
+  }
+}
+
+bool UringWriter::WriteAll(int fd, const uint8_t* data, size_t length, uint64_t offset) {
+  if (ringFd_ < 0) {
+    errno = EBADF;
+    return false;
+  }
+
+  size_t queued = 0;
+  unsigned inFlight = 0;
+  int firstError = 0;
+  std::vector<uint32_t> retry;
+
+  while (inFlight > 0 || (firstError == 0 && (!retry.empty() || queued < length))) {
+    unsigned toSubmit = 0;
+    if (firstError == 0) {
+      for (uint32_t slot : retry) {
+        Submit(fd, slot, &toSubmit);
+      }
+      retry.clear();
+      while (queued < length && !freeSlots_.empty()) {
+        uint32_t slot = freeSlots_.back();
+        freeSlots_.pop_back();
+        Chunk& chunk = chunks_[slot];
+        chunk.data = data + queued;
+        chunk.offset = offset + queued;
+        chunk.length = static_cast<uint32_t>(std::min<size_t>(kChunkBytes, length - queued));
+        queued += chunk.length;
+        Submit(fd, slot, &toSubmit);
+      }
+    } else {
+      for (uint32_t slot : retry) {
+        freeSlots_.push_back(slot);
+      }
+      retry.clear();
+    }
+
+    inFlight += toSubmit;
+    if (!Enter(toSubmit, inFlight > 0 ? 1 : 0)) {
+      // The ring is unusable; the destructor waits for whatever is in flight.
+      return false;
+    }
+
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+      const io_uring_cqe* cqe = static_cast<const io_uring_cqe*>(cqes_) + (head & *cqMask_);
+      uint32_t slot = static_cast<uint32_t>(cqe->user_data);
+      int32_t res = cqe->res;
+      ++head;
+      --inFlight;
+
+      Chunk& chunk = chunks_[slot];
+      if (res < 0 && (res == -EINTR || res == -EAGAIN)) {
+        retry.push_back(slot);
+      } else if (res <= 0) {
+        if (firstError == 0) {
+          firstError = res < 0 ? -res : EIO;
+        }
+        freeSlots_.push_back(slot);
+      } else if (static_cast<uint32_t>(res) < chunk.length) {
+        chunk.data += res;
+        chunk.offset += static_cast<uint32_t>(res);
+        chunk.length -= static_cast<uint32_t>(res);
+        retry.push_back(slot);
+      } else {
+        freeSlots_.push_back(slot);
+      }
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+  }
+
+  if (firstError != 0) {
+    errno = firstError;
+    return false;
+  }
+  return true;
+}
+
+#else
+
+UringWriter::~UringWriter() = default;
+
+bool UringWriter::Init(unsigned) {
+  errno = ENOSYS;
+  return false;
+}
+
+void UringWriter::Submit(int, uint32_t, unsigned*) {}
+
+bool UringWriter::Enter(unsigned, unsigned) {
+  errno = ENOSYS;
+  return false;
+}
+
+bool UringWriter::WriteAll(int, const uint8_t*, size_t, uint64_t) {
+  errno = ENOSYS;
+  return false;
+}
+
+#endif
+
+} // namespace shmio
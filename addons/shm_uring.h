@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace shmio {
+
+// Minimal io_uring submitter for large file writes, driven through the raw
+// syscalls so the addon does not need liburing. Only IORING_OP_WRITE is used.
+// Callers fall back to pwrite() when Init() or WriteAll() fail with EINVAL,
+// ENOSYS, EPERM or EOPNOTSUPP (old kernels, seccomp, containers).
+class UringWriter {
+public:
+  UringWriter() = default;
+  UringWriter(const UringWriter&) = delete;
+  UringWriter& operator=(const UringWriter&) = delete;
+  ~UringWriter();
+
+  // Sets up a ring with `entries` submission slots. Returns false with errno
+  // set when io_uring is unavailable.
+  bool Init(unsigned entries);
+
+  // Writes [data, data + length) to fd at offset, keeping up to `entries`
+  // chunks in flight. Short writes are resubmitted. Returns false with errno
+  // set; nothing is left in flight when it returns.
+  bool WriteAll(int fd, const uint8_t* data, size_t length, uint64_t offset);
+
+  static bool IsUnsupported(int error);
+
+private:
+  struct Chunk {
+    const uint8_t* data { nullptr };
+    uint64_t offset { 0 };
+    uint32_t length { 0 };
+  };
+
+  void Submit(int fd, uint32_t slot, unsigned* toSubmit);
+  bool Enter(unsigned toSubmit, unsigned minComplete);
+
+  int ringFd_ { -1 };
+  unsigned entries_ { 0 };
+
+  void* sqRing_ { nullptr };
+  size_t sqRingBytes_ { 0 };
+  void* cqRing_ { nullptr };
+  size_t cqRingBytes_ { 0 };
+  void* sqes_ { nullptr };
+  size_t sqesBytes_ { 0 };
+
+  unsigned* sqTail_ { nullptr };
+  unsigned* sqMask_ { nullptr };
+  unsigned* sqArray_ { nullptr };
+  unsigned* cqHead_ { nullptr };
+  unsigned* cqTail_ { nullptr };
+  unsigned* cqMask_ { nullptr };
+  void* cqes_ { nullptr };
+
+  std::vector<Chunk> chunks_;
+  std::vector<uint32_t> freeSlots_;
+};
+
+} // namespace shmio
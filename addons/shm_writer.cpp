@@ -3,8 +3,13 @@
 #include <algorithm>
 #include <atomic>
 #include <limits>
+#include <string>
 
+#include "shm_buffer_views.h"
+#include "shm_format.h"
 #include "shm_mapping.h"
+#include "shm_readers.h"
+#include "shm_spin.h"
 
 namespace {
 constexpr uint32_t kMessageHeaderBytes = 2;
@@ -16,7 +21,10 @@ Napi::FunctionReference ShmWriter::constructor_;
 void ShmWriter::Init(Napi::Env env, Napi::Object exports) {
   Napi::Function func = DefineClass(env, "ShmWriter", {
     InstanceMethod<&ShmWriter::Allocate>("allocate"),
+    InstanceMethod<&ShmWriter::Reserve>("reserve"),
     InstanceMethod<&ShmWriter::Commit>("commit"),
+    InstanceMethod<&ShmWriter::CommitThrough>("commitThrough"),
+    InstanceMethod<&ShmWriter::Abort>("abort"),
     InstanceMethod<&ShmWriter::Close>("close"),
     InstanceMethod<&ShmWriter::GetLastAllocatedAddress>("getLastAllocatedAddress"),
     InstanceMethod<&ShmWriter::GetBufferAtAddress>("getBufferAtAddress"),
@@ -42,9 +50,19 @@ ShmWriter::ShmWriter(const Napi::CallbackInfo& info)
   mappingRef_ = Napi::Persistent(info[1].As<Napi::Object>());
   mappingRef_.SuppressDestruct();
   debugChecks_ = info[2].As<Napi::Boolean>().Value();
+  if (info.Length() >= 5) {
+    std::string policy = info[3].As<Napi::String>().Utf8Value();
+    backpressure_ = policy == "block" ? Backpressure::Block
+      : policy == "fail" ? Backpressure::Fail : Backpressure::Overwrite;
+    maxBlockNs_ = static_cast<uint64_t>(info[4].As<Napi::Number>().DoubleValue());
+  }
 
   if (mapping_ != nullptr) {
     cursor_ = mapping_->LoadCommittedSize();
+    committedMessages_ = mapping_->LoadCommittedMessages();
+    if (mapping_->ringBytes() != 0) {
+      writeFrontier_ = std::max(cursor_, shmio::ReadUint64LE(mapping_->base() + shmio::kWriteFrontierOffset));
+    }
   }
 }
 
@@ -70,89 +88,323 @@ Napi::Value ShmWriter::Allocate(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
   EnsureOpen(env);
 
-  if (info.Length() < 1 || !info[0].IsNumber()) {
-    Napi::TypeError::New(env, "allocate(size) expects a number").ThrowAsJavaScriptException();
+  uint32_t payloadSize = 0;
+  uint32_t alignment = 1;
+  if (!ParseAllocation(env, info, 0, &payloadSize, &alignment)) {
+    return env.Null();
+  }
+  uint8_t* payloadPtr = AllocateFrame(env, payloadSize, alignment);
+  if (payloadPtr == nullptr) {
+    return env.Null();
+  }
+  return PayloadView(env, payloadPtr, payloadSize);
+}
+
+Napi::Value ShmWriter::Reserve(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  EnsureOpen(env);
+
+  uint32_t payloadSize = 0;
+  uint32_t alignment = 1;
+  if (!ParseAllocation(env, info, 0, &payloadSize, &alignment)) {
     return env.Null();
   }
+  uint8_t* payloadPtr = AllocateFrame(env, payloadSize, alignment);
+  if (payloadPtr == nullptr) {
+    return env.Null();
+  }
+  Napi::Object reservation = Napi::Object::New(env);
+  reservation.Set("token", Napi::BigInt::New(env, committedMessages_ + pendingFrameEnds_.size() - 1));
+  reservation.Set("buffer", PayloadView(env, payloadPtr, payloadSize));
+  return reservation;
+}
+
+bool ShmWriter::ParseAllocation(Napi::Env env, const Napi::CallbackInfo& info, size_t sizeArg,
+    uint32_t* payloadSize, uint32_t* alignment) {
+  if (env.IsExceptionPending()) {
+    return false;
+  }
+  if (info.Length() <= sizeArg || !info[sizeArg].IsNumber()) {
+    Napi::TypeError::New(env, "allocate(size) expects a number").ThrowAsJavaScriptException();
+    return false;
+  }
 
-  int64_t requested = info[0].As<Napi::Number>().Int64Value();
+  int64_t requested = info[sizeArg].As<Napi::Number>().Int64Value();
   if (requested <= 0) {
     Napi::RangeError::New(env, "allocate size must be positive").ThrowAsJavaScriptException();
-    return env.Null();
+    return false;
   }
+  *payloadSize = static_cast<uint32_t>(std::min<int64_t>(requested, std::numeric_limits<uint32_t>::max()));
 
-  uint32_t payloadSize = static_cast<uint32_t>(requested);
-  uint32_t frameSize = payloadSize + kFrameMetadataBytes;
+  *alignment = 1;
+  return info.Length() <= sizeArg + 1 || ParseAlignment(env, info[sizeArg + 1], alignment);
+}
+
+bool ShmWriter::ParseAlignment(Napi::Env env, const Napi::Value& options, uint32_t* alignment) {
+  if (!options.IsObject()) {
+    return true;
+  }
+  Napi::Object opts = options.As<Napi::Object>();
+  if (opts.Has("align") && !opts.Get("align").IsUndefined()) {
+    Napi::Value alignValue = opts.Get("align");
+    int64_t align = alignValue.IsNumber() ? alignValue.As<Napi::Number>().Int64Value() : 0;
+    if (align <= 0 || align > shmio::kMaxAlignment || (align & (align - 1)) != 0) {
+      Napi::RangeError::New(env, "align must be a power of two <= " + std::to_string(shmio::kMaxAlignment))
+        .ThrowAsJavaScriptException();
+      return false;
+    }
+    *alignment = static_cast<uint32_t>(align);
+  }
+  return true;
+}
+
+uint8_t* ShmWriter::AllocateFrame(Napi::Env env, uint32_t payloadSize, uint32_t alignment) {
+  uint32_t sequenceBytes = mapping_->frameSequenceBytes();
+  if (payloadSize > shmio::kMaxPayloadBytes - sequenceBytes) {
+    Napi::RangeError::New(env, "allocate size must be <= " + std::to_string(shmio::kMaxPayloadBytes - sequenceBytes))
+      .ThrowAsJavaScriptException();
+    return nullptr;
+  }
+
+  uint32_t frameSize = payloadSize + kFrameMetadataBytes + sequenceBytes;
 
   uint64_t headerSize = mapping_->headerSize();
   uint64_t dataOffset = mapping_->dataOffset();
   uint64_t length = mapping_->length();
-  uint8_t* base = mapping_->base();
 
   uint64_t writeCursor = cursor_ + pendingBytes_;
   if (writeCursor < dataOffset) {
     writeCursor = dataOffset;
   }
 
-  if (writeCursor + frameSize > length) {
-    Napi::Error::New(env, "Shared memory exhausted while allocating frame").ThrowAsJavaScriptException();
-    return env.Null();
+  // Positions are aligned rather than pointers: mappings are page aligned and
+  // ring sizes are whole pages, so the payload address is aligned as well.
+  uint32_t padding = shmio::PaddingFor(writeCursor, alignment, kMessageHeaderBytes + sequenceBytes);
+  uint64_t allocationSize = static_cast<uint64_t>(padding) + frameSize;
+
+  uint64_t ringBytes = mapping_->ringBytes();
+  if (ringBytes != 0) {
+    // Ring logs wrap instead of running out, but a single uncommitted batch
+    // must not lap itself.
+    if (pendingBytes_ + allocationSize > ringBytes) {
+      Napi::Error::New(env, "Pending frames exceed ring capacity; commit before allocating more").ThrowAsJavaScriptException();
+      return nullptr;
+    }
+    if (mapping_->readerSlots().valid() && !MakeRoomForReaders(env, writeCursor + allocationSize)) {
+      return nullptr;
+    }
+    // Readers without a slot find out from the frontier that the bytes about
+    // to be written are no longer the frames they were reading.
+    if (writeCursor + allocationSize > writeFrontier_) {
+      writeFrontier_ = writeCursor + allocationSize;
+      shmio::PublishWriteFrontier(mapping_->base(), writeFrontier_);
+    }
+  } else if (writeCursor + allocationSize > length) {
+    if (!mapping_->Grow(env, writeCursor + allocationSize)) {
+      if (!env.IsExceptionPending()) {
+        Napi::Error::New(env, "Shared memory exhausted while allocating frame").ThrowAsJavaScriptException();
+      }
+      return nullptr;
+    }
+    length = mapping_->length();
   }
 
   if (debugChecks_) {
     if (writeCursor > dataOffset && writeCursor >= headerSize + kFrameMetadataBytes) {
       uint64_t previousFrameEnd = writeCursor;
       uint64_t previousFrameSuffixOffset = previousFrameEnd - kMessageHeaderBytes;
-      uint16_t previousFrameSize = ReadUint16LE(base + previousFrameSuffixOffset);
+      uint16_t previousFrameSize = ReadUint16LE(mapping_->DataPtr(previousFrameSuffixOffset));
       if (previousFrameSize < kFrameMetadataBytes || previousFrameSize > std::numeric_limits<uint32_t>::max()) {
         Napi::Error::New(env, "[DEBUG] Invalid previous frame size").ThrowAsJavaScriptException();
-        return env.Null();
+        return nullptr;
       }
       uint64_t previousFrameStart = previousFrameEnd - previousFrameSize;
       if (previousFrameStart < dataOffset) {
         Napi::Error::New(env, "[DEBUG] Previous frame crosses data offset").ThrowAsJavaScriptException();
-        return env.Null();
+        return nullptr;
       }
-      uint16_t leading = ReadUint16LE(base + previousFrameStart);
+      uint16_t leading = ReadUint16LE(mapping_->DataPtr(previousFrameStart));
       if (leading != previousFrameSize) {
         Napi::Error::New(env, "[DEBUG] Frame corruption detected (prefix != suffix)").ThrowAsJavaScriptException();
-        return env.Null();
+        return nullptr;
       }
     }
   }
 
-  uint8_t* framePtr = base + writeCursor;
+  if (padding != 0) {
+    shmio::WritePadding(mapping_->DataPtr(writeCursor), padding);
+    writeCursor += padding;
+  }
+
+  uint8_t* framePtr = mapping_->DataPtr(writeCursor);
   WriteUint16LE(framePtr, static_cast<uint16_t>(frameSize));
   WriteUint16LE(framePtr + frameSize - kMessageHeaderBytes, static_cast<uint16_t>(frameSize));
 
-  uint8_t* payloadPtr = framePtr + kMessageHeaderBytes;
+  if (sequenceBytes != 0) {
+    shmio::WriteUint64LE(framePtr + kMessageHeaderBytes, committedMessages_ + pendingFrameEnds_.size());
+  }
+
+  uint8_t* payloadPtr = framePtr + kMessageHeaderBytes + sequenceBytes;
 
   // Track last allocated buffer location
-  lastAllocatedOffset_ = writeCursor + kMessageHeaderBytes;
+  lastAllocatedOffset_ = writeCursor + kMessageHeaderBytes + sequenceBytes;
   lastAllocatedPayloadSize_ = payloadSize;
 
-  pendingBytes_ += frameSize;
+  pendingBytes_ += allocationSize;
+  pendingFrameEnds_.push_back(writeCursor + frameSize);
 
-  return Napi::Buffer<uint8_t>::New(env, payloadPtr, payloadSize);
+  return payloadPtr;
+}
+
+bool ShmWriter::MakeRoomForReaders(Napi::Env env, uint64_t end) {
+  shmio::ReaderSlots& readers = mapping_->readerSlots();
+  // Readers only move forward between generations, which only raises the
+  // limit, so the slots are scanned again only once it is in the way.
+  if (end <= readerLimit_ && readers.Generation() == readerGeneration_) {
+    return true;
+  }
+  auto rescan = [&] {
+    readerGeneration_ = readers.Generation();
+    readerLimit_ = ReaderLimit(readers.MinCursor());
+    return end <= readerLimit_;
+  };
+  if (rescan()) {
+    return true;
+  }
+
+  if (backpressure_ == Backpressure::Overwrite) {
+    // The limit is at least dataOffset + ringBytes, so this cannot wrap.
+    readers.MarkLappedBelow(end - mapping_->dataOffset() - mapping_->ringBytes());
+    rescan();
+    return true;
+  }
+  // A reader that crashed would otherwise hold the writer back for good.
+  if (readers.ReclaimDead() != 0 && rescan()) {
+    return true;
+  }
+  if (backpressure_ == Backpressure::Block && readers.WaitForReaders(rescan, maxBlockNs_)) {
+    return true;
+  }
+
+  Napi::Error err = Napi::Error::New(env, "Ring is full: the next frame would overwrite frames a critical reader has not read");
+  err.Set("code", Napi::String::New(env, "ERR_SHM_BACKPRESSURE"));
+  err.ThrowAsJavaScriptException();
+  return false;
+}
+
+uint64_t ShmWriter::ReaderLimit(uint64_t minCursor) const {
+  if (minCursor == shmio::kNoReaderCursor) {
+    return std::numeric_limits<uint64_t>::max();
+  }
+  return mapping_->dataOffset() + minCursor + mapping_->ringBytes();
 }
 
 void ShmWriter::Commit(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
   EnsureOpen(env);
+  CommitPending(env);
+}
 
-  if (pendingBytes_ == 0) {
+void ShmWriter::CommitPending(Napi::Env env) {
+  if (pendingFrameEnds_.empty()) {
     return;
   }
+  PublishFrames(env, pendingFrameEnds_.size());
+}
+
+void ShmWriter::AbortPending() {
+  if (!closed_) {
+    DropPendingFrames(0);
+  }
+}
+
+void ShmWriter::CommitThrough(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  EnsureOpen(env);
+
+  uint64_t token = 0;
+  if (info.Length() < 1 || !ParseToken(env, info[0], &token)) {
+    return;
+  }
+  // Tokens below committedMessages_ were published by an earlier call.
+  if (token < committedMessages_) {
+    return;
+  }
+  if (token - committedMessages_ >= pendingFrameEnds_.size()) {
+    Napi::RangeError::New(env, "token " + std::to_string(token) + " does not refer to a pending frame")
+      .ThrowAsJavaScriptException();
+    return;
+  }
+  PublishFrames(env, token - committedMessages_ + 1);
+}
+
+void ShmWriter::Abort(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  EnsureOpen(env);
+
+  // Without a token every pending frame is dropped.
+  uint64_t keep = 0;
+  if (info.Length() >= 1 && !info[0].IsUndefined()) {
+    uint64_t token = 0;
+    if (!ParseToken(env, info[0], &token)) {
+      return;
+    }
+    if (token < committedMessages_) {
+      Napi::Error::New(env, "token " + std::to_string(token) + " is already committed").ThrowAsJavaScriptException();
+      return;
+    }
+    keep = token - committedMessages_;
+    if (keep >= pendingFrameEnds_.size()) {
+      Napi::RangeError::New(env, "token " + std::to_string(token) + " does not refer to a pending frame")
+        .ThrowAsJavaScriptException();
+      return;
+    }
+  }
+
+  DropPendingFrames(keep);
+}
 
-  uint64_t newSize = cursor_ + pendingBytes_;
-  mapping_->StoreCommittedSize(newSize);
+void ShmWriter::DropPendingFrames(uint64_t keep) {
+  // The dropped bytes were never published, so rewinding the write position
+  // is enough; the next allocation overwrites them.
+  pendingFrameEnds_.resize(keep);
+  uint64_t writeFrontier = keep == 0 ? cursor_ : pendingFrameEnds_.back();
+  pendingBytes_ = writeFrontier - cursor_;
+  if (lastAllocatedOffset_ >= writeFrontier) {
+    lastAllocatedOffset_ = 0;
+    lastAllocatedPayloadSize_ = 0;
+  }
+}
+
+void ShmWriter::PublishFrames(Napi::Env env, uint64_t frames) {
+  uint64_t newSize = pendingFrameEnds_[frames - 1];
+  committedMessages_ += frames;
+  mapping_->StoreCommittedSize(newSize, committedMessages_);
+  pendingBytes_ -= newSize - cursor_;
   cursor_ = newSize;
-  pendingBytes_ = 0;
+  pendingFrameEnds_.erase(pendingFrameEnds_.begin(), pendingFrameEnds_.begin() + frames);
+  mapping_->NotifyCommitWaiters();
+}
+
+bool ShmWriter::ParseToken(Napi::Env env, const Napi::Value& value, uint64_t* token) const {
+  if (value.IsBigInt()) {
+    bool lossless = false;
+    *token = value.As<Napi::BigInt>().Uint64Value(&lossless);
+    if (lossless) {
+      return true;
+    }
+  } else if (value.IsNumber() && value.As<Napi::Number>().DoubleValue() >= 0) {
+    *token = static_cast<uint64_t>(value.As<Napi::Number>().DoubleValue());
+    return true;
+  }
+  Napi::TypeError::New(env, "token must be a reservation token from reserve()").ThrowAsJavaScriptException();
+  return false;
 }
 
 void ShmWriter::Close(const Napi::CallbackInfo& info) {
   closed_ = true;
   pendingBytes_ = 0;
+  pendingFrameEnds_.clear();
   lastAllocatedOffset_ = 0;
   lastAllocatedPayloadSize_ = 0;
   if (!mappingRef_.IsEmpty()) {
@@ -216,15 +468,27 @@ Napi::Value ShmWriter::GetBufferAtAddress(const Napi::CallbackInfo& info) {
 
   uint64_t dataOffset = mapping_->dataOffset();
   uint64_t length = mapping_->length();
-  uint8_t* base = mapping_->base();
-
-  if (address < dataOffset || address + static_cast<uint64_t>(size) > length) {
+  uint64_t ringBytes = mapping_->ringBytes();
+
+  if (ringBytes != 0) {
+    // Ring addresses are monotonic positions; only the last lap is mapped.
+    uint64_t writeFrontier = cursor_ + pendingBytes_;
+    if (address < dataOffset || address + static_cast<uint64_t>(size) > writeFrontier
+        || writeFrontier - address > ringBytes) {
+      Napi::RangeError::New(env, "Address/size out of bounds").ThrowAsJavaScriptException();
+      return env.Null();
+    }
+  } else if (address < dataOffset || address + static_cast<uint64_t>(size) > length) {
     Napi::RangeError::New(env, "Address/size out of bounds").ThrowAsJavaScriptException();
     return env.Null();
   }
 
-  uint8_t* ptr = base + address;
-  return Napi::Buffer<uint8_t>::New(env, ptr, static_cast<size_t>(size));
+  uint8_t* ptr = mapping_->DataPtr(address);
+  return PayloadView(env, ptr, static_cast<size_t>(size));
+}
+
+Napi::Value ShmWriter::PayloadView(Napi::Env env, const uint8_t* data, size_t length) const {
+  return shmio::BufferViews(env, mapping_->MappingArrayBuffer(env)).View(data, length);
 }
 
 uint16_t ShmWriter::ReadUint16LE(const uint8_t* data) {
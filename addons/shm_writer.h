@@ -2,6 +2,7 @@
 
 #include <napi.h>
 #include <atomic>
+#include <deque>
 
 class ShmMapping;
 
@@ -13,15 +14,55 @@ public:
   ShmWriter(const Napi::CallbackInfo& info);
   ~ShmWriter() override;
 
+  // Native interface for ShmPartitionedWriter, which drives several writers
+  // from one JS object. The methods that can fail leave a JS exception
+  // pending.
+  void EnsureOpen(Napi::Env env) const;
+  bool SharesMapping(const ShmWriter& other) const { return mapping_ == other.mapping_; }
+  // Reads the size at info[sizeArg] and the { align } options after it.
+  bool ParseAllocation(Napi::Env env, const Napi::CallbackInfo& info, size_t sizeArg,
+    uint32_t* payloadSize, uint32_t* alignment);
+  // Reads { align } from an allocate() options object; leaves `alignment`
+  // unchanged when absent.
+  static bool ParseAlignment(Napi::Env env, const Napi::Value& options, uint32_t* alignment);
+  // Appends a pending frame. Returns the payload pointer, or nullptr with a
+  // JS exception pending.
+  uint8_t* AllocateFrame(Napi::Env env, uint32_t payloadSize, uint32_t alignment);
+  // Buffer over `length` bytes of the mapping at `data`, as a view of the
+  // mapping's ArrayBuffer.
+  Napi::Value PayloadView(Napi::Env env, const uint8_t* data, size_t length) const;
+  // Publishes every pending frame, as commit() does.
+  void CommitPending(Napi::Env env);
+  // Drops every pending frame, as abort() without a token does. Does nothing
+  // once the writer is closed.
+  void AbortPending();
+
 private:
+  // What a ring writer does when its next frame would overwrite frames a
+  // critical reader has not read yet.
+  enum class Backpressure { Overwrite, Fail, Block };
+
   friend class ShmMapping;
   Napi::Value Allocate(const Napi::CallbackInfo& info);
+  Napi::Value Reserve(const Napi::CallbackInfo& info);
   void Commit(const Napi::CallbackInfo& info);
+  void CommitThrough(const Napi::CallbackInfo& info);
+  void Abort(const Napi::CallbackInfo& info);
   void Close(const Napi::CallbackInfo& info);
   Napi::Value GetLastAllocatedAddress(const Napi::CallbackInfo& info);
   Napi::Value GetBufferAtAddress(const Napi::CallbackInfo& info);
 
-  void EnsureOpen(Napi::Env env) const;
+  // Checks that ring writes up to `end` leave every critical reader's
+  // unread frames alone, applying the backpressure policy when they would
+  // not. Returns false with a JS exception pending.
+  bool MakeRoomForReaders(Napi::Env env, uint64_t end);
+  // First position writes may not reach past, for the lowest reader cursor.
+  uint64_t ReaderLimit(uint64_t minCursor) const;
+  // Publishes the oldest `frames` pending frames.
+  void PublishFrames(Napi::Env env, uint64_t frames);
+  // Keeps the oldest `keep` pending frames and rewinds past the rest.
+  void DropPendingFrames(uint64_t keep);
+  bool ParseToken(Napi::Env env, const Napi::Value& value, uint64_t* token) const;
   void WriteFrameHeaders(uint8_t* framePtr, uint32_t frameSize) const;
   static uint16_t ReadUint16LE(const uint8_t* data);
   static void WriteUint16LE(uint8_t* data, uint16_t value);
@@ -30,8 +71,21 @@ private:
   Napi::Reference<Napi::Object> mappingRef_;
   bool closed_ { false };
   bool debugChecks_ { false };
+  Backpressure backpressure_ { Backpressure::Overwrite };
+  uint64_t maxBlockNs_ { 0 };
+  // Writes may run up to readerLimit_ without looking at the reader slots
+  // while their generation is still readerGeneration_.
+  uint64_t readerLimit_ { 0 };
+  uint32_t readerGeneration_ { 0 };
   uint64_t cursor_ { 0 };
   uint64_t pendingBytes_ { 0 };
+  // Ring write frontier last published in the header (shm_format.h); aborted
+  // frames do not lower it.
+  uint64_t writeFrontier_ { 0 };
+  uint64_t committedMessages_ { 0 };
+  // End position of every pending frame, oldest first. A frame's token is its
+  // sequence number, committedMessages_ + its index here.
+  std::deque<uint64_t> pendingFrameEnds_;
   uint64_t lastAllocatedOffset_ { 0 };
   uint32_t lastAllocatedPayloadSize_ { 0 };
 };
@@ -21,7 +21,7 @@
       "msvs_settings": {
         "VCCLCompilerTool": { "ExceptionHandling": 1 },
       },
-  "sources": [ "./addons/mmap.cpp", "./addons/shm_iterator.cpp", "./addons/shm_mapping.cpp", "./addons/shm_writer.cpp" ],
+  "sources": [ "./addons/mmap.cpp", "./addons/shm_iterator.cpp", "./addons/shm_mapping.cpp", "./addons/shm_writer.cpp", "./addons/shm_compactor.cpp", "./addons/shm_mirror.cpp", "./addons/shm_archiver.cpp", "./addons/shm_uring.cpp", "./addons/shm_checkpoint.cpp", "./addons/shm_scanner.cpp", "./addons/shm_merged_iterator.cpp", "./addons/shm_partitioned_writer.cpp", "./addons/shm_compressor.cpp", "./addons/shm_compressed_iterator.cpp" ],
         "cflags_cc": [ "<@(cflags_cc)" ],
         "include_dirs" : [
           "<!(node -p \"require('node-addon-api').include\")",
@@ -40,6 +40,29 @@
             }
           ]
         ]
+    },
+    {
+      "target_name": "shmio-inspect",
+      "type": "executable",
+      "cflags!": [ "-fno-exceptions" ],
+      "cflags_cc!": [ "-fno-exceptions" ],
+      "xcode_settings": { "GCC_ENABLE_CPP_EXCEPTIONS": "YES",
+        "MACOSX_DEPLOYMENT_TARGET": "10.7",
+      },
+      "sources": [ "./addons/shm_inspect.cpp", "./addons/shm_mirror.cpp" ],
+      "cflags_cc": [ "<@(cflags_cc)" ],
+    },
+    {
+      "target_name": "shmio-stress",
+      "type": "executable",
+      "cflags!": [ "-fno-exceptions" ],
+      "cflags_cc!": [ "-fno-exceptions" ],
+      "xcode_settings": { "GCC_ENABLE_CPP_EXCEPTIONS": "YES",
+        "MACOSX_DEPLOYMENT_TARGET": "10.7",
+      },
+      "sources": [ "./addons/shm_stress.cpp", "./addons/shm_mirror.cpp" ],
+      "cflags_cc": [ "<@(cflags_cc)", "-pthread" ],
+      "ldflags": [ "-pthread" ],
     }
   ]
 }
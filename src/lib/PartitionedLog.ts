@@ -0,0 +1,168 @@
+import fs from 'fs'
+import path from 'path'
+import { createSharedLog, SharedLog } from './SharedLog'
+import { createPartitionedWriter } from './native'
+import type { PartitionedWriter } from './native/types'
+
+/**
+ * FNV-1a (64-bit) of the key bytes modulo the partition count. Stored in the
+ * manifest so producers and consumers in other languages can route keys.
+ */
+export const PARTITION_HASH = 'fnv1a64'
+
+export interface PartitionManifest {
+  version: 1
+  hash: typeof PARTITION_HASH
+  keyOffset: number
+  keyLength: number
+  /** Partition logs in partition order, relative to the manifest's directory. */
+  partitions: string[]
+}
+
+export interface PartitionedLogOptions {
+  /** Manifest path; partition logs are created next to it as `<path>.<index>`. */
+  path: string
+  partitions: number
+  /** Payload offset of the key that selects the partition. */
+  keyOffset: number
+  keyLength: number
+  /** Capacity of each partition. */
+  capacityBytes: number | bigint
+  debugChecks?: boolean
+  maxCapacityBytes?: number | bigint
+  growthStepBytes?: number | bigint
+  ring?: boolean
+  headerVersion?: 1 | 2
+  frameSequences?: boolean
+}
+
+export interface PartitionedLog {
+  manifest: PartitionManifest
+  /** One log per partition, in manifest order. */
+  partitions: SharedLog[]
+  /** Present when the log was opened with createPartitionedLog. */
+  writer?: PartitionedWriter
+  close(): void
+}
+
+export const readPartitionManifest = (manifestPath: string): PartitionManifest => {
+  const manifest = JSON.parse(fs.readFileSync(manifestPath, 'utf8')) as PartitionManifest
+  if (manifest.version !== 1 || manifest.hash !== PARTITION_HASH) {
+    throw new Error(`Unsupported partition manifest ${manifestPath}`)
+  }
+  if (!Array.isArray(manifest.partitions) || manifest.partitions.length === 0) {
+    throw new Error(`Partition manifest ${manifestPath} lists no partitions`)
+  }
+  return manifest
+}
+
+const partitionPath = (manifestPath: string, partition: string) =>
+  path.resolve(path.dirname(manifestPath), partition)
+
+// The manifest appears only once every partition exists, so a consumer that
+// can read it can open all of them.
+const writeManifest = (manifestPath: string, manifest: PartitionManifest) => {
+  const temporaryPath = `${manifestPath}.tmp`
+  fs.writeFileSync(temporaryPath, `${JSON.stringify(manifest, null, 2)}\n`)
+  fs.renameSync(temporaryPath, manifestPath)
+}
+
+const closeAll = (logs: SharedLog[]) => {
+  for (const log of logs) {
+    log.close()
+  }
+}
+
+/**
+ * Creates (or reopens) a set of logs that a PartitionedWriter fans out to,
+ * described by a manifest at `options.path`. Reopening checks that the
+ * partition count and key range match the manifest, since changing either
+ * would move keys between partitions.
+ */
+export const createPartitionedLog = (options: PartitionedLogOptions): PartitionedLog => {
+  let manifest: PartitionManifest
+  if (fs.existsSync(options.path)) {
+    manifest = readPartitionManifest(options.path)
+    if (manifest.partitions.length !== options.partitions
+        || manifest.keyOffset !== options.keyOffset || manifest.keyLength !== options.keyLength) {
+      throw new Error(`Partition manifest ${options.path} does not match the requested partitioning`)
+    }
+  } else {
+    if (!Number.isInteger(options.partitions) || options.partitions < 1) {
+      throw new RangeError('partitions must be a positive integer')
+    }
+    const base = path.basename(options.path)
+    manifest = {
+      version: 1,
+      hash: PARTITION_HASH,
+      keyOffset: options.keyOffset,
+      keyLength: options.keyLength,
+      partitions: Array.from({ length: options.partitions }, (_, index) => `${base}.${index}`),
+    }
+  }
+
+  const partitions: SharedLog[] = []
+  try {
+    for (const partition of manifest.partitions) {
+      partitions.push(createSharedLog({
+        path: partitionPath(options.path, partition),
+        writable: true,
+        capacityBytes: options.capacityBytes,
+        debugChecks: options.debugChecks,
+        maxCapacityBytes: options.maxCapacityBytes,
+        growthStepBytes: options.growthStepBytes,
+        ring: options.ring,
+        headerVersion: options.headerVersion,
+        frameSequences: options.frameSequences,
+      }))
+    }
+    if (!fs.existsSync(options.path)) {
+      writeManifest(options.path, manifest)
+    }
+  } catch (error) {
+    closeAll(partitions)
+    throw error
+  }
+
+  const writer = createPartitionedWriter(partitions.map(log => log.writer!), {
+    keyOffset: manifest.keyOffset,
+    keyLength: manifest.keyLength,
+  })
+
+  return {
+    manifest,
+    partitions,
+    writer,
+    close: () => {
+      writer.close()
+      closeAll(partitions)
+    },
+  }
+}
+
+/**
+ * Opens every partition listed in a manifest read-only, e.g. to give each
+ * consumer in a group its own partitions or to merge them back together.
+ */
+export const openPartitionedLog = (manifestPath: string, options: { debugChecks?: boolean } = {}): PartitionedLog => {
+  const manifest = readPartitionManifest(manifestPath)
+  const partitions: SharedLog[] = []
+  try {
+    for (const partition of manifest.partitions) {
+      partitions.push(createSharedLog({
+        path: partitionPath(manifestPath, partition),
+        writable: false,
+        debugChecks: options.debugChecks,
+      }))
+    }
+  } catch (error) {
+    closeAll(partitions)
+    throw error
+  }
+
+  return {
+    manifest,
+    partitions,
+    close: () => closeAll(partitions),
+  }
+}
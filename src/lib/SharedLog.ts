@@ -1,18 +1,75 @@
-import { getBendec, MemHeader } from './memHeader'
-import type { ShmIterator, ShmWriter, OpenSharedLogOptions } from './native/types'
+import { MemHeader, wrapMemHeader } from './memHeader'
+import type {
+  BackpressurePolicy,
+  CommitWaitResult,
+  ShmIterator,
+  ShmWriter,
+  OpenSharedLogOptions,
+  CreateIteratorOptions,
+  LastFrame,
+  LogSnapshot,
+  ScanRangeOptions,
+  ScanRangeResult,
+  ValidateResult,
+} from './native/types'
 import { openSharedLog } from './native'
 
-const mhBendec = getBendec()
+// Exactly one of path, fd and (for writers) memfd selects the log.
+interface SharedLogSource {
+  /** File to open or create, e.g. /dev/shm/name. */
+  path?: string
+  /**
+   * Inherited or received descriptor of an existing log. It is duplicated,
+   * so the caller still owns and closes `fd`.
+   */
+  fd?: number
+}
 
-interface WritableSharedLogOptions {
-  path: string
+interface WritableSharedLogOptions extends SharedLogSource {
+  /**
+   * Creates the log in an anonymous memfd instead of a file. It is sealed
+   * against shrinking (and growing, unless growable), and readers open it by
+   * descriptor; see SharedLog.fd().
+   */
+  memfd?: boolean
   capacityBytes: number | bigint
   writable: true
   debugChecks?: boolean
+  /**
+   * Makes a newly created log growable up to this size. Readers reserve this
+   * much address space and map added space lazily.
+   */
+  maxCapacityBytes?: number | bigint
+  /**
+   * Bytes added each time the writer runs out of space. Defaults to the
+   * initial capacity.
+   */
+  growthStepBytes?: number | bigint
+  /**
+   * Creates a ring log: the data region is mapped twice so frames wrap at the
+   * end of the segment. Readers that fall a full ring behind get ERR_SHM_LAPPED.
+   */
+  ring?: boolean
+  /**
+   * Header layout for a new log. Defaults to 2; use 1 only when readers built
+   * against older releases must read the log.
+   */
+  headerVersion?: 1 | 2
+  /**
+   * Stamps every frame of a new log with its sequence number, so iterators
+   * know their sequence and lag after seeking anywhere. Costs 8 bytes per frame.
+   */
+  frameSequences?: boolean
+  /**
+   * Ring logs: what the writer does when it would overwrite frames a critical
+   * iterator has not read. Defaults to 'overwrite'.
+   */
+  backpressure?: BackpressurePolicy
+  /** Longest a 'block' writer waits in allocate(). Defaults to 1 s. */
+  maxBlockNs?: number
 }
 
-interface ReadonlySharedLogOptions {
-  path: string
+interface ReadonlySharedLogOptions extends SharedLogSource {
   writable: false
   capacityBytes?: number | bigint
   debugChecks?: boolean
@@ -22,20 +79,46 @@ export type SharedLogOptions = WritableSharedLogOptions | ReadonlySharedLogOptio
 
 export interface SharedLog {
   header: MemHeader
-  createIterator: (options?: { startCursor?: bigint }) => ShmIterator
+  atomicHeaderView: () => ArrayBuffer
+  /**
+   * Blocks the calling thread, event loop included, until a commit moves the
+   * sequence past `lastSequence`. Meant for worker threads and processes that
+   * only consume.
+   */
+  waitForCommit: (lastSequence: number, timeoutMs?: number) => CommitWaitResult
+  capacityBytes: () => bigint
+  /** Descriptor of the log's file, to hand a memfd log to another process. */
+  fd: () => number
+  /** True when the file cannot shrink, so readers can never fault on it. */
+  sealed: () => boolean
+  /**
+   * Captures the committed size. Iterators created with `{ snapshot }` read
+   * exactly the frames below it, however far the writer has moved on.
+   */
+  snapshot: () => LogSnapshot
+  createIterator: (options?: CreateIteratorOptions) => ShmIterator
+  /** Off-thread scans of the committed frames; see NativeSharedLogHandle. */
+  countFrames: () => Promise<number>
+  validate: () => Promise<ValidateResult>
+  findLast: () => Promise<LastFrame | null>
+  scanRange: (options?: ScanRangeOptions) => Promise<ScanRangeResult>
   writer?: ShmWriter
   close(): void
 }
 
+const toBigInt = (value: number | bigint | undefined): bigint | undefined => {
+  if (value === undefined) {
+    return undefined
+  }
+  return typeof value === 'bigint' ? value : BigInt(value)
+}
+
 export const createSharedLog = (options: SharedLogOptions): SharedLog => {
-  const capacityBigInt = options.capacityBytes !== undefined
-    ? (typeof options.capacityBytes === 'bigint'
-      ? options.capacityBytes
-      : BigInt(options.capacityBytes))
-    : undefined
+  const capacityBigInt = toBigInt(options.capacityBytes)
 
   const openOptions: OpenSharedLogOptions = {
     path: options.path,
+    fd: options.fd,
     writable: options.writable,
     debugChecks: options.debugChecks ?? false,
   }
@@ -44,27 +127,43 @@ export const createSharedLog = (options: SharedLogOptions): SharedLog => {
     openOptions.capacityBytes = capacityBigInt
   }
 
+  if (options.writable) {
+    openOptions.maxCapacityBytes = toBigInt(options.maxCapacityBytes)
+    openOptions.growthStepBytes = toBigInt(options.growthStepBytes)
+    openOptions.ring = options.ring ?? false
+    openOptions.headerVersion = options.headerVersion
+    openOptions.frameSequences = options.frameSequences ?? false
+    openOptions.memfd = options.memfd ?? false
+  }
+
   const handle = openSharedLog(openOptions)
 
-  const headerBuffer = handle.headerView()
-  const headerWrapper = mhBendec.getWrapper('MemHeader') as MemHeader
-  headerWrapper.setBuffer(headerBuffer)
+  const headerWrapper = wrapMemHeader(handle.headerView())
 
-  const createIterator = (iteratorOptions?: { startCursor?: bigint }) => {
-    const startCursor = iteratorOptions?.startCursor
-    if (startCursor !== undefined) {
-      return handle.createIterator({ startCursor })
-    }
-    return handle.createIterator()
-  }
+  const createIterator = (iteratorOptions?: CreateIteratorOptions) =>
+    handle.createIterator(iteratorOptions)
 
   const writer = options.writable
-    ? handle.createWriter({ debugChecks: options.debugChecks ?? false })
+    ? handle.createWriter({
+      debugChecks: options.debugChecks ?? false,
+      backpressure: options.backpressure,
+      maxBlockNs: options.maxBlockNs,
+    })
     : undefined
 
   return {
     header: headerWrapper,
+    atomicHeaderView: () => handle.atomicHeaderView(),
+    waitForCommit: (lastSequence, timeoutMs) => handle.waitForCommit(lastSequence, timeoutMs),
+    capacityBytes: () => handle.capacityBytes(),
+    fd: () => handle.fd(),
+    sealed: () => handle.sealed(),
+    snapshot: () => handle.snapshot(),
     createIterator,
+    countFrames: () => handle.countFrames(),
+    validate: () => handle.validate(),
+    findLast: () => handle.findLast(),
+    scanRange: (scanOptions?: ScanRangeOptions) => handle.scanRange(scanOptions),
     writer,
     close: () => handle.close(),
   }
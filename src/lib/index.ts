@@ -1,3 +1,5 @@
 export * from './memHeader'
+export * from './sharedHeader'
 export * from './native'
 export * from './SharedLog'
+export * from './PartitionedLog'
@@ -41,6 +41,42 @@ const getBendec = () => {
   return new Bendec<any>({ types, getVariant, readers, writers})
 }
 
+// Header v2 keeps the committed size on the writer's own cache lines instead
+// of in the third u64; see addons/shm_format.h for the full layout.
+const HEADER_V2_MAGIC = 0x3244484f494d4853n // "SHMIOHD2"
+const HEADER_V2_SIZE = 384
+const HEADER_MAGIC_OFFSET = 24
+const COMMITTED_SIZE_V2_OFFSET = 128
+
+const isHeaderV2 = (buffer: Buffer) =>
+  buffer.length >= HEADER_V2_SIZE && buffer.readBigUInt64LE(HEADER_MAGIC_OFFSET) === HEADER_V2_MAGIC
+
+/**
+ * Wraps a header view (v1 or v2) so `size` always reads the committed size.
+ */
+const wrapMemHeader = (buffer: Buffer): MemHeader => {
+  const wrapper = getBendec().getWrapper('MemHeader') as MemHeader
+  wrapper.setBuffer(buffer)
+  if (!isHeaderV2(buffer)) {
+    return wrapper
+  }
+
+  let current = buffer
+  return {
+    get headerSize() { return wrapper.headerSize },
+    set headerSize(value: bigint) { wrapper.headerSize = value },
+    get dataOffset() { return wrapper.dataOffset },
+    set dataOffset(value: bigint) { wrapper.dataOffset = value },
+    get size() { return current.readBigUInt64LE(COMMITTED_SIZE_V2_OFFSET) },
+    set size(value: bigint) { current.writeBigUInt64LE(value, COMMITTED_SIZE_V2_OFFSET) },
+    getBuffer: () => current,
+    setBuffer: (data: Buffer) => {
+      current = data
+      return wrapper.setBuffer(data)
+    },
+  }
+}
+
 interface MemHeader {
   headerSize: bigint
   dataOffset: bigint
@@ -49,4 +85,4 @@ interface MemHeader {
   setBuffer: (data: Buffer) => boolean
 }
 
-export { MemHeader, getBendec }
+export { MemHeader, getBendec, wrapMemHeader, isHeaderV2, HEADER_V2_MAGIC, HEADER_V2_SIZE }
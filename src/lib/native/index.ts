@@ -4,6 +4,20 @@ import type {
   ShmIteratorConstructor,
   OpenSharedLogOptions,
   NativeSharedLogHandle,
+  CompactLogOptions,
+  CompactLogResult,
+  ArchiveLogOptions,
+  ArchiveLogResult,
+  CompressLogOptions,
+  CompressLogResult,
+  CompressedIterator,
+  CompressedIteratorOptions,
+  MergedIterator,
+  MergedIteratorOptions,
+  PartitionedWriter,
+  PartitionedWriterOptions,
+  ShmIterator,
+  ShmWriter,
 } from './types'
 
 let cachedAddon: ShmIteratorAddon | null = null
@@ -37,4 +51,78 @@ export const openSharedLog = (options: OpenSharedLogOptions): NativeSharedLogHan
   return addon.openSharedLog(options)
 }
 
+export const compactLog = (options: CompactLogOptions): Promise<CompactLogResult> => {
+  const addon = loadAddon()
+  if (typeof addon.compactLog !== 'function') {
+    throw new Error('Native addon missing compactLog')
+  }
+  return addon.compactLog(options)
+}
+
+export const archiveLog = (options: ArchiveLogOptions): Promise<ArchiveLogResult> => {
+  const addon = loadAddon()
+  if (typeof addon.archiveLog !== 'function') {
+    throw new Error('Native addon missing archiveLog')
+  }
+  return addon.archiveLog(options)
+}
+
+/**
+ * Writes a range of a log to a file of compressed blocks, e.g. to keep cold
+ * history on disk at a fraction of its size. Runs on the libuv threadpool.
+ */
+export const compressLog = (options: CompressLogOptions): Promise<CompressLogResult> => {
+  const addon = loadAddon()
+  if (typeof addon.compressLog !== 'function') {
+    throw new Error('Native addon missing compressLog')
+  }
+  return addon.compressLog(options)
+}
+
+/** Opens a file written by compressLog for reading. */
+export const openCompressedLog = (path: string, options?: CompressedIteratorOptions): CompressedIterator => {
+  const addon = loadAddon()
+  if (typeof addon.CompressedIterator !== 'function') {
+    throw new Error('Native addon missing CompressedIterator')
+  }
+  return new addon.CompressedIterator(path, options)
+}
+
+/**
+ * Merges iterators (typically one per log) into a single stream ordered by a
+ * timestamp in the payload. The sources must not be read directly while the
+ * merged iterator is open.
+ */
+export const createMergedIterator = (iterators: ShmIterator[], options: MergedIteratorOptions): MergedIterator => {
+  const addon = loadAddon()
+  if (typeof addon.MergedIterator !== 'function') {
+    throw new Error('Native addon missing MergedIterator')
+  }
+  return new addon.MergedIterator(iterators, options)
+}
+
+/**
+ * Routes frames to `writers` by a hash of a payload key range. Usually
+ * created through createPartitionedLog, which also writes the manifest.
+ */
+export const createPartitionedWriter = (writers: ShmWriter[], options: PartitionedWriterOptions): PartitionedWriter => {
+  const addon = loadAddon()
+  if (typeof addon.PartitionedWriter !== 'function') {
+    throw new Error('Native addon missing PartitionedWriter')
+  }
+  return new addon.PartitionedWriter(writers, options)
+}
+
+/**
+ * Pins the calling thread to `cpu` (Linux only). Meant for a process or
+ * worker that spins on spinNext()/spinBatch() on a dedicated core.
+ */
+export const pinThread = (cpu: number): void => {
+  const addon = loadAddon()
+  if (typeof addon.pinThread !== 'function') {
+    throw new Error('Native addon missing pinThread')
+  }
+  addon.pinThread(cpu)
+}
+
 export * from './types'
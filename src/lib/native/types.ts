@@ -17,6 +17,39 @@ export interface NextBatchOptions {
    * iterator throws ERR_SHM_FRAME_CORRUPT on mismatch.
    */
   debugChecks?: boolean
+  /**
+   * Returns every frame as an external Buffer of its own instead of a view of
+   * the mapping ArrayBuffer, as older releases did. Slower; kept so
+   * perf/collect.ts can compare the two.
+   */
+  externalBuffers?: boolean
+}
+
+export interface SpinOptions {
+  /**
+   * How long to spin in native code waiting for a committed frame before
+   * giving up. Defaults to 100 µs. The calling thread is blocked meanwhile.
+   */
+  maxSpinNs?: number
+}
+
+export interface SpinBatchOptions extends NextBatchOptions, SpinOptions {}
+
+export interface TransferOptions {
+  /**
+   * Upper bound on bytes written by a single call. Only whole frames are
+   * selected, so a frame larger than this limit is never transferred.
+   * Defaults to 256 KiB when omitted.
+   */
+  maxBytes?: number
+  /**
+   * Optional upper bound on the number of frames selected. Unlimited by default.
+   */
+  maxMessages?: number
+  /**
+   * Validates frame prefixes/suffixes while selecting the range.
+   */
+  debugChecks?: boolean
 }
 
 export interface ShmIteratorMetrics {
@@ -32,12 +65,56 @@ export type ShmIteratorErrorCode =
   | 'ERR_SHM_CURSOR'
   | 'ERR_SHM_FRAME_CORRUPT'
   | 'ERR_SHM_MAPPING_GONE'
+  | 'ERR_SHM_IO'
+  | 'ERR_SHM_LAPPED'
+  | 'ERR_SHM_BACKPRESSURE'
+  | 'ERR_SHM_READER_SLOTS'
+  | 'ERR_SHM_READER_ACCESS'
 
 export interface ShmIterator {
   next(): Buffer | null
   nextBatch(options?: NextBatchOptions): Buffer[]
+  /**
+   * Like next(), but first spins (pause hints, then yielding) until a frame
+   * is committed or `maxSpinNs` pass. Returns null on timeout.
+   */
+  spinNext(options?: SpinOptions): Buffer | null
+  /** Like nextBatch(), after spinning as spinNext() does. Empty on timeout. */
+  spinBatch(options?: SpinBatchOptions): Buffer[]
   cursor(): bigint
   committedSize(): bigint
+  /**
+   * Writes the next contiguous range of committed frames (raw, including
+   * frame headers) to `fd` and advances the cursor by the bytes written.
+   * Returns 0 when nothing is committed or the descriptor would block.
+   */
+  transferTo(fd: number, options?: TransferOptions): number
+  /**
+   * Stores the current cursor in the consumer's checkpoint and returns it.
+   * Only available on iterators created with `consumer`.
+   */
+  checkpoint(options?: { flush?: boolean }): bigint
+  /**
+   * Number of frames before the cursor. Null when unknown: after seeking in a
+   * log without frame sequences, or at the head of one with them.
+   */
+  sequence(): bigint | null
+  /**
+   * Committed frames not yet read, without scanning. Null for v1 headers and
+   * when sequence() is unknown.
+   */
+  lag(): bigint | null
+  /**
+   * True once a snapshot iterator has read every frame of its snapshot.
+   * Always false for live iterators.
+   */
+  isFinished(): boolean
+  /**
+   * Lifts a snapshot iterator's bound, so it goes on with frames committed
+   * after the snapshot. Called after isFinished() this hands over to live
+   * tailing without skipping or repeating a frame.
+   */
+  follow(): void
   seek(position: bigint): void
   close(): void
 }
@@ -46,31 +123,395 @@ export interface ShmIteratorConstructor {
   new (base: Buffer, length: bigint, startCursor?: bigint): ShmIterator
 }
 
+export interface MergedIteratorOptions {
+  /** Payload offset of the u64 little-endian timestamp frames are ordered by. */
+  timestampOffset: number
+  /**
+   * Stops a batch as soon as any source has no committed frame, so frames
+   * are never returned ahead of an earlier one a lagging source may still
+   * commit. Defaults to false: idle sources are skipped.
+   */
+  waitForAll?: boolean
+  debugChecks?: boolean
+}
+
+export interface MergedBatch {
+  /** Payload views, as returned by ShmIterator.nextBatch(). */
+  frames: Buffer[]
+  /** Index into the source iterators for every frame. */
+  sources: Uint32Array
+}
+
+export interface MergedIterator {
+  next(): { frame: Buffer, source: number } | null
+  nextBatch(options?: NextBatchOptions): MergedBatch
+  /**
+   * Releases the sources. Each resumes at the first frame the merge did not
+   * return.
+   */
+  close(): void
+}
+
+export interface MergedIteratorConstructor {
+  new (iterators: ShmIterator[], options: MergedIteratorOptions): MergedIterator
+}
+
+export interface PartitionedWriterOptions {
+  /** Payload offset of the key that selects the partition. */
+  keyOffset: number
+  keyLength: number
+}
+
+export interface PartitionedWriter {
+  /** Partition the key (exactly keyLength bytes) is routed to. */
+  partitionFor(key: Buffer): number
+  /** Copies `payload` into the partition of its key; returns the partition. */
+  append(payload: Buffer, options?: AllocateOptions): number
+  /**
+   * Allocates a frame in the partition of `key` with the key already written
+   * at keyOffset; the rest of the payload is filled in by the caller.
+   */
+  allocate(key: Buffer, size: number, options?: AllocateOptions): Buffer
+  /**
+   * Publishes the pending frames of every partition, one partition after
+   * another. This is not atomic across partitions. Each partition's frames
+   * appear together, but a reader of several partitions can see some
+   * partitions' frames before others. If the process dies part way, the
+   * earlier partitions stay committed.
+   */
+  commit(): void
+  /** Drops the pending frames of every partition. */
+  abort(): void
+  close(): void
+}
+
+export interface PartitionedWriterConstructor {
+  new (writers: ShmWriter[], options: PartitionedWriterOptions): PartitionedWriter
+}
+
 export interface ShmIteratorAddon {
   ShmIterator: ShmIteratorConstructor
+  MergedIterator?: MergedIteratorConstructor
+  PartitionedWriter?: PartitionedWriterConstructor
   openSharedLog?: (options: OpenSharedLogOptions) => NativeSharedLogHandle
+  compactLog?: (options: CompactLogOptions) => Promise<CompactLogResult>
+  archiveLog?: (options: ArchiveLogOptions) => Promise<ArchiveLogResult>
+  compressLog?: (options: CompressLogOptions) => Promise<CompressLogResult>
+  CompressedIterator?: CompressedIteratorConstructor
+  pinThread?: (cpu: number) => void
+}
+
+export interface AllocateOptions {
+  debugChecks?: boolean
+  align?: number
+}
+
+export interface Reservation {
+  token: bigint
+  buffer: Buffer
 }
 
 export interface ShmWriter {
-  allocate(size: number, options?: { debugChecks?: boolean }): Buffer
+  /**
+   * Reserves a frame of `size` bytes (at most 65531, or 65523 with frame
+   * sequences). With `align` (a power
+   * of two up to 4096) the payload address is a multiple of `align`; padding
+   * in front of the frame is skipped by readers.
+   */
+  allocate(size: number, options?: AllocateOptions): Buffer
+  /**
+   * Allocates like allocate() and also returns a token for the frame, its
+   * sequence number, for commitThrough() and abort().
+   */
+  reserve(size: number, options?: AllocateOptions): Reservation
+  /** Publishes every pending frame. */
   commit(): void
+  /**
+   * Publishes pending frames up to and including `token`, leaving later
+   * reservations pending. Tokens that are already committed are ignored.
+   */
+  commitThrough(token: bigint): void
+  /**
+   * Drops the pending frame `token` and every frame reserved after it, or
+   * all pending frames when called without a token. Dropped frames are never
+   * seen by readers and their space is reused.
+   */
+  abort(token?: bigint): void
   close(): void
   getLastAllocatedAddress(): bigint | null
   getBufferAtAddress(address: bigint | number, size: number): Buffer
 }
 
+export type CommitWaitResult = 'ok' | 'not-equal' | 'timed-out'
+
 export interface NativeSharedLogHandle {
   headerView(): Buffer
-  createIterator(options?: { startCursor?: bigint }): ShmIterator
-  createWriter(options?: { debugChecks?: boolean }): ShmWriter
+  /**
+   * Header in a read-only ArrayBuffer of its own mapping, for Atomics.load.
+   * Not a SharedArrayBuffer, so Atomics.wait rejects it. Stays readable after
+   * close(). See SharedHeader.
+   */
+  atomicHeaderView(): ArrayBuffer
+  /**
+   * Sleeps until the commit sequence differs from `lastSequence` or
+   * `timeoutMs` passes. Woken by commits in any process. Blocks the calling
+   * thread and its event loop meanwhile. Throws for v1 logs.
+   */
+  waitForCommit(lastSequence: number, timeoutMs?: number): CommitWaitResult
+  capacityBytes(): bigint
+  /** Descriptor of the log's file, e.g. to pass a memfd log to a child process. */
+  fd(): number
+  /** True when the file is sealed against shrinking (memfd logs). */
+  sealed(): boolean
+  /** Captures the committed watermark for bounded, repeatable replays. */
+  snapshot(): LogSnapshot
+  createIterator(options?: CreateIteratorOptions): ShmIterator
+  createWriter(options?: CreateWriterOptions): ShmWriter
+  /**
+   * Scans run on the libuv threadpool over the frames committed when they are
+   * called. Ring logs start at the oldest frame still held; a scan overtaken
+   * by the ring writer rejects with ERR_SHM_LAPPED. close() waits for pending
+   * scans before unmapping.
+   */
+  countFrames(): Promise<number>
+  validate(): Promise<ValidateResult>
+  findLast(): Promise<LastFrame | null>
+  scanRange(options?: ScanRangeOptions): Promise<ScanRangeResult>
   close(): void
 }
 
+export interface ValidateResult {
+  /** True when prefixes, suffixes, padding and frame sequences all check out. */
+  valid: boolean
+  /** Frames that passed before the first problem. */
+  frames: number
+  startCursor: bigint
+  /** Committed size when valid, otherwise the cursor of the first bad frame. */
+  endCursor: bigint
+  error?: string
+}
+
+export interface LastFrame {
+  cursor: bigint
+  /** Cursor just after the frame, i.e. the committed size that was scanned. */
+  endCursor: bigint
+  /** Copy of the payload. */
+  payload: Buffer
+  /** Frame sequence number; null unless the log has frame sequences. */
+  sequence: bigint | null
+}
+
+export interface ScanRangeOptions {
+  /** Frame boundary to start at. Defaults to the oldest committed frame. */
+  fromCursor?: number | bigint
+  /** Cursor to stop at (whole frames only). Defaults to the committed size. */
+  toCursor?: number | bigint
+  /** Stops after this many frames. */
+  maxFrames?: number | bigint
+  /** Also compares suffixes, padding markers and frame sequences. */
+  validate?: boolean
+}
+
+export interface ScanRangeResult {
+  startCursor: bigint
+  /** Pass as fromCursor to continue the scan. */
+  endCursor: bigint
+  frames: number
+  payloadBytes: number
+  paddingBytes: number
+  /** Cursor of every frame scanned, e.g. to build an index. */
+  cursors: BigUint64Array
+}
+
+export interface CreateIteratorOptions {
+  /** Position to start from. Overrides a stored consumer checkpoint. */
+  startCursor?: bigint
+  /**
+   * Durable consumer name. The iterator resumes from the last checkpoint in
+   * `<path>.<consumer>.cursor` and keeps it up to date while reading.
+   */
+  consumer?: string
+  /**
+   * Frames handed out between automatic checkpoints. Checkpoints are taken
+   * at the start of the next read, so they only cover frames the consumer
+   * has finished with. Defaults to 1.
+   */
+  checkpointEvery?: number
+  /** msync the checkpoint every time it is stored. Defaults to false. */
+  flushCheckpoints?: boolean
+  /**
+   * Ring logs only: publishes the cursor in one of the log's 8 reader slots,
+   * so a writer with a `fail` or `block` backpressure policy never overwrites
+   * frames this iterator has not read. Frames stay protected until the next
+   * read call. Throws ERR_SHM_READER_SLOTS when all slots are taken.
+   *
+   * The slots live in the log header, so a critical iterator writes to the
+   * log even when the log was opened read-only: it needs write permission on
+   * the file (logs opened by path are reopened read-write for the slots) or a
+   * descriptor opened read-write. Otherwise it throws ERR_SHM_READER_ACCESS.
+   */
+  critical?: boolean
+  /**
+   * Bounds the iterator to the frames committed when the snapshot was taken;
+   * see SharedLog.snapshot().
+   */
+  snapshot?: LogSnapshot
+}
+
+/** Committed watermark of a log, captured by snapshot(). */
+export interface LogSnapshot {
+  /** Committed size at the time; snapshot iterators stop here. */
+  endCursor: bigint
+  /**
+   * Number of frames below endCursor, or null for v1 headers and for logs
+   * whose writer died in the middle of a commit.
+   */
+  messages: bigint | null
+}
+
+/**
+ * What a ring writer does when its next frame would overwrite frames a
+ * critical iterator has not read: overwrite them and make that iterator
+ * throw ERR_SHM_LAPPED, throw ERR_SHM_BACKPRESSURE, or wait for the reader
+ * (up to `maxBlockNs`) and then throw ERR_SHM_BACKPRESSURE. A waiting
+ * writer spins for 20 µs, then sleeps until a critical reader moves on; the
+ * calling thread is blocked either way.
+ */
+export type BackpressurePolicy = 'overwrite' | 'fail' | 'block'
+
+export interface CreateWriterOptions {
+  debugChecks?: boolean
+  /** Defaults to 'overwrite'. Only ring logs ever overwrite frames. */
+  backpressure?: BackpressurePolicy
+  /** Longest a 'block' writer waits in allocate(). Defaults to 10 ms. */
+  maxBlockNs?: number
+}
+
 export interface OpenSharedLogOptions {
-  path: string
+  /** Exactly one of path, fd and memfd selects the log. */
+  path?: string
+  fd?: number
+  memfd?: boolean
   writable: boolean
   capacityBytes?: bigint
   debugChecks?: boolean
+  growthStepBytes?: bigint
+  maxCapacityBytes?: bigint
+  ring?: boolean
+  headerVersion?: 1 | 2
+  frameSequences?: boolean
+}
+
+export interface CompactLogOptions {
+  /** Log to read. It may still be written to; only frames committed at start are read. */
+  sourcePath: string
+  /** Path of the compacted log. Written to a temporary file and renamed into place. */
+  targetPath: string
+  /** Offset of the key within the frame payload. */
+  keyOffset: number
+  /** Length of the key in bytes. */
+  keyLength: number
+  /**
+   * Capacity of the compacted log. Defaults to the exact size needed; pass a
+   * larger value to keep appending to the snapshot.
+   */
+  capacityBytes?: number | bigint
+}
+
+export interface CompactLogResult {
+  framesRead: number
+  framesWritten: number
+  /** Frames whose payload is too short to contain the key; they are dropped. */
+  framesWithoutKey: number
+  /** Bytes of the compacted log: its header plus the kept frames. */
+  bytesWritten: number
+}
+
+export interface ArchiveLogOptions {
+  /** Log to copy from. It may still be written to. */
+  sourcePath: string
+  /**
+   * Plain log to append to; created when missing. Archives use the normal
+   * frame format and can be opened with createSharedLog.
+   */
+  targetPath: string
+  /** Source cursor to start from; must be a frame boundary. Defaults to 0. */
+  fromCursor?: number | bigint
+  /** Source cursor to stop at (whole frames only). Defaults to the committed size. */
+  toCursor?: number | bigint
+  /** Minimum size of the target file, e.g. to keep appending after a restore. */
+  capacityBytes?: number | bigint
+  /** Write with io_uring when the kernel allows it. Defaults to true. */
+  useIoUring?: boolean
+}
+
+export interface ArchiveLogResult {
+  startCursor: bigint
+  /** Pass as fromCursor to archive the next range. */
+  endCursor: bigint
+  framesWritten: number
+  bytesWritten: number
+  /** False when the copy fell back to pwrite on the worker thread. */
+  usedIoUring: boolean
+}
+
+export interface CompressLogOptions {
+  /** Log to read from. It may still be written to. */
+  sourcePath: string
+  /** Compressed log to create; replaced atomically when it exists. */
+  targetPath: string
+  /**
+   * Source cursor to start from; must be a frame boundary. Defaults to the
+   * oldest frame the source still holds.
+   */
+  fromCursor?: number | bigint
+  /** Source cursor to stop at (whole frames only). Defaults to the committed size. */
+  toCursor?: number | bigint
+  /**
+   * Raw bytes per block (4 KiB to 16 MiB, default 64 KiB). Larger blocks
+   * compress better; a read decompresses a whole block.
+   */
+  blockBytes?: number
+}
+
+export interface CompressLogResult {
+  startCursor: bigint
+  /** Pass as fromCursor to compress the next range into a new file. */
+  endCursor: bigint
+  blocks: number
+  framesWritten: number
+  /** Source bytes covered, including alignment padding. */
+  rawBytes: number
+  /** Size of the compressed log file. */
+  compressedBytes: number
+}
+
+export interface CompressedIteratorOptions {
+  /** Source cursor to start at; must be a frame boundary in the file. */
+  startCursor?: bigint
+}
+
+export interface CompressedIterator {
+  /**
+   * Payload of the next frame. Views point into a buffer the iterator
+   * reuses and are only valid until the next call.
+   */
+  next(): Buffer | null
+  /** Frames up to the end of the current block; valid until the next call. */
+  nextBatch(options?: Pick<NextBatchOptions, 'maxMessages' | 'maxBytes'>): Buffer[]
+  /** Source cursor of the next frame. */
+  cursor(): bigint
+  startCursor(): bigint
+  endCursor(): bigint
+  /** Number of frames in the file. */
+  frames(): number
+  /** Moves to a source cursor using the block index. */
+  seek(position: bigint): void
+  close(): void
+}
+
+export interface CompressedIteratorConstructor {
+  new (path: string, options?: CompressedIteratorOptions): CompressedIterator
 }
 
 export const isShmIteratorError = (error: unknown): error is NodeJS.ErrnoException & {
@@ -85,4 +526,9 @@ export const isShmIteratorError = (error: unknown): error is NodeJS.ErrnoExcepti
     || code === 'ERR_SHM_CURSOR'
     || code === 'ERR_SHM_FRAME_CORRUPT'
     || code === 'ERR_SHM_MAPPING_GONE'
+    || code === 'ERR_SHM_IO'
+    || code === 'ERR_SHM_LAPPED'
+    || code === 'ERR_SHM_BACKPRESSURE'
+    || code === 'ERR_SHM_READER_SLOTS'
+    || code === 'ERR_SHM_READER_ACCESS'
 }
@@ -0,0 +1,78 @@
+import { HEADER_V2_MAGIC, HEADER_V2_SIZE } from './memHeader'
+import type { CommitWaitResult } from './native/types'
+
+// Word indexes into the header; byte offsets match addons/shm_format.h.
+const DATA_OFFSET_INDEX = 1 // u64
+const MAGIC_INDEX = 3 // u64
+const COMMITTED_SIZE_V1_INDEX = 2 // u64
+const COMMITTED_SIZE_V2_INDEX = 16 // u64, writer section at byte 128
+const COMMIT_SEQUENCE_INDEX = 36 // i32, byte 144
+const COMMITTED_MESSAGES_INDEX = 19 // u64, byte 152
+
+export interface SharedHeaderSource {
+  atomicHeaderView(): ArrayBuffer
+  waitForCommit(lastSequence: number, timeoutMs?: number): CommitWaitResult
+}
+
+/**
+ * Atomic, waitable access to a log header. Build it from a shared log opened
+ * in this thread; a worker thread or another process opens the log itself
+ * (read-only is enough, and nothing is written to the log). `commit()` wakes
+ * waiters in every thread of every process that maps the log.
+ */
+export class SharedHeader {
+  readonly buffer: ArrayBuffer
+  private readonly words: BigUint64Array
+  private readonly committedIndex: number
+  private readonly sequence: Int32Array | null
+
+  constructor(private readonly source: SharedHeaderSource) {
+    const buffer = source.atomicHeaderView()
+    this.buffer = buffer
+    this.words = new BigUint64Array(buffer, 0, buffer.byteLength >> 3)
+    const v2 = buffer.byteLength >= HEADER_V2_SIZE && this.words[MAGIC_INDEX] === HEADER_V2_MAGIC
+    this.committedIndex = v2 ? COMMITTED_SIZE_V2_INDEX : COMMITTED_SIZE_V1_INDEX
+    this.sequence = v2 ? new Int32Array(buffer, 0, HEADER_V2_SIZE >> 2) : null
+  }
+
+  /** Committed bytes, comparable with `iterator.committedSize()`. */
+  committedSize(): bigint {
+    return Atomics.load(this.words, this.committedIndex) - this.words[DATA_OFFSET_INDEX]
+  }
+
+  /**
+   * Frames committed so far (for logs with frame sequences: the sequence of
+   * the next frame). Null for v1 headers.
+   */
+  committedMessages(): bigint | null {
+    return this.sequence === null ? null : Atomics.load(this.words, COMMITTED_MESSAGES_INDEX)
+  }
+
+  /** False for v1 (24-byte) headers, which have no commit sequence. */
+  hasCommitSequence(): boolean {
+    return this.sequence !== null
+  }
+
+  /** Incremented on every commit; wraps at 2^32. */
+  commitSequence(): number {
+    return Atomics.load(this.requireSequence(), COMMIT_SEQUENCE_INDEX)
+  }
+
+  /**
+   * Sleeps until the commit sequence differs from `lastSequence` or the
+   * timeout (ms) expires. Blocks the calling thread, like Atomics.wait, so
+   * nothing else runs on its event loop meanwhile; wait in a worker thread or
+   * a consumer process.
+   */
+  waitForCommit(lastSequence: number, timeoutMs?: number): CommitWaitResult {
+    this.requireSequence()
+    return this.source.waitForCommit(lastSequence, timeoutMs)
+  }
+
+  private requireSequence(): Int32Array {
+    if (this.sequence === null) {
+      throw new Error('v1 log headers have no commit sequence; recreate the log with headerVersion 2')
+    }
+    return this.sequence
+  }
+}
@@ -1,5 +1,21 @@
 // Index for all tests
 import './lib/shm'
 import './lib/sharedLog'
+import './lib/compaction'
+import './lib/growth'
+import './lib/ring'
+import './lib/archive'
+import './lib/checkpoint'
+import './lib/sharedHeader'
+import './lib/sequence'
+import './lib/scan'
+import './lib/reservation'
+import './lib/merge'
+import './lib/partition'
+import './lib/spin'
+import './lib/memfd'
+import './lib/compress'
+import './lib/snapshot'
+import './lib/views'
 import './mmap/index'
 import './mmap/segfault'
\ No newline at end of file
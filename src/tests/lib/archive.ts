@@ -0,0 +1,84 @@
+import test from 'tape'
+import { promises as fs } from 'fs'
+import { tmpdir } from 'os'
+import { join } from 'path'
+import { createSharedLog } from '../../lib/SharedLog'
+import { archiveLog } from '../../lib/native'
+
+const logPath = (name: string) => `/dev/shm/${name}`
+
+const readAll = (path: string): number[] => {
+  const log = createSharedLog({ path, writable: false })
+  const iterator = log.createIterator()
+  const values: number[] = []
+  let batch = iterator.nextBatch({ maxMessages: 256 })
+  while (batch.length > 0) {
+    batch.forEach(frame => values.push(frame.readUInt32LE(0)))
+    batch = iterator.nextBatch({ maxMessages: 256 })
+  }
+  iterator.close()
+  log.close()
+  return values
+}
+
+test('archiveLog appends committed ranges incrementally and restores them', async t => {
+  const sourcePath = logPath('archive-source')
+  const restorePath = logPath('archive-restore')
+  const archivePath = join(tmpdir(), 'shmio-archive.log')
+  await Promise.all([sourcePath, restorePath, archivePath].map(p => fs.unlink(p).catch(() => undefined)))
+
+  const log = createSharedLog({ path: sourcePath, capacityBytes: 64 * 1024, writable: true })
+  const writer = log.writer!
+  for (let i = 0; i < 100; i++) {
+    writer.allocate(4 + (i % 5)).writeUInt32LE(i, 0)
+  }
+  writer.commit()
+
+  const first = await archiveLog({ sourcePath, targetPath: archivePath })
+  t.equal(first.framesWritten, 100, 'should archive every committed frame')
+  t.equal(first.startCursor, 0n, 'should start at the beginning')
+
+  for (let i = 100; i < 150; i++) {
+    writer.allocate(4).writeUInt32LE(i, 0)
+  }
+  writer.allocate(4).writeUInt32LE(999, 0) // uncommitted, must not be archived
+
+  const second = await archiveLog({ sourcePath, targetPath: archivePath, fromCursor: first.endCursor, useIoUring: false })
+  t.equal(second.framesWritten, 0, 'uncommitted frames should not be archived')
+  writer.commit()
+  const third = await archiveLog({ sourcePath, targetPath: archivePath, fromCursor: second.endCursor })
+  t.equal(third.framesWritten, 51, 'should archive the newly committed frames')
+  t.equal(third.endCursor, log.createIterator().committedSize(), 'should stop at the committed size')
+
+  const expected = Array.from({ length: 150 }, (_, i) => i).concat([999])
+  t.deepEqual(readAll(archivePath), expected, 'archive should be readable with the normal iterator')
+
+  const restored = await archiveLog({ sourcePath: archivePath, targetPath: restorePath, capacityBytes: 64 * 1024 })
+  t.equal(restored.framesWritten, 151, 'should restore every archived frame')
+  t.deepEqual(readAll(restorePath), expected, 'restored log should replay the same frames')
+
+  log.close()
+  await Promise.all([sourcePath, restorePath, archivePath].map(p => fs.unlink(p).catch(() => undefined)))
+  t.end()
+})
+
+test('archiveLog rejects cursors that are not frame boundaries', async t => {
+  const sourcePath = logPath('archive-misaligned')
+  const archivePath = join(tmpdir(), 'shmio-archive-misaligned.log')
+  await Promise.all([sourcePath, archivePath].map(p => fs.unlink(p).catch(() => undefined)))
+
+  const log = createSharedLog({ path: sourcePath, capacityBytes: 4096, writable: true })
+  log.writer!.allocate(100).fill(0)
+  log.writer!.commit()
+
+  try {
+    await archiveLog({ sourcePath, targetPath: archivePath, fromCursor: 3 })
+    t.fail('should reject')
+  } catch (err) {
+    t.ok(/Invalid frame size|suffix mismatch/.test((err as Error).message), 'should report the bad cursor')
+  }
+
+  log.close()
+  await Promise.all([sourcePath, archivePath].map(p => fs.unlink(p).catch(() => undefined)))
+  t.end()
+})
@@ -0,0 +1,84 @@
+import test from 'tape'
+import { promises as fs } from 'fs'
+import { createSharedLog } from '../../lib/SharedLog'
+
+const logPath = (name: string) => `/dev/shm/${name}`
+
+test('consumer iterators resume from their last checkpoint', async t => {
+  const path = logPath('shared-log-checkpoint')
+  const sidecar = `${path}.billing.cursor`
+  await fs.unlink(path).catch(() => undefined)
+  await fs.unlink(sidecar).catch(() => undefined)
+
+  const log = createSharedLog({ path, capacityBytes: 64 * 1024, writable: true })
+  const writer = log.writer!
+  for (let i = 0; i < 10; i++) {
+    writer.allocate(4).writeUInt32LE(i, 0)
+  }
+  writer.commit()
+
+  const first = log.createIterator({ consumer: 'billing' })
+  t.equal(first.cursor(), 0n, 'new consumer should start at the beginning')
+  const batch = first.nextBatch({ maxMessages: 4 })
+  t.equal(batch.length, 4, 'should read the first batch')
+  first.next() // checkpoints the first batch before handing out frame 4
+  first.close()
+
+  const stat = await fs.stat(sidecar)
+  t.ok(stat.size > 0, 'sidecar checkpoint file should exist')
+
+  const resumed = log.createIterator({ consumer: 'billing' })
+  t.equal(resumed.cursor(), 4n * 8n, 'should resume after the checkpointed batch')
+  t.equal(resumed.next()!.readUInt32LE(0), 4, 'unacknowledged frame should be delivered again')
+  t.equal(resumed.checkpoint({ flush: true }), 5n * 8n, 'explicit checkpoint should store the cursor')
+  resumed.close()
+
+  const again = log.createIterator({ consumer: 'billing' })
+  t.equal(again.next()!.readUInt32LE(0), 5, 'should resume after the explicit checkpoint')
+  again.close()
+
+  const override = log.createIterator({ consumer: 'billing', startCursor: 0n })
+  t.equal(override.cursor(), 0n, 'startCursor should override the checkpoint')
+  override.close()
+
+  const plain = log.createIterator()
+  t.throws(() => plain.checkpoint(), /consumer/, 'checkpoint requires a consumer')
+  plain.close()
+
+  t.throws(() => log.createIterator({ consumer: '../escape' }), /consumer/, 'consumer names must be file-name safe')
+
+  log.close()
+  await fs.unlink(path).catch(() => undefined)
+  await fs.unlink(sidecar).catch(() => undefined)
+  t.end()
+})
+
+test('checkpointEvery limits how often the cursor is stored', async t => {
+  const path = logPath('shared-log-checkpoint-every')
+  const sidecar = `${path}.audit.cursor`
+  await fs.unlink(path).catch(() => undefined)
+  await fs.unlink(sidecar).catch(() => undefined)
+
+  const log = createSharedLog({ path, capacityBytes: 64 * 1024, writable: true })
+  const writer = log.writer!
+  for (let i = 0; i < 10; i++) {
+    writer.allocate(4).writeUInt32LE(i, 0)
+  }
+  writer.commit()
+
+  const iterator = log.createIterator({ consumer: 'audit', checkpointEvery: 3 })
+  iterator.next()
+  iterator.next()
+  iterator.next() // two frames consumed so far: no checkpoint yet
+  iterator.next() // three consumed: checkpoint at frame 3
+  iterator.close()
+
+  const resumed = log.createIterator({ consumer: 'audit' })
+  t.equal(resumed.cursor(), 3n * 8n, 'should resume from the last periodic checkpoint')
+  resumed.close()
+
+  log.close()
+  await fs.unlink(path).catch(() => undefined)
+  await fs.unlink(sidecar).catch(() => undefined)
+  t.end()
+})
@@ -0,0 +1,64 @@
+import test from 'tape'
+import { promises as fs } from 'fs'
+import { createSharedLog } from '../../lib/SharedLog'
+import { compactLog } from '../../lib/native'
+
+const logPath = (name: string) => `/dev/shm/${name}`
+
+test('compactLog keeps only the last frame per key', async t => {
+  const sourcePath = logPath('compaction-source')
+  const targetPath = logPath('compaction-target')
+  await fs.unlink(sourcePath).catch(() => undefined)
+  await fs.unlink(targetPath).catch(() => undefined)
+
+  const log = createSharedLog({
+    path: sourcePath,
+    capacityBytes: 64 * 1024,
+    writable: true,
+  })
+  const writer = log.writer!
+
+  // payload: u32 entity id followed by u32 version
+  for (let version = 0; version < 20; version++) {
+    const frame = writer.allocate(8)
+    frame.writeUInt32LE(version % 4, 0)
+    frame.writeUInt32LE(version, 4)
+  }
+  const short = writer.allocate(2)
+  short.fill(0)
+  writer.commit()
+  log.close()
+
+  const result = await compactLog({ sourcePath, targetPath, keyOffset: 0, keyLength: 4 })
+  t.equal(result.framesRead, 21, 'should read every committed frame')
+  t.equal(result.framesWritten, 4, 'should keep one frame per key')
+  t.equal(result.framesWithoutKey, 1, 'should report frames too short for the key')
+  t.equal(result.bytesWritten, 24 + 4 * 12, 'bytesWritten should count the header and the kept frames')
+
+  const snapshot = createSharedLog({ path: targetPath, writable: false })
+  const iterator = snapshot.createIterator()
+  const frames = iterator.nextBatch({ maxMessages: 100 })
+  const decoded = frames.map(frame => [frame.readUInt32LE(0), frame.readUInt32LE(4)])
+  t.deepEqual(decoded, [[0, 16], [1, 17], [2, 18], [3, 19]], 'should keep latest versions in log order')
+
+  iterator.close()
+  snapshot.close()
+  await fs.unlink(sourcePath).catch(() => undefined)
+  await fs.unlink(targetPath).catch(() => undefined)
+  t.end()
+})
+
+test('compactLog rejects when the source log is missing', async t => {
+  try {
+    await compactLog({
+      sourcePath: logPath('compaction-missing'),
+      targetPath: logPath('compaction-missing-target'),
+      keyOffset: 0,
+      keyLength: 4,
+    })
+    t.fail('compactLog should reject')
+  } catch (error) {
+    t.ok(error instanceof Error, 'should reject with an Error')
+  }
+  t.end()
+})
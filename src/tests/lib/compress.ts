@@ -0,0 +1,106 @@
+import test from 'tape'
+import { promises as fs } from 'fs'
+import { tmpdir } from 'os'
+import { join } from 'path'
+import { createSharedLog } from '../../lib/SharedLog'
+import { compressLog, openCompressedLog } from '../../lib/native'
+
+const logPath = (name: string) => `/dev/shm/${name}`
+
+const readValues = (path: string, options?: { startCursor?: bigint }): number[] => {
+  const iterator = openCompressedLog(path, options)
+  const values: number[] = []
+  let batch = iterator.nextBatch({ maxMessages: 100 })
+  while (batch.length > 0) {
+    batch.forEach(frame => values.push(frame.readUInt32LE(0)))
+    batch = iterator.nextBatch({ maxMessages: 100 })
+  }
+  iterator.close()
+  return values
+}
+
+test('compressLog writes blocks that replay the source frames', async t => {
+  const sourcePath = logPath('compress-source')
+  const targetPath = join(tmpdir(), 'shmio-compress.shmz')
+  await Promise.all([sourcePath, targetPath].map(p => fs.unlink(p).catch(() => undefined)))
+
+  const log = createSharedLog({ path: sourcePath, capacityBytes: 1024 * 1024, writable: true, frameSequences: true })
+  const writer = log.writer!
+  for (let i = 0; i < 2000; i++) {
+    const frame = writer.allocate(24 + (i % 9), { align: i % 5 === 0 ? 64 : 1 })
+    frame.fill(0)
+    frame.writeUInt32LE(i, 0)
+    frame.write(`order-${i % 10}`, 8)
+  }
+  writer.commit()
+  writer.allocate(8).writeUInt32LE(999999, 0) // uncommitted, must not be compressed
+
+  // Source cursor after each frame.
+  const cursors: bigint[] = []
+  const source = log.createIterator()
+  while (source.next() !== null) {
+    cursors.push(source.cursor())
+  }
+  source.close()
+
+  const result = await compressLog({ sourcePath, targetPath, blockBytes: 4096 })
+  t.equal(result.framesWritten, 2000, 'should compress every committed frame')
+  t.equal(result.startCursor, 0n, 'should start at the oldest frame')
+  t.equal(result.endCursor, cursors[cursors.length - 1], 'should stop at the committed size')
+  t.ok(result.blocks > 1, 'should cut the range into blocks')
+  t.ok(result.compressedBytes < result.rawBytes / 2, 'repetitive frames should shrink')
+
+  const expected = Array.from({ length: 2000 }, (_, i) => i)
+  t.deepEqual(readValues(targetPath), expected, 'should return every frame in order')
+
+  const iterator = openCompressedLog(targetPath)
+  t.equal(iterator.frames(), 2000, 'should report the frame count')
+  const first = iterator.next()!
+  t.equal(first.readUInt32LE(0), 0, 'next() should return the first payload')
+  t.equal(first.length, 24, 'payloads should not include the frame sequence')
+  t.equal(iterator.cursor(), cursors[0], 'cursor should be a source cursor')
+
+  iterator.seek(cursors[1499])
+  t.equal(iterator.next()!.readUInt32LE(0), 1500, 'seek should use source cursors')
+  iterator.seek(result.endCursor)
+  t.equal(iterator.next(), null, 'should be exhausted at the end cursor')
+  t.throws(() => iterator.seek(cursors[10] + 1n), /not a frame boundary/, 'should reject cursors inside a frame')
+  iterator.close()
+  t.throws(() => iterator.next(), /closed/, 'should reject reads after close')
+
+  t.deepEqual(readValues(targetPath, { startCursor: cursors[99] }), expected.slice(100), 'should start at startCursor')
+
+  log.close()
+  await Promise.all([sourcePath, targetPath].map(p => fs.unlink(p).catch(() => undefined)))
+  t.end()
+})
+
+test('compressLog covers ranges and rejects corrupt blocks', async t => {
+  const sourcePath = logPath('compress-range')
+  const targetPath = join(tmpdir(), 'shmio-compress-range.shmz')
+  await Promise.all([sourcePath, targetPath].map(p => fs.unlink(p).catch(() => undefined)))
+
+  const log = createSharedLog({ path: sourcePath, capacityBytes: 256 * 1024, writable: true })
+  const writer = log.writer!
+  for (let i = 0; i < 500; i++) {
+    writer.allocate(100).fill(i & 0xff).writeUInt32LE(i, 0)
+  }
+  writer.commit()
+
+  const head = await compressLog({ sourcePath, targetPath, toCursor: 104 * 200 + 50 })
+  t.equal(head.framesWritten, 200, 'should only take whole frames before toCursor')
+  const tail = await compressLog({ sourcePath, targetPath, fromCursor: head.endCursor })
+  t.equal(tail.framesWritten, 300, 'should continue from the previous end cursor')
+  t.deepEqual(readValues(targetPath), Array.from({ length: 300 }, (_, i) => i + 200), 'should replace the target')
+
+  const bytes = await fs.readFile(targetPath)
+  bytes[64 + 24 + 10] ^= 0xff
+  await fs.writeFile(targetPath, bytes)
+  const iterator = openCompressedLog(targetPath)
+  t.throws(() => iterator.next(), /checksum/, 'should detect a damaged block')
+  iterator.close()
+
+  log.close()
+  await Promise.all([sourcePath, targetPath].map(p => fs.unlink(p).catch(() => undefined)))
+  t.end()
+})
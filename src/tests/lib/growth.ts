@@ -0,0 +1,80 @@
+import test from 'tape'
+import { promises as fs } from 'fs'
+import { createSharedLog } from '../../lib/SharedLog'
+
+const logPath = (name: string) => `/dev/shm/${name}`
+
+test('growable log extends capacity and readers remap lazily', async t => {
+  const path = logPath('shared-log-growable')
+  await fs.unlink(path).catch(() => undefined)
+
+  const writerLog = createSharedLog({
+    path,
+    capacityBytes: 4096,
+    maxCapacityBytes: 1024 * 1024,
+    growthStepBytes: 16 * 1024,
+    writable: true,
+  })
+  const writer = writerLog.writer!
+
+  const readerLog = createSharedLog({ path, writable: false })
+  const iterator = readerLog.createIterator()
+  t.equal(readerLog.capacityBytes(), 4096n, 'reader should see initial capacity')
+
+  const first = writer.allocate(100)
+  first.fill(1)
+  const frameCount = 200
+  for (let i = 1; i < frameCount; i++) {
+    writer.allocate(100).fill(i & 0xff)
+  }
+  writer.commit()
+  first[0] = 7
+
+  const stat = await fs.stat(path)
+  t.ok(stat.size > 4096, 'file should have grown')
+  t.equal(writerLog.capacityBytes(), BigInt(stat.size), 'capacity should match file size')
+  t.equal(first[0], 7, 'buffers allocated before growth should stay valid')
+
+  let frames = 0
+  let batch = iterator.nextBatch({ maxMessages: 64 })
+  while (batch.length > 0) {
+    batch.forEach((frame, index) => {
+      if (frames + index > 0 && frame[0] !== ((frames + index) & 0xff)) {
+        t.fail(`frame ${frames + index} payload mismatch`)
+      }
+    })
+    frames += batch.length
+    batch = iterator.nextBatch({ maxMessages: 64 })
+  }
+  t.equal(frames, frameCount, 'reader opened before growth should read every frame')
+
+  iterator.close()
+  readerLog.close()
+  writerLog.close()
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
+
+test('growable log refuses to grow beyond maxCapacityBytes', async t => {
+  const path = logPath('shared-log-growable-limit')
+  await fs.unlink(path).catch(() => undefined)
+
+  const log = createSharedLog({
+    path,
+    capacityBytes: 4096,
+    maxCapacityBytes: 8192,
+    writable: true,
+  })
+  const writer = log.writer!
+
+  t.throws(() => {
+    for (let i = 0; i < 100; i++) {
+      writer.allocate(1000)
+    }
+  }, /Shared memory exhausted/, 'allocation beyond maxCapacityBytes should fail')
+  t.equal(log.capacityBytes(), 8192n, 'capacity should stop at the maximum')
+
+  log.close()
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
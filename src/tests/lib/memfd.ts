@@ -0,0 +1,48 @@
+import test from 'tape'
+import { spawnSync } from 'child_process'
+import { createSharedLog } from '../../lib/SharedLog'
+
+const readSealed = (fd: number) => {
+  const reader = createSharedLog({ fd, writable: false })
+  const iterator = reader.createIterator()
+  const frames = iterator.nextBatch().map(frame => frame.toString())
+  const sealed = reader.sealed()
+  iterator.close()
+  reader.close()
+  return { frames, sealed }
+}
+
+test('memfd logs are sealed and can be opened by descriptor', t => {
+  if (process.platform !== 'linux') {
+    t.skip('memfd is Linux only')
+    t.end()
+    return
+  }
+
+  const log = createSharedLog({ memfd: true, capacityBytes: 64 * 1024, writable: true })
+  t.ok(log.sealed(), 'a memfd log should be sealed against shrinking')
+
+  log.writer!.allocate(5).write('hello')
+  log.writer!.commit()
+
+  const { frames, sealed } = readSealed(log.fd())
+  t.deepEqual(frames, ['hello'], 'a reader opened by fd should see committed frames')
+  t.ok(sealed, 'the seal should be visible through the shared descriptor')
+
+  // The reader duplicated the descriptor, so the writer's copy is still open.
+  log.writer!.allocate(5).write('again')
+  log.writer!.commit()
+  t.deepEqual(readSealed(log.fd()).frames, ['hello', 'again'], 'the writer should keep its descriptor')
+
+  // Another process can open the log through /proc while the writer holds it.
+  const child = spawnSync('sh', ['-c', 'wc -c < "$0"', `/proc/${process.pid}/fd/${log.fd()}`], { encoding: 'utf8' })
+  t.equal(Number(child.stdout.trim()), 64 * 1024, 'the memfd should be reachable through /proc')
+
+  t.throws(() => log.createIterator({ consumer: 'billing' }), /opened by path/,
+    'consumer checkpoints need a path for their sidecar file')
+  t.throws(() => createSharedLog({ memfd: true, path: '/dev/shm/memfd-test', capacityBytes: 4096, writable: true }),
+    /exactly one of path, fd or memfd/, 'a log has a single source')
+
+  log.close()
+  t.end()
+})
@@ -0,0 +1,127 @@
+import test from 'tape'
+import { promises as fs } from 'fs'
+import { createSharedLog, SharedLog } from '../../lib/SharedLog'
+import { createMergedIterator } from '../../lib/native'
+
+const logPath = (name: string) => `/dev/shm/${name}`
+
+const openLog = async (name: string): Promise<SharedLog> => {
+  const path = logPath(name)
+  await fs.unlink(path).catch(() => undefined)
+  return createSharedLog({ path, capacityBytes: 64 * 1024, writable: true })
+}
+
+// Payload: [u32 tag][u64 timestamp]
+const append = (log: SharedLog, tag: number, timestamps: number[]) => {
+  for (const timestamp of timestamps) {
+    const frame = log.writer!.allocate(12)
+    frame.writeUInt32LE(tag, 0)
+    frame.writeBigUInt64LE(BigInt(timestamp), 4)
+  }
+  log.writer!.commit()
+}
+
+test('merged iterator orders frames of several logs by timestamp', async t => {
+  const names = ['merge-a', 'merge-b', 'merge-c']
+  const logs = await Promise.all(names.map(openLog))
+  append(logs[0], 0, [1, 4, 7, 10])
+  append(logs[1], 1, [2, 4, 8])
+  append(logs[2], 2, [3, 5, 6, 9, 11])
+
+  const iterators = logs.map(log => log.createIterator())
+  const merged = createMergedIterator(iterators, { timestampOffset: 4 })
+
+  const first = merged.nextBatch({ maxMessages: 5 })
+  const rest = merged.nextBatch()
+  const frames = [...first.frames, ...rest.frames]
+  const sources = [...first.sources, ...rest.sources]
+
+  t.deepEqual(frames.map(frame => Number(frame.readBigUInt64LE(4))), [1, 2, 3, 4, 4, 5, 6, 7, 8, 9, 10, 11],
+    'frames should come out in timestamp order')
+  t.deepEqual(sources, frames.map(frame => frame.readUInt32LE(0)), 'sources should identify the log of each frame')
+  t.equal(sources[3], 0, 'equal timestamps should favour the lower source index')
+  t.equal(merged.next(), null, 'merged iterator should be drained')
+
+  append(logs[1], 1, [12])
+  const next = merged.next()
+  t.equal(next && next.source, 1, 'newly committed frames should be picked up')
+
+  merged.close()
+  t.equal(iterators[2].cursor(), iterators[2].committedSize(), 'sources should be positioned after the returned frames')
+  for (const iterator of iterators) {
+    iterator.close()
+  }
+  for (const log of logs) {
+    log.close()
+  }
+  await Promise.all(names.map(name => fs.unlink(logPath(name)).catch(() => undefined)))
+  t.end()
+})
+
+test('merged iterator can wait for every source before returning frames', async t => {
+  const names = ['merge-wait-a', 'merge-wait-b']
+  const logs = await Promise.all(names.map(openLog))
+  append(logs[0], 0, [1, 5])
+
+  const iterators = logs.map(log => log.createIterator())
+  const merged = createMergedIterator(iterators, { timestampOffset: 4, waitForAll: true })
+
+  t.equal(merged.nextBatch().frames.length, 0, 'nothing should be returned while a source is idle')
+  t.equal(iterators[0].cursor(), 0n, 'lookahead should not move the source cursor')
+
+  append(logs[1], 1, [3])
+  const batch = merged.nextBatch()
+  t.deepEqual(Array.from(batch.sources), [0, 1], 'the batch should stop when a source runs dry')
+
+  t.throws(() => createMergedIterator([iterators[0], iterators[0]], { timestampOffset: 4 }), /distinct/,
+    'a source cannot be merged twice')
+  t.throws(() => createMergedIterator(iterators, { timestampOffset: -1 }), /timestampOffset/,
+    'the timestamp offset must be valid')
+
+  merged.close()
+  for (const iterator of iterators) {
+    iterator.close()
+  }
+  for (const log of logs) {
+    log.close()
+  }
+  await Promise.all(names.map(name => fs.unlink(logPath(name)).catch(() => undefined)))
+  t.end()
+})
+
+test('merged sources only count frames handed out towards checkpoints', async t => {
+  const names = ['merge-checkpoint-a', 'merge-checkpoint-b']
+  const logs = await Promise.all(names.map(openLog))
+  const sidecars = names.map(name => `${logPath(name)}.merged.cursor`)
+  await Promise.all(sidecars.map(sidecar => fs.unlink(sidecar).catch(() => undefined)))
+  append(logs[0], 0, [1, 3, 5])
+  append(logs[1], 1, [2, 4, 6])
+
+  const iterators = logs.map(log => log.createIterator({ consumer: 'merged', checkpointEvery: 2 }))
+  const merged = createMergedIterator(iterators, { timestampOffset: 4 })
+  const resumeCursor = () => {
+    const resumed = logs[0].createIterator({ consumer: 'merged' })
+    const cursor = resumed.cursor()
+    resumed.close()
+    return cursor
+  }
+
+  merged.next() // timestamp 1 from source 0, whose lookahead now holds 3
+  merged.next() // timestamp 2 from source 1
+  t.equal(resumeCursor(), 0n, 'one frame handed out is not enough for a checkpoint of two')
+
+  merged.next() // timestamp 3 from source 0
+  merged.next() // timestamp 4: source 0 checkpoints its two frames first
+  t.equal(resumeCursor(), 2n * 16n, 'the checkpoint should cover exactly the frames handed out')
+
+  merged.close()
+  for (const iterator of iterators) {
+    iterator.close()
+  }
+  for (const log of logs) {
+    log.close()
+  }
+  await Promise.all(names.map(name => fs.unlink(logPath(name)).catch(() => undefined)))
+  await Promise.all(sidecars.map(sidecar => fs.unlink(sidecar).catch(() => undefined)))
+  t.end()
+})
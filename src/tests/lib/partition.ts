@@ -0,0 +1,81 @@
+import test from 'tape'
+import { promises as fs } from 'fs'
+import { createPartitionedLog, openPartitionedLog, readPartitionManifest } from '../../lib/PartitionedLog'
+
+const manifestPath = '/dev/shm/shared-log-partitioned'
+
+const cleanup = async (partitions: number) => {
+  await fs.unlink(manifestPath).catch(() => undefined)
+  for (let i = 0; i < partitions; i++) {
+    await fs.unlink(`${manifestPath}.${i}`).catch(() => undefined)
+  }
+}
+
+// Payload: [u32 key][u32 per-key counter]
+const payload = (key: number, counter: number) => {
+  const buffer = Buffer.alloc(8)
+  buffer.writeUInt32LE(key, 0)
+  buffer.writeUInt32LE(counter, 4)
+  return buffer
+}
+
+test('partitioned writer routes keys to one partition each and keeps their order', async t => {
+  await cleanup(4)
+  const log = createPartitionedLog({ path: manifestPath, partitions: 4, keyOffset: 0, keyLength: 4, capacityBytes: 64 * 1024 })
+  const writer = log.writer!
+
+  const manifest = readPartitionManifest(manifestPath)
+  t.deepEqual(manifest.partitions, [0, 1, 2, 3].map(i => `shared-log-partitioned.${i}`), 'manifest should list the partitions')
+  t.equal(manifest.hash, 'fnv1a64', 'manifest should name the hash')
+
+  const routed = new Map<number, number>()
+  let stable = true
+  for (let counter = 0; counter < 20; counter++) {
+    for (let key = 0; key < 16; key++) {
+      const partition = writer.append(payload(key, counter))
+      stable = stable && (routed.get(key) ?? partition) === partition
+      routed.set(key, partition)
+    }
+  }
+  t.ok(stable, 'a key should always be routed to the same partition')
+  const frame = writer.allocate(payload(99, 0).subarray(0, 4), 8)
+  t.equal(frame.readUInt32LE(0), 99, 'allocate should write the key')
+  frame.writeUInt32LE(0, 4)
+  writer.commit()
+
+  t.ok(new Set(routed.values()).size > 1, 'keys should spread over several partitions')
+
+  const readers = openPartitionedLog(manifestPath)
+  const seen = new Map<number, number[]>()
+  let placed = true
+  readers.partitions.forEach((partition, index) => {
+    const iterator = partition.createIterator()
+    for (const frame of iterator.nextBatch({ maxMessages: 1000 })) {
+      const key = frame.readUInt32LE(0)
+      placed = placed && writer.partitionFor(frame.subarray(0, 4)) === index
+      seen.set(key, [...(seen.get(key) ?? []), frame.readUInt32LE(4)])
+    }
+    iterator.close()
+  })
+  t.ok(placed, 'frames should be stored in the partition of their key')
+  t.equal(seen.size, 17, 'every key should be readable')
+  t.ok([...seen.entries()].filter(([key]) => key < 16).every(([, counters]) =>
+    counters.length === 20 && counters.every((value, i) => value === i)), 'per-key order should be preserved')
+
+  const target = readers.partitions[writer.partitionFor(payload(1, 0).subarray(0, 4))].createIterator()
+  const committed = target.committedSize()
+  writer.append(payload(1, 20))
+  writer.abort()
+  writer.commit()
+  t.equal(target.committedSize(), committed, 'aborted frames should not be published')
+  target.close()
+
+  readers.close()
+  log.close()
+
+  t.throws(() => createPartitionedLog({ path: manifestPath, partitions: 8, keyOffset: 0, keyLength: 4, capacityBytes: 64 * 1024 }),
+    /does not match/, 'reopening with another partition count should fail')
+
+  await cleanup(4)
+  t.end()
+})
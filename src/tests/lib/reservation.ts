@@ -0,0 +1,72 @@
+import test from 'tape'
+import { promises as fs } from 'fs'
+import { createSharedLog } from '../../lib/SharedLog'
+
+const logPath = (name: string) => `/dev/shm/${name}`
+
+test('commitThrough publishes a prefix of the pending frames', async t => {
+  const path = logPath('shared-log-reservation')
+  await fs.unlink(path).catch(() => undefined)
+
+  const log = createSharedLog({ path, capacityBytes: 64 * 1024, writable: true })
+  const writer = log.writer!
+  const iterator = log.createIterator()
+
+  const tokens = [0, 1, 2, 3].map(i => {
+    const reservation = writer.reserve(8)
+    reservation.buffer.fill(i)
+    return reservation.token
+  })
+  t.deepEqual(tokens, [0n, 1n, 2n, 3n], 'tokens should be frame sequence numbers')
+
+  writer.commitThrough(tokens[1])
+  const first = iterator.nextBatch()
+  t.deepEqual(first.map(frame => frame[0]), [0, 1], 'only frames up to the token should be published')
+
+  writer.commitThrough(tokens[0])
+  t.equal(iterator.next(), null, 'committed tokens should be ignored')
+
+  writer.commit()
+  t.deepEqual(iterator.nextBatch().map(frame => frame[0]), [2, 3], 'commit should publish the rest')
+  t.throws(() => writer.commitThrough(10n), /pending/, 'unknown tokens should be rejected')
+
+  iterator.close()
+  log.close()
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
+
+test('abort drops pending frames and reuses their space', async t => {
+  const path = logPath('shared-log-reservation-abort')
+  await fs.unlink(path).catch(() => undefined)
+
+  const log = createSharedLog({ path, capacityBytes: 64 * 1024, writable: true, frameSequences: true })
+  const writer = log.writer!
+  const iterator = log.createIterator()
+
+  writer.reserve(8).buffer.fill(1)
+  const failed = writer.reserve(8, { align: 64 })
+  writer.reserve(8).buffer.fill(0xff)
+  writer.abort(failed.token)
+
+  const retried = writer.reserve(8)
+  t.equal(retried.token, failed.token, 'the aborted sequence number should be reused')
+  retried.buffer.fill(2)
+  writer.commit()
+
+  const frames = iterator.nextBatch({ debugChecks: true })
+  t.deepEqual(frames.map(frame => frame[0]), [1, 2], 'aborted frames should never be read')
+  t.equal(iterator.sequence(), 2n, 'frame sequences should stay consecutive')
+  t.equal(iterator.committedSize(), 40n, 'aborted space should be reused (two 20-byte frames)')
+
+  writer.reserve(8)
+  writer.abort()
+  writer.commit()
+  t.equal(iterator.next(), null, 'abort without a token should drop every pending frame')
+  t.throws(() => writer.abort(0n), /already committed/, 'committed frames cannot be aborted')
+
+  iterator.close()
+  log.close()
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
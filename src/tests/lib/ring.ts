@@ -0,0 +1,318 @@
+import test from 'tape'
+import { promises as fs, openSync, closeSync } from 'fs'
+import { spawn } from 'child_process'
+import { createSharedLog } from '../../lib/SharedLog'
+import { isShmIteratorError } from '../../lib/native/types'
+
+const logPath = (name: string) => `/dev/shm/${name}`
+const ringCapacity = 4096 + 64 * 1024
+
+test('ring log wraps frames across the end of the segment', async t => {
+  const path = logPath('shared-log-ring')
+  await fs.unlink(path).catch(() => undefined)
+
+  const log = createSharedLog({ path, capacityBytes: ringCapacity, writable: true, ring: true })
+  const writer = log.writer!
+  const iterator = log.createIterator()
+
+  // 1000-byte payloads do not divide the ring evenly, so some frames straddle the wrap point.
+  const frameCount = 300
+  let read = 0
+  for (let i = 0; i < frameCount; i++) {
+    const frame = writer.allocate(1000)
+    frame.fill(i & 0xff)
+    writer.commit()
+
+    const message = iterator.next()
+    if (message === null || message.length !== 1000 || message[0] !== (i & 0xff) || message[999] !== (i & 0xff)) {
+      t.fail(`frame ${i} did not round-trip`)
+      break
+    }
+    read++
+  }
+
+  t.equal(read, frameCount, 'every frame should be readable after wrapping')
+  t.ok(iterator.committedSize() > BigInt(ringCapacity), 'positions should keep growing past the ring size')
+
+  iterator.close()
+  log.close()
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
+
+test('ring log reports lapped readers and lets them resynchronise', async t => {
+  const path = logPath('shared-log-ring-lapped')
+  await fs.unlink(path).catch(() => undefined)
+
+  const log = createSharedLog({ path, capacityBytes: ringCapacity, writable: true, ring: true })
+  const writer = log.writer!
+  const readerLog = createSharedLog({ path, writable: false })
+  const iterator = readerLog.createIterator()
+
+  for (let i = 0; i < 200; i++) {
+    writer.allocate(1000).fill(1)
+    writer.commit()
+  }
+
+  try {
+    iterator.next()
+    t.fail('lapped reader should throw')
+  } catch (err) {
+    t.ok(isShmIteratorError(err), 'should be a shm iterator error')
+    t.equal((err as any).code, 'ERR_SHM_LAPPED', 'should report ERR_SHM_LAPPED')
+  }
+
+  iterator.seek(iterator.committedSize())
+  writer.allocate(10).fill(9)
+  writer.commit()
+  const message = iterator.next()
+  t.ok(message !== null && message[0] === 9, 'reader should resume after seeking to the head')
+
+  t.throws(() => {
+    for (let i = 0; i < 100; i++) {
+      writer.allocate(1000)
+    }
+  }, /exceed ring capacity/, 'uncommitted frames cannot exceed the ring')
+
+  iterator.close()
+  readerLog.close()
+  log.close()
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
+
+test('ring readers are lapped by frames allocated but not committed yet', async t => {
+  const path = logPath('shared-log-ring-pending')
+  await fs.unlink(path).catch(() => undefined)
+
+  const log = createSharedLog({ path, capacityBytes: ringCapacity, writable: true, ring: true })
+  const writer = log.writer!
+  const readerLog = createSharedLog({ path, writable: false })
+  const behind = readerLog.createIterator()
+  const atHead = readerLog.createIterator()
+
+  for (let i = 0; i < 30; i++) {
+    writer.allocate(1000).fill(1)
+  }
+  writer.commit()
+  atHead.seek(atHead.committedSize())
+
+  // Pending frames reach a lap past the first committed ones before any of
+  // them is committed.
+  for (let i = 0; i < 40; i++) {
+    writer.allocate(1000).fill(2)
+  }
+  try {
+    behind.next()
+    t.fail('reader behind the pending frames should throw')
+  } catch (err) {
+    t.equal((err as any).code, 'ERR_SHM_LAPPED', 'should report ERR_SHM_LAPPED rather than a torn frame')
+  }
+  t.equal(atHead.next(), null, 'a reader less than a lap behind only waits for the commit')
+
+  writer.commit()
+  const frames = atHead.nextBatch({ maxMessages: 100 })
+  t.ok(frames.length === 40 && frames.every(frame => frame[0] === 2 && frame[999] === 2), 'committed frames are intact')
+
+  behind.close()
+  atHead.close()
+  readerLog.close()
+  log.close()
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
+
+const errorCode = (fn: () => unknown): string | undefined => {
+  try {
+    fn()
+  } catch (err) {
+    return (err as any).code
+  }
+  return undefined
+}
+
+test('ring writer with fail backpressure never laps a critical reader', async t => {
+  const path = logPath('shared-log-ring-backpressure')
+  await fs.unlink(path).catch(() => undefined)
+
+  const log = createSharedLog({ path, capacityBytes: ringCapacity, writable: true, ring: true, backpressure: 'fail' })
+  const writer = log.writer!
+  const readerLog = createSharedLog({ path, writable: false })
+  const critical = readerLog.createIterator({ critical: true })
+  const bestEffort = readerLog.createIterator()
+
+  let written = 0
+  let code: string | undefined
+  while (code === undefined && written < 1000) {
+    code = errorCode(() => {
+      writer.allocate(1000).fill(written & 0xff)
+      writer.commit()
+    })
+    if (code === undefined) {
+      written++
+    }
+  }
+  t.equal(code, 'ERR_SHM_BACKPRESSURE', 'writer should stop once the ring is full')
+  t.ok(written > 50 && written < 70, 'writer should fill about one ring')
+
+  const frames = critical.nextBatch({ maxMessages: 1000 })
+  t.equal(frames.length, written, 'critical reader should see every frame')
+  t.ok(frames.every((frame, index) => frame[0] === (index & 0xff) && frame[999] === (index & 0xff)), 'no frame was overwritten')
+  t.equal(bestEffort.nextBatch({ maxMessages: 1000 }).length, written, 'best-effort reader should see them too')
+
+  // The batch stays protected until the next read publishes the new cursor.
+  t.equal(errorCode(() => writer.allocate(1000)), 'ERR_SHM_BACKPRESSURE', 'frames being read are still held')
+  t.equal(critical.next(), null, 'reader is at the head')
+  writer.allocate(1000).fill(7)
+  writer.commit()
+  t.equal(critical.next()![0], 7, 'writer should continue once the reader moved on')
+
+  critical.close()
+  const fill = () => {
+    for (let i = 0; i < 100; i++) {
+      writer.allocate(1000)
+      writer.commit()
+    }
+  }
+  t.equal(errorCode(fill), undefined, 'best-effort readers do not hold the writer back')
+  t.equal(errorCode(() => bestEffort.next()), 'ERR_SHM_LAPPED', 'and are lapped instead')
+
+  bestEffort.close()
+  readerLog.close()
+  log.close()
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
+
+test('ring writer with overwrite backpressure marks lapped critical readers', async t => {
+  const path = logPath('shared-log-ring-overwrite')
+  await fs.unlink(path).catch(() => undefined)
+
+  const log = createSharedLog({ path, capacityBytes: ringCapacity, writable: true, ring: true })
+  const writer = log.writer!
+  const iterator = log.createIterator({ critical: true })
+
+  for (let i = 0; i < 65; i++) {
+    writer.allocate(1000)
+  }
+  writer.commit()
+  // This frame overwrites the reader's first one before anything past a full
+  // ring is committed; the mark tells the reader anyway.
+  writer.allocate(1000)
+  t.equal(errorCode(() => iterator.next()), 'ERR_SHM_LAPPED', 'lapped critical reader should throw')
+
+  writer.commit()
+  iterator.seek(iterator.committedSize())
+  writer.allocate(10).fill(9)
+  writer.commit()
+  t.equal(iterator.next()![0], 9, 'reader should resume after seeking to the head')
+
+  iterator.close()
+  log.close()
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
+
+test('critical readers need write access to the log', async t => {
+  const path = logPath('shared-log-ring-reader-access')
+  await fs.unlink(path).catch(() => undefined)
+
+  const log = createSharedLog({ path, capacityBytes: ringCapacity, writable: true, ring: true })
+  const fd = openSync(path, 'r')
+  const reader = createSharedLog({ fd, writable: false })
+  t.equal(errorCode(() => reader.createIterator({ critical: true })), 'ERR_SHM_READER_ACCESS',
+    'a read-only descriptor cannot hold a reader slot')
+  const iterator = reader.createIterator()
+  t.equal(iterator.next(), null, 'non-critical iterators only read')
+
+  iterator.close()
+  reader.close()
+  closeSync(fd)
+  log.close()
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
+
+test('ring writer with block backpressure gives up after maxBlockNs', async t => {
+  const path = logPath('shared-log-ring-block')
+  await fs.unlink(path).catch(() => undefined)
+
+  const log = createSharedLog({
+    path, capacityBytes: ringCapacity, writable: true, ring: true, backpressure: 'block', maxBlockNs: 1_000_000,
+  })
+  const writer = log.writer!
+  const iterators = Array.from({ length: 8 }, () => log.createIterator({ critical: true }))
+  t.equal(errorCode(() => log.createIterator({ critical: true })), 'ERR_SHM_READER_SLOTS', 'there are 8 reader slots')
+
+  const fill = () => {
+    for (let i = 0; i < 1000; i++) {
+      writer.allocate(1000)
+      writer.commit()
+    }
+  }
+  const started = process.hrtime.bigint()
+  t.equal(errorCode(fill), 'ERR_SHM_BACKPRESSURE', 'a reader on the same thread cannot catch up')
+  t.ok(process.hrtime.bigint() - started >= 1_000_000n, 'writer should have waited')
+
+  iterators.forEach(iterator => iterator.close())
+  t.equal(errorCode(fill), undefined, 'closing the readers frees the writer')
+
+  log.close()
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
+
+// Reads `count` frames through a critical iterator in its own process.
+const criticalReaderSource = `
+const [path, count, lib] = process.argv.slice(1)
+const { createSharedLog } = require(lib)
+const log = createSharedLog({ path, writable: false })
+const iterator = log.createIterator({ critical: true })
+process.stdout.write('ready\\n')
+let read = 0
+const deadline = Date.now() + 10000
+while (read < Number(count) && Date.now() < deadline) {
+  read += iterator.nextBatch().length
+}
+process.stdout.write(read + '\\n')
+iterator.close()
+log.close()
+`
+
+test('a blocked ring writer sleeps until a critical reader in another process moves on', async t => {
+  const path = logPath('shared-log-ring-block-wake')
+  await fs.unlink(path).catch(() => undefined)
+
+  const log = createSharedLog({
+    path, capacityBytes: ringCapacity, writable: true, ring: true, backpressure: 'block', maxBlockNs: 5_000_000_000,
+  })
+  const writer = log.writer!
+  const frames = 1000
+  const child = spawn(process.execPath, ['-e', criticalReaderSource, path, String(frames), require.resolve('../../lib')],
+    { stdio: ['ignore', 'pipe', 'inherit'] })
+
+  let output = ''
+  let error: string | undefined = 'not run'
+  const lines = await new Promise<string[]>((resolve, reject) => {
+    child.on('error', reject)
+    child.stdout.on('data', chunk => {
+      output += chunk
+      if (output === 'ready\n') {
+        error = errorCode(() => {
+          for (let i = 0; i < frames; i++) {
+            writer.allocate(1000)
+            writer.commit()
+          }
+        })
+      }
+    })
+    child.on('close', () => resolve(output.trim().split('\n')))
+  })
+
+  t.equal(error, undefined, 'the writer should get through 15 laps of the ring')
+  t.equal(lines[1], String(frames), 'the reader should get every frame')
+
+  log.close()
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
@@ -0,0 +1,140 @@
+import test from 'tape'
+import { promises as fs } from 'fs'
+import { createSharedLog } from '../../lib/SharedLog'
+
+const logPath = (name: string) => `/dev/shm/${name}`
+const ringCapacity = 4096 + 64 * 1024
+
+test('async scans count, validate and page through committed frames', async t => {
+  const path = logPath('shared-log-scan')
+  await fs.unlink(path).catch(() => undefined)
+
+  const log = createSharedLog({ path, capacityBytes: 1024 * 1024, writable: true, frameSequences: true })
+  const writer = log.writer!
+
+  t.equal(await log.countFrames(), 0, 'empty log should have no frames')
+  t.equal(await log.findLast(), null, 'empty log should have no last frame')
+
+  for (let i = 0; i < 1000; i++) {
+    writer.allocate(20 + (i % 7), { align: i % 3 === 0 ? 64 : 1 }).fill(i & 0xff)
+  }
+  writer.allocate(8).fill(0xee)
+  // Uncommitted frames are not scanned.
+  t.equal(await log.countFrames(), 0, 'scans should only see committed frames')
+  writer.commit()
+
+  t.equal(await log.countFrames(), 1001, 'all committed frames should be counted')
+
+  const validation = await log.validate()
+  t.ok(validation.valid, 'intact log should validate')
+  t.equal(validation.frames, 1001, 'validation should cover every frame')
+  t.equal(validation.endCursor, log.createIterator().committedSize(), 'validation should reach the committed size')
+
+  const last = await log.findLast()
+  t.ok(last !== null, 'last frame should be found')
+  t.ok(last!.payload.equals(Buffer.alloc(8, 0xee)), 'last payload should be returned')
+  t.equal(last!.sequence, 1000n, 'last frame should carry its sequence')
+  t.equal(last!.endCursor, validation.endCursor, 'last frame should end at the committed size')
+
+  const first = await log.scanRange({ maxFrames: 400 })
+  t.equal(first.frames, 400, 'maxFrames should bound a page')
+  t.equal(first.cursors.length, 400, 'a cursor should be reported per frame')
+  t.equal(first.cursors[0], 0n, 'the first page should start at the first frame')
+  t.ok(first.paddingBytes > 0, 'aligned frames should have skipped padding')
+
+  const rest = await log.scanRange({ fromCursor: first.endCursor, validate: true })
+  t.equal(rest.frames, 601, 'the next page should resume from endCursor')
+  t.equal(rest.endCursor, validation.endCursor, 'the last page should end at the committed size')
+
+  const bounded = await log.scanRange({ toCursor: first.cursors[10] })
+  t.equal(bounded.frames, 10, 'toCursor on a frame boundary should end the range there')
+  try {
+    await log.scanRange({ toCursor: first.cursors[10] + 1n })
+    t.fail('toCursor inside a frame should reject')
+  } catch (error) {
+    t.ok(error instanceof RangeError, 'toCursor inside a frame should be a RangeError')
+    t.equal((error as NodeJS.ErrnoException).code, 'ERR_SHM_CURSOR', 'and blame the cursor, not the log')
+  }
+
+  const iterator = log.createIterator({ startCursor: rest.cursors[0] })
+  t.equal(iterator.next()![0], 400 & 0xff, 'reported cursors should be frame boundaries')
+  iterator.close()
+
+  log.close()
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
+
+test('async validation reports corruption without throwing', async t => {
+  const path = logPath('shared-log-scan-corrupt')
+  await fs.unlink(path).catch(() => undefined)
+
+  const log = createSharedLog({ path, capacityBytes: 64 * 1024, writable: true })
+  const writer = log.writer!
+  for (let i = 0; i < 10; i++) {
+    writer.allocate(16).fill(i)
+  }
+  writer.commit()
+
+  // Break the suffix of the fourth frame (20 bytes each).
+  const suffixOffset = Number(log.header.dataOffset) + 3 * 20 + 18
+  const fd = await fs.open(path, 'r+')
+  try {
+    await fd.write(Buffer.from([0x99, 0x00]), 0, 2, suffixOffset)
+  } finally {
+    await fd.close()
+  }
+
+  const result = await log.validate()
+  t.notOk(result.valid, 'corrupt log should not validate')
+  t.equal(result.frames, 3, 'frames before the corruption should be counted')
+  t.equal(result.endCursor, 60n, 'the corrupt frame should be located')
+  t.ok(result.error && /suffix/.test(result.error), 'the problem should be described')
+
+  t.equal(await log.countFrames(), 10, 'counting only follows frame prefixes')
+  try {
+    await log.scanRange({ validate: true })
+    t.fail('validating scanRange should reject')
+  } catch (error) {
+    t.equal((error as NodeJS.ErrnoException).code, 'ERR_SHM_FRAME_CORRUPT', 'should reject with frame corrupt code')
+  }
+
+  log.close()
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
+
+test('async scans of a ring log start at the oldest frame and survive close', async t => {
+  const path = logPath('shared-log-scan-ring')
+  await fs.unlink(path).catch(() => undefined)
+
+  const log = createSharedLog({ path, capacityBytes: ringCapacity, writable: true, ring: true })
+  const writer = log.writer!
+  for (let i = 0; i < 200; i++) {
+    writer.allocate(1000).fill(i & 0xff)
+    writer.commit()
+  }
+
+  const validation = await log.validate()
+  t.ok(validation.valid, 'the last lap should validate')
+  t.ok(validation.frames > 0 && validation.frames < 200, 'only frames still in the ring should be scanned')
+  t.ok(validation.startCursor > 0n, 'the scan should start past overwritten frames')
+
+  const last = await log.findLast()
+  t.equal(last!.payload[0], 199, 'the newest frame should be found')
+
+  try {
+    await log.scanRange({ fromCursor: 0 })
+    t.fail('scanning overwritten frames should reject')
+  } catch (error) {
+    t.equal((error as NodeJS.ErrnoException).code, 'ERR_SHM_LAPPED', 'should reject with lapped code')
+  }
+
+  const pending = log.countFrames()
+  log.close()
+  t.equal(await pending, validation.frames, 'a pending scan should finish after close')
+  t.throws(() => log.countFrames(), /closed/, 'new scans should be refused after close')
+
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
@@ -0,0 +1,82 @@
+import test from 'tape'
+import { promises as fs } from 'fs'
+import { createSharedLog } from '../../lib/SharedLog'
+import { SharedHeader } from '../../lib/sharedHeader'
+
+const logPath = (name: string) => `/dev/shm/${name}`
+
+test('iterators track their sequence and lag from cursor 0', async t => {
+  const path = logPath('shared-log-sequence')
+  await fs.unlink(path).catch(() => undefined)
+
+  const log = createSharedLog({ path, capacityBytes: 64 * 1024, writable: true })
+  const writer = log.writer!
+  for (let i = 0; i < 10; i++) {
+    writer.allocate(16).fill(i)
+  }
+  writer.commit()
+
+  const header = new SharedHeader(log)
+  t.equal(header.committedMessages(), 10n, 'header should count committed messages')
+
+  const iterator = log.createIterator()
+  t.equal(iterator.lag(), 10n, 'fresh iterator should lag by every committed frame')
+  iterator.nextBatch({ maxMessages: 4 })
+  t.equal(iterator.sequence(), 4n, 'sequence should count frames read')
+  t.equal(iterator.lag(), 6n, 'lag should shrink as frames are read')
+  iterator.nextBatch()
+  t.equal(iterator.lag(), 0n, 'caught-up iterator should have no lag')
+
+  iterator.seek(0n)
+  iterator.next()
+  const cursor = iterator.cursor()
+  iterator.seek(cursor)
+  t.equal(iterator.sequence(), null, 'unstamped logs cannot recover the sequence after seeking')
+  t.equal(iterator.lag(), null, 'lag is unknown without a sequence')
+
+  iterator.close()
+  log.close()
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
+
+test('frame sequences are stamped into frames and recovered after seeking', async t => {
+  const path = logPath('shared-log-frame-sequences')
+  await fs.unlink(path).catch(() => undefined)
+
+  const log = createSharedLog({ path, capacityBytes: 64 * 1024, writable: true, frameSequences: true })
+  const writer = log.writer!
+  const cursors: bigint[] = []
+  const iterator = log.createIterator()
+  for (let i = 0; i < 5; i++) {
+    writer.allocate(24, { align: i % 2 === 0 ? 16 : 1 }).fill(i)
+  }
+  writer.commit()
+
+  const frames = iterator.nextBatch({ debugChecks: true })
+  t.equal(frames.length, 5, 'all frames should be returned')
+  t.ok(frames.every((frame, i) => frame.length === 24 && frame[0] === i), 'payloads should exclude the stamp')
+
+  iterator.seek(0n)
+  for (let i = 0; i < 5; i++) {
+    cursors.push(iterator.cursor())
+    iterator.next()
+  }
+
+  // Frame 2 is aligned, so the cursor may point at padding in front of it.
+  const readerLog = createSharedLog({ path, writable: false })
+  const reader = readerLog.createIterator({ startCursor: cursors[2] })
+  t.equal(reader.sequence(), 2n, 'sequence should be read from the frame at the cursor')
+  t.equal(reader.lag(), 3n, 'lag should be exact after a seek')
+  reader.next()
+  t.equal(reader.sequence(), 3n, 'sequence should advance with reads')
+
+  t.throws(() => writer.allocate(65524), /65523/, 'stamps reduce the maximum payload')
+
+  reader.close()
+  readerLog.close()
+  iterator.close()
+  log.close()
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
@@ -0,0 +1,78 @@
+import test from 'tape'
+import { promises as fs } from 'fs'
+import { spawn } from 'child_process'
+import { createSharedLog } from '../../lib/SharedLog'
+import { SharedHeader } from '../../lib/sharedHeader'
+
+const logPath = (name: string) => `/dev/shm/${name}`
+
+// Opens the log read-only in its own process and sleeps on the commit sequence.
+const waiterSource = `
+const [path, lastSequence, lib] = process.argv.slice(1)
+const { createSharedLog, SharedHeader } = require(lib)
+const log = createSharedLog({ path, writable: false })
+const header = new SharedHeader(log)
+process.stdout.write('ready\\n')
+process.stdout.write(header.waitForCommit(Number(lastSequence), 5000) + '\\n')
+log.close()
+`
+
+test('shared header view exposes committed size and commit sequence atomically', async t => {
+  const path = logPath('shared-log-shared-header')
+  await fs.unlink(path).catch(() => undefined)
+
+  const log = createSharedLog({ path, capacityBytes: 64 * 1024, writable: true })
+  const header = new SharedHeader(log)
+  const iterator = log.createIterator()
+
+  t.ok(header.hasCommitSequence(), 'new logs should carry a commit sequence')
+  t.notOk(header.buffer instanceof SharedArrayBuffer, 'the view is a plain ArrayBuffer, not for Atomics.wait')
+  const before = header.commitSequence()
+  log.writer!.allocate(16).fill(1)
+  log.writer!.commit()
+
+  t.equal(header.commitSequence(), before + 1, 'commit should bump the sequence')
+  t.equal(header.committedSize(), iterator.committedSize(), 'committed size should match the iterator')
+  t.equal(header.waitForCommit(before, 0), 'not-equal', 'wait should return at once when the sequence moved')
+  t.equal(header.waitForCommit(header.commitSequence(), 1), 'timed-out', 'wait should time out without commits')
+
+  iterator.close()
+  log.close()
+  t.equal(header.committedSize() > 0n, true, 'view should stay readable after close')
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
+
+test('commit wakes a waiter blocked in another process', async t => {
+  const path = logPath('shared-log-shared-header-wait')
+  await fs.unlink(path).catch(() => undefined)
+
+  const log = createSharedLog({ path, capacityBytes: 64 * 1024, writable: true })
+  const header = new SharedHeader(log)
+
+  const child = spawn(process.execPath, [
+    '-e', waiterSource, path, String(header.commitSequence()), require.resolve('../../lib'),
+  ], { stdio: ['ignore', 'pipe', 'inherit'] })
+
+  const lines = await new Promise<string[]>((resolve, reject) => {
+    let output = ''
+    child.on('error', reject)
+    child.stdout.on('data', chunk => {
+      output += chunk
+      if (output === 'ready\n') {
+        setTimeout(() => {
+          log.writer!.allocate(8).fill(2)
+          log.writer!.commit()
+        }, 50)
+      }
+    })
+    child.on('close', () => resolve(output.trim().split('\n')))
+  })
+
+  t.equal(lines[0], 'ready', 'the waiter should open the log')
+  t.notEqual(lines[1], 'timed-out', 'the waiting process should be woken by the commit')
+  t.equal(log.waitForCommit(header.commitSequence(), 1), 'timed-out', 'the writer can wait on its own log too')
+  log.close()
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
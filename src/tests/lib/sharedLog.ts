@@ -85,3 +85,113 @@ test('reader ignores provided capacity when mapping existing log', async t => {
   await fs.unlink(path).catch(() => undefined)
   t.end()
 })
+
+test('new logs use header v2 and headerVersion 1 keeps the legacy layout', async t => {
+  const path = logPath('shared-log-header-version')
+  await fs.unlink(path).catch(() => undefined)
+
+  const log = createSharedLog({ path, capacityBytes: 64 * 1024, writable: true })
+  t.equal(log.header.headerSize, 384n, 'new logs should default to the 384-byte v2 header')
+  log.writer!.allocate(32).fill(1)
+  log.writer!.commit()
+  const view = log.header.getBuffer()
+  t.equal(view.readBigUInt64LE(128), log.header.size, 'v2 committed size should live in the writer section')
+  t.equal(view.readBigUInt64LE(16), log.header.dataOffset, 'v1 size slot should stay pinned to dataOffset')
+  log.close()
+
+  const reader = createSharedLog({ path, writable: false })
+  const frames = reader.createIterator().nextBatch()
+  t.equal(frames.length, 1, 'reader should find the committed frame through the v2 header')
+  reader.close()
+  await fs.unlink(path).catch(() => undefined)
+
+  const legacy = createSharedLog({ path, capacityBytes: 64 * 1024, writable: true, headerVersion: 1 })
+  t.equal(legacy.header.headerSize, 24n, 'headerVersion 1 should create a 24-byte header')
+  legacy.writer!.allocate(32).fill(2)
+  legacy.writer!.commit()
+  t.equal(legacy.header.size, 24n + 36n, 'v1 committed size should advance in place')
+  t.equal(legacy.createIterator().nextBatch().length, 1, 'v1 log should still be readable')
+  legacy.close()
+  await fs.unlink(path).catch(() => undefined)
+
+  t.throws(
+    () => createSharedLog({ path, capacityBytes: 64 * 1024, writable: true, headerVersion: 1, ring: true }),
+    /header/i,
+    'ring logs should require header v2',
+  )
+  await fs.unlink(path).catch(() => undefined)
+
+  const small = createSharedLog({ path, capacityBytes: 512, writable: true })
+  t.equal(small.header.headerSize, 24n, 'logs too small for v2 should default to a v1 header')
+  small.close()
+  await fs.unlink(path).catch(() => undefined)
+
+  t.throws(
+    () => createSharedLog({ path, capacityBytes: 512, writable: true, headerVersion: 2 }),
+    RangeError,
+    'an explicit headerVersion 2 should not fall back to v1',
+  )
+  await fs.unlink(path).catch(() => undefined)
+  t.throws(
+    () => createSharedLog({ path, capacityBytes: 512, writable: true, frameSequences: true }),
+    RangeError,
+    'frameSequences should not be dropped on small logs',
+  )
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
+
+test('opening a log with an unknown header version fails', async t => {
+  const path = logPath('shared-log-header-unknown')
+  await fs.unlink(path).catch(() => undefined)
+
+  const log = createSharedLog({ path, capacityBytes: 64 * 1024, writable: true })
+  log.close()
+
+  const handle = await fs.open(path, 'r+')
+  const version = Buffer.alloc(4)
+  version.writeUInt32LE(3)
+  await handle.write(version, 0, 4, 32)
+  await handle.close()
+
+  t.throws(() => createSharedLog({ path, writable: false }), /header/i, 'unsupported header versions should be refused')
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
+
+test('aligned allocations can be viewed as typed arrays in place', async t => {
+  const path = logPath('shared-log-aligned')
+  await fs.unlink(path).catch(() => undefined)
+
+  const log = createSharedLog({ path, capacityBytes: 64 * 1024, writable: true })
+  const writer = log.writer!
+
+  // Odd-sized unaligned frames in between force padding of varying length.
+  const counts = [3, 1, 7, 2]
+  counts.forEach((count, index) => {
+    writer.allocate(index * 2 + 1).fill(0xaa)
+    const frame = writer.allocate(8 * count, { align: 64 })
+    t.equal(writer.getLastAllocatedAddress()! % 64n, 0n, 'payload position should be aligned')
+    new Float64Array(frame.buffer, frame.byteOffset, count).fill(index + 0.5)
+  })
+  writer.commit()
+
+  const iterator = log.createIterator()
+  const frames = iterator.nextBatch({ maxMessages: 100, debugChecks: true })
+  t.equal(frames.length, counts.length * 2, 'padding should not be returned as frames')
+  t.ok(frames.every(frame => frame.buffer === frames[0].buffer), 'frames should view one ArrayBuffer over the mapping')
+  t.ok(Buffer.isBuffer(frames[0]), 'frames should be Buffers')
+  counts.forEach((count, index) => {
+    const frame = frames[index * 2 + 1]
+    const values = new Float64Array(frame.buffer, frame.byteOffset, count)
+    t.ok(values.every(value => value === index + 0.5), 'reader should view the aligned payload in place')
+  })
+
+  t.throws(() => writer.allocate(16, { align: 48 }), /power of two/, 'align must be a power of two')
+  t.throws(() => writer.allocate(65532), /65531/, 'payloads must fit the u16 frame size')
+
+  iterator.close()
+  log.close()
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
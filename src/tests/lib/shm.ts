@@ -314,3 +314,37 @@ test('writer address methods throw after close', async t => {
   log.close()
   t.end()
 })
+
+test('iterator transferTo writes raw committed frames to a file descriptor', async t => {
+  const log = await createWritableLog('native-iterator-transfer', 6)
+  const msgSize = bendec.getSize('Sample')
+  const frameBytes = msgSize + 4
+
+  const targetPath = '/tmp/native-iterator-transfer.bin'
+  await fs.unlink(targetPath).catch(() => undefined)
+  const target = await fs.open(targetPath, 'w')
+
+  const iterator = log.createIterator()
+  try {
+    const first = iterator.transferTo(target.fd, { maxBytes: frameBytes * 4 })
+    t.equal(first, frameBytes * 4, 'should transfer whole frames up to maxBytes')
+    t.equal(iterator.cursor(), BigInt(frameBytes * 4), 'cursor should advance by bytes written')
+
+    const second = iterator.transferTo(target.fd)
+    t.equal(second, frameBytes * 2, 'should transfer remaining frames')
+    t.equal(iterator.transferTo(target.fd), 0, 'should return 0 when no frames are committed')
+  } finally {
+    await target.close()
+  }
+
+  const written = await fs.readFile(targetPath)
+  const raw = await fs.readFile(logPath('native-iterator-transfer'))
+  const dataOffset = Number(log.header.dataOffset)
+  t.ok(written.equals(raw.subarray(dataOffset, dataOffset + frameBytes * 6)), 'file should contain raw frames')
+  t.equal(written.readUInt16LE(0), frameBytes, 'frame prefix should be preserved')
+
+  iterator.close()
+  log.close()
+  await fs.unlink(targetPath).catch(() => undefined)
+  t.end()
+})
@@ -0,0 +1,123 @@
+import test from 'tape'
+import { promises as fs } from 'fs'
+import { spawn } from 'child_process'
+import { createSharedLog } from '../../lib/SharedLog'
+
+const logPath = (name: string) => `/dev/shm/${name}`
+
+// Creates the log in its own process and commits 8-byte frames one at a time
+// (12 bytes each with the size prefix and suffix) until it is full.
+const committerSource = `
+const [path, lib] = process.argv.slice(1)
+const { createSharedLog } = require(lib)
+const log = createSharedLog({ path, capacityBytes: 4 * 1024 * 1024, writable: true })
+process.stdout.write('ready\\n')
+const frames = Math.floor((4 * 1024 * 1024 - 4096) / 12)
+for (let i = 0; i < frames; i++) {
+  log.writer.allocate(8)
+  log.writer.commit()
+}
+log.close()
+`
+
+test('snapshot iterators replay the same frames and hand over to live tailing', async t => {
+  const path = logPath('shared-log-snapshot')
+  await fs.unlink(path).catch(() => undefined)
+
+  const log = createSharedLog({ path, capacityBytes: 64 * 1024, writable: true })
+  const writer = log.writer!
+  for (let i = 0; i < 10; i++) {
+    writer.allocate(16).fill(i)
+  }
+  writer.commit()
+
+  const snapshot = log.snapshot()
+  t.equal(snapshot.messages, 10n, 'snapshot should count the committed frames')
+
+  const first = log.createIterator({ snapshot })
+  first.nextBatch({ maxMessages: 4 })
+  writer.allocate(16).fill(10)
+  writer.commit()
+  const second = log.createIterator({ snapshot })
+
+  t.equal(first.committedSize(), snapshot.endCursor, 'committed size should stop at the snapshot')
+  t.equal(first.lag(), 6n, 'lag should count frames left in the snapshot')
+  t.equal(first.nextBatch().length, 6, 'first reader should get the rest of the snapshot')
+  t.equal(second.nextBatch().length, 10, 'a reader created after more commits sees the same frames')
+  t.ok(first.isFinished() && second.isFinished(), 'both readers should be finished')
+  t.equal(first.next(), null, 'finished readers get nothing more')
+  t.equal(first.spinNext({ maxSpinNs: 1_000_000_000 }), null, 'and do not wait for the writer')
+  t.throws(() => first.seek(snapshot.endCursor + 20n), /beyond committed size/, 'seeking past the snapshot fails')
+
+  first.follow()
+  t.notOk(first.isFinished(), 'live readers are never finished')
+  const live = first.nextBatch()
+  t.ok(live.length === 1 && live[0][0] === 10, 'first live frame is the one committed after the snapshot')
+  t.equal(first.lag(), 0n, 'lag follows the writer after the handover')
+
+  first.close()
+  second.close()
+  log.close()
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
+
+test('snapshot option must come from a snapshot of the log', async t => {
+  const path = logPath('shared-log-snapshot-invalid')
+  await fs.unlink(path).catch(() => undefined)
+
+  const log = createSharedLog({ path, capacityBytes: 64 * 1024, writable: true })
+  log.writer!.allocate(16)
+  log.writer!.commit()
+  const { endCursor } = log.snapshot()
+
+  t.throws(() => log.createIterator({ snapshot: {} as any }), TypeError, 'endCursor is required')
+  t.throws(() => log.createIterator({ snapshot: { endCursor: endCursor + 1n, messages: null } }), RangeError,
+    'a snapshot cannot end past the committed size')
+  const empty = log.createIterator({ snapshot: { endCursor: 0n, messages: null } })
+  t.ok(empty.isFinished(), 'an empty snapshot is finished from the start')
+  const iterator = log.createIterator({ snapshot: { endCursor, messages: null } })
+  t.equal(iterator.lag(), null, 'lag is unknown without the snapshot message count')
+
+  empty.close()
+  iterator.close()
+  log.close()
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
+
+test('snapshot message counts stay exact while another process commits', async t => {
+  const path = logPath('shared-log-snapshot-concurrent')
+  await fs.unlink(path).catch(() => undefined)
+
+  const child = spawn(process.execPath, ['-e', committerSource, path, require.resolve('../../lib')],
+    { stdio: ['ignore', 'pipe', 'inherit'] })
+  await new Promise<void>((resolve, reject) => {
+    child.on('error', reject)
+    child.stdout.once('data', () => resolve())
+  })
+
+  const log = createSharedLog({ path, writable: false })
+  let mismatches = 0
+  let moving = 0
+  let last = -1n
+  for (let i = 0; i < 100_000; i++) {
+    const { endCursor, messages } = log.snapshot()
+    if (messages !== endCursor / 12n) {
+      mismatches++
+    }
+    if (endCursor !== last) {
+      moving++
+      last = endCursor
+    }
+  }
+  await new Promise(resolve => child.on('close', resolve))
+
+  t.ok(moving > 1, 'snapshots should be taken while frames are being committed')
+  t.equal(mismatches, 0, 'messages should always count exactly the frames below endCursor')
+  const { endCursor, messages } = log.snapshot()
+  t.equal(messages, endCursor / 12n, 'the final snapshot should match too')
+  log.close()
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
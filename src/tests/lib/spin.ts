@@ -0,0 +1,45 @@
+import test from 'tape'
+import { promises as fs } from 'fs'
+import { createSharedLog } from '../../lib/SharedLog'
+import { pinThread } from '../../lib/native'
+
+const logPath = '/dev/shm/spin-test'
+
+test('spinNext and spinBatch return committed frames or time out', async t => {
+  await fs.unlink(logPath).catch(() => undefined)
+  const log = createSharedLog({ path: logPath, capacityBytes: 64 * 1024, writable: true })
+  const iterator = log.createIterator()
+
+  const start = process.hrtime.bigint()
+  t.equal(iterator.spinNext({ maxSpinNs: 2_000_000 }), null, 'spinNext should time out on an idle log')
+  t.ok(process.hrtime.bigint() - start >= 2_000_000n, 'spinNext should spin for maxSpinNs')
+  t.deepEqual(iterator.spinBatch({ maxSpinNs: 0 }), [], 'a zero spin should behave like nextBatch')
+
+  for (let i = 0; i < 3; i++) {
+    log.writer!.allocate(4).writeUInt32LE(i, 0)
+  }
+  log.writer!.commit()
+
+  const first = iterator.spinNext()
+  t.equal(first && first.readUInt32LE(0), 0, 'spinNext should return the next frame')
+  const batch = iterator.spinBatch({ maxSpinNs: 1_000_000, maxMessages: 1 })
+  t.deepEqual(batch.map(frame => frame.readUInt32LE(0)), [1], 'spinBatch should honour batch options')
+  t.equal(iterator.spinBatch().length, 1, 'spinBatch should drain the rest')
+
+  t.throws(() => iterator.spinNext({ maxSpinNs: -1 }), /maxSpinNs/, 'negative spins are rejected')
+
+  iterator.close()
+  log.close()
+  await fs.unlink(logPath).catch(() => undefined)
+  t.end()
+})
+
+test('pinThread pins the calling thread', t => {
+  if (process.platform !== 'linux') {
+    t.throws(() => pinThread(0), /pinThread failed/, 'thread affinity is Linux only')
+  } else {
+    t.doesNotThrow(() => pinThread(0), 'pinning to CPU 0 should succeed')
+  }
+  t.throws(() => pinThread(-1), /non-negative/, 'negative CPUs are rejected')
+  t.end()
+})
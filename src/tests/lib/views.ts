@@ -0,0 +1,108 @@
+import test from 'tape'
+import { promises as fs } from 'fs'
+import { createSharedLog } from '../../lib/SharedLog'
+
+const logPath = (name: string) => `/dev/shm/${name}`
+
+test('frames are views of the data region at their offset in the log', async t => {
+  const path = logPath('shared-log-views')
+  await fs.unlink(path).catch(() => undefined)
+
+  const log = createSharedLog({ path, capacityBytes: 64 * 1024, writable: true })
+  const writer = log.writer!
+  const dataOffset = log.header.dataOffset
+  const sizes = [1, 13, 64, 255]
+  const addresses: bigint[] = []
+  sizes.forEach((size, index) => {
+    const allocation = writer.allocate(size)
+    allocation.fill(index + 1)
+    addresses.push(writer.getLastAllocatedAddress()!)
+    t.equal(BigInt(allocation.byteOffset), addresses[index] - dataOffset, 'allocation should sit at its address')
+  })
+  writer.commit()
+
+  const iterator = log.createIterator()
+  const frames = iterator.nextBatch({ maxMessages: 100 })
+  t.equal(frames.length, sizes.length, 'reader should get every frame')
+  frames.forEach((frame, index) => {
+    t.equal(frame.length, sizes[index], 'view length should be the payload size')
+    t.equal(BigInt(frame.byteOffset), addresses[index] - dataOffset, 'view should start at the payload')
+    t.ok(frame.every(byte => byte === index + 1), 'view should show the payload bytes')
+  })
+  t.equal(BigInt(frames[0].buffer.byteLength), log.capacityBytes() - dataOffset,
+    'the ArrayBuffer should cover the data region only, not the header')
+  t.equal(writer.getBufferAtAddress(addresses[2], 64).byteOffset, frames[2].byteOffset,
+    'getBufferAtAddress should view the same bytes')
+
+  iterator.close()
+  log.close()
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
+
+test('views stay valid after the mapping grows', async t => {
+  const path = logPath('shared-log-views-growth')
+  await fs.unlink(path).catch(() => undefined)
+
+  const log = createSharedLog({
+    path,
+    capacityBytes: 4096,
+    maxCapacityBytes: 1024 * 1024,
+    growthStepBytes: 16 * 1024,
+    writable: true,
+  })
+  const writer = log.writer!
+  writer.allocate(100).fill(1)
+  writer.commit()
+
+  const iterator = log.createIterator()
+  const before = iterator.nextBatch()
+  t.equal(before.length, 1, 'reader should get the first frame')
+  const smallBuffer = before[0].buffer
+
+  for (let i = 0; i < 200; i++) {
+    writer.allocate(100).fill(2)
+  }
+  writer.commit()
+
+  const after = iterator.nextBatch({ maxMessages: 1000 })
+  t.equal(after.length, 200, 'reader should get the frames written after growth')
+  t.ok(after[after.length - 1].buffer.byteLength > smallBuffer.byteLength, 'new frames should view a larger ArrayBuffer')
+  t.ok(before[0].every(byte => byte === 1), 'views made before growth should still read the old frame')
+  after[0].fill(3)
+  t.ok(after.every(frame => frame.length === 100), 'views made after growth should have the payload length')
+  t.equal(new Uint8Array(smallBuffer, before[0].byteOffset + 100 + 4, 1)[0], 3,
+    'the old ArrayBuffer should still alias the same pages')
+
+  iterator.close()
+  log.close()
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
+
+test('externalBuffers returns the same bytes as one Buffer per frame', async t => {
+  const path = logPath('shared-log-views-external')
+  await fs.unlink(path).catch(() => undefined)
+
+  const log = createSharedLog({ path, capacityBytes: 64 * 1024, writable: true })
+  for (let i = 0; i < 8; i++) {
+    log.writer!.allocate(16).fill(i)
+  }
+  log.writer!.commit()
+
+  const viewIterator = log.createIterator()
+  const externalIterator = log.createIterator()
+  const views = viewIterator.nextBatch({ maxMessages: 100 })
+  const external = externalIterator.nextBatch({ maxMessages: 100, externalBuffers: true })
+  t.equal(external.length, views.length, 'both paths should return every frame')
+  t.ok(external.every((frame, index) => frame.equals(views[index])), 'both paths should show the same bytes')
+  t.ok(external.every(frame => frame.byteOffset === 0 && frame.buffer.byteLength === 16),
+    'external frames should have an ArrayBuffer of their own')
+  t.throws(() => viewIterator.nextBatch({ externalBuffers: 1 as any }), /externalBuffers must be boolean/)
+
+  viewIterator.close()
+  externalIterator.close()
+  log.close()
+  await fs.unlink(path).catch(() => undefined)
+  t.end()
+})
@@ -0,0 +1,210 @@
+#!/usr/bin/env node
+
+// Read-side cost of nextBatch() per frame for small payloads, with and
+// without debugChecks, and with frames returned as views of the mapping
+// ArrayBuffer or, as before, as one external Buffer each (externalBuffers).
+// The log is larger than the last-level cache so frame headers have to come
+// from memory, which is what the prefetching in CollectFrames targets.
+// Compare builds by saving a report from one and passing it as the baseline
+// of the other:
+//
+//   node dist/tests/perf/collect.js [--payloads 16,32,64,128,256]
+//     [--out report.json] [--baseline previous.json] [--tolerance 0.15]
+
+import { promises as fs, readFileSync, writeFileSync } from 'fs'
+import os from 'os'
+import { createSharedLog } from '../../lib/SharedLog'
+
+const BENCH_PATH = '/dev/shm/shmio-bench-collect'
+const LOG_BYTES = 256 * 1024 * 1024
+const BATCH_MESSAGES = 1024
+const ROUNDS = 3
+const REPORT_SCHEMA = 1
+
+interface CollectVariant {
+  debugChecks: boolean
+  externalBuffers: boolean
+}
+
+const VARIANTS: CollectVariant[] = [
+  { debugChecks: false, externalBuffers: false },
+  { debugChecks: true, externalBuffers: false },
+  { debugChecks: false, externalBuffers: true },
+]
+
+export interface CollectResult {
+  payloadSize: number
+  debugChecks: boolean
+  externalBuffers: boolean
+  frames: number
+  nsPerFrame: number
+  framesPerSec: number
+}
+
+export interface CollectReport {
+  schema: number
+  environment: {
+    node: string
+    platform: string
+    kernel: string
+    cpuModel: string
+  }
+  results: CollectResult[]
+}
+
+interface CollectOptions {
+  payloads: number[]
+  out?: string
+  baseline?: string
+  tolerance: number
+}
+
+function parseArgs(argv: string[]): CollectOptions {
+  const options: CollectOptions = {
+    payloads: [16, 32, 64, 128, 256],
+    tolerance: 0.15,
+  }
+  for (let i = 0; i < argv.length; i += 2) {
+    const [flag, value] = [argv[i], argv[i + 1]]
+    if (value === undefined) {
+      throw new Error(`Missing value for ${flag}`)
+    }
+    switch (flag) {
+      case '--payloads':
+        options.payloads = value.split(',').filter(Boolean).map(Number)
+        if (options.payloads.some(size => !Number.isInteger(size) || size < 4)) {
+          throw new Error(`Payload sizes must be integers of at least 4 bytes, got "${value}"`)
+        }
+        break
+      case '--out': options.out = value; break
+      case '--baseline': options.baseline = value; break
+      case '--tolerance': options.tolerance = Number(value); break
+      default: throw new Error(`Unknown option ${flag}`)
+    }
+  }
+  return options
+}
+
+async function populate(payloadSize: number): Promise<number> {
+  await fs.unlink(BENCH_PATH).catch(() => undefined)
+  const log = createSharedLog({ path: BENCH_PATH, capacityBytes: LOG_BYTES, writable: true })
+  const writer = log.writer!
+  const frames = Math.floor((LOG_BYTES - 4096) / (payloadSize + 4))
+  for (let i = 0; i < frames; i++) {
+    writer.allocate(payloadSize).writeUInt32LE(i, 0)
+    if (i % BATCH_MESSAGES === BATCH_MESSAGES - 1) {
+      writer.commit()
+    }
+  }
+  writer.commit()
+  log.close()
+  return frames
+}
+
+function readAll(payloadSize: number, { debugChecks, externalBuffers }: CollectVariant): CollectResult {
+  const log = createSharedLog({ path: BENCH_PATH, writable: false })
+  let best = Number.POSITIVE_INFINITY
+  let frames = 0
+
+  for (let round = 0; round < ROUNDS; round++) {
+    const iterator = log.createIterator()
+    const start = process.hrtime.bigint()
+    frames = 0
+    let batch = iterator.nextBatch({ maxMessages: BATCH_MESSAGES, debugChecks, externalBuffers })
+    while (batch.length > 0) {
+      frames += batch.length
+      batch = iterator.nextBatch({ maxMessages: BATCH_MESSAGES, debugChecks, externalBuffers })
+    }
+    best = Math.min(best, Number(process.hrtime.bigint() - start))
+    iterator.close()
+  }
+
+  log.close()
+  return {
+    payloadSize,
+    debugChecks,
+    externalBuffers,
+    frames,
+    nsPerFrame: best / frames,
+    framesPerSec: frames / (best / 1e9),
+  }
+}
+
+// Reports from builds without externalBuffers have no such field.
+const resultKey = (result: CollectResult) =>
+  `${result.payloadSize}B/${result.debugChecks ? 'checked' : 'unchecked'}/${result.externalBuffers ? 'external' : 'views'}`
+
+// A result regresses when its cost per frame grows by more than `tolerance`
+// relative to the baseline result with the same key. Every matched result is
+// printed with its change, so improvements show up as well.
+function compareWithBaseline(report: CollectReport, baseline: CollectReport, tolerance: number): string[] {
+  if (baseline.schema !== report.schema) {
+    return [`baseline schema ${baseline.schema} does not match ${report.schema}`]
+  }
+  const previous = new Map(baseline.results.map(result => [resultKey(result), result]))
+  const failures: string[] = []
+  console.log('\nagainst baseline                 ns/frame   baseline    change')
+  for (const result of report.results) {
+    const before = previous.get(resultKey(result))
+    if (!before) {
+      continue
+    }
+    const change = result.nsPerFrame / before.nsPerFrame - 1
+    console.log(`${resultKey(result).padEnd(30)} ${result.nsPerFrame.toFixed(1).padStart(10)} `
+      + `${before.nsPerFrame.toFixed(1).padStart(10)} ${`${(change * 100).toFixed(1)}%`.padStart(9)}`)
+    if (change > tolerance) {
+      failures.push(`${resultKey(result)}: ${result.nsPerFrame.toFixed(1)} ns/frame > baseline ${before.nsPerFrame.toFixed(1)} ns/frame`)
+    }
+  }
+  return failures
+}
+
+async function main() {
+  const options = parseArgs(process.argv.slice(2))
+  const report: CollectReport = {
+    schema: REPORT_SCHEMA,
+    environment: {
+      node: process.version,
+      platform: `${process.platform}-${process.arch}`,
+      kernel: os.release(),
+      cpuModel: os.cpus()[0]?.model ?? 'unknown',
+    },
+    results: [],
+  }
+
+  console.log('\nnextBatch() cost per frame (best of 3 passes over a 256 MiB log)')
+  console.log('payload  debugChecks  frames as      frames   ns/frame     frames/sec')
+  for (const payloadSize of options.payloads) {
+    await populate(payloadSize)
+    for (const variant of VARIANTS) {
+      const result = readAll(payloadSize, variant)
+      report.results.push(result)
+      console.log(`${String(payloadSize).padStart(7)}  ${String(result.debugChecks).padStart(11)}  `
+        + `${(result.externalBuffers ? 'external' : 'views').padStart(9)} `
+        + `${String(result.frames).padStart(10)} ${result.nsPerFrame.toFixed(1).padStart(10)} `
+        + `${Math.round(result.framesPerSec).toLocaleString().padStart(14)}`)
+    }
+  }
+  await fs.unlink(BENCH_PATH).catch(() => undefined)
+
+  if (options.out) {
+    writeFileSync(options.out, `${JSON.stringify(report, null, 2)}\n`)
+    console.log(`report written to ${options.out}`)
+  }
+
+  if (options.baseline) {
+    const baseline = JSON.parse(readFileSync(options.baseline, 'utf8')) as CollectReport
+    const failures = compareWithBaseline(report, baseline, options.tolerance)
+    for (const failure of failures) {
+      console.error(`regression: ${failure}`)
+    }
+    if (failures.length > 0) {
+      process.exitCode = 1
+    }
+  }
+}
+
+main().catch(error => {
+  console.error(error)
+  process.exitCode = 1
+})
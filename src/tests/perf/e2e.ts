@@ -0,0 +1,392 @@
+#!/usr/bin/env node
+
+// Multi-process end-to-end benchmark: one writer process and N reader
+// processes share a log, each pinned to its own CPU (via taskset when it is
+// available). The writer stamps every batch with a CLOCK_MONOTONIC time just
+// before commit; readers record commit-to-consume latency into histograms that
+// the driver merges into a JSON report.
+//
+//   node dist/tests/perf/e2e.js [--payloads 16,64,256,1024] [--batches 1,16,256]
+//     [--strategies busy,yield,timer,spin] [--readers 2] [--messages 100000]
+//     [--rate 100000] [--cpus 0,1,2] [--out report.json]
+//     [--baseline previous.json] [--tolerance 0.15]
+
+import { spawn, spawnSync } from 'child_process'
+import fs from 'fs'
+import os from 'os'
+import { createSharedLog } from '../../lib/SharedLog'
+import { LatencyHistogram, LatencySummary } from './histogram'
+
+const REPORT_SCHEMA = 1
+const TIMESTAMP_BYTES = 8
+
+type Strategy = 'busy' | 'yield' | 'timer' | 'spin'
+
+// How a reader waits when nextBatch() comes back empty. `spin` waits inside
+// spinBatch() instead.
+const STRATEGIES: Record<Strategy, (() => Promise<void>) | null> = {
+  busy: null,
+  yield: () => new Promise(resolve => setImmediate(resolve)),
+  timer: () => new Promise(resolve => setTimeout(resolve, 0)),
+  spin: null,
+}
+
+interface RunConfig {
+  path: string
+  payloadSize: number
+  batchSize: number
+  strategy: Strategy
+  messages: number
+  /** Messages per second the writer paces itself to; 0 writes flat out. */
+  rate: number
+  /** process.hrtime.bigint() origin shared by all processes, as a string. */
+  origin: string
+}
+
+interface ReaderResult {
+  type: 'result'
+  received: number
+  histogram: ReturnType<LatencyHistogram['toSparse']>
+}
+
+interface WriterResult {
+  type: 'done'
+  durationNs: number
+}
+
+export interface RunReport {
+  payloadSize: number
+  batchSize: number
+  strategy: Strategy
+  readers: number
+  messages: number
+  rate: number
+  writer: {
+    durationMs: number
+    messagesPerSec: number
+    mbPerSec: number
+  }
+  latency: LatencySummary
+}
+
+export interface Report {
+  schema: number
+  environment: {
+    node: string
+    platform: string
+    kernel: string
+    cpuModel: string
+    cpus: number
+    pinned: boolean
+  }
+  runs: RunReport[]
+}
+
+const elapsedNs = (origin: bigint) => Number(process.hrtime.bigint() - origin)
+
+const send = (message: object) => new Promise<void>((resolve, reject) => {
+  process.send!(message, (error: Error | null) => error ? reject(error) : resolve())
+})
+
+async function runWriter(config: RunConfig) {
+  const origin = BigInt(config.origin)
+  const log = createSharedLog({ path: config.path, writable: true })
+  const writer = log.writer!
+  const frames: Buffer[] = new Array(config.batchSize)
+
+  const start = elapsedNs(origin)
+  let sent = 0
+  while (sent < config.messages) {
+    const count = Math.min(config.batchSize, config.messages - sent)
+    if (config.rate > 0) {
+      const due = start + (sent / config.rate) * 1e9
+      while (elapsedNs(origin) < due) {
+        // Spin: the writer owns its CPU and sleeping would add jitter.
+      }
+    }
+    for (let i = 0; i < count; i++) {
+      frames[i] = writer.allocate(config.payloadSize)
+    }
+    const stamp = elapsedNs(origin)
+    for (let i = 0; i < count; i++) {
+      frames[i].writeDoubleLE(stamp, 0)
+    }
+    writer.commit()
+    sent += count
+  }
+  const durationNs = elapsedNs(origin) - start
+
+  log.close()
+  await send({ type: 'done', durationNs } as WriterResult)
+}
+
+async function runReader(config: RunConfig) {
+  const origin = BigInt(config.origin)
+  const log = createSharedLog({ path: config.path, writable: false })
+  const iterator = log.createIterator()
+  const histogram = new LatencyHistogram()
+  const idle = STRATEGIES[config.strategy]
+
+  await send({ type: 'ready' })
+
+  let received = 0
+  while (received < config.messages) {
+    const batch = config.strategy === 'spin'
+      ? iterator.spinBatch({ maxMessages: 1024, maxSpinNs: 1_000_000 })
+      : iterator.nextBatch({ maxMessages: 1024 })
+    if (batch.length === 0) {
+      if (idle) {
+        await idle()
+      }
+      continue
+    }
+    const now = elapsedNs(origin)
+    for (const frame of batch) {
+      histogram.record(now - frame.readDoubleLE(0))
+    }
+    received += batch.length
+  }
+
+  iterator.close()
+  log.close()
+  await send({ type: 'result', received, histogram: histogram.toSparse() } as ReaderResult)
+}
+
+// ---------------------------------------------------------------------------
+// Driver
+// ---------------------------------------------------------------------------
+
+interface DriverOptions {
+  payloads: number[]
+  batches: number[]
+  strategies: Strategy[]
+  readers: number
+  messages: number
+  rate: number
+  cpus: number[]
+  out?: string
+  baseline?: string
+  tolerance: number
+}
+
+const parseList = (value: string) => value.split(',').filter(Boolean).map(item => {
+  const number = Number(item)
+  if (!Number.isInteger(number) || number < 0) {
+    throw new Error(`Expected a list of non-negative integers, got "${value}"`)
+  }
+  return number
+})
+
+function parseArgs(argv: string[]): DriverOptions {
+  const options: DriverOptions = {
+    payloads: [16, 64, 256, 1024],
+    batches: [1, 16, 256],
+    strategies: ['busy', 'spin', 'yield', 'timer'],
+    readers: 2,
+    messages: 100_000,
+    rate: 100_000,
+    cpus: [],
+    tolerance: 0.15,
+  }
+  for (let i = 0; i < argv.length; i += 2) {
+    const [flag, value] = [argv[i], argv[i + 1]]
+    if (value === undefined) {
+      throw new Error(`Missing value for ${flag}`)
+    }
+    switch (flag) {
+      case '--payloads': options.payloads = parseList(value); break
+      case '--batches': options.batches = parseList(value); break
+      case '--strategies':
+        options.strategies = value.split(',').map(name => {
+          if (!(name in STRATEGIES)) {
+            throw new Error(`Unknown strategy "${name}"; expected one of ${Object.keys(STRATEGIES).join(', ')}`)
+          }
+          return name as Strategy
+        })
+        break
+      case '--readers': options.readers = parseList(value)[0]; break
+      case '--messages': options.messages = parseList(value)[0]; break
+      case '--rate': options.rate = parseList(value)[0]; break
+      case '--cpus': options.cpus = parseList(value); break
+      case '--out': options.out = value; break
+      case '--baseline': options.baseline = value; break
+      case '--tolerance': options.tolerance = Number(value); break
+      default: throw new Error(`Unknown option ${flag}`)
+    }
+  }
+  if (options.payloads.some(size => size < TIMESTAMP_BYTES)) {
+    throw new Error(`Payload sizes must be at least ${TIMESTAMP_BYTES} bytes`)
+  }
+  if (options.readers < 1 || options.messages < 1 || options.batches.some(size => size < 1)) {
+    throw new Error('--readers, --messages and --batches must be positive')
+  }
+  if (options.cpus.length === 0) {
+    // Writer on CPU 0, readers after it, wrapping on small machines.
+    const available = os.cpus().length
+    options.cpus = Array.from({ length: options.readers + 1 }, (_, index) => index % available)
+  }
+  return options
+}
+
+const hasTaskset = () => process.platform === 'linux' && spawnSync('taskset', ['-V']).status === 0
+
+function spawnRole(role: 'writer' | 'reader', config: RunConfig, cpu: number | null) {
+  const nodeArgs = [...process.execArgv, __filename, role, JSON.stringify(config)]
+  const [command, args] = cpu === null
+    ? [process.execPath, nodeArgs]
+    : ['taskset', ['-c', String(cpu), process.execPath, ...nodeArgs]]
+  return spawn(command, args, { stdio: ['ignore', 'inherit', 'inherit', 'ipc'] })
+}
+
+const waitForMessage = <T>(child: ReturnType<typeof spawnRole>, type: string) =>
+  new Promise<T>((resolve, reject) => {
+    const onExit = (code: number | null) => reject(new Error(`${type}: child exited with ${code}`))
+    child.once('exit', onExit)
+    child.on('message', (message: any) => {
+      if (message && message.type === type) {
+        child.off('exit', onExit)
+        resolve(message as T)
+      }
+    })
+  })
+
+async function runOnce(options: DriverOptions, run: Omit<RunConfig, 'path' | 'origin'>, pinned: boolean): Promise<RunReport> {
+  const path = `/dev/shm/shmio-e2e-${process.pid}`
+  await fs.promises.unlink(path).catch(() => undefined)
+  // Linear log sized for the whole run so slow strategies are never lapped.
+  const capacityBytes = BigInt(run.messages) * BigInt(run.payloadSize + 4) + (1n << 20n)
+  createSharedLog({ path, writable: true, capacityBytes }).close()
+
+  const config: RunConfig = { ...run, path, origin: process.hrtime.bigint().toString() }
+  const cpuFor = (index: number) => pinned ? options.cpus[index % options.cpus.length] : null
+
+  try {
+    const readers = Array.from({ length: options.readers }, (_, index) => spawnRole('reader', config, cpuFor(index + 1)))
+    const results = readers.map(reader => waitForMessage<ReaderResult>(reader, 'result'))
+    await Promise.all(readers.map(reader => waitForMessage(reader, 'ready')))
+
+    const writer = spawnRole('writer', config, cpuFor(0))
+    const done = await waitForMessage<WriterResult>(writer, 'done')
+
+    const histogram = new LatencyHistogram()
+    for (const result of await Promise.all(results)) {
+      histogram.mergeSparse(result.histogram)
+    }
+
+    const seconds = done.durationNs / 1e9
+    return {
+      ...run,
+      readers: options.readers,
+      writer: {
+        durationMs: Math.round(done.durationNs / 1e6),
+        messagesPerSec: Math.round(run.messages / seconds),
+        mbPerSec: Math.round((run.messages * run.payloadSize) / (1024 * 1024) / seconds),
+      },
+      latency: histogram.summary(),
+    }
+  } finally {
+    await fs.promises.unlink(path).catch(() => undefined)
+  }
+}
+
+const runKey = (run: RunReport) => `${run.strategy}/${run.payloadSize}B/batch${run.batchSize}/${run.readers}r`
+
+// A run regresses when its p99 latency grows or its writer throughput drops by
+// more than `tolerance` relative to the baseline run with the same key.
+function compareWithBaseline(report: Report, baseline: Report, tolerance: number): string[] {
+  if (baseline.schema !== report.schema) {
+    return [`baseline schema ${baseline.schema} does not match ${report.schema}`]
+  }
+  const previous = new Map(baseline.runs.map(run => [runKey(run), run]))
+  const failures: string[] = []
+  for (const run of report.runs) {
+    const before = previous.get(runKey(run))
+    if (!before) {
+      continue
+    }
+    if (run.latency.p99Ns > before.latency.p99Ns * (1 + tolerance)) {
+      failures.push(`${runKey(run)}: p99 ${run.latency.p99Ns} ns > baseline ${before.latency.p99Ns} ns`)
+    }
+    if (run.rate === 0 && run.writer.messagesPerSec < before.writer.messagesPerSec * (1 - tolerance)) {
+      failures.push(`${runKey(run)}: ${run.writer.messagesPerSec} msg/s < baseline ${before.writer.messagesPerSec} msg/s`)
+    }
+  }
+  return failures
+}
+
+const micros = (ns: number) => (ns / 1000).toFixed(1).padStart(9)
+
+async function main() {
+  const options = parseArgs(process.argv.slice(2))
+  const pinned = hasTaskset()
+
+  const report: Report = {
+    schema: REPORT_SCHEMA,
+    environment: {
+      node: process.version,
+      platform: `${process.platform}-${process.arch}`,
+      kernel: os.release(),
+      cpuModel: os.cpus()[0]?.model ?? 'unknown',
+      cpus: os.cpus().length,
+      pinned,
+    },
+    runs: [],
+  }
+
+  console.log(`shmio e2e: ${options.readers} reader(s), ${options.messages} messages per run, `
+    + `${options.rate === 0 ? 'unpaced' : `${options.rate} msg/s`}, `
+    + `${pinned ? `pinned to CPUs ${options.cpus.join(',')}` : 'unpinned (taskset not found)'}`)
+  console.log('strategy  payload  batch     p50 µs    p99 µs  p99.9 µs p99.99 µs    max µs     msg/s')
+
+  for (const strategy of options.strategies) {
+    for (const payloadSize of options.payloads) {
+      for (const batchSize of options.batches) {
+        const run = await runOnce(options, {
+          payloadSize,
+          batchSize,
+          strategy,
+          messages: options.messages,
+          rate: options.rate,
+        }, pinned)
+        report.runs.push(run)
+        const { latency } = run
+        console.log(`${strategy.padEnd(8)} ${String(payloadSize).padStart(8)} ${String(batchSize).padStart(6)} `
+          + `${micros(latency.p50Ns)} ${micros(latency.p99Ns)} ${micros(latency.p999Ns)} `
+          + `${micros(latency.p9999Ns)} ${micros(latency.maxNs)} ${String(run.writer.messagesPerSec).padStart(9)}`)
+      }
+    }
+  }
+
+  if (options.out) {
+    fs.writeFileSync(options.out, `${JSON.stringify(report, null, 2)}\n`)
+    console.log(`report written to ${options.out}`)
+  }
+
+  if (options.baseline) {
+    const baseline = JSON.parse(fs.readFileSync(options.baseline, 'utf8')) as Report
+    const failures = compareWithBaseline(report, baseline, options.tolerance)
+    for (const failure of failures) {
+      console.error(`regression: ${failure}`)
+    }
+    if (failures.length > 0) {
+      process.exitCode = 1
+    }
+  }
+}
+
+const [role, configJson] = process.argv.slice(2)
+if (role === 'writer' || role === 'reader') {
+  const config = JSON.parse(configJson) as RunConfig
+  const run = role === 'writer' ? runWriter : runReader
+  run(config)
+    .then(() => process.disconnect())
+    .catch(error => {
+      console.error(error)
+      process.exit(1)
+    })
+} else {
+  main().catch(error => {
+    console.error(error)
+    process.exitCode = 1
+  })
+}
@@ -0,0 +1,105 @@
+// Log-linear latency histogram: exact below 64 ns, then 64 buckets per power
+// of two (about 1.6% relative error) up to ~2^62 ns. Reader processes send the
+// non-empty buckets to the benchmark driver over IPC, which merges them.
+const SUB_BUCKET_BITS = 6
+const SUB_BUCKETS = 1 << SUB_BUCKET_BITS
+const BUCKETS = SUB_BUCKETS * 58
+
+const bucketOf = (value: number): number => {
+  if (value < SUB_BUCKETS) {
+    return Math.max(0, Math.floor(value))
+  }
+  const exponent = Math.floor(Math.log2(value))
+  const shift = exponent - SUB_BUCKET_BITS
+  const sub = Math.floor(value / 2 ** shift) - SUB_BUCKETS
+  // log2 can round up just below a power of two.
+  if (sub < 0) {
+    return shift * SUB_BUCKETS + SUB_BUCKETS - 1
+  }
+  return Math.min(BUCKETS - 1, (shift + 1) * SUB_BUCKETS + sub)
+}
+
+// Upper bound of a bucket, so quantiles never under-report.
+const valueOf = (bucket: number): number => {
+  if (bucket < SUB_BUCKETS) {
+    return bucket
+  }
+  const shift = Math.floor(bucket / SUB_BUCKETS) - 1
+  const sub = bucket % SUB_BUCKETS
+  return (SUB_BUCKETS + sub + 1) * 2 ** shift - 1
+}
+
+export interface LatencySummary {
+  count: number
+  meanNs: number
+  p50Ns: number
+  p90Ns: number
+  p99Ns: number
+  p999Ns: number
+  p9999Ns: number
+  maxNs: number
+}
+
+export class LatencyHistogram {
+  readonly counts = new Float64Array(BUCKETS)
+  private total = 0
+  private sum = 0
+  private max = 0
+
+  record(valueNs: number) {
+    this.counts[bucketOf(valueNs)] += 1
+    this.total += 1
+    this.sum += valueNs
+    if (valueNs > this.max) {
+      this.max = valueNs
+    }
+  }
+
+  /** Non-empty buckets as [bucket, count] pairs, for IPC. */
+  toSparse(): { buckets: Array<[number, number]>, sum: number, max: number } {
+    const buckets: Array<[number, number]> = []
+    this.counts.forEach((count, bucket) => {
+      if (count > 0) {
+        buckets.push([bucket, count])
+      }
+    })
+    return { buckets, sum: this.sum, max: this.max }
+  }
+
+  mergeSparse(sparse: { buckets: Array<[number, number]>, sum: number, max: number }) {
+    for (const [bucket, count] of sparse.buckets) {
+      this.counts[bucket] += count
+      this.total += count
+    }
+    this.sum += sparse.sum
+    this.max = Math.max(this.max, sparse.max)
+  }
+
+  quantile(q: number): number {
+    if (this.total === 0) {
+      return 0
+    }
+    const rank = Math.ceil(q * this.total)
+    let seen = 0
+    for (let bucket = 0; bucket < BUCKETS; bucket++) {
+      seen += this.counts[bucket]
+      if (seen >= rank) {
+        return Math.min(valueOf(bucket), this.max)
+      }
+    }
+    return this.max
+  }
+
+  summary(): LatencySummary {
+    return {
+      count: this.total,
+      meanNs: this.total === 0 ? 0 : Math.round(this.sum / this.total),
+      p50Ns: Math.round(this.quantile(0.5)),
+      p90Ns: Math.round(this.quantile(0.9)),
+      p99Ns: Math.round(this.quantile(0.99)),
+      p999Ns: Math.round(this.quantile(0.999)),
+      p9999Ns: Math.round(this.quantile(0.9999)),
+      maxNs: Math.round(this.max),
+    }
+  }
+}